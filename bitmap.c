@@ -0,0 +1,1266 @@
+#include "php_git2.h"
+#include "php_git2_priv.h"
+#include "bitmap.h"
+#include "ext/standard/sha1.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PHP_GIT2_BITMAP_OPT_FULL_DAG 1
+#define PHP_GIT2_BITMAP_MIN_INTERVAL 100
+#define PHP_GIT2_BITMAP_MAX_ENTRIES 500
+#define PHP_GIT2_BITMAP_MAX_TIPS 100
+#define PHP_GIT2_BITMAP_CACHE_MAX 8
+
+#define PHP_GIT2_BIT_GET(b, pos) (((b)->words[(pos) >> 6] >> ((pos) & 63)) & 1)
+#define PHP_GIT2_BIT_SET(b, pos) ((b)->words[(pos) >> 6] |= (uint64_t)1 << ((pos) & 63))
+#define PHP_GIT2_BIT_CLEAR(b, pos) ((b)->words[(pos) >> 6] &= ~((uint64_t)1 << ((pos) & 63)))
+
+typedef struct php_git2_bitmap_order {
+	uint64_t offset;
+	uint32_t idx;
+} php_git2_bitmap_order;
+
+typedef struct php_git2_bitmap_stack {
+	git_oid *ids;
+	size_t count;
+	size_t alloc;
+} php_git2_bitmap_stack;
+
+static uint32_t php_git2_bitmap_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint64_t php_git2_bitmap_be64(const unsigned char *p)
+{
+	return ((uint64_t)php_git2_bitmap_be32(p) << 32) | php_git2_bitmap_be32(p + 4);
+}
+
+static void php_git2_bitmap_put32(smart_str *out, uint32_t v)
+{
+	unsigned char buf[4];
+
+	buf[0] = (unsigned char)(v >> 24);
+	buf[1] = (unsigned char)(v >> 16);
+	buf[2] = (unsigned char)(v >> 8);
+	buf[3] = (unsigned char)v;
+	smart_str_appendl(out, (const char*)buf, 4);
+}
+
+static void php_git2_bitmap_put64(smart_str *out, uint64_t v)
+{
+	php_git2_bitmap_put32(out, (uint32_t)(v >> 32));
+	php_git2_bitmap_put32(out, (uint32_t)v);
+}
+
+/* persistent bitmaps belong to a cached index and outlive the request */
+static void php_git2_bitmap_init(php_git2_bitmap *bitmap, uint32_t bits, int persistent)
+{
+	bitmap->nwords = ((size_t)bits + 63) / 64;
+	bitmap->words = (uint64_t*)pecalloc(bitmap->nwords ? bitmap->nwords : 1, sizeof(uint64_t), persistent);
+	bitmap->persistent = persistent;
+}
+
+static void php_git2_bitmap_dtor(php_git2_bitmap *bitmap)
+{
+	if (bitmap->words != NULL) {
+		pefree(bitmap->words, bitmap->persistent);
+	}
+	bitmap->words = NULL;
+	bitmap->nwords = 0;
+}
+
+static long php_git2_bitmap_popcount(uint64_t v)
+{
+	long n = 0;
+
+	while (v) {
+		v &= v - 1;
+		n++;
+	}
+	return n;
+}
+
+/* maps path read-only. git replaces .idx and .bitmap files by renaming, so a mapping stays
+   valid for as long as it is held */
+static int php_git2_bitmap_map(const unsigned char **out, size_t *len, const char *path)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return GIT_ENOTFOUND;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		giterr_set_str(GITERR_OS, "failed to read pack index");
+		return -1;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		giterr_set_str(GITERR_OS, "failed to map pack index");
+		return -1;
+	}
+	*out = (const unsigned char*)map;
+	*len = (size_t)st.st_size;
+	return 0;
+}
+
+static void php_git2_bitmap_unmap(const unsigned char *map, size_t len)
+{
+	if (map != NULL) {
+		munmap((void*)map, len);
+	}
+}
+
+/* path with its ".pack" suffix swapped for suffix */
+static char *php_git2_bitmap_sibling(const char *pack_path, const char *suffix)
+{
+	size_t len = strlen(pack_path);
+	char *path;
+
+	if (len > 5 && strcmp(pack_path + len - 5, ".pack") == 0) {
+		len -= 5;
+	}
+	spprintf(&path, 0, "%.*s%s", (int)len, pack_path, suffix);
+	return path;
+}
+
+/* indexes are allocated persistently so the per-process cache can keep them; the one
+   php_git2_bitmap_write builds is freed again before it returns */
+static php_git2_bitmap_index *php_git2_bitmap_index_new(void)
+{
+	php_git2_bitmap_index *index;
+
+	index = (php_git2_bitmap_index*)pecalloc(1, sizeof(php_git2_bitmap_index), 1);
+	index->refcount = 1;
+	zend_hash_init(&index->commits, 64, NULL, NULL, 1);
+	return index;
+}
+
+static void php_git2_bitmap_index_forget(php_git2_bitmap_index *index)
+{
+	uint32_t i;
+
+	for (i = 0; i < index->entry_count; i++) {
+		if (index->entries[i].decoded != NULL) {
+			php_git2_bitmap_dtor(index->entries[i].decoded);
+			pefree(index->entries[i].decoded, 1);
+			index->entries[i].decoded = NULL;
+		}
+	}
+}
+
+static void php_git2_bitmap_index_destroy(php_git2_bitmap_index *index)
+{
+	int t;
+
+	if (index->entries != NULL) {
+		php_git2_bitmap_index_forget(index);
+		pefree(index->entries, 1);
+	}
+	for (t = 0; t < 4; t++) {
+		php_git2_bitmap_dtor(&index->types[t]);
+	}
+	if (index->positions != NULL) {
+		pefree(index->positions, 1);
+	}
+	if (index->idx_order != NULL) {
+		pefree(index->idx_order, 1);
+	}
+	php_git2_bitmap_unmap(index->idx_map, index->idx_len);
+	php_git2_bitmap_unmap(index->data, index->data_len);
+	zend_hash_destroy(&index->commits);
+	pefree(index, 1);
+}
+
+/* drops the caller's reference, a cached index stays around for the next request */
+void php_git2_bitmap_index_free(php_git2_bitmap_index *index)
+{
+	if (index == NULL) {
+		return;
+	}
+	if (--index->refcount == 0 && !index->cached) {
+		php_git2_bitmap_index_destroy(index);
+	}
+}
+
+static void php_git2_bitmap_cache_dtor(void *data)
+{
+	php_git2_bitmap_index *index = *(php_git2_bitmap_index**)data;
+
+	index->cached = 0;
+	if (index->refcount == 0) {
+		php_git2_bitmap_index_destroy(index);
+	}
+}
+
+void php_git2_bitmap_cache_destroy(HashTable *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+	zend_hash_destroy(cache);
+	pefree(cache, 1);
+}
+
+/* evicts the indexes nobody holds until there is room for one more */
+static int php_git2_bitmap_cache_make_room(HashTable *cache)
+{
+	php_git2_bitmap_index **index;
+	HashPosition pos;
+	char *key;
+	uint key_len;
+	ulong num;
+	unsigned char drop[GIT_OID_RAWSZ];
+
+	while (zend_hash_num_elements(cache) >= PHP_GIT2_BITMAP_CACHE_MAX) {
+		key = NULL;
+		for (zend_hash_internal_pointer_reset_ex(cache, &pos);
+			zend_hash_get_current_data_ex(cache, (void**)&index, &pos) == SUCCESS;
+			zend_hash_move_forward_ex(cache, &pos)) {
+			if ((*index)->refcount == 0) {
+				zend_hash_get_current_key_ex(cache, &key, &key_len, &num, 0, &pos);
+				break;
+			}
+		}
+		if (key == NULL) {
+			return -1;
+		}
+		memcpy(drop, key, GIT_OID_RAWSZ);
+		zend_hash_del(cache, (char*)drop, GIT_OID_RAWSZ);
+	}
+	return 0;
+}
+
+static int php_git2_bitmap_order_cmp(const void *a, const void *b)
+{
+	const php_git2_bitmap_order *x = (const php_git2_bitmap_order*)a, *y = (const php_git2_bitmap_order*)b;
+
+	if (x->offset == y->offset) {
+		return 0;
+	}
+	return x->offset < y->offset ? -1 : 1;
+}
+
+/* checks the version 2 .idx in index->idx_map and derives the pack order the bitmaps are
+   laid out in. the ids are read in place from the mapping */
+static int php_git2_bitmap_load_idx(php_git2_bitmap_index *index)
+{
+	php_git2_bitmap_order *order;
+	const unsigned char *data = index->idx_map, *offsets, *large;
+	size_t len = index->idx_len, large_count;
+	uint32_t i, n, value;
+
+	if (len < 8 + 1024 + 40 || memcmp(data, "\377tOc", 4) != 0 || php_git2_bitmap_be32(data + 4) != 2) {
+		giterr_set_str(GITERR_ODB, "unsupported pack index version");
+		return -1;
+	}
+	n = php_git2_bitmap_be32(data + 8 + 255 * 4);
+	if (len < 8 + 1024 + (size_t)n * 28 + 40) {
+		giterr_set_str(GITERR_ODB, "truncated pack index");
+		return -1;
+	}
+	offsets = data + 8 + 1024 + (size_t)n * 24;
+	large = offsets + (size_t)n * 4;
+	large_count = (len - 40 - (large - data)) / 8;
+
+	index->count = n;
+	index->ids = (const git_oid*)(data + 8 + 1024);
+	index->positions = (uint32_t*)pemalloc(sizeof(uint32_t) * (n ? n : 1), 1);
+	index->idx_order = (uint32_t*)pemalloc(sizeof(uint32_t) * (n ? n : 1), 1);
+	order = (php_git2_bitmap_order*)emalloc(sizeof(php_git2_bitmap_order) * (n ? n : 1));
+	for (i = 0; i < n; i++) {
+		value = php_git2_bitmap_be32(offsets + (size_t)i * 4);
+		if (value & 0x80000000) {
+			value &= 0x7fffffff;
+			if (value >= large_count) {
+				efree(order);
+				giterr_set_str(GITERR_ODB, "corrupt pack index offset");
+				return -1;
+			}
+			order[i].offset = php_git2_bitmap_be64(large + (size_t)value * 8);
+		} else {
+			order[i].offset = value;
+		}
+		order[i].idx = i;
+	}
+	qsort(order, n, sizeof(php_git2_bitmap_order), php_git2_bitmap_order_cmp);
+	for (i = 0; i < n; i++) {
+		index->positions[order[i].idx] = i;
+		index->idx_order[i] = order[i].idx;
+	}
+	memcpy(index->checksum, data + len - 40, GIT_OID_RAWSZ);
+	efree(order);
+	return 0;
+}
+
+/* idx position of id, -1 when the pack does not have it */
+static long php_git2_bitmap_lookup(php_git2_bitmap_index *index, const git_oid *id)
+{
+	uint32_t lo = 0, hi = index->count, mid;
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = git_oid_cmp(&index->ids[mid], id);
+		if (cmp == 0) {
+			return (long)mid;
+		}
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return -1;
+}
+
+/* size in bytes of the serialized ewah bitmap at p, 0 when it runs past len */
+static size_t php_git2_bitmap_ewah_size(const unsigned char *p, size_t len)
+{
+	size_t words;
+
+	if (len < 12) {
+		return 0;
+	}
+	words = php_git2_bitmap_be32(p + 4);
+	if (words > (len - 12) / 8) {
+		return 0;
+	}
+	return 12 + words * 8;
+}
+
+static int php_git2_bitmap_ewah_read(php_git2_bitmap *out, const unsigned char *p, size_t len, uint32_t bits, int persistent)
+{
+	size_t words, i = 0, w = 0, n;
+	uint64_t rlw, run, literals;
+
+	if (php_git2_bitmap_ewah_size(p, len) == 0 || php_git2_bitmap_be32(p) > bits) {
+		return -1;
+	}
+	words = php_git2_bitmap_be32(p + 4);
+	p += 8;
+	php_git2_bitmap_init(out, bits, persistent);
+	while (i < words) {
+		rlw = php_git2_bitmap_be64(p + i * 8);
+		i++;
+		run = (rlw >> 1) & 0xffffffffULL;
+		literals = rlw >> 33;
+		if (run > out->nwords - w) {
+			goto corrupt;
+		}
+		if (rlw & 1) {
+			for (n = 0; n < run; n++) {
+				out->words[w + n] = ~(uint64_t)0;
+			}
+		}
+		w += run;
+		if (literals > words - i || literals > out->nwords - w) {
+			goto corrupt;
+		}
+		for (n = 0; n < literals; n++) {
+			out->words[w++] = php_git2_bitmap_be64(p + (i++) * 8);
+		}
+	}
+	if (bits & 63) {
+		out->words[out->nwords - 1] &= ((uint64_t)1 << (bits & 63)) - 1;
+	}
+	return 0;
+
+corrupt:
+	php_git2_bitmap_dtor(out);
+	return -1;
+}
+
+/* serializes bitmap as ewah: runs of empty or full words collapse into their marker word */
+static void php_git2_bitmap_ewah_write(smart_str *out, const php_git2_bitmap *bitmap, uint32_t bits)
+{
+	uint64_t *buf, full = ~(uint64_t)0, run, literals;
+	size_t i = 0, n = 0, marker = 0, start;
+	int run_bit;
+
+	buf = (uint64_t*)emalloc(sizeof(uint64_t) * (bitmap->nwords * 2 + 1));
+	while (i < bitmap->nwords || n == 0) {
+		run_bit = 0;
+		run = 0;
+		if (i < bitmap->nwords && (bitmap->words[i] == 0 || bitmap->words[i] == full)) {
+			run_bit = bitmap->words[i] == full;
+			while (i < bitmap->nwords && bitmap->words[i] == (run_bit ? full : 0) && run < 0xffffffffULL) {
+				run++;
+				i++;
+			}
+		}
+		start = i;
+		literals = 0;
+		while (i < bitmap->nwords && bitmap->words[i] != 0 && bitmap->words[i] != full && literals < 0x7fffffffULL) {
+			literals++;
+			i++;
+		}
+		marker = n;
+		buf[n++] = (uint64_t)run_bit | (run << 1) | (literals << 33);
+		memcpy(buf + n, bitmap->words + start, literals * sizeof(uint64_t));
+		n += literals;
+	}
+	php_git2_bitmap_put32(out, bits);
+	php_git2_bitmap_put32(out, (uint32_t)n);
+	for (i = 0; i < n; i++) {
+		php_git2_bitmap_put64(out, buf[i]);
+	}
+	php_git2_bitmap_put32(out, (uint32_t)marker);
+	efree(buf);
+}
+
+/* reads the mapped .bitmap: type bitmaps plus one ewah per selected commit, decoded lazily
+   since most fetches only touch the ones near the tips */
+static int php_git2_bitmap_load(php_git2_bitmap_index *index)
+{
+	const unsigned char *p;
+	size_t len, size, left;
+	uint32_t i, count, pos;
+	int t;
+
+	len = index->data_len;
+	p = index->data;
+	if (len < 32 + GIT_OID_RAWSZ || memcmp(p, "BITM", 4) != 0 || ((p[4] << 8) | p[5]) != 1 ||
+		!(((p[6] << 8) | p[7]) & PHP_GIT2_BITMAP_OPT_FULL_DAG)) {
+		giterr_set_str(GITERR_ODB, "unsupported bitmap index");
+		return -1;
+	}
+	if (memcmp(p + 12, index->checksum, GIT_OID_RAWSZ) != 0) {
+		giterr_set_str(GITERR_ODB, "bitmap index does not match its pack");
+		return -1;
+	}
+	count = php_git2_bitmap_be32(p + 8);
+	p += 32;
+	left = len - 32 - GIT_OID_RAWSZ;
+	if (count > left / 6) {
+		giterr_set_str(GITERR_ODB, "corrupt bitmap index");
+		return -1;
+	}
+	for (t = 0; t < 4; t++) {
+		size = php_git2_bitmap_ewah_size(p, left);
+		if (size == 0 || php_git2_bitmap_ewah_read(&index->types[t], p, size, index->count, 1)) {
+			giterr_set_str(GITERR_ODB, "corrupt bitmap index");
+			return -1;
+		}
+		p += size;
+		left -= size;
+	}
+	index->entries = (php_git2_bitmap_entry*)pecalloc(count ? count : 1, sizeof(php_git2_bitmap_entry), 1);
+	for (i = 0; i < count; i++) {
+		if (left < 6) {
+			giterr_set_str(GITERR_ODB, "corrupt bitmap index");
+			return -1;
+		}
+		pos = php_git2_bitmap_be32(p);
+		index->entries[i].xor_offset = p[4];
+		p += 6;
+		left -= 6;
+		size = php_git2_bitmap_ewah_size(p, left);
+		if (size == 0 || pos >= index->count || index->entries[i].xor_offset > i) {
+			giterr_set_str(GITERR_ODB, "corrupt bitmap index");
+			return -1;
+		}
+		index->entries[i].ewah = p;
+		index->entries[i].ewah_len = size;
+		index->entry_count = i + 1;
+		zend_hash_add(&index->commits, (char*)index->ids[pos].id, GIT_OID_RAWSZ, &i, sizeof(uint32_t), NULL);
+		p += size;
+		left -= size;
+	}
+	return 0;
+}
+
+/* decodes entry e, resolving its xor chain back to the nearest entry already decoded */
+static php_git2_bitmap *php_git2_bitmap_entry_get(php_git2_bitmap_index *index, uint32_t e)
+{
+	php_git2_bitmap_entry *entry;
+	php_git2_bitmap *bitmap, *base;
+	uint32_t *chain, depth = 0, cur = e;
+	size_t w;
+
+	chain = (uint32_t*)emalloc(sizeof(uint32_t) * (index->entry_count ? index->entry_count : 1));
+	while (index->entries[cur].decoded == NULL) {
+		chain[depth++] = cur;
+		if (index->entries[cur].xor_offset == 0) {
+			break;
+		}
+		cur -= index->entries[cur].xor_offset;
+	}
+	while (depth > 0) {
+		cur = chain[--depth];
+		entry = &index->entries[cur];
+		bitmap = (php_git2_bitmap*)pemalloc(sizeof(php_git2_bitmap), 1);
+		if (php_git2_bitmap_ewah_read(bitmap, entry->ewah, entry->ewah_len, index->count, 1)) {
+			pefree(bitmap, 1);
+			efree(chain);
+			return NULL;
+		}
+		if (entry->xor_offset) {
+			base = index->entries[cur - entry->xor_offset].decoded;
+			for (w = 0; w < bitmap->nwords; w++) {
+				bitmap->words[w] ^= base->words[w];
+			}
+		}
+		entry->decoded = bitmap;
+	}
+	efree(chain);
+	return index->entries[e].decoded;
+}
+
+/* first pack in objects/pack with a .bitmap next to it, or with with_bitmap unset the
+   only pack there */
+int php_git2_bitmap_pack_path(char **out, git_repository *repo, int with_bitmap TSRMLS_DC)
+{
+	php_stream *dir;
+	php_stream_dirent entry;
+	char *path, *pack, *bitmap, *found = NULL;
+	size_t len;
+	int packs = 0;
+	FILE *fp;
+
+	spprintf(&path, 0, "%sobjects/pack", git_repository_path(repo));
+	dir = php_stream_opendir(path, 0, NULL);
+	if (dir == NULL) {
+		efree(path);
+		giterr_set_str(GITERR_ODB, "no pack directory");
+		return GIT_ENOTFOUND;
+	}
+	while (php_stream_readdir(dir, &entry)) {
+		len = strlen(entry.d_name);
+		if (len <= 5 || strcmp(entry.d_name + len - 5, ".pack") != 0) {
+			continue;
+		}
+		spprintf(&pack, 0, "%s/%s", path, entry.d_name);
+		if (with_bitmap) {
+			bitmap = php_git2_bitmap_sibling(pack, ".bitmap");
+			fp = fopen(bitmap, "rb");
+			efree(bitmap);
+			if (fp != NULL) {
+				fclose(fp);
+				found = pack;
+				break;
+			}
+			efree(pack);
+			continue;
+		}
+		packs++;
+		if (found == NULL) {
+			found = pack;
+		} else {
+			efree(pack);
+		}
+	}
+	php_stream_closedir(dir);
+	efree(path);
+
+	if (found == NULL) {
+		giterr_set_str(GITERR_ODB, with_bitmap ? "no pack has a bitmap index" : "no pack found");
+		return GIT_ENOTFOUND;
+	}
+	if (packs > 1) {
+		efree(found);
+		giterr_set_str(GITERR_ODB, "several packs found, pass the one to index");
+		return GIT_EAMBIGUOUS;
+	}
+	*out = found;
+	return 0;
+}
+
+/* the bitmap index of the first pack with a .bitmap. indexes are cached per process by the
+   pack checksum, so a pack's .idx is put into pack order once and the commit bitmaps decoded
+   for one request serve the next; a rewritten .bitmap has another trailer and replaces the
+   cached index */
+int php_git2_bitmap_index_open(php_git2_bitmap_index **out, git_repository *repo TSRMLS_DC)
+{
+	php_git2_bitmap_index *index, **cached;
+	HashTable *cache = GIT2G(bitmap_indexes);
+	const unsigned char *idx_map = NULL, *data = NULL;
+	size_t idx_len = 0, data_len = 0;
+	char *pack_path, *path;
+	int error;
+
+	if ((error = php_git2_bitmap_pack_path(&pack_path, repo, 1 TSRMLS_CC))) {
+		return error;
+	}
+	path = php_git2_bitmap_sibling(pack_path, ".idx");
+	if ((error = php_git2_bitmap_map(&idx_map, &idx_len, path)) == GIT_ENOTFOUND) {
+		giterr_set_str(GITERR_ODB, "pack index not found");
+	}
+	efree(path);
+	if (error == 0) {
+		path = php_git2_bitmap_sibling(pack_path, ".bitmap");
+		if ((error = php_git2_bitmap_map(&data, &data_len, path)) == GIT_ENOTFOUND) {
+			giterr_set_str(GITERR_ODB, "bitmap index not found");
+		}
+		efree(path);
+	}
+	efree(pack_path);
+	if (error == 0 && (idx_len < 40 || data_len < GIT_OID_RAWSZ)) {
+		giterr_set_str(GITERR_ODB, "truncated pack index");
+		error = -1;
+	}
+	if (error) {
+		php_git2_bitmap_unmap(idx_map, idx_len);
+		php_git2_bitmap_unmap(data, data_len);
+		return error;
+	}
+
+	if (cache != NULL &&
+		zend_hash_find(cache, (char*)idx_map + idx_len - 40, GIT_OID_RAWSZ, (void**)&cached) == SUCCESS &&
+		memcmp((*cached)->data + (*cached)->data_len - GIT_OID_RAWSZ, data + data_len - GIT_OID_RAWSZ, GIT_OID_RAWSZ) == 0) {
+		php_git2_bitmap_unmap(idx_map, idx_len);
+		php_git2_bitmap_unmap(data, data_len);
+		(*cached)->refcount++;
+		*out = *cached;
+		return 0;
+	}
+
+	index = php_git2_bitmap_index_new();
+	index->idx_map = idx_map;
+	index->idx_len = idx_len;
+	index->data = data;
+	index->data_len = data_len;
+	if ((error = php_git2_bitmap_load_idx(index)) || (error = php_git2_bitmap_load(index))) {
+		php_git2_bitmap_index_free(index);
+		return error;
+	}
+	if (cache == NULL) {
+		cache = (HashTable*)pemalloc(sizeof(HashTable), 1);
+		zend_hash_init(cache, PHP_GIT2_BITMAP_CACHE_MAX, NULL, php_git2_bitmap_cache_dtor, 1);
+		GIT2G(bitmap_indexes) = cache;
+	}
+	if (php_git2_bitmap_cache_make_room(cache) == 0) {
+		index->cached = 1;
+		zend_hash_update(cache, (char*)index->checksum, GIT_OID_RAWSZ, &index, sizeof(php_git2_bitmap_index*), NULL);
+	}
+	*out = index;
+	return 0;
+}
+
+static void php_git2_bitmap_stack_push(php_git2_bitmap_stack *stack, const git_oid *id)
+{
+	if (stack->count == stack->alloc) {
+		stack->alloc = stack->alloc ? stack->alloc * 2 : 64;
+		stack->ids = (git_oid*)erealloc(stack->ids, sizeof(git_oid) * stack->alloc);
+	}
+	git_oid_cpy(&stack->ids[stack->count++], id);
+}
+
+/* returns 1 when id was not reachable yet */
+static int php_git2_bitmap_reach_mark(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index, const git_oid *id, git_otype type)
+{
+	long idx;
+	uint32_t pos;
+	char t = (char)type;
+
+	if (index != NULL && (idx = php_git2_bitmap_lookup(index, id)) >= 0) {
+		pos = index->positions[idx];
+		if (PHP_GIT2_BIT_GET(&reach->bits, pos)) {
+			return 0;
+		}
+		PHP_GIT2_BIT_SET(&reach->bits, pos);
+		return 1;
+	}
+	if (zend_hash_exists(&reach->extra, (char*)id->id, GIT_OID_RAWSZ)) {
+		return 0;
+	}
+	zend_hash_add(&reach->extra, (char*)id->id, GIT_OID_RAWSZ, &t, sizeof(char), NULL);
+	return 1;
+}
+
+static int php_git2_bitmap_reach_tree(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index, git_repository *repo, const git_oid *id)
+{
+	git_tree *tree = NULL;
+	const git_tree_entry *entry;
+	size_t i, count;
+	int error = 0;
+
+	if (!php_git2_bitmap_reach_mark(reach, index, id, GIT_OBJ_TREE)) {
+		return 0;
+	}
+	if ((error = git_tree_lookup(&tree, repo, id))) {
+		return error;
+	}
+	count = git_tree_entrycount(tree);
+	for (i = 0; i < count && error == 0; i++) {
+		entry = git_tree_entry_byindex(tree, i);
+		if (git_tree_entry_type(entry) == GIT_OBJ_TREE) {
+			error = php_git2_bitmap_reach_tree(reach, index, repo, git_tree_entry_id(entry));
+		} else if (git_tree_entry_type(entry) == GIT_OBJ_BLOB) {
+			php_git2_bitmap_reach_mark(reach, index, git_tree_entry_id(entry), GIT_OBJ_BLOB);
+		}
+	}
+	git_tree_free(tree);
+	return error;
+}
+
+/* everything reachable from tips. commits with a stored bitmap are ORed in whole, the walk
+   only covers history between the tips and the nearest bitmapped commits */
+int php_git2_bitmap_reach_init(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index,
+	git_repository *repo, const git_oid *tips, size_t count)
+{
+	php_git2_bitmap_stack stack = {0};
+	php_git2_bitmap *stored;
+	git_object *object = NULL, *target = NULL;
+	git_commit *commit = NULL;
+	git_oid id;
+	uint32_t *e;
+	size_t i, w, parents;
+	int error = 0;
+
+	php_git2_bitmap_init(&reach->bits, index ? index->count : 0, 0);
+	zend_hash_init(&reach->extra, 64, NULL, NULL, 0);
+
+	for (i = 0; i < count && error == 0; i++) {
+		if ((error = git_object_lookup(&object, repo, &tips[i], GIT_OBJ_ANY))) {
+			break;
+		}
+		while (git_object_type(object) == GIT_OBJ_TAG) {
+			php_git2_bitmap_reach_mark(reach, index, git_object_id(object), GIT_OBJ_TAG);
+			target = NULL;
+			error = git_tag_target(&target, (git_tag*)object);
+			git_object_free(object);
+			object = target;
+			if (error) {
+				break;
+			}
+		}
+		if (error) {
+			break;
+		}
+		switch (git_object_type(object)) {
+			case GIT_OBJ_COMMIT:
+				php_git2_bitmap_stack_push(&stack, git_object_id(object));
+				break;
+			case GIT_OBJ_TREE:
+				error = php_git2_bitmap_reach_tree(reach, index, repo, git_object_id(object));
+				break;
+			default:
+				php_git2_bitmap_reach_mark(reach, index, git_object_id(object), git_object_type(object));
+				break;
+		}
+		git_object_free(object);
+		object = NULL;
+	}
+
+	while (error == 0 && stack.count > 0) {
+		git_oid_cpy(&id, &stack.ids[--stack.count]);
+		if (index != NULL && zend_hash_find(&index->commits, (char*)id.id, GIT_OID_RAWSZ, (void**)&e) == SUCCESS) {
+			if ((stored = php_git2_bitmap_entry_get(index, *e)) == NULL) {
+				giterr_set_str(GITERR_ODB, "corrupt bitmap index");
+				error = -1;
+				break;
+			}
+			for (w = 0; w < reach->bits.nwords; w++) {
+				reach->bits.words[w] |= stored->words[w];
+			}
+			continue;
+		}
+		if (!php_git2_bitmap_reach_mark(reach, index, &id, GIT_OBJ_COMMIT)) {
+			continue;
+		}
+		if ((error = git_commit_lookup(&commit, repo, &id))) {
+			break;
+		}
+		error = php_git2_bitmap_reach_tree(reach, index, repo, git_commit_tree_id(commit));
+		parents = git_commit_parentcount(commit);
+		for (i = 0; i < parents && error == 0; i++) {
+			php_git2_bitmap_stack_push(&stack, git_commit_parent_id(commit, i));
+		}
+		git_commit_free(commit);
+	}
+	if (stack.ids != NULL) {
+		efree(stack.ids);
+	}
+	if (error) {
+		php_git2_bitmap_reach_free(reach);
+	}
+	return error;
+}
+
+void php_git2_bitmap_reach_free(php_git2_bitmap_reach *reach)
+{
+	php_git2_bitmap_dtor(&reach->bits);
+	zend_hash_destroy(&reach->extra);
+}
+
+/* reach minus everything in other */
+void php_git2_bitmap_reach_subtract(php_git2_bitmap_reach *reach, php_git2_bitmap_reach *other)
+{
+	HashPosition pos;
+	char *key;
+	uint key_len;
+	ulong num;
+	git_oid *drop;
+	size_t w, n = 0;
+
+	for (w = 0; w < reach->bits.nwords && w < other->bits.nwords; w++) {
+		reach->bits.words[w] &= ~other->bits.words[w];
+	}
+	drop = (git_oid*)emalloc(sizeof(git_oid) * (zend_hash_num_elements(&reach->extra) + 1));
+	for (zend_hash_internal_pointer_reset_ex(&reach->extra, &pos);
+		zend_hash_get_current_key_ex(&reach->extra, &key, &key_len, &num, 0, &pos) == HASH_KEY_IS_STRING;
+		zend_hash_move_forward_ex(&reach->extra, &pos)) {
+		if (zend_hash_exists(&other->extra, key, key_len)) {
+			git_oid_fromraw(&drop[n++], (const unsigned char*)key);
+		}
+	}
+	for (w = 0; w < n; w++) {
+		zend_hash_del(&reach->extra, (char*)drop[w].id, GIT_OID_RAWSZ);
+	}
+	efree(drop);
+}
+
+/* counts per type: commits, trees, blobs, tags */
+void php_git2_bitmap_reach_count(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index, long counts[4])
+{
+	HashPosition pos;
+	char *t;
+	size_t w;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		counts[i] = 0;
+		if (index == NULL) {
+			continue;
+		}
+		for (w = 0; w < reach->bits.nwords && w < index->types[i].nwords; w++) {
+			counts[i] += php_git2_bitmap_popcount(reach->bits.words[w] & index->types[i].words[w]);
+		}
+	}
+	for (zend_hash_internal_pointer_reset_ex(&reach->extra, &pos);
+		zend_hash_get_current_data_ex(&reach->extra, (void**)&t, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&reach->extra, &pos)) {
+		if (*t >= GIT_OBJ_COMMIT && *t <= GIT_OBJ_TAG) {
+			counts[*t - GIT_OBJ_COMMIT]++;
+		}
+	}
+}
+
+/* calls cb for every object, the bitmapped ones in pack order first */
+int php_git2_bitmap_reach_foreach(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index,
+	php_git2_bitmap_reach_cb cb, void *payload)
+{
+	HashPosition pos;
+	git_oid id;
+	char *key, *t;
+	uint key_len;
+	ulong num;
+	uint32_t bit;
+	git_otype type;
+	int i, error = 0;
+
+	if (index != NULL) {
+		for (bit = 0; bit < index->count && error == 0; bit++) {
+			if (!PHP_GIT2_BIT_GET(&reach->bits, bit)) {
+				continue;
+			}
+			type = GIT_OBJ_BAD;
+			for (i = 0; i < 4; i++) {
+				if (bit >> 6 < index->types[i].nwords && PHP_GIT2_BIT_GET(&index->types[i], bit)) {
+					type = (git_otype)(GIT_OBJ_COMMIT + i);
+					break;
+				}
+			}
+			error = cb(&index->ids[index->idx_order[bit]], type, payload);
+		}
+	}
+	for (zend_hash_internal_pointer_reset_ex(&reach->extra, &pos);
+		error == 0 && zend_hash_get_current_key_ex(&reach->extra, &key, &key_len, &num, 0, &pos) == HASH_KEY_IS_STRING;
+		zend_hash_move_forward_ex(&reach->extra, &pos)) {
+		zend_hash_get_current_data_ex(&reach->extra, (void**)&t, &pos);
+		git_oid_fromraw(&id, (const unsigned char*)key);
+		error = cb(&id, (git_otype)*t, payload);
+	}
+	return error;
+}
+
+typedef struct php_git2_bitmap_insert {
+	php_git2_bitmap_reach pending; /* what is still to be inserted */
+	php_git2_bitmap_index *index;
+	php_git2_bitmap_stack commits;
+	git_repository *repo;
+	git_packbuilder *pb;
+	smart_str path;
+} php_git2_bitmap_insert;
+
+/* returns 1 and forgets id when it is still pending */
+static int php_git2_bitmap_insert_take(php_git2_bitmap_insert *insert, const git_oid *id)
+{
+	long idx;
+	uint32_t pos;
+
+	if (insert->index != NULL && (idx = php_git2_bitmap_lookup(insert->index, id)) >= 0) {
+		pos = insert->index->positions[idx];
+		if (!PHP_GIT2_BIT_GET(&insert->pending.bits, pos)) {
+			return 0;
+		}
+		PHP_GIT2_BIT_CLEAR(&insert->pending.bits, pos);
+		return 1;
+	}
+	return zend_hash_del(&insert->pending.extra, (char*)id->id, GIT_OID_RAWSZ) == SUCCESS;
+}
+
+/* commits and tags go in first and nameless, the commits are kept for the tree walk */
+static int php_git2_bitmap_insert_history_cb(const git_oid *id, git_otype type, void *payload)
+{
+	php_git2_bitmap_insert *insert = (php_git2_bitmap_insert*)payload;
+
+	if (type != GIT_OBJ_COMMIT && type != GIT_OBJ_TAG) {
+		return 0;
+	}
+	php_git2_bitmap_insert_take(insert, id);
+	if (type == GIT_OBJ_COMMIT) {
+		php_git2_bitmap_stack_push(&insert->commits, id);
+	}
+	return git_packbuilder_insert(insert->pb, id, NULL);
+}
+
+/* inserts the pending trees and blobs below a tree under their paths, which is what the
+   packbuilder pairs delta candidates by. a tree that is not pending was either done already
+   or is outside the set together with everything below it */
+static int php_git2_bitmap_insert_tree(php_git2_bitmap_insert *insert, const git_oid *id)
+{
+	git_tree *tree = NULL;
+	const git_tree_entry *entry;
+	size_t i, count, len;
+	int error;
+
+	if (!php_git2_bitmap_insert_take(insert, id)) {
+		return 0;
+	}
+	smart_str_0(&insert->path);
+	if ((error = git_packbuilder_insert(insert->pb, id, insert->path.c))) {
+		return error;
+	}
+	if ((error = git_tree_lookup(&tree, insert->repo, id))) {
+		return error;
+	}
+	len = insert->path.len;
+	count = git_tree_entrycount(tree);
+	for (i = 0; i < count && error == 0; i++) {
+		entry = git_tree_entry_byindex(tree, i);
+		if (len > 0) {
+			smart_str_appendc(&insert->path, '/');
+		}
+		smart_str_appends(&insert->path, git_tree_entry_name(entry));
+		smart_str_0(&insert->path);
+		if (git_tree_entry_type(entry) == GIT_OBJ_TREE) {
+			error = php_git2_bitmap_insert_tree(insert, git_tree_entry_id(entry));
+		} else if (git_tree_entry_type(entry) == GIT_OBJ_BLOB &&
+			php_git2_bitmap_insert_take(insert, git_tree_entry_id(entry))) {
+			error = git_packbuilder_insert(insert->pb, git_tree_entry_id(entry), insert->path.c);
+		}
+		insert->path.len = len;
+	}
+	git_tree_free(tree);
+	return error;
+}
+
+/* whatever no commit's tree led to, e.g. a tag of a blob */
+static int php_git2_bitmap_insert_rest_cb(const git_oid *id, git_otype type, void *payload)
+{
+	return git_packbuilder_insert((git_packbuilder*)payload, id, NULL);
+}
+
+/* inserts every object of reach into pb. bitmaps carry no paths, so the trees of the
+   commits in the set are walked to give trees and blobs the names delta search needs;
+   the walk stops at everything outside the set */
+int php_git2_bitmap_reach_insert(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index,
+	git_repository *repo, git_packbuilder *pb)
+{
+	php_git2_bitmap_insert insert;
+	git_commit *commit = NULL;
+	size_t i;
+	int error;
+
+	memset(&insert, 0, sizeof(insert));
+	insert.index = index;
+	insert.repo = repo;
+	insert.pb = pb;
+	php_git2_bitmap_init(&insert.pending.bits, index ? index->count : 0, 0);
+	memcpy(insert.pending.bits.words, reach->bits.words, sizeof(uint64_t) * reach->bits.nwords);
+	zend_hash_init(&insert.pending.extra, zend_hash_num_elements(&reach->extra), NULL, NULL, 0);
+	zend_hash_copy(&insert.pending.extra, &reach->extra, NULL, NULL, sizeof(char));
+
+	error = php_git2_bitmap_reach_foreach(reach, index, php_git2_bitmap_insert_history_cb, &insert);
+	for (i = 0; i < insert.commits.count && error == 0; i++) {
+		if ((error = git_commit_lookup(&commit, repo, &insert.commits.ids[i])) == 0) {
+			insert.path.len = 0;
+			error = php_git2_bitmap_insert_tree(&insert, git_commit_tree_id(commit));
+			git_commit_free(commit);
+		}
+	}
+	if (error == 0) {
+		error = php_git2_bitmap_reach_foreach(&insert.pending, index, php_git2_bitmap_insert_rest_cb, pb);
+	}
+	smart_str_free(&insert.path);
+	if (insert.commits.ids != NULL) {
+		efree(insert.commits.ids);
+	}
+	php_git2_bitmap_reach_free(&insert.pending);
+	return error;
+}
+
+/* "<rev>" or "<from>..<to>" as revparse understands them */
+int php_git2_bitmap_reach_range(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index,
+	git_repository *repo, const char *range)
+{
+	php_git2_bitmap_reach hidden;
+	git_revspec spec;
+	git_oid tip;
+	int error;
+
+	memset(&spec, 0, sizeof(spec));
+	if ((error = git_revparse(&spec, repo, range))) {
+		return error;
+	}
+	if (spec.flags & GIT_REVPARSE_MERGE_BASE) {
+		giterr_set_str(GITERR_INVALID, "symmetric ranges are not supported");
+		error = -1;
+		goto done;
+	}
+	if (spec.flags & GIT_REVPARSE_RANGE) {
+		git_oid_cpy(&tip, git_object_id(spec.to));
+	} else {
+		git_oid_cpy(&tip, git_object_id(spec.from));
+	}
+	if ((error = php_git2_bitmap_reach_init(reach, index, repo, &tip, 1))) {
+		goto done;
+	}
+	if (spec.flags & GIT_REVPARSE_RANGE) {
+		if ((error = php_git2_bitmap_reach_init(&hidden, index, repo, git_object_id(spec.from), 1))) {
+			php_git2_bitmap_reach_free(reach);
+			goto done;
+		}
+		php_git2_bitmap_reach_subtract(reach, &hidden);
+		php_git2_bitmap_reach_free(&hidden);
+	}
+
+done:
+	if (spec.from != NULL) {
+		git_object_free(spec.from);
+	}
+	if (spec.to != NULL) {
+		git_object_free(spec.to);
+	}
+	return error;
+}
+
+/* tips of every ref peeled to commits, oldest history first */
+static int php_git2_bitmap_commits(php_git2_bitmap_stack *commits, php_git2_bitmap_stack *tips, git_repository *repo)
+{
+	git_revwalk *walk = NULL;
+	git_strarray names = {0};
+	git_object *object = NULL, *peeled = NULL;
+	git_oid id;
+	size_t i;
+	int error;
+
+	if ((error = git_revwalk_new(&walk, repo))) {
+		return error;
+	}
+	git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME | GIT_SORT_REVERSE);
+	if ((error = git_reference_list(&names, repo))) {
+		git_revwalk_free(walk);
+		return error;
+	}
+	for (i = 0; i < names.count && error == 0; i++) {
+		if (git_reference_name_to_id(&id, repo, names.strings[i]) != 0 ||
+			git_object_lookup(&object, repo, &id, GIT_OBJ_ANY) != 0) {
+			giterr_clear();
+			continue;
+		}
+		if (git_object_peel(&peeled, object, GIT_OBJ_COMMIT) == 0) {
+			php_git2_bitmap_stack_push(tips, git_object_id(peeled));
+			error = git_revwalk_push(walk, git_object_id(peeled));
+			git_object_free(peeled);
+		} else {
+			/* tags of trees and blobs select nothing */
+			giterr_clear();
+		}
+		git_object_free(object);
+	}
+	while (error == 0 && (error = git_revwalk_next(&id, walk)) == 0) {
+		php_git2_bitmap_stack_push(commits, &id);
+	}
+	if (error == GIT_ITEROVER) {
+		error = 0;
+	}
+	git_strarray_free(&names);
+	git_revwalk_free(walk);
+	return error;
+}
+
+/* marks the commits that get a bitmap: the newest PHP_GIT2_BITMAP_MAX_TIPS ref tips, a
+   repository with thousands of tags or pull request refs would otherwise select every one of
+   them, plus one commit in each interval of history */
+static unsigned char *php_git2_bitmap_select(php_git2_bitmap_stack *commits, php_git2_bitmap_stack *tips)
+{
+	HashTable tip_set;
+	unsigned char *pick, one = 1;
+	size_t i, interval, taken = 0;
+
+	zend_hash_init(&tip_set, tips->count + 1, NULL, NULL, 0);
+	for (i = 0; i < tips->count; i++) {
+		zend_hash_update(&tip_set, (char*)tips->ids[i].id, GIT_OID_RAWSZ, &one, sizeof(one), NULL);
+	}
+	interval = commits->count / PHP_GIT2_BITMAP_MAX_ENTRIES;
+	if (interval < PHP_GIT2_BITMAP_MIN_INTERVAL) {
+		interval = PHP_GIT2_BITMAP_MIN_INTERVAL;
+	}
+	pick = (unsigned char*)ecalloc(commits->count + 1, 1);
+	for (i = commits->count; i > 0; i--) {
+		if (taken < PHP_GIT2_BITMAP_MAX_TIPS &&
+			zend_hash_exists(&tip_set, (char*)commits->ids[i - 1].id, GIT_OID_RAWSZ)) {
+			pick[i - 1] = 1;
+			taken++;
+		} else if (i % interval == 0) {
+			pick[i - 1] = 1;
+		}
+	}
+	zend_hash_destroy(&tip_set);
+	return pick;
+}
+
+/* writes pack-*.bitmap next to pack_path for the commits php_git2_bitmap_select picks,
+   computed oldest first so each one starts from its ancestors'. every bitmap is compressed
+   as soon as it is built and only decoded again while a descendant ORs it in, so memory
+   stays at the ewah size of the selection. the pack has to hold everything reachable from
+   the refs, as after a full repack */
+int php_git2_bitmap_write(git_repository *repo, const char *pack_path, long *selected)
+{
+	php_git2_bitmap_index *index;
+	php_git2_bitmap_stack commits = {0}, tips = {0};
+	php_git2_bitmap_reach reach;
+	git_odb *odb = NULL;
+	git_otype type;
+	smart_str out = {0}, *ewahs = NULL;
+	PHP_SHA1_CTX ctx;
+	unsigned char digest[20], *pick = NULL;
+	char *path = NULL;
+	size_t size, i;
+	uint32_t pos, e;
+	long idx;
+	int error;
+
+	index = php_git2_bitmap_index_new();
+	path = php_git2_bitmap_sibling(pack_path, ".idx");
+	if ((error = php_git2_bitmap_map(&index->idx_map, &index->idx_len, path)) == GIT_ENOTFOUND) {
+		giterr_set_str(GITERR_ODB, "pack index not found");
+	}
+	efree(path);
+	path = NULL;
+	if (error || (error = php_git2_bitmap_load_idx(index))) {
+		php_git2_bitmap_index_free(index);
+		return error;
+	}
+	if ((error = git_repository_odb(&odb, repo))) {
+		goto done;
+	}
+	for (i = 0; i < 4; i++) {
+		php_git2_bitmap_init(&index->types[i], index->count, 1);
+	}
+	for (pos = 0; pos < index->count; pos++) {
+		if ((error = git_odb_read_header(&size, &type, odb, &index->ids[index->idx_order[pos]]))) {
+			goto done;
+		}
+		if (type >= GIT_OBJ_COMMIT && type <= GIT_OBJ_TAG) {
+			PHP_GIT2_BIT_SET(&index->types[type - GIT_OBJ_COMMIT], pos);
+		}
+	}
+
+	if ((error = php_git2_bitmap_commits(&commits, &tips, repo))) {
+		goto done;
+	}
+	pick = php_git2_bitmap_select(&commits, &tips);
+	index->entries = (php_git2_bitmap_entry*)pecalloc(commits.count ? commits.count : 1, sizeof(php_git2_bitmap_entry), 1);
+	ewahs = (smart_str*)ecalloc(commits.count ? commits.count : 1, sizeof(smart_str));
+	for (i = 0; i < commits.count; i++) {
+		if (!pick[i]) {
+			continue;
+		}
+		error = php_git2_bitmap_reach_init(&reach, index, repo, &commits.ids[i], 1);
+		php_git2_bitmap_index_forget(index);
+		if (error) {
+			goto done;
+		}
+		if (zend_hash_num_elements(&reach.extra) > 0) {
+			php_git2_bitmap_reach_free(&reach);
+			giterr_set_str(GITERR_ODB, "pack does not hold every reachable object, repack first");
+			error = -1;
+			goto done;
+		}
+		e = index->entry_count++;
+		php_git2_bitmap_ewah_write(&ewahs[e], &reach.bits, index->count);
+		php_git2_bitmap_reach_free(&reach);
+		index->entries[e].ewah = (const unsigned char*)ewahs[e].c;
+		index->entries[e].ewah_len = ewahs[e].len;
+		zend_hash_add(&index->commits, (char*)commits.ids[i].id, GIT_OID_RAWSZ, &e, sizeof(uint32_t), NULL);
+	}
+
+	smart_str_appendl(&out, "BITM", 4);
+	smart_str_appendl(&out, "\0\1", 2);
+	smart_str_appendl(&out, "\0\1", 2);
+	php_git2_bitmap_put32(&out, index->entry_count);
+	smart_str_appendl(&out, (const char*)index->checksum, GIT_OID_RAWSZ);
+	for (i = 0; i < 4; i++) {
+		php_git2_bitmap_ewah_write(&out, &index->types[i], index->count);
+	}
+	for (i = 0, e = 0; i < commits.count; i++) {
+		if (!pick[i]) {
+			continue;
+		}
+		idx = php_git2_bitmap_lookup(index, &commits.ids[i]);
+		php_git2_bitmap_put32(&out, (uint32_t)idx);
+		smart_str_appendl(&out, "\0\0", 2);
+		smart_str_appendl(&out, ewahs[e].c, ewahs[e].len);
+		e++;
+	}
+	PHP_SHA1Init(&ctx);
+	PHP_SHA1Update(&ctx, (const unsigned char*)out.c, out.len);
+	PHP_SHA1Final(digest, &ctx);
+	smart_str_appendl(&out, (const char*)digest, sizeof(digest));
+
+	path = php_git2_bitmap_sibling(pack_path, ".bitmap");
+	if (php_git2_lockfile_write(path, out.c, out.len)) {
+		giterr_set_str(GITERR_OS, "failed to write bitmap index");
+		error = -1;
+		goto done;
+	}
+	if (selected != NULL) {
+		*selected = index->entry_count;
+	}
+
+done:
+	smart_str_free(&out);
+	if (ewahs != NULL) {
+		for (i = 0; i < index->entry_count; i++) {
+			smart_str_free(&ewahs[i]);
+		}
+		efree(ewahs);
+	}
+	if (pick != NULL) {
+		efree(pick);
+	}
+	if (path != NULL) {
+		efree(path);
+	}
+	if (commits.ids != NULL) {
+		efree(commits.ids);
+	}
+	if (tips.ids != NULL) {
+		efree(tips.ids);
+	}
+	if (odb != NULL) {
+		git_odb_free(odb);
+	}
+	php_git2_bitmap_index_free(index);
+	return error;
+}
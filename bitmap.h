@@ -0,0 +1,100 @@
+/*
+ * PHP Libgit2 Extension
+ *
+ * https://github.com/libgit2/php-git
+ *
+ * Copyright 2014 Shuhei Tanuma.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef PHP_GIT2_BITMAP_H
+#define PHP_GIT2_BITMAP_H
+
+/* uncompressed bitset over the objects of one pack, bit n is the n-th object by pack offset */
+typedef struct php_git2_bitmap {
+	size_t nwords;
+	uint64_t *words;
+	int persistent;
+} php_git2_bitmap;
+
+typedef struct php_git2_bitmap_entry {
+	const unsigned char *ewah;
+	size_t ewah_len;
+	unsigned char xor_offset;
+	php_git2_bitmap *decoded;
+} php_git2_bitmap_entry;
+
+/* a pack's .idx in pack order plus the commit bitmaps of its .bitmap file. both files are
+   mapped, opened indexes are shared through the per-process cache in GIT2G(bitmap_indexes) */
+typedef struct php_git2_bitmap_index {
+	unsigned char checksum[GIT_OID_RAWSZ];
+	uint32_t count;
+	const git_oid *ids;    /* idx order, sorted by id, inside idx_map */
+	uint32_t *positions;   /* idx order -> pack order */
+	uint32_t *idx_order;   /* pack order -> idx order */
+	php_git2_bitmap types[4]; /* commits, trees, blobs, tags */
+	php_git2_bitmap_entry *entries;
+	uint32_t entry_count;
+	HashTable commits;     /* raw commit id -> entry number */
+	const unsigned char *idx_map;
+	size_t idx_len;
+	const unsigned char *data; /* the mapped .bitmap */
+	size_t data_len;
+	long refcount;
+	int cached;
+} php_git2_bitmap_index;
+
+/* objects reachable from a set of tips: bits inside the bitmapped pack, extra
+   (raw id -> git_otype) for everything outside it or when there is no index */
+typedef struct php_git2_bitmap_reach {
+	php_git2_bitmap bits;
+	HashTable extra;
+} php_git2_bitmap_reach;
+
+typedef int (*php_git2_bitmap_reach_cb)(const git_oid *id, git_otype type, void *payload);
+
+int php_git2_bitmap_pack_path(char **out, git_repository *repo, int with_bitmap TSRMLS_DC);
+
+int php_git2_bitmap_index_open(php_git2_bitmap_index **out, git_repository *repo TSRMLS_DC);
+
+void php_git2_bitmap_index_free(php_git2_bitmap_index *index);
+
+void php_git2_bitmap_cache_destroy(HashTable *cache);
+
+int php_git2_bitmap_write(git_repository *repo, const char *pack_path, long *selected);
+
+int php_git2_bitmap_reach_init(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index,
+	git_repository *repo, const git_oid *tips, size_t count);
+
+void php_git2_bitmap_reach_subtract(php_git2_bitmap_reach *reach, php_git2_bitmap_reach *other);
+
+void php_git2_bitmap_reach_count(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index, long counts[4]);
+
+int php_git2_bitmap_reach_foreach(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index,
+	php_git2_bitmap_reach_cb cb, void *payload);
+
+int php_git2_bitmap_reach_insert(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index,
+	git_repository *repo, git_packbuilder *pb);
+
+void php_git2_bitmap_reach_free(php_git2_bitmap_reach *reach);
+
+int php_git2_bitmap_reach_range(php_git2_bitmap_reach *reach, php_git2_bitmap_index *index,
+	git_repository *repo, const char *range);
+
+#endif
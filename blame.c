@@ -1,37 +1,71 @@
 #include "php_git2.h"
 #include "php_git2_priv.h"
 #include "blame.h"
+#include "revwalk.h"
 
-static void php_git2_array_to_git_blame_options(git_blame_options *options, zval *array TSRMLS_DC)
+/* extension side blame options that have no place in git_blame_options */
+typedef struct php_git2_blame_extra {
+	php_git2_changed_paths *changed_paths;
+	php_git2_blame_cache *cache;
+} php_git2_blame_extra;
+
+static php_git2_t *php_git2_blame_option_resource(zval *array, char *name, size_t name_len, enum php_git2_resource_type type TSRMLS_DC)
 {
 	zval *tmp;
+	php_git2_t *resource;
 
-	options->version = php_git2_read_arrval_long(array, ZEND_STRS("version") TSRMLS_CC);
-	options->flags = php_git2_read_arrval_long(array, ZEND_STRS("flags") TSRMLS_CC);
-	options->min_match_characters = php_git2_read_arrval_long(array, ZEND_STRS("min_match_characters") TSRMLS_CC);
-	tmp = php_git2_read_arrval(array, ZEND_STRS("newest_commit") TSRMLS_CC);
-	if (Z_TYPE_P(tmp) != NULL) {
-		if (Z_TYPE_P(tmp) != IS_STRING) {
-			convert_to_string(tmp);
-		}
-		if (git_oid_fromstrn(&options->newest_commit, Z_STRVAL_P(tmp), Z_STRLEN_P(tmp)) != GIT_OK) {
-			return;
-		}
+	tmp = php_git2_read_arrval(array, name, name_len TSRMLS_CC);
+	if (tmp == NULL || Z_TYPE_P(tmp) != IS_RESOURCE) {
+		return NULL;
 	}
+	resource = (php_git2_t*)zend_fetch_resource(&tmp TSRMLS_CC, -1, PHP_GIT2_RESOURCE_NAME, NULL, 1, git2_resource_handle);
+	if (resource == NULL || resource->type != type) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "blame option `%s` has the wrong resource type, ignored", name);
+		return NULL;
+	}
+	return resource;
+}
 
-	tmp = php_git2_read_arrval(array, ZEND_STRS("oldest_commit") TSRMLS_CC);
-	if (Z_TYPE_P(tmp) != NULL) {
-		if (Z_TYPE_P(tmp) != IS_STRING) {
-			convert_to_string(tmp);
-		}
-		if (git_oid_fromstrn(&options->newest_commit, Z_STRVAL_P(tmp), Z_STRLEN_P(tmp)) != GIT_OK) {
-			return;
-		}
+/* reads a commit id option, a missing, null or malformed value leaves the oid as it is */
+static void php_git2_blame_option_oid(git_oid *out, zval *array, char *name, size_t name_len TSRMLS_DC)
+{
+	zval *tmp;
+	git_oid id;
+
+	tmp = php_git2_read_arrval(array, name, name_len TSRMLS_CC);
+	if (tmp == NULL || Z_TYPE_P(tmp) == IS_NULL) {
+		return;
+	}
+	if (Z_TYPE_P(tmp) != IS_STRING) {
+		convert_to_string(tmp);
 	}
+	if (git_oid_fromstrn(&id, Z_STRVAL_P(tmp), Z_STRLEN_P(tmp)) != GIT_OK) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "blame option `%s` is not a commit id, ignored", name);
+		giterr_clear();
+		return;
+	}
+	git_oid_cpy(out, &id);
+}
 
-	options->min_line = php_git2_read_arrval_long(array, ZEND_STRS("min_line") TSRMLS_CC);
-	options->max_line = php_git2_read_arrval_long(array, ZEND_STRS("max_line") TSRMLS_CC);
+static void php_git2_array_to_git_blame_options(git_blame_options *options, php_git2_blame_extra *extra, zval *array TSRMLS_DC)
+{
+	php_git2_t *resource;
+
+	memset(extra, 0, sizeof(php_git2_blame_extra));
+	options->version = php_git2_read_arrval_long2(array, ZEND_STRS("version"), options->version TSRMLS_CC);
+	options->flags = php_git2_read_arrval_long2(array, ZEND_STRS("flags"), options->flags TSRMLS_CC);
+	options->min_match_characters = php_git2_read_arrval_long2(array, ZEND_STRS("min_match_characters"), options->min_match_characters TSRMLS_CC);
+	php_git2_blame_option_oid(&options->newest_commit, array, ZEND_STRS("newest_commit") TSRMLS_CC);
+	php_git2_blame_option_oid(&options->oldest_commit, array, ZEND_STRS("oldest_commit") TSRMLS_CC);
+	options->min_line = php_git2_read_arrval_long2(array, ZEND_STRS("min_line"), options->min_line TSRMLS_CC);
+	options->max_line = php_git2_read_arrval_long2(array, ZEND_STRS("max_line"), options->max_line TSRMLS_CC);
 
+	if ((resource = php_git2_blame_option_resource(array, ZEND_STRS("changed_paths"), PHP_GIT2_TYPE_CHANGED_PATHS TSRMLS_CC)) != NULL) {
+		extra->changed_paths = PHP_GIT2_V(resource, changed_paths);
+	}
+	if ((resource = php_git2_blame_option_resource(array, ZEND_STRS("blame_cache"), PHP_GIT2_TYPE_BLAME_CACHE TSRMLS_CC)) != NULL) {
+		extra->cache = PHP_GIT2_V(resource, blame_cache);
+	}
 }
 
 static void php_git2_git_blame_options_to_array(git_blame_options *options, zval **out TSRMLS_DC)
@@ -101,6 +135,544 @@ static void php_git2_git_blame_hunk_to_array(git_blame_hunk *hunk, zval **out TS
 	*out = result;
 }
 
+/* moves newest_commit back over commits leaving path as their first parent had it; the blame comes out the same */
+static int php_git2_blame_skip_untouched(git_oid *newest, git_repository *repo, php_git2_changed_paths *changed_paths, const char *path)
+{
+	git_commit *commit = NULL;
+	int error = 0, touched;
+
+	if (git_oid_iszero(newest)) {
+		error = git_reference_name_to_id(newest, repo, "HEAD");
+	}
+	while (error == 0) {
+		touched = php_git2_changed_paths_touches(changed_paths, repo, newest, path, 1);
+		if (touched != 0) {
+			return touched < 0 ? touched : 0;
+		}
+		error = git_commit_lookup(&commit, repo, newest);
+		if (error != 0) {
+			break;
+		}
+		if (git_commit_parentcount(commit) == 0) {
+			git_commit_free(commit);
+			break;
+		}
+		git_oid_cpy(newest, git_commit_parent_id(commit, 0));
+		git_commit_free(commit);
+	}
+	return error;
+}
+
+#define PHP_GIT2_BLAME_CACHE_MAGIC "PGBC1"
+/* first parent commits looked at before giving up on finding a cached ancestor */
+#define PHP_GIT2_BLAME_CACHE_MAX_WALK 64
+#define PHP_GIT2_BLAME_CACHE_MAX_LINES (1 << 24)
+#define PHP_GIT2_BLAME_LINES_SIZE(count) (offsetof(php_git2_blame_lines, lines) + ((count) > 0 ? (count) : 1) * sizeof(php_git2_blame_line))
+
+static char *php_git2_blame_cache_key(const char *path, const git_oid *id, uint *key_len)
+{
+	size_t path_len = strlen(path);
+	char *key;
+
+	*key_len = path_len + 1 + GIT_OID_RAWSZ;
+	key = (char*)emalloc(*key_len);
+	memcpy(key, path, path_len + 1);
+	memcpy(key + path_len + 1, id->id, GIT_OID_RAWSZ);
+	return key;
+}
+
+static php_git2_blame_lines *php_git2_blame_cache_find(php_git2_blame_cache *cache, const char *path, const git_oid *id)
+{
+	php_git2_blame_lines *lines = NULL;
+	uint key_len;
+	char *key;
+
+	key = php_git2_blame_cache_key(path, id, &key_len);
+	if (zend_hash_find(&cache->entries, key, key_len, (void**)&lines) != SUCCESS) {
+		lines = NULL;
+	}
+	efree(key);
+	return lines;
+}
+
+static long php_git2_blame_cache_path_count(php_git2_blame_cache *cache, const char *path)
+{
+	long *count;
+
+	if (zend_hash_find(&cache->paths, path, strlen(path) + 1, (void**)&count) == SUCCESS) {
+		return *count;
+	}
+	return 0;
+}
+
+/* key is the cache key built by php_git2_blame_cache_key, which starts with the NUL terminated path */
+static void php_git2_blame_cache_put(php_git2_blame_cache *cache, const char *key, uint key_len, php_git2_blame_lines *lines)
+{
+	long count;
+
+	if (!zend_hash_exists(&cache->entries, key, key_len)) {
+		count = php_git2_blame_cache_path_count(cache, key) + 1;
+		zend_hash_update(&cache->paths, key, strlen(key) + 1, (void*)&count, sizeof(long), NULL);
+	}
+	zend_hash_update(&cache->entries, key, key_len, (void*)lines, PHP_GIT2_BLAME_LINES_SIZE(lines->count), NULL);
+}
+
+static void php_git2_blame_cache_store(php_git2_blame_cache *cache, const char *path, const git_oid *id, php_git2_blame_lines *lines)
+{
+	uint key_len;
+	char *key;
+
+	key = php_git2_blame_cache_key(path, id, &key_len);
+	php_git2_blame_cache_put(cache, key, key_len, lines);
+	efree(key);
+	cache->dirty = 1;
+}
+
+static void php_git2_blame_cache_store_blame(php_git2_blame_cache *cache, const char *path, const git_oid *id, git_blame *blame)
+{
+	php_git2_blame_lines *lines;
+	const git_blame_hunk *hunk;
+	uint32_t count, i, j, total = 0;
+
+	count = git_blame_get_hunk_count(blame);
+	for (i = 0; i < count; i++) {
+		total += git_blame_get_hunk_byindex(blame, i)->lines_in_hunk;
+	}
+	lines = (php_git2_blame_lines*)emalloc(PHP_GIT2_BLAME_LINES_SIZE(total));
+	lines->count = 0;
+	for (i = 0; i < count; i++) {
+		hunk = git_blame_get_hunk_byindex(blame, i);
+		for (j = 0; j < hunk->lines_in_hunk; j++) {
+			git_oid_cpy(&lines->lines[lines->count].commit, &hunk->final_commit_id);
+			lines->lines[lines->count].orig_line = hunk->orig_start_line_number + j;
+			lines->count++;
+		}
+	}
+	php_git2_blame_cache_store(cache, path, id, lines);
+	efree(lines);
+}
+
+static void php_git2_blame_cache_load(php_git2_blame_cache *cache)
+{
+	char magic[sizeof(PHP_GIT2_BLAME_CACHE_MAGIC) - 1], *key;
+	php_git2_blame_lines *lines;
+	unsigned int key_len, count;
+	FILE *fp;
+
+	fp = fopen(cache->path, "rb");
+	if (fp == NULL) {
+		return;
+	}
+	if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+		memcmp(magic, PHP_GIT2_BLAME_CACHE_MAGIC, sizeof(magic)) == 0) {
+		while (fread(&key_len, 1, sizeof(key_len), fp) == sizeof(key_len) &&
+			key_len > GIT_OID_RAWSZ && key_len <= MAXPATHLEN + 1 + GIT_OID_RAWSZ) {
+			key = (char*)emalloc(key_len);
+			if (fread(key, 1, key_len, fp) != key_len ||
+				fread(&count, 1, sizeof(count), fp) != sizeof(count) || count > PHP_GIT2_BLAME_CACHE_MAX_LINES) {
+				efree(key);
+				break;
+			}
+			lines = (php_git2_blame_lines*)emalloc(PHP_GIT2_BLAME_LINES_SIZE(count));
+			lines->count = count;
+			if (fread(lines->lines, sizeof(php_git2_blame_line), count, fp) != count) {
+				efree(lines);
+				efree(key);
+				break;
+			}
+			if (memchr(key, '\0', key_len - GIT_OID_RAWSZ) == key + key_len - GIT_OID_RAWSZ - 1) {
+				php_git2_blame_cache_put(cache, key, key_len, lines);
+			}
+			efree(lines);
+			efree(key);
+		}
+	}
+	fclose(fp);
+}
+
+static int php_git2_blame_cache_save(php_git2_blame_cache *cache)
+{
+	php_git2_blame_lines *lines;
+	HashPosition pos;
+	char *key;
+	uint key_len;
+	ulong num_key;
+	smart_str out = {0};
+	int error = 0;
+
+	if (cache->path == NULL || !cache->dirty) {
+		return 0;
+	}
+	smart_str_appendl(&out, PHP_GIT2_BLAME_CACHE_MAGIC, sizeof(PHP_GIT2_BLAME_CACHE_MAGIC) - 1);
+	for (zend_hash_internal_pointer_reset_ex(&cache->entries, &pos);
+		zend_hash_get_current_data_ex(&cache->entries, (void**)&lines, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&cache->entries, &pos)) {
+		zend_hash_get_current_key_ex(&cache->entries, &key, &key_len, &num_key, 0, &pos);
+		smart_str_appendl(&out, (const char*)&key_len, sizeof(unsigned int));
+		smart_str_appendl(&out, key, key_len);
+		smart_str_appendl(&out, (const char*)&lines->count, sizeof(lines->count));
+		smart_str_appendl(&out, (const char*)lines->lines, sizeof(php_git2_blame_line) * lines->count);
+	}
+	if (php_git2_lockfile_write(cache->path, out.c, out.len)) {
+		error = -1;
+	} else {
+		cache->dirty = 0;
+	}
+	smart_str_free(&out);
+	return error;
+}
+
+void php_git2_blame_cache_free(php_git2_blame_cache *cache)
+{
+	php_git2_blame_cache_save(cache);
+	zend_hash_destroy(&cache->entries);
+	zend_hash_destroy(&cache->paths);
+	if (cache->path != NULL) {
+		efree(cache->path);
+	}
+	efree(cache);
+}
+
+static int php_git2_blame_blob(git_blob **out, git_commit *commit, const char *path)
+{
+	git_tree *tree = NULL;
+	git_tree_entry *entry = NULL;
+	int error;
+
+	error = git_commit_tree(&tree, commit);
+	if (error == 0) {
+		error = git_tree_entry_bypath(&entry, tree, path);
+	}
+	if (error == 0) {
+		if (git_tree_entry_type(entry) == GIT_OBJ_BLOB) {
+			error = git_blob_lookup(out, git_commit_owner(commit), git_tree_entry_id(entry));
+		} else {
+			error = GIT_ENOTFOUND;
+		}
+	}
+	git_tree_entry_free(entry);
+	git_tree_free(tree);
+	return error;
+}
+
+/* shifts the attributions through one patch; added lines belong to id */
+static int php_git2_blame_remap(php_git2_blame_lines **lines, git_patch *patch, const git_oid *id)
+{
+	php_git2_blame_lines *base = *lines, *next;
+	const git_diff_line *line;
+	size_t adds = 0, dels = 0, hunks, h, i, o = 0, k = 0, count, target;
+
+	git_patch_line_stats(NULL, &adds, &dels, patch);
+	if (dels > base->count) {
+		return GIT_ENOTFOUND;
+	}
+	count = base->count + adds - dels;
+	next = (php_git2_blame_lines*)emalloc(PHP_GIT2_BLAME_LINES_SIZE(count));
+
+	hunks = git_patch_num_hunks(patch);
+	for (h = 0; h < hunks; h++) {
+		for (i = 0; i < (size_t)git_patch_num_lines_in_hunk(patch, h); i++) {
+			git_patch_get_line_in_hunk(&line, patch, h, i);
+			if (line->origin == GIT_DIFF_LINE_DELETION) {
+				target = line->old_lineno - 1;
+				while (o < target && o < base->count && k < count) {
+					next->lines[k++] = base->lines[o++];
+				}
+				o++;
+			} else if (line->origin == GIT_DIFF_LINE_ADDITION) {
+				target = line->new_lineno - 1;
+				while (k < target && o < base->count && k < count) {
+					next->lines[k++] = base->lines[o++];
+				}
+				if (k < count) {
+					git_oid_cpy(&next->lines[k].commit, id);
+					next->lines[k].orig_line = line->new_lineno;
+					k++;
+				}
+			}
+		}
+	}
+	while (o < base->count && k < count) {
+		next->lines[k++] = base->lines[o++];
+	}
+	if (k != count || o != base->count) {
+		efree(next);
+		return GIT_ENOTFOUND;
+	}
+	next->count = count;
+	efree(base);
+	*lines = next;
+	return 0;
+}
+
+static int php_git2_blame_apply(php_git2_blame_lines **lines, git_repository *repo, const char *path, const git_oid *id)
+{
+	git_commit *commit = NULL, *parent = NULL;
+	git_blob *old_blob = NULL, *new_blob = NULL;
+	git_patch *patch = NULL;
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	int error;
+
+	opts.context_lines = 0;
+	error = git_commit_lookup(&commit, repo, id);
+	if (error == 0) {
+		error = git_commit_parent(&parent, commit, 0);
+	}
+	if (error == 0) {
+		error = php_git2_blame_blob(&old_blob, parent, path);
+	}
+	if (error == 0) {
+		error = php_git2_blame_blob(&new_blob, commit, path);
+	}
+	if (error == 0) {
+		error = git_patch_from_blobs(&patch, old_blob, path, new_blob, path, &opts);
+	}
+	if (error == 0) {
+		if (git_patch_get_delta(patch)->flags & GIT_DIFF_FLAG_BINARY) {
+			error = GIT_ENOTFOUND;
+		} else {
+			error = php_git2_blame_remap(lines, patch, id);
+		}
+	}
+	git_patch_free(patch);
+	git_blob_free(new_blob);
+	git_blob_free(old_blob);
+	git_commit_free(parent);
+	git_commit_free(commit);
+	return error;
+}
+
+/* finds path cached at id or at a first parent ancestor and replays the commits in between that touch it.
+   GIT_ENOTFOUND when there is nothing to start from, or a merge touching path is in the way. a path the
+   cache has never seen misses without walking, and the walk for one it has is kept short, since a full
+   git_blame_file is cheaper than crawling a long history for an ancestor that may not be there */
+static int php_git2_blame_replay(php_git2_blame_lines **out, git_repository *repo, const char *path, const git_oid *id, php_git2_blame_extra *extra)
+{
+	php_git2_blame_cache *cache = extra->cache;
+	php_git2_blame_lines *base = NULL, *lines;
+	git_commit *commit = NULL;
+	git_oid *chain, cur;
+	size_t n = 0, steps;
+	int error = 0, touched;
+
+	if (php_git2_blame_cache_path_count(cache, path) == 0) {
+		return GIT_ENOTFOUND;
+	}
+	if ((base = php_git2_blame_cache_find(cache, path, id)) != NULL) {
+		lines = (php_git2_blame_lines*)emalloc(PHP_GIT2_BLAME_LINES_SIZE(base->count));
+		memcpy(lines, base, PHP_GIT2_BLAME_LINES_SIZE(base->count));
+		cache->hits++;
+		*out = lines;
+		return 0;
+	}
+	chain = (git_oid*)safe_emalloc(PHP_GIT2_BLAME_CACHE_MAX_WALK, sizeof(git_oid), 0);
+	git_oid_cpy(&cur, id);
+	for (steps = 0; steps < PHP_GIT2_BLAME_CACHE_MAX_WALK; steps++) {
+		if (steps > 0 && (base = php_git2_blame_cache_find(cache, path, &cur)) != NULL) {
+			break;
+		}
+		touched = php_git2_changed_paths_touches(extra->changed_paths, repo, &cur, path, 1);
+		if (touched < 0) {
+			error = touched;
+			break;
+		}
+		error = git_commit_lookup(&commit, repo, &cur);
+		if (error != 0) {
+			break;
+		}
+		if (git_commit_parentcount(commit) == 0 || (touched && git_commit_parentcount(commit) > 1)) {
+			git_commit_free(commit);
+			error = GIT_ENOTFOUND;
+			break;
+		}
+		if (touched) {
+			git_oid_cpy(&chain[n++], &cur);
+		}
+		git_oid_cpy(&cur, git_commit_parent_id(commit, 0));
+		git_commit_free(commit);
+	}
+	if (error == 0 && base == NULL) {
+		error = GIT_ENOTFOUND;
+	}
+
+	if (error == 0) {
+		lines = (php_git2_blame_lines*)emalloc(PHP_GIT2_BLAME_LINES_SIZE(base->count));
+		memcpy(lines, base, PHP_GIT2_BLAME_LINES_SIZE(base->count));
+		while (n > 0 && error == 0) {
+			error = php_git2_blame_apply(&lines, repo, path, &chain[--n]);
+			cache->replayed_commits++;
+		}
+		if (error == 0) {
+			cache->replays++;
+			php_git2_blame_cache_store(cache, path, id, lines);
+			*out = lines;
+		} else {
+			efree(lines);
+		}
+	}
+	efree(chain);
+	return error;
+}
+
+static const git_signature *php_git2_blame_result_signature(php_git2_blame_result *result, git_repository *repo, const git_oid *id)
+{
+	git_signature **found, *signature = NULL;
+	git_commit *commit = NULL;
+
+	if (zend_hash_find(&result->signatures, (char*)id->id, GIT_OID_RAWSZ, (void**)&found) == SUCCESS) {
+		return *found;
+	}
+	if (git_commit_lookup(&commit, repo, id) == 0) {
+		signature = git_signature_dup(git_commit_author(commit));
+		git_commit_free(commit);
+	}
+	zend_hash_update(&result->signatures, (char*)id->id, GIT_OID_RAWSZ, (void*)&signature, sizeof(git_signature*), NULL);
+	return signature;
+}
+
+/* joins lines from the same commit with consecutive original lines into hunks, as git_blame_file does */
+static php_git2_blame_result *php_git2_blame_result_new(git_repository *repo, const char *path, const php_git2_blame_lines *lines)
+{
+	php_git2_blame_result *result;
+	const php_git2_blame_line *line;
+	git_blame_hunk *hunk;
+	unsigned int i;
+
+	result = (php_git2_blame_result*)ecalloc(1, sizeof(php_git2_blame_result));
+	result->path = estrdup(path);
+	result->hunks = (git_blame_hunk*)safe_emalloc(lines->count > 0 ? lines->count : 1, sizeof(git_blame_hunk), 0);
+	zend_hash_init(&result->signatures, 16, NULL, NULL, 0);
+
+	for (i = 0; i < lines->count; i++) {
+		line = &lines->lines[i];
+		if (result->count > 0) {
+			hunk = &result->hunks[result->count - 1];
+			if (git_oid_equal(&hunk->final_commit_id, &line->commit) &&
+				hunk->orig_start_line_number + hunk->lines_in_hunk == line->orig_line) {
+				hunk->lines_in_hunk++;
+				continue;
+			}
+		}
+		hunk = &result->hunks[result->count++];
+		memset(hunk, 0, sizeof(git_blame_hunk));
+		hunk->lines_in_hunk = 1;
+		git_oid_cpy(&hunk->final_commit_id, &line->commit);
+		hunk->final_start_line_number = i + 1;
+		git_oid_cpy(&hunk->orig_commit_id, &line->commit);
+		hunk->orig_path = result->path;
+		hunk->orig_start_line_number = line->orig_line;
+		hunk->final_signature = (git_signature*)php_git2_blame_result_signature(result, repo, &line->commit);
+		hunk->orig_signature = hunk->final_signature;
+	}
+	return result;
+}
+
+void php_git2_blame_result_free(php_git2_blame_result *result)
+{
+	git_signature **signature;
+	HashPosition pos;
+
+	for (zend_hash_internal_pointer_reset_ex(&result->signatures, &pos);
+		zend_hash_get_current_data_ex(&result->signatures, (void**)&signature, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&result->signatures, &pos)) {
+		git_signature_free(*signature);
+	}
+	zend_hash_destroy(&result->signatures);
+	efree(result->hunks);
+	efree(result->path);
+	efree(result);
+}
+
+static int php_git2_blame_cacheable(const git_blame_options *opts)
+{
+	return opts->flags == GIT_BLAME_NORMAL && opts->min_line == 0 && opts->max_line == 0 &&
+		git_oid_iszero(&opts->oldest_commit);
+}
+
+/* blames through the options' changed paths index and blame cache; a cached answer comes back
+   as result, anything else as a git_blame stored in the cache on the way out */
+static int php_git2_blame_file(git_blame **blame, php_git2_blame_result **result, git_repository *repo,
+	const char *path, git_blame_options *opts, php_git2_blame_extra *extra)
+{
+	php_git2_blame_lines *lines = NULL;
+	int error = 0;
+
+	*blame = NULL;
+	*result = NULL;
+	if (extra->changed_paths != NULL) {
+		error = php_git2_blame_skip_untouched(&opts->newest_commit, repo, extra->changed_paths, path);
+		if (error != 0) {
+			return error;
+		}
+	}
+	if (extra->cache == NULL || !php_git2_blame_cacheable(opts)) {
+		return git_blame_file(blame, repo, path, opts);
+	}
+	if (git_oid_iszero(&opts->newest_commit)) {
+		error = git_reference_name_to_id(&opts->newest_commit, repo, "HEAD");
+		if (error != 0) {
+			return error;
+		}
+	}
+
+	error = php_git2_blame_replay(&lines, repo, path, &opts->newest_commit, extra);
+	if (error == 0) {
+		*result = php_git2_blame_result_new(repo, path, lines);
+		efree(lines);
+		return 0;
+	}
+	if (error != GIT_ENOTFOUND) {
+		return error;
+	}
+	giterr_clear();
+	extra->cache->misses++;
+	error = git_blame_file(blame, repo, path, opts);
+	if (error == 0) {
+		php_git2_blame_cache_store_blame(extra->cache, path, &opts->newest_commit, *blame);
+	}
+	return error;
+}
+
+static uint32_t php_git2_blame_hunk_count(php_git2_t *blame)
+{
+	if (blame->priv != NULL) {
+		return ((php_git2_blame_result*)blame->priv)->count;
+	}
+	return git_blame_get_hunk_count(PHP_GIT2_V(blame, blame));
+}
+
+static const git_blame_hunk *php_git2_blame_hunk_byindex(php_git2_t *blame, uint32_t index)
+{
+	php_git2_blame_result *result = (php_git2_blame_result*)blame->priv;
+
+	if (result == NULL) {
+		return git_blame_get_hunk_byindex(PHP_GIT2_V(blame, blame), index);
+	}
+	return index < result->count ? &result->hunks[index] : NULL;
+}
+
+static const git_blame_hunk *php_git2_blame_hunk_byline(php_git2_t *blame, uint32_t lineno)
+{
+	php_git2_blame_result *result = (php_git2_blame_result*)blame->priv;
+	uint32_t low = 0, high, mid;
+
+	if (result == NULL) {
+		return git_blame_get_hunk_byline(PHP_GIT2_V(blame, blame), lineno);
+	}
+	high = result->count;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (lineno < result->hunks[mid].final_start_line_number) {
+			high = mid;
+		} else if (lineno >= (uint32_t)result->hunks[mid].final_start_line_number + result->hunks[mid].lines_in_hunk) {
+			low = mid + 1;
+		} else {
+			return &result->hunks[mid];
+		}
+	}
+	return NULL;
+}
+
 /* {{{ proto long git_blame_get_hunk_count(resource $blame)
  */
 PHP_FUNCTION(git_blame_get_hunk_count)
@@ -115,7 +687,7 @@ PHP_FUNCTION(git_blame_get_hunk_count)
 	}
 	
 	ZEND_FETCH_RESOURCE(_blame, php_git2_t*, &blame, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
-	result = git_blame_get_hunk_count(PHP_GIT2_V(_blame, blame));
+	result = php_git2_blame_hunk_count(_blame);
 	RETURN_LONG(result);
 }
 /* }}} */
@@ -135,7 +707,7 @@ PHP_FUNCTION(git_blame_get_hunk_byindex)
 	}
 	
 	ZEND_FETCH_RESOURCE(_blame, php_git2_t*, &blame, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
-	result = git_blame_get_hunk_byindex(PHP_GIT2_V(_blame, blame), index);
+	result = php_git2_blame_hunk_byindex(_blame, index);
 	if (result == NULL) {
 		RETURN_FALSE;
 	}
@@ -159,7 +731,7 @@ PHP_FUNCTION(git_blame_get_hunk_byline)
 	}
 	
 	ZEND_FETCH_RESOURCE(_blame, php_git2_t*, &blame, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
-	result = git_blame_get_hunk_byline(PHP_GIT2_V(_blame, blame), lineno);
+	result = php_git2_blame_hunk_byline(_blame, lineno);
 	if (result == NULL) {
 		RETURN_FALSE;
 	}
@@ -169,11 +741,16 @@ PHP_FUNCTION(git_blame_get_hunk_byline)
 /* }}} */
 
 /* {{{ proto resource git_blame_file(resource $repo, string $path,  $options)
- */
+  `changed_paths` in the options array takes an index from git_revwalk_changed_paths_new
+  to start the blame at the last commit touching $path. `blame_cache` takes a cache from
+  git_blame_cache_new; whole file blames are then answered from a cached ancestor blame
+  by replaying the commits touching $path since */
 PHP_FUNCTION(git_blame_file)
 {
 	php_git2_t *result = NULL, *_repo = NULL;
 	git_blame *out = NULL;
+	php_git2_blame_result *cached = NULL;
+	php_git2_blame_extra extra = {0};
 	zval *repo = NULL, *options = NULL;
 	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
 	char *path = NULL;
@@ -185,14 +762,18 @@ PHP_FUNCTION(git_blame_file)
 	}
 
 	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
-	php_git2_array_to_git_blame_options(&opts, options TSRMLS_CC);
-	error = git_blame_file(&out, PHP_GIT2_V(_repo, repository), path, &opts);
+	php_git2_array_to_git_blame_options(&opts, &extra, options TSRMLS_CC);
+	error = php_git2_blame_file(&out, &cached, PHP_GIT2_V(_repo, repository), path, &opts, &extra);
 	if (php_git2_check_error(error, "git_blame_file" TSRMLS_CC)) {
 		RETURN_FALSE;
 	}
 	if (php_git2_make_resource(&result, PHP_GIT2_TYPE_BLAME, out, 1 TSRMLS_CC)) {
+		if (cached != NULL) {
+			php_git2_blame_result_free(cached);
+		}
 		RETURN_FALSE;
 	}
+	result->priv = cached;
 	ZVAL_RESOURCE(return_value, GIT2_RVAL_P(result));
 }
 /* }}} */
@@ -213,6 +794,10 @@ PHP_FUNCTION(git_blame_buffer)
 	}
 	
 	ZEND_FETCH_RESOURCE(_reference, php_git2_t*, &reference, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (PHP_GIT2_V(_reference, blame) == NULL) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "git_blame_buffer needs a blame computed by libgit2, not one answered from a blame cache");
+		RETURN_FALSE;
+	}
 	error = git_blame_buffer(&out, PHP_GIT2_V(_reference, blame), buffer, buffer_len);
 	if (php_git2_check_error(error, "git_blame_buffer" TSRMLS_CC)) {
 		RETURN_FALSE;
@@ -256,3 +841,592 @@ PHP_FUNCTION(git_blame_options_new)
 	RETURN_ZVAL(result, 0, 1);
 }
 /* }}} */
+
+enum php_git2_blame_field {
+	PHP_GIT2_BLAME_FIELD_START = 0,
+	PHP_GIT2_BLAME_FIELD_LINES,
+	PHP_GIT2_BLAME_FIELD_FINAL_COMMIT_ID,
+	PHP_GIT2_BLAME_FIELD_ORIG_COMMIT_ID,
+	PHP_GIT2_BLAME_FIELD_ORIG_PATH,
+	PHP_GIT2_BLAME_FIELD_ORIG_START,
+	PHP_GIT2_BLAME_FIELD_TIME,
+	PHP_GIT2_BLAME_FIELD_BOUNDARY,
+	PHP_GIT2_BLAME_FIELD_MAX
+};
+
+static const char *php_git2_blame_field_names[PHP_GIT2_BLAME_FIELD_MAX] = {
+	"start", "lines", "final_commit_id", "orig_commit_id", "orig_path", "orig_start", "time", "boundary"
+};
+
+/* one plain name/email/time/offset row per commit instead of a DateTime per hunk */
+static void php_git2_blame_add_signature(zval *signatures, const char *id, const git_signature *signature)
+{
+	zval *row;
+
+	if (signature == NULL || zend_hash_exists(Z_ARRVAL_P(signatures), id, GIT_OID_HEXSZ + 1)) {
+		return;
+	}
+	MAKE_STD_ZVAL(row);
+	array_init(row);
+	add_assoc_string_ex(row, ZEND_STRS("name"), signature->name ? signature->name : "", 1);
+	add_assoc_string_ex(row, ZEND_STRS("email"), signature->email ? signature->email : "", 1);
+	add_assoc_long_ex(row, ZEND_STRS("time"), signature->when.time);
+	add_assoc_long_ex(row, ZEND_STRS("offset"), signature->when.offset);
+	add_assoc_zval_ex(signatures, id, GIT_OID_HEXSZ + 1, row);
+}
+
+/* {{{ proto array git_blame_to_array(resource $blame[, array $fields])
+  returns ['hunks' => rows, 'signatures' => commit id => signature] in one call. rows hold the requested
+  fields (start, lines, final_commit_id, orig_commit_id, orig_path, orig_start, time, boundary);
+  start, lines, final_commit_id and time by default */
+PHP_FUNCTION(git_blame_to_array)
+{
+	zval *blame = NULL, *fields = NULL, *hunks, *signatures, *row;
+	php_git2_t *_blame = NULL;
+	const git_blame_hunk *hunk;
+	int wanted[PHP_GIT2_BLAME_FIELD_MAX] = {0};
+	char final_id[GIT2_OID_HEXSIZE] = {0}, orig_id[GIT2_OID_HEXSIZE] = {0};
+	uint32_t count, i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r|a", &blame, &fields) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_blame, php_git2_t*, &blame, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (php_git2_fields_parse(wanted, fields, php_git2_blame_field_names, PHP_GIT2_BLAME_FIELD_MAX, "blame hunk" TSRMLS_CC) == 0) {
+		wanted[PHP_GIT2_BLAME_FIELD_START] = 1;
+		wanted[PHP_GIT2_BLAME_FIELD_LINES] = 1;
+		wanted[PHP_GIT2_BLAME_FIELD_FINAL_COMMIT_ID] = 1;
+		wanted[PHP_GIT2_BLAME_FIELD_TIME] = 1;
+	}
+
+	count = php_git2_blame_hunk_count(_blame);
+	MAKE_STD_ZVAL(hunks);
+	array_init_size(hunks, count);
+	MAKE_STD_ZVAL(signatures);
+	array_init(signatures);
+
+	for (i = 0; i < count; i++) {
+		hunk = php_git2_blame_hunk_byindex(_blame, i);
+		if (hunk == NULL) {
+			break;
+		}
+		git_oid_fmt(final_id, &hunk->final_commit_id);
+		git_oid_fmt(orig_id, &hunk->orig_commit_id);
+
+		MAKE_STD_ZVAL(row);
+		array_init(row);
+		if (wanted[PHP_GIT2_BLAME_FIELD_START]) {
+			add_assoc_long_ex(row, ZEND_STRS("start"), hunk->final_start_line_number);
+		}
+		if (wanted[PHP_GIT2_BLAME_FIELD_LINES]) {
+			add_assoc_long_ex(row, ZEND_STRS("lines"), hunk->lines_in_hunk);
+		}
+		if (wanted[PHP_GIT2_BLAME_FIELD_FINAL_COMMIT_ID]) {
+			add_assoc_stringl_ex(row, ZEND_STRS("final_commit_id"), final_id, GIT_OID_HEXSZ, 1);
+			php_git2_blame_add_signature(signatures, final_id, hunk->final_signature);
+		}
+		if (wanted[PHP_GIT2_BLAME_FIELD_ORIG_COMMIT_ID]) {
+			add_assoc_stringl_ex(row, ZEND_STRS("orig_commit_id"), orig_id, GIT_OID_HEXSZ, 1);
+			php_git2_blame_add_signature(signatures, orig_id, hunk->orig_signature);
+		}
+		if (wanted[PHP_GIT2_BLAME_FIELD_ORIG_PATH]) {
+			add_assoc_string_ex(row, ZEND_STRS("orig_path"), hunk->orig_path ? (char*)hunk->orig_path : "", 1);
+		}
+		if (wanted[PHP_GIT2_BLAME_FIELD_ORIG_START]) {
+			add_assoc_long_ex(row, ZEND_STRS("orig_start"), hunk->orig_start_line_number);
+		}
+		if (wanted[PHP_GIT2_BLAME_FIELD_TIME]) {
+			add_assoc_long_ex(row, ZEND_STRS("time"), hunk->final_signature ? hunk->final_signature->when.time : 0);
+		}
+		if (wanted[PHP_GIT2_BLAME_FIELD_BOUNDARY]) {
+			add_assoc_bool_ex(row, ZEND_STRS("boundary"), hunk->boundary);
+		}
+		add_next_index_zval(hunks, row);
+	}
+
+	array_init(return_value);
+	add_assoc_zval_ex(return_value, ZEND_STRS("hunks"), hunks);
+	add_assoc_zval_ex(return_value, ZEND_STRS("signatures"), signatures);
+}
+/* }}} */
+
+/* {{{ proto resource git_blame_cache_new(resource $repo[, bool $persist])
+  creates a (path, commit) => line attribution cache for the `blame_cache` blame option.
+  with $persist it is loaded from and written back to $GIT_DIR/php_git2_blame_cache */
+PHP_FUNCTION(git_blame_cache_new)
+{
+	zval *repo = NULL;
+	php_git2_t *_repo = NULL, *result = NULL;
+	php_git2_blame_cache *cache;
+	zend_bool persist = 0;
+	char path[MAXPATHLEN];
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r|b", &repo, &persist) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	cache = (php_git2_blame_cache*)ecalloc(1, sizeof(php_git2_blame_cache));
+	zend_hash_init(&cache->entries, 64, NULL, NULL, 0);
+	zend_hash_init(&cache->paths, 16, NULL, NULL, 0);
+	if (persist) {
+		snprintf(path, sizeof(path), "%sphp_git2_blame_cache", git_repository_path(PHP_GIT2_V(_repo, repository)));
+		cache->path = estrdup(path);
+		php_git2_blame_cache_load(cache);
+	}
+	if (php_git2_make_resource(&result, PHP_GIT2_TYPE_BLAME_CACHE, cache, 1 TSRMLS_CC)) {
+		php_git2_blame_cache_free(cache);
+		RETURN_FALSE;
+	}
+	ZVAL_RESOURCE(return_value, GIT2_RVAL_P(result));
+}
+/* }}} */
+
+/* {{{ proto long git_blame_cache_prewarm(resource $cache, resource $repo, array $paths[, array $options])
+  blames every path into the cache, meant to run after pushes. $options are the git_blame_file
+  options, newest_commit picks the commit (HEAD by default). returns the number of paths cached */
+PHP_FUNCTION(git_blame_cache_prewarm)
+{
+	zval *cache = NULL, *repo = NULL, *paths = NULL, *options = NULL, **value = NULL;
+	php_git2_t *_cache = NULL, *_repo = NULL;
+	php_git2_blame_extra extra = {0};
+	php_git2_blame_result *cached = NULL;
+	git_blame_options opts = GIT_BLAME_OPTIONS_INIT, base = GIT_BLAME_OPTIONS_INIT;
+	git_blame *out = NULL;
+	HashPosition pos;
+	long warmed = 0;
+	int error = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rra|a", &cache, &repo, &paths, &options) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_cache, php_git2_t*, &cache, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (_cache->type != PHP_GIT2_TYPE_BLAME_CACHE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "cache expects a git_blame_cache_new resource");
+		RETURN_FALSE;
+	}
+	if (options != NULL) {
+		php_git2_array_to_git_blame_options(&base, &extra, options TSRMLS_CC);
+	}
+	extra.cache = PHP_GIT2_V(_cache, blame_cache);
+
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(paths), &pos);
+		zend_hash_get_current_data_ex(Z_ARRVAL_P(paths), (void **)&value, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(Z_ARRVAL_P(paths), &pos)) {
+		if (Z_TYPE_PP(value) != IS_STRING) {
+			continue;
+		}
+		memcpy(&opts, &base, sizeof(git_blame_options));
+		error = php_git2_blame_file(&out, &cached, PHP_GIT2_V(_repo, repository), Z_STRVAL_PP(value), &opts, &extra);
+		if (error == 0) {
+			warmed++;
+		} else {
+			/* a path missing at that commit is not worth failing the whole batch */
+			giterr_clear();
+		}
+		git_blame_free(out);
+		if (cached != NULL) {
+			php_git2_blame_result_free(cached);
+		}
+	}
+	RETURN_LONG(warmed);
+}
+/* }}} */
+
+/* {{{ proto bool git_blame_cache_save(resource $cache)
+ */
+PHP_FUNCTION(git_blame_cache_save)
+{
+	zval *cache = NULL;
+	php_git2_t *_cache = NULL;
+	int error = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &cache) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_cache, php_git2_t*, &cache, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (_cache->type != PHP_GIT2_TYPE_BLAME_CACHE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "cache expects a git_blame_cache_new resource");
+		RETURN_FALSE;
+	}
+	error = php_git2_blame_cache_save(PHP_GIT2_V(_cache, blame_cache));
+	if (php_git2_check_error(error, "git_blame_cache_save" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto array git_blame_cache_stats(resource $cache)
+ */
+PHP_FUNCTION(git_blame_cache_stats)
+{
+	zval *cache = NULL;
+	php_git2_t *_cache = NULL;
+	php_git2_blame_cache *_c;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &cache) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_cache, php_git2_t*, &cache, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (_cache->type != PHP_GIT2_TYPE_BLAME_CACHE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "cache expects a git_blame_cache_new resource");
+		RETURN_FALSE;
+	}
+	_c = PHP_GIT2_V(_cache, blame_cache);
+	array_init(return_value);
+	add_assoc_long_ex(return_value, ZEND_STRS("entries"), zend_hash_num_elements(&_c->entries));
+	add_assoc_long_ex(return_value, ZEND_STRS("hits"), _c->hits);
+	add_assoc_long_ex(return_value, ZEND_STRS("replays"), _c->replays);
+	add_assoc_long_ex(return_value, ZEND_STRS("misses"), _c->misses);
+	add_assoc_long_ex(return_value, ZEND_STRS("replayed_commits"), _c->replayed_commits);
+	add_assoc_bool_ex(return_value, ZEND_STRS("persistent"), _c->path != NULL);
+}
+/* }}} */
+
+/* a line of the blamed window: its number in the newest version and in the version being looked at */
+typedef struct php_git2_blame_track {
+	unsigned int final_line;
+	unsigned int line;
+} php_git2_blame_track;
+
+typedef struct php_git2_blame_resolved {
+	unsigned int final_line;
+	unsigned int orig_line;
+	git_oid commit;
+} php_git2_blame_resolved;
+
+typedef struct php_git2_blame_stream {
+	git_repository *repo;
+	const char *path;
+	php_git2_cb_t *cb;
+	php_git2_blame_track *pending;
+	size_t count;
+	php_git2_blame_resolved *resolved;
+	size_t resolved_count;
+	long emitted;
+} php_git2_blame_stream;
+
+static void php_git2_blame_stream_resolve(php_git2_blame_stream *stream, const php_git2_blame_track *track, unsigned int orig_line, const git_oid *commit)
+{
+	php_git2_blame_resolved *resolved = &stream->resolved[stream->resolved_count++];
+
+	resolved->final_line = track->final_line;
+	resolved->orig_line = orig_line;
+	git_oid_cpy(&resolved->commit, commit);
+}
+
+static int php_git2_blame_stream_call(php_git2_blame_stream *stream, const php_git2_blame_resolved *first,
+	unsigned int lines, const git_signature *signature, int boundary)
+{
+	zval *row, *retval_ptr = NULL;
+	char buf[GIT2_OID_HEXSIZE] = {0};
+	long retval = 0;
+	GIT2_TSRMLS_SET(stream->cb->tsrm_ls)
+
+	MAKE_STD_ZVAL(row);
+	array_init(row);
+	git_oid_fmt(buf, &first->commit);
+	add_assoc_long_ex(row, ZEND_STRS("start"), first->final_line);
+	add_assoc_long_ex(row, ZEND_STRS("lines"), lines);
+	add_assoc_stringl_ex(row, ZEND_STRS("final_commit_id"), buf, GIT_OID_HEXSZ, 1);
+	add_assoc_long_ex(row, ZEND_STRS("orig_start"), first->orig_line);
+	add_assoc_string_ex(row, ZEND_STRS("orig_path"), (char*)stream->path, 1);
+	add_assoc_bool_ex(row, ZEND_STRS("boundary"), boundary);
+	add_assoc_string_ex(row, ZEND_STRS("name"), signature && signature->name ? signature->name : "", 1);
+	add_assoc_string_ex(row, ZEND_STRS("email"), signature && signature->email ? signature->email : "", 1);
+	add_assoc_long_ex(row, ZEND_STRS("time"), signature ? signature->when.time : 0);
+
+	Z_ADDREF_P(stream->cb->payload);
+	if (php_git2_call_function_v(stream->cb->fci, stream->cb->fcc TSRMLS_CC, &retval_ptr, 2,
+		&row, &stream->cb->payload)) {
+		return GIT_EUSER;
+	}
+	stream->emitted++;
+	if (retval_ptr != NULL) {
+		convert_to_long(retval_ptr);
+		retval = Z_LVAL_P(retval_ptr);
+		zval_ptr_dtor(&retval_ptr);
+	}
+	return retval ? GIT_EUSER : 0;
+}
+
+/* hands the lines resolved in one step to the callback, joined into hunks like git_blame_file makes them */
+static int php_git2_blame_stream_emit(php_git2_blame_stream *stream, int boundary)
+{
+	php_git2_blame_resolved *first, *line;
+	git_commit *commit = NULL;
+	git_oid last = {{0}};
+	size_t i, j;
+	int error = 0;
+
+	for (i = 0; i < stream->resolved_count && error == 0; i = j) {
+		first = &stream->resolved[i];
+		for (j = i + 1; j < stream->resolved_count; j++) {
+			line = &stream->resolved[j];
+			if (!git_oid_equal(&line->commit, &first->commit) ||
+				line->final_line != first->final_line + (j - i) ||
+				line->orig_line != first->orig_line + (j - i)) {
+				break;
+			}
+		}
+		if (commit == NULL || !git_oid_equal(&last, &first->commit)) {
+			git_commit_free(commit);
+			commit = NULL;
+			git_commit_lookup(&commit, stream->repo, &first->commit);
+			git_oid_cpy(&last, &first->commit);
+		}
+		error = php_git2_blame_stream_call(stream, first, j - i, commit ? git_commit_author(commit) : NULL, boundary);
+	}
+	git_commit_free(commit);
+	stream->resolved_count = 0;
+	return error;
+}
+
+/* maps every pending line through a zero context patch parent -> id; lines the patch adds belong to id */
+static void php_git2_blame_stream_step(php_git2_blame_stream *stream, git_patch *patch, const git_oid *id)
+{
+	const git_diff_hunk *hunk = NULL;
+	size_t h = 0, hunks, lines, i, kept = 0;
+	unsigned int line;
+	long delta = 0;
+
+	hunks = git_patch_num_hunks(patch);
+	for (i = 0; i < stream->count; i++) {
+		line = stream->pending[i].line;
+		while (h < hunks) {
+			git_patch_get_hunk(&hunk, &lines, patch, h);
+			if (hunk->new_lines == 0 ? line > (unsigned int)hunk->new_start :
+				line >= (unsigned int)(hunk->new_start + hunk->new_lines)) {
+				delta += hunk->old_lines - hunk->new_lines;
+				h++;
+				continue;
+			}
+			break;
+		}
+		if (h < hunks && hunk->new_lines > 0 && line >= (unsigned int)hunk->new_start) {
+			php_git2_blame_stream_resolve(stream, &stream->pending[i], line, id);
+		} else {
+			stream->pending[kept].final_line = stream->pending[i].final_line;
+			stream->pending[kept].line = line + delta;
+			kept++;
+		}
+	}
+	stream->count = kept;
+}
+
+static void php_git2_blame_stream_resolve_all(php_git2_blame_stream *stream, const git_oid *id)
+{
+	size_t i;
+
+	for (i = 0; i < stream->count; i++) {
+		php_git2_blame_stream_resolve(stream, &stream->pending[i], stream->pending[i].line, id);
+	}
+	stream->count = 0;
+}
+
+/* libgit2 blames what is left at a merge that touched the path, with the caller's flags and
+   oldest_commit but limited to the lines still pending */
+static int php_git2_blame_stream_merge(php_git2_blame_stream *stream, const git_blame_options *caller, const git_oid *id)
+{
+	git_blame_options opts;
+	git_blame *blame = NULL;
+	const git_blame_hunk *hunk;
+	size_t i;
+	int error;
+
+	memcpy(&opts, caller, sizeof(git_blame_options));
+	git_oid_cpy(&opts.newest_commit, id);
+	opts.min_line = stream->pending[0].line;
+	opts.max_line = stream->pending[stream->count - 1].line;
+	error = git_blame_file(&blame, stream->repo, stream->path, &opts);
+	if (error != 0) {
+		return error;
+	}
+	for (i = 0; i < stream->count; i++) {
+		hunk = git_blame_get_hunk_byline(blame, stream->pending[i].line);
+		if (hunk == NULL) {
+			php_git2_blame_stream_resolve(stream, &stream->pending[i], stream->pending[i].line, id);
+			continue;
+		}
+		php_git2_blame_stream_resolve(stream, &stream->pending[i],
+			hunk->orig_start_line_number + (stream->pending[i].line - hunk->final_start_line_number), &hunk->final_commit_id);
+	}
+	stream->count = 0;
+	git_blame_free(blame);
+	return 0;
+}
+
+static unsigned int php_git2_blame_count_lines(git_blob *blob)
+{
+	const char *content = (const char*)git_blob_rawcontent(blob);
+	git_off_t size = git_blob_rawsize(blob), i;
+	unsigned int lines = 0;
+
+	for (i = 0; i < size; i++) {
+		if (content[i] == '\n') {
+			lines++;
+		}
+	}
+	if (size > 0 && content[size - 1] != '\n') {
+		lines++;
+	}
+	return lines;
+}
+
+/* walks first parents from the newest commit, resolving the window as soon as each line's origin is known */
+static int php_git2_blame_stream_run(php_git2_blame_stream *stream, git_blame_options *opts, php_git2_blame_extra *extra)
+{
+	git_commit *commit = NULL, *parent = NULL;
+	git_blob *old_blob = NULL, *new_blob = NULL;
+	git_patch *patch = NULL;
+	git_diff_options diffopts = GIT_DIFF_OPTIONS_INIT;
+	git_oid cur;
+	int error = 0, touched, boundary;
+
+	diffopts.context_lines = 0;
+	git_oid_cpy(&cur, &opts->newest_commit);
+	while (error == 0 && stream->count > 0) {
+		error = git_commit_lookup(&commit, stream->repo, &cur);
+		if (error != 0) {
+			break;
+		}
+		boundary = git_commit_parentcount(commit) == 0 || git_oid_equal(&cur, &opts->oldest_commit);
+		if (boundary) {
+			php_git2_blame_stream_resolve_all(stream, &cur);
+			error = php_git2_blame_stream_emit(stream, 1);
+			break;
+		}
+		touched = php_git2_changed_paths_touches(extra->changed_paths, stream->repo, &cur, stream->path, 1);
+		if (touched < 0) {
+			error = touched;
+		} else if (touched && git_commit_parentcount(commit) > 1) {
+			error = php_git2_blame_stream_merge(stream, opts, &cur);
+		} else if (touched) {
+			error = git_commit_parent(&parent, commit, 0);
+			if (error == 0) {
+				error = php_git2_blame_blob(&new_blob, commit, stream->path);
+			}
+			if (error == 0) {
+				error = php_git2_blame_blob(&old_blob, parent, stream->path);
+			}
+			if (error == GIT_ENOTFOUND) {
+				/* the path starts here */
+				giterr_clear();
+				error = 0;
+				php_git2_blame_stream_resolve_all(stream, &cur);
+			} else if (error == 0) {
+				error = git_patch_from_blobs(&patch, old_blob, stream->path, new_blob, stream->path, &diffopts);
+				if (error == 0 && (git_patch_get_delta(patch)->flags & GIT_DIFF_FLAG_BINARY)) {
+					php_git2_blame_stream_resolve_all(stream, &cur);
+				} else if (error == 0) {
+					php_git2_blame_stream_step(stream, patch, &cur);
+				}
+			}
+			git_patch_free(patch);
+			git_blob_free(old_blob);
+			git_blob_free(new_blob);
+			git_commit_free(parent);
+			patch = NULL;
+			old_blob = new_blob = NULL;
+			parent = NULL;
+		}
+		if (error == 0 && stream->resolved_count > 0) {
+			error = php_git2_blame_stream_emit(stream, 0);
+		}
+		git_oid_cpy(&cur, git_commit_parent_id(commit, 0));
+		git_commit_free(commit);
+		commit = NULL;
+	}
+	git_commit_free(commit);
+	return error;
+}
+
+/* {{{ proto long git_blame_file_stream(resource $repo, string $path, array $options, Callable $callback, $payload)
+  calls $callback(array $hunk, $payload) as soon as each hunk's origin is known, newest first, and
+  only for the min_line/max_line window; walking stops once the window is attributed or the
+  callback returns a non zero value. `changed_paths` skips commits without reading trees.
+  `flags` only reach the libgit2 blame run at merges touching $path, `oldest_commit` ends the
+  walk with boundary hunks. returns the number of hunks emitted */
+PHP_FUNCTION(git_blame_file_stream)
+{
+	zval *repo = NULL, *options = NULL, *payload = NULL;
+	php_git2_t *_repo = NULL;
+	zend_fcall_info fci = empty_fcall_info;
+	zend_fcall_info_cache fcc = empty_fcall_info_cache;
+	php_git2_blame_extra extra = {0};
+	php_git2_blame_stream stream = {0};
+	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+	git_commit *commit = NULL;
+	git_blob *blob = NULL;
+	char *path = NULL;
+	int path_len = 0, error = 0;
+	unsigned int total = 0, first, last, i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rsafz", &repo, &path, &path_len, &options, &fci, &fcc, &payload) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	php_git2_array_to_git_blame_options(&opts, &extra, options TSRMLS_CC);
+	stream.repo = PHP_GIT2_V(_repo, repository);
+	stream.path = path;
+
+	if (git_oid_iszero(&opts.newest_commit)) {
+		error = git_reference_name_to_id(&opts.newest_commit, stream.repo, "HEAD");
+	}
+	if (error == 0) {
+		error = git_commit_lookup(&commit, stream.repo, &opts.newest_commit);
+	}
+	if (error == 0) {
+		error = php_git2_blame_blob(&blob, commit, path);
+	}
+	if (error == 0) {
+		total = php_git2_blame_count_lines(blob);
+	}
+	git_blob_free(blob);
+	git_commit_free(commit);
+	if (php_git2_check_error(error, "git_blame_file_stream" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+
+	first = opts.min_line > 0 ? opts.min_line : 1;
+	last = opts.max_line > 0 && opts.max_line < total ? opts.max_line : total;
+	if (first > last) {
+		RETURN_LONG(0);
+	}
+	if (php_git2_cb_init(&stream.cb, &fci, &fcc, payload TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	stream.count = last - first + 1;
+	stream.pending = (php_git2_blame_track*)safe_emalloc(stream.count, sizeof(php_git2_blame_track), 0);
+	stream.resolved = (php_git2_blame_resolved*)safe_emalloc(stream.count, sizeof(php_git2_blame_resolved), 0);
+	for (i = 0; i < stream.count; i++) {
+		stream.pending[i].final_line = first + i;
+		stream.pending[i].line = first + i;
+	}
+
+	error = php_git2_blame_stream_run(&stream, &opts, &extra);
+	efree(stream.pending);
+	efree(stream.resolved);
+	php_git2_cb_free(stream.cb);
+	if (error == GIT_EUSER) {
+		RETURN_LONG(stream.emitted);
+	}
+	if (php_git2_check_error(error, "git_blame_file_stream" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_LONG(stream.emitted);
+}
+/* }}} */
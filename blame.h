@@ -26,6 +26,40 @@
 #ifndef PHP_GIT2_BLAME_H
 #define PHP_GIT2_BLAME_H
 
+/* the commit and original line number every line of a blamed file comes from */
+typedef struct php_git2_blame_line {
+	git_oid commit;
+	unsigned int orig_line;
+} php_git2_blame_line;
+
+typedef struct php_git2_blame_lines {
+	unsigned int count;
+	php_git2_blame_line lines[1];
+} php_git2_blame_lines;
+
+/* path NUL commit oid => php_git2_blame_lines, optionally kept in $GIT_DIR */
+typedef struct php_git2_blame_cache {
+	HashTable entries;
+	HashTable paths; /* path => number of commits cached for it */
+	char *path;
+	int dirty;
+	long hits;
+	long replays;
+	long misses;
+	long replayed_commits;
+} php_git2_blame_cache;
+
+/* hunks of a blame answered from the cache, kept on a blame resource without a git_blame */
+typedef struct php_git2_blame_result {
+	char *path;
+	git_blame_hunk *hunks;
+	uint32_t count;
+	HashTable signatures;
+} php_git2_blame_result;
+
+void php_git2_blame_cache_free(php_git2_blame_cache *cache);
+void php_git2_blame_result_free(php_git2_blame_result *result);
+
 ZEND_BEGIN_ARG_INFO_EX(arginfo_git_blame_get_hunk_count, 0, 0, 1)
 	ZEND_ARG_INFO(0, blame)
 ZEND_END_ARG_INFO()
@@ -59,6 +93,39 @@ ZEND_END_ARG_INFO()
 ZEND_BEGIN_ARG_INFO_EX(arginfo_git_blame_options_new, 0, 0, 0)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_blame_to_array, 0, 0, 1)
+	ZEND_ARG_INFO(0, blame)
+	ZEND_ARG_INFO(0, fields)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_blame_cache_new, 0, 0, 1)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, persist)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_blame_cache_prewarm, 0, 0, 3)
+	ZEND_ARG_INFO(0, cache)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, paths)
+	ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_blame_cache_save, 0, 0, 1)
+	ZEND_ARG_INFO(0, cache)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_blame_cache_stats, 0, 0, 1)
+	ZEND_ARG_INFO(0, cache)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_blame_file_stream, 0, 0, 5)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, path)
+	ZEND_ARG_INFO(0, options)
+	ZEND_ARG_INFO(0, callback)
+	ZEND_ARG_INFO(0, payload)
+ZEND_END_ARG_INFO()
+
 /* {{{ proto resource git_blame_get_hunk_count(blame)
 */
 PHP_FUNCTION(git_blame_get_hunk_count);
@@ -87,4 +154,28 @@ PHP_FUNCTION(git_blame_free);
  */
 PHP_FUNCTION(git_blame_options_new);
 
+/* {{{ proto array git_blame_to_array(blame[, fields])
+*/
+PHP_FUNCTION(git_blame_to_array);
+
+/* {{{ proto resource git_blame_cache_new(repo[, persist])
+*/
+PHP_FUNCTION(git_blame_cache_new);
+
+/* {{{ proto long git_blame_cache_prewarm(cache, repo, paths[, options])
+*/
+PHP_FUNCTION(git_blame_cache_prewarm);
+
+/* {{{ proto bool git_blame_cache_save(cache)
+*/
+PHP_FUNCTION(git_blame_cache_save);
+
+/* {{{ proto array git_blame_cache_stats(cache)
+*/
+PHP_FUNCTION(git_blame_cache_stats);
+
+/* {{{ proto long git_blame_file_stream(repo, path, options, callback, payload)
+*/
+PHP_FUNCTION(git_blame_file_stream);
+
 #endif
\ No newline at end of file
@@ -1,6 +1,11 @@
 #include "php_git2.h"
 #include "php_git2_priv.h"
 #include "diff.h"
+#include <ctype.h>
+
+#ifndef PHP_WIN32
+#include <pthread.h>
+#endif
 
 /* {{{ proto void git_diff_free(resource $diff)
  */
@@ -23,7 +28,19 @@ PHP_FUNCTION(git_diff_free)
 }
 /* }}} */
 
-/* {{{ proto long git_diff_tree_to_tree(resource $repo, resource $old_tree, resource $new_tree,  $opts)
+/* attaches the budget found in the options to a new diff resource */
+static void php_git2_diff_make_resource(zval *return_value, git_diff *diff, zval *opts TSRMLS_DC)
+{
+	php_git2_t *result = NULL;
+
+	if (php_git2_make_resource(&result, PHP_GIT2_TYPE_DIFF, diff, 0 TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	result->priv = php_git2_array_to_diff_budget(opts TSRMLS_CC);
+	ZVAL_RESOURCE(return_value, GIT2_RVAL_P(result));
+}
+
+/* {{{ proto resource git_diff_tree_to_tree(resource $repo, resource $old_tree, resource $new_tree,  $opts)
  */
 PHP_FUNCTION(git_diff_tree_to_tree)
 {
@@ -47,13 +64,15 @@ PHP_FUNCTION(git_diff_tree_to_tree)
 	ZEND_FETCH_RESOURCE(_old_tree, php_git2_t*, &old_tree, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	ZEND_FETCH_RESOURCE(_new_tree, php_git2_t*, &new_tree, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	php_git2_array_to_git_diff_options(&options, opts TSRMLS_CC);
-	result = git_diff_tree_to_tree(&diff, PHP_GIT2_V(_repo, repository), PHP_GIT2_V(_old_tree, tree), PHP_GIT2_V(_new_tree, tree), opts);
+	result = git_diff_tree_to_tree(&diff, PHP_GIT2_V(_repo, repository), PHP_GIT2_V(_old_tree, tree), PHP_GIT2_V(_new_tree, tree), &options);
 	php_git2_git_diff_options_free(&options);
-	RETURN_LONG(result);
+	if (php_git2_check_error(result, "git_diff_tree_to_tree" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	php_git2_diff_make_resource(return_value, diff, opts TSRMLS_CC);
 }
 /* }}} */
 
-
 /* {{{ proto long git_diff_tree_to_index(resource $repo, resource $old_tree, resource $index,  $opts)
  */
 PHP_FUNCTION(git_diff_tree_to_index)
@@ -61,7 +80,7 @@ PHP_FUNCTION(git_diff_tree_to_index)
 	int result = 0;
 	git_diff *diff = NULL;
 	zval *repo = NULL, *old_tree = NULL, *index = NULL, *opts = NULL;
-	php_git2_t *_repo = NULL, *_old_tree = NULL, *_index = NULL, *_diff = NULL;
+	php_git2_t *_repo = NULL, *_old_tree = NULL, *_index = NULL;
 	git_diff_options options = {0};
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
@@ -73,12 +92,12 @@ PHP_FUNCTION(git_diff_tree_to_index)
 	ZEND_FETCH_RESOURCE(_old_tree, php_git2_t*, &old_tree, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	ZEND_FETCH_RESOURCE(_index, php_git2_t*, &index, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	php_git2_array_to_git_diff_options(&options, opts TSRMLS_CC);
-	result = git_diff_tree_to_index(&diff, PHP_GIT2_V(_repo, repository), PHP_GIT2_V(_old_tree, tree), PHP_GIT2_V(_index, index), opts);
+	result = git_diff_tree_to_index(&diff, PHP_GIT2_V(_repo, repository), PHP_GIT2_V(_old_tree, tree), PHP_GIT2_V(_index, index), &options);
 	php_git2_git_diff_options_free(&options);
-	if (php_git2_make_resource(&_diff, PHP_GIT2_TYPE_DIFF, diff, 0 TSRMLS_CC)) {
+	if (php_git2_check_error(result, "git_diff_tree_to_index" TSRMLS_CC)) {
 		RETURN_FALSE;
 	}
-	ZVAL_RESOURCE(return_value, GIT2_RVAL_P(_diff));
+	php_git2_diff_make_resource(return_value, diff, opts TSRMLS_CC);
 
 }
 /* }}} */
@@ -90,7 +109,7 @@ PHP_FUNCTION(git_diff_index_to_workdir)
 	int result = 0;
 	git_diff *diff = NULL;
 	zval *repo = NULL, *index = NULL, *opts = NULL;
-	php_git2_t *_repo = NULL, *_index = NULL, *_diff = NULL;
+	php_git2_t *_repo = NULL, *_index = NULL;
 	git_diff_options options = GIT_DIFF_OPTIONS_INIT;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
@@ -101,12 +120,12 @@ PHP_FUNCTION(git_diff_index_to_workdir)
 	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	ZEND_FETCH_RESOURCE(_index, php_git2_t*, &index, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	php_git2_array_to_git_diff_options(&options, opts TSRMLS_CC);
-	result = git_diff_index_to_workdir(&diff, PHP_GIT2_V(_repo, repository), PHP_GIT2_V(_index, index), opts);
+	result = git_diff_index_to_workdir(&diff, PHP_GIT2_V(_repo, repository), PHP_GIT2_V(_index, index), &options);
 	php_git2_git_diff_options_free(&options);
-	if (php_git2_make_resource(&_diff, PHP_GIT2_TYPE_DIFF, diff, 0 TSRMLS_CC)) {
+	if (php_git2_check_error(result, "git_diff_index_to_workdir" TSRMLS_CC)) {
 		RETURN_FALSE;
 	}
-	ZVAL_RESOURCE(return_value, GIT2_RVAL_P(_diff));
+	php_git2_diff_make_resource(return_value, diff, opts TSRMLS_CC);
 }
 /* }}} */
 
@@ -117,7 +136,7 @@ PHP_FUNCTION(git_diff_tree_to_workdir)
 	int result = 0;
 	git_diff *diff = NULL;
 	zval *repo = NULL, *old_tree = NULL, *opts = NULL;
-	php_git2_t *_repo = NULL, *_old_tree = NULL, *_result;
+	php_git2_t *_repo = NULL, *_old_tree = NULL;
 	git_diff_options options = {0};
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
@@ -135,11 +154,7 @@ PHP_FUNCTION(git_diff_tree_to_workdir)
 	}
 
 	php_git2_git_diff_options_free(&options);
-
-	if (php_git2_make_resource(&_result, PHP_GIT2_TYPE_DIFF, diff, 0 TSRMLS_CC)) {
-		RETURN_FALSE;
-	}
-	ZVAL_RESOURCE(return_value, GIT2_RVAL_P(_result));
+	php_git2_diff_make_resource(return_value, diff, opts TSRMLS_CC);
 }
 /* }}} */
 
@@ -150,7 +165,7 @@ PHP_FUNCTION(git_diff_tree_to_workdir_with_index)
 	int result = 0;
 	git_diff *diff = NULL;
 	zval *repo = NULL, *old_tree = NULL, *opts = NULL;
-	php_git2_t *_repo = NULL, *_old_tree = NULL, *_diff = NULL;
+	php_git2_t *_repo = NULL, *_old_tree = NULL;
 	git_diff_options options = {0};
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
@@ -161,12 +176,12 @@ PHP_FUNCTION(git_diff_tree_to_workdir_with_index)
 	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	ZEND_FETCH_RESOURCE(_old_tree, php_git2_t*, &old_tree, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	php_git2_array_to_git_diff_options(&options, opts TSRMLS_CC);
-	result = git_diff_tree_to_workdir_with_index(&diff, PHP_GIT2_V(_repo, repository), PHP_GIT2_V(_old_tree, tree), opts);
+	result = git_diff_tree_to_workdir_with_index(&diff, PHP_GIT2_V(_repo, repository), PHP_GIT2_V(_old_tree, tree), &options);
 	php_git2_git_diff_options_free(&options);
-	if (php_git2_make_resource(&_diff, PHP_GIT2_TYPE_DIFF, diff, 0 TSRMLS_CC)) {
+	if (php_git2_check_error(result, "git_diff_tree_to_workdir_with_index" TSRMLS_CC)) {
 		RETURN_FALSE;
 	}
-	ZVAL_RESOURCE(return_value, GIT2_RVAL_P(_diff));
+	php_git2_diff_make_resource(return_value, diff, opts TSRMLS_CC);
 }
 /* }}} */
 
@@ -190,15 +205,327 @@ PHP_FUNCTION(git_diff_merge)
 }
 /* }}} */
 
+#define PHP_GIT2_SIMILARITY_MAGIC "PHPGIT2SIM2\n"
+#define PHP_GIT2_SIMILARITY_SIG_KEY (GIT_OID_RAWSZ + 1)
+#define PHP_GIT2_SIMILARITY_SCORE_KEY (GIT_OID_RAWSZ * 2 + 1)
+
+/* the whitespace handling libgit2 picks for its own metric from the same flags */
+static git_hashsig_option_t php_git2_similarity_option(const git_diff_find_options *options)
+{
+	if (options->flags & GIT_DIFF_FIND_IGNORE_WHITESPACE) {
+		return GIT_HASHSIG_IGNORE_WHITESPACE;
+	}
+	if (options->flags & GIT_DIFF_FIND_DONT_IGNORE_WHITESPACE) {
+		return GIT_HASHSIG_NORMAL;
+	}
+	return GIT_HASHSIG_SMART_WHITESPACE;
+}
+
+static int php_git2_similarity_cacheable(const git_diff_file *file)
+{
+	return (file->flags & GIT_DIFF_FLAG_VALID_OID) != 0 && !git_oid_iszero(&file->oid);
+}
+
+/* the same blob hashes differently per whitespace option */
+static void php_git2_similarity_sig_key(char *key, const git_oid *oid, git_hashsig_option_t option)
+{
+	memcpy(key, oid->id, GIT_OID_RAWSZ);
+	key[GIT_OID_RAWSZ] = (char)option;
+}
+
+/* the smaller oid first, a score does not depend on the direction */
+static void php_git2_similarity_score_key(char *key, const git_oid *a, const git_oid *b, git_hashsig_option_t option)
+{
+	const git_oid *tmp;
+
+	if (git_oid_cmp(a, b) > 0) {
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+	memcpy(key, a->id, GIT_OID_RAWSZ);
+	memcpy(key + GIT_OID_RAWSZ, b->id, GIT_OID_RAWSZ);
+	key[GIT_OID_RAWSZ * 2] = (char)option;
+}
+
+static void php_git2_similarity_hashsig_dtor(void *data)
+{
+	git_hashsig_free(*(git_hashsig**)data);
+}
+
+/* takes the hashsig from the cache, returns 0 when it is not there */
+static int php_git2_similarity_lookup(php_git2_similarity_cache *cache, php_git2_similarity_sig *sig)
+{
+	char key[PHP_GIT2_SIMILARITY_SIG_KEY];
+	git_hashsig **found;
+
+	if (!sig->cacheable) {
+		return 0;
+	}
+	php_git2_similarity_sig_key(key, &sig->oid, cache->option);
+	if (zend_hash_find(&cache->sigs, key, sizeof(key), (void**)&found) == FAILURE) {
+		return 0;
+	}
+	sig->hashsig = *found;
+	return 1;
+}
+
+/* hashes the file at path or the buffer as libgit2's own metric does. a blob too small for a
+   signature is left without one, libgit2 then skips its pairs */
+static int php_git2_similarity_hash(php_git2_similarity_cache *cache, php_git2_similarity_sig *sig, const char *path, const char *buf, size_t len)
+{
+	char key[PHP_GIT2_SIMILARITY_SIG_KEY];
+	git_hashsig *hashsig = NULL;
+	int error;
+
+	if (path != NULL) {
+		error = git_hashsig_create_fromfile(&hashsig, path, cache->option);
+	} else {
+		error = git_hashsig_create(&hashsig, buf, len, cache->option);
+	}
+	cache->misses++;
+	cache->hashed_bytes += len;
+	if (error == GIT_EBUFS) {
+		giterr_clear();
+		return 0;
+	}
+	if (error) {
+		return error;
+	}
+	sig->hashsig = hashsig;
+	sig->owned = 1;
+	if (sig->cacheable && zend_hash_num_elements(&cache->sigs) < PHP_GIT2_SIMILARITY_MAX_SIGS) {
+		php_git2_similarity_sig_key(key, &sig->oid, cache->option);
+		if (zend_hash_add(&cache->sigs, key, sizeof(key), (void*)&hashsig, sizeof(git_hashsig*), NULL) == SUCCESS) {
+			sig->owned = 0;
+		}
+	}
+	return 0;
+}
+
+/* hashes a signature that was put off because its scores were known */
+static int php_git2_similarity_resolve(php_git2_similarity_cache *cache, php_git2_similarity_sig *sig)
+{
+	int error = 0;
+
+	if (sig->path == NULL && sig->content == NULL) {
+		return 0;
+	}
+	if (php_git2_similarity_lookup(cache, sig)) {
+		cache->hits++;
+	} else {
+		error = php_git2_similarity_hash(cache, sig, sig->path, sig->content, sig->content_len);
+	}
+	if (sig->path != NULL) {
+		efree(sig->path);
+		sig->path = NULL;
+	}
+	if (sig->content != NULL) {
+		efree(sig->content);
+		sig->content = NULL;
+	}
+	return error;
+}
+
+/* a cached signature, a put off one or a fresh hash. path is set for working directory files */
+static int php_git2_similarity_signature(void **out, php_git2_similarity_cache *cache, const git_diff_file *file, const char *path, const char *buf, size_t len)
+{
+	php_git2_similarity_sig *sig;
+	int error = 0;
+
+	sig = (php_git2_similarity_sig*)ecalloc(1, sizeof(php_git2_similarity_sig));
+	git_oid_cpy(&sig->oid, &file->oid);
+	sig->cacheable = php_git2_similarity_cacheable(file);
+	if (!sig->cacheable) {
+		cache->uncached++;
+	}
+
+	if (php_git2_similarity_lookup(cache, sig)) {
+		cache->hits++;
+		cache->saved_bytes += len;
+	} else if (sig->cacheable && zend_hash_exists(&cache->known, (char*)sig->oid.id, GIT_OID_RAWSZ)) {
+		/* likely all of its scores are cached, it is hashed only if one is not */
+		sig->content_len = len;
+		if (path != NULL) {
+			sig->path = estrdup(path);
+		} else {
+			sig->content = estrndup(buf, len);
+		}
+	} else {
+		error = php_git2_similarity_hash(cache, sig, path, buf, len);
+	}
+	if (error || (sig->hashsig == NULL && sig->path == NULL && sig->content == NULL)) {
+		efree(sig);
+		sig = NULL;
+	}
+	*out = sig;
+	return error;
+}
+
+static int php_git2_similarity_file_signature(void **out, const git_diff_file *file, const char *fullpath, void *payload)
+{
+	return php_git2_similarity_signature(out, (php_git2_similarity_cache*)payload, file, fullpath, NULL, (size_t)file->size);
+}
+
+static int php_git2_similarity_buffer_signature(void **out, const git_diff_file *file, const char *buf, size_t buflen, void *payload)
+{
+	/* libgit2 has already read the blob by now, only the hashing can be skipped */
+	return php_git2_similarity_signature(out, (php_git2_similarity_cache*)payload, file, NULL, buf, buflen);
+}
+
+static void php_git2_similarity_free_signature(void *signature, void *payload)
+{
+	php_git2_similarity_cache *cache = (php_git2_similarity_cache*)payload;
+	php_git2_similarity_sig *sig = (php_git2_similarity_sig*)signature;
+
+	if (sig->path != NULL || sig->content != NULL) {
+		/* put off and never needed */
+		cache->saved_bytes += sig->content_len;
+		if (sig->path != NULL) {
+			efree(sig->path);
+		}
+		if (sig->content != NULL) {
+			efree(sig->content);
+		}
+	}
+	if (sig->owned) {
+		git_hashsig_free(sig->hashsig);
+	}
+	efree(sig);
+}
+
+static void php_git2_similarity_remember(php_git2_similarity_cache *cache, const char *key, int score)
+{
+	if (zend_hash_num_elements(&cache->scores) >= PHP_GIT2_SIMILARITY_MAX_SCORES) {
+		return;
+	}
+	zend_hash_update(&cache->scores, (char*)key, PHP_GIT2_SIMILARITY_SCORE_KEY, (void*)&score, sizeof(int), NULL);
+	zend_hash_add_empty_element(&cache->known, (char*)key, GIT_OID_RAWSZ);
+	zend_hash_add_empty_element(&cache->known, (char*)key + GIT_OID_RAWSZ, GIT_OID_RAWSZ);
+	cache->dirty = 1;
+}
+
+/* the score git_hashsig_compare gave this pair before, or a fresh one */
+static int php_git2_similarity_score(int *score, void *siga, void *sigb, void *payload)
+{
+	php_git2_similarity_cache *cache = (php_git2_similarity_cache*)payload;
+	php_git2_similarity_sig *a = (php_git2_similarity_sig*)siga, *b = (php_git2_similarity_sig*)sigb;
+	char key[PHP_GIT2_SIMILARITY_SCORE_KEY];
+	int *found, error;
+
+	if (a->cacheable && b->cacheable) {
+		php_git2_similarity_score_key(key, &a->oid, &b->oid, cache->option);
+		if (zend_hash_find(&cache->scores, key, sizeof(key), (void**)&found) == SUCCESS) {
+			cache->score_hits++;
+			*score = *found;
+			return 0;
+		}
+	}
+	if ((error = php_git2_similarity_resolve(cache, a)) != 0 ||
+		(error = php_git2_similarity_resolve(cache, b)) != 0) {
+		return error;
+	}
+	if (a->hashsig == NULL || b->hashsig == NULL) {
+		/* what libgit2 reports for a blob without a signature */
+		*score = -1;
+		return 0;
+	}
+	*score = git_hashsig_compare(a->hashsig, b->hashsig);
+	if (a->cacheable && b->cacheable && *score >= 0) {
+		php_git2_similarity_remember(cache, key, *score);
+	}
+	return 0;
+}
+
+static void php_git2_similarity_cache_load(php_git2_similarity_cache *cache)
+{
+	char magic[sizeof(PHP_GIT2_SIMILARITY_MAGIC) - 1], key[PHP_GIT2_SIMILARITY_SCORE_KEY];
+	int score;
+	FILE *fp;
+
+	fp = fopen(cache->path, "rb");
+	if (fp == NULL) {
+		return;
+	}
+	if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+		memcmp(magic, PHP_GIT2_SIMILARITY_MAGIC, sizeof(magic)) == 0) {
+		while (fread(key, 1, sizeof(key), fp) == sizeof(key) &&
+			fread(&score, 1, sizeof(score), fp) == sizeof(score)) {
+			php_git2_similarity_remember(cache, key, score);
+		}
+	}
+	fclose(fp);
+	cache->dirty = 0;
+}
+
+static int php_git2_similarity_cache_save(php_git2_similarity_cache *cache)
+{
+	HashPosition pos;
+	char *key;
+	uint key_len;
+	ulong num_key;
+	int *score;
+	smart_str out = {0};
+	int error = 0;
+
+	if (cache->path == NULL || !cache->dirty) {
+		return 0;
+	}
+	smart_str_appendl(&out, PHP_GIT2_SIMILARITY_MAGIC, sizeof(PHP_GIT2_SIMILARITY_MAGIC) - 1);
+	for (zend_hash_internal_pointer_reset_ex(&cache->scores, &pos);
+		zend_hash_get_current_data_ex(&cache->scores, (void**)&score, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&cache->scores, &pos)) {
+		zend_hash_get_current_key_ex(&cache->scores, &key, &key_len, &num_key, 0, &pos);
+		smart_str_appendl(&out, key, PHP_GIT2_SIMILARITY_SCORE_KEY);
+		smart_str_appendl(&out, (const char*)score, sizeof(int));
+	}
+	if (php_git2_lockfile_write(cache->path, out.c, out.len)) {
+		error = -1;
+	} else {
+		cache->dirty = 0;
+	}
+	smart_str_free(&out);
+	return error;
+}
+
+void php_git2_similarity_cache_free(php_git2_similarity_cache *cache)
+{
+	php_git2_similarity_cache_save(cache);
+	zend_hash_destroy(&cache->sigs);
+	zend_hash_destroy(&cache->scores);
+	zend_hash_destroy(&cache->known);
+	if (cache->path != NULL) {
+		efree(cache->path);
+	}
+	efree(cache);
+}
+
+static void php_git2_array_to_git_diff_find_options(git_diff_find_options *options, zval *array TSRMLS_DC)
+{
+	options->version = php_git2_read_arrval_long2(array, ZEND_STRS("version"), GIT_DIFF_FIND_OPTIONS_VERSION TSRMLS_CC);
+	options->flags = php_git2_read_arrval_long2(array, ZEND_STRS("flags"), 0 TSRMLS_CC);
+	options->rename_threshold = php_git2_read_arrval_long2(array, ZEND_STRS("rename_threshold"), 0 TSRMLS_CC);
+	options->rename_from_rewrite_threshold = php_git2_read_arrval_long2(array, ZEND_STRS("rename_from_rewrite_threshold"), 0 TSRMLS_CC);
+	options->copy_threshold = php_git2_read_arrval_long2(array, ZEND_STRS("copy_threshold"), 0 TSRMLS_CC);
+	options->break_rewrite_threshold = php_git2_read_arrval_long2(array, ZEND_STRS("break_rewrite_threshold"), 0 TSRMLS_CC);
+	options->rename_limit = php_git2_read_arrval_long2(array, ZEND_STRS("rename_limit"), 0 TSRMLS_CC);
+}
+
 /* {{{ proto long git_diff_find_similar(resource $diff,  $options)
- */
+  `similarity_cache` in the options array takes a cache from git_diff_similarity_cache_new */
 PHP_FUNCTION(git_diff_find_similar)
 {
 	int result = 0;
-	zval *diff = NULL;
-	php_git2_t *_diff = NULL;
-	zval *options = NULL;
-	git_diff_options _options = {0};
+	zval *diff = NULL, *options = NULL, *cache = NULL;
+	php_git2_t *_diff = NULL, *_cache = NULL;
+	git_diff_find_options _options = GIT_DIFF_FIND_OPTIONS_INIT;
+	git_diff_similarity_metric metric = {
+		php_git2_similarity_file_signature,
+		php_git2_similarity_buffer_signature,
+		php_git2_similarity_free_signature,
+		php_git2_similarity_score,
+		NULL
+	};
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
 		"ra", &diff, &options) == FAILURE) {
@@ -206,13 +533,118 @@ PHP_FUNCTION(git_diff_find_similar)
 	}
 
 	ZEND_FETCH_RESOURCE(_diff, php_git2_t*, &diff, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
-	php_git2_array_to_git_diff_options(&_options, options TSRMLS_CC);
+	php_git2_array_to_git_diff_find_options(&_options, options TSRMLS_CC);
+	cache = php_git2_read_arrval(options, ZEND_STRS("similarity_cache") TSRMLS_CC);
+	if (cache != NULL && Z_TYPE_P(cache) == IS_RESOURCE) {
+		ZEND_FETCH_RESOURCE(_cache, php_git2_t*, &cache, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+		if (_cache->type != PHP_GIT2_TYPE_SIMILARITY_CACHE) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "similarity_cache expects a git_diff_similarity_cache_new resource");
+			RETURN_FALSE;
+		}
+		metric.payload = PHP_GIT2_V(_cache, similarity_cache);
+		PHP_GIT2_V(_cache, similarity_cache)->option = php_git2_similarity_option(&_options);
+		_options.metric = &metric;
+	}
 	result = git_diff_find_similar(PHP_GIT2_V(_diff, diff), &_options);
-	php_git2_git_diff_options_free(&_options);
 	RETURN_LONG(result);
 }
 /* }}} */
 
+/* {{{ proto resource git_diff_similarity_cache_new(resource $repo[, bool $persist])
+  creates a cache for git_diff_find_similar. it keeps libgit2's own signatures by blob oid and
+  the scores they gave by blob pair, so the renames found are the ones found without it. a
+  cached blob is not hashed again, but libgit2 still reads it before asking for its signature.
+  with $persist the scores are loaded from and written back to $GIT_DIR/php_git2_similarity_cache */
+PHP_FUNCTION(git_diff_similarity_cache_new)
+{
+	zval *repo = NULL;
+	php_git2_t *_repo = NULL, *result = NULL;
+	php_git2_similarity_cache *cache;
+	zend_bool persist = 0;
+	char path[MAXPATHLEN];
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r|b", &repo, &persist) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	cache = (php_git2_similarity_cache*)ecalloc(1, sizeof(php_git2_similarity_cache));
+	zend_hash_init(&cache->sigs, 256, NULL, php_git2_similarity_hashsig_dtor, 0);
+	zend_hash_init(&cache->scores, 256, NULL, NULL, 0);
+	zend_hash_init(&cache->known, 256, NULL, NULL, 0);
+	if (persist) {
+		snprintf(path, sizeof(path), "%sphp_git2_similarity_cache", git_repository_path(PHP_GIT2_V(_repo, repository)));
+		cache->path = estrdup(path);
+		php_git2_similarity_cache_load(cache);
+	}
+	if (php_git2_make_resource(&result, PHP_GIT2_TYPE_SIMILARITY_CACHE, cache, 1 TSRMLS_CC)) {
+		php_git2_similarity_cache_free(cache);
+		RETURN_FALSE;
+	}
+	ZVAL_RESOURCE(return_value, GIT2_RVAL_P(result));
+}
+/* }}} */
+
+/* {{{ proto bool git_diff_similarity_cache_save(resource $cache)
+ */
+PHP_FUNCTION(git_diff_similarity_cache_save)
+{
+	zval *cache = NULL;
+	php_git2_t *_cache = NULL;
+	int error = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &cache) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_cache, php_git2_t*, &cache, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (_cache->type != PHP_GIT2_TYPE_SIMILARITY_CACHE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "cache expects a git_diff_similarity_cache_new resource");
+		RETURN_FALSE;
+	}
+	error = php_git2_similarity_cache_save(PHP_GIT2_V(_cache, similarity_cache));
+	if (php_git2_check_error(error, "git_diff_similarity_cache_save" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto array git_diff_similarity_cache_stats(resource $cache)
+  hits are signatures reused instead of hashed, score_hits pairs not compared again;
+  saved_bytes is what was not hashed */
+PHP_FUNCTION(git_diff_similarity_cache_stats)
+{
+	zval *cache = NULL;
+	php_git2_t *_cache = NULL;
+	php_git2_similarity_cache *_c;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &cache) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_cache, php_git2_t*, &cache, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (_cache->type != PHP_GIT2_TYPE_SIMILARITY_CACHE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "cache expects a git_diff_similarity_cache_new resource");
+		RETURN_FALSE;
+	}
+	_c = PHP_GIT2_V(_cache, similarity_cache);
+	array_init(return_value);
+	add_assoc_long_ex(return_value, ZEND_STRS("entries"), zend_hash_num_elements(&_c->sigs));
+	add_assoc_long_ex(return_value, ZEND_STRS("scores"), zend_hash_num_elements(&_c->scores));
+	add_assoc_long_ex(return_value, ZEND_STRS("hits"), _c->hits);
+	add_assoc_long_ex(return_value, ZEND_STRS("score_hits"), _c->score_hits);
+	add_assoc_long_ex(return_value, ZEND_STRS("misses"), _c->misses);
+	add_assoc_long_ex(return_value, ZEND_STRS("uncached"), _c->uncached);
+	add_assoc_long_ex(return_value, ZEND_STRS("hashed_bytes"), _c->hashed_bytes);
+	add_assoc_long_ex(return_value, ZEND_STRS("saved_bytes"), _c->saved_bytes);
+	add_assoc_bool_ex(return_value, ZEND_STRS("persistent"), _c->path != NULL);
+}
+/* }}} */
+
 /* {{{ proto long git_diff_options_init(long $version)
  */
 PHP_FUNCTION(git_diff_options_init)
@@ -312,9 +744,152 @@ PHP_FUNCTION(git_diff_is_sorted_icase)
 }
 /* }}} */
 
+/* the file, hunk and line callbacks for one patch, in the order git_diff_foreach calls them */
+static int php_git2_diff_patch_foreach(git_patch *patch, float progress,
+	git_diff_file_cb file_cb, git_diff_hunk_cb hunk_cb, git_diff_line_cb line_cb, void *payload)
+{
+	const git_diff_delta *delta = git_patch_get_delta(patch);
+	const git_diff_hunk *hunk;
+	const git_diff_line *line;
+	size_t h, l, lines;
+	int error = 0;
+
+	if (file_cb != NULL && file_cb(delta, progress, payload)) {
+		return GIT_EUSER;
+	}
+	for (h = 0; h < git_patch_num_hunks(patch); h++) {
+		if ((error = git_patch_get_hunk(&hunk, &lines, patch, h)) < 0) {
+			return error;
+		}
+		if (hunk_cb != NULL && hunk_cb(delta, hunk, payload)) {
+			return GIT_EUSER;
+		}
+		for (l = 0; l < lines; l++) {
+			if ((error = git_patch_get_line_in_hunk(&line, patch, h, l)) < 0) {
+				return error;
+			}
+			if (line_cb != NULL && line_cb(delta, hunk, line, payload)) {
+				return GIT_EUSER;
+			}
+		}
+	}
+	return 0;
+}
+
+/* prints a file skipped by the diff budget the way libgit2 prints a binary one:
+   the header and "Binary files ... differ", with the default a/ and b/ prefixes */
+static int php_git2_diff_print_too_large(const git_diff_delta *delta, git_diff_line_cb line_cb, void *payload)
+{
+	smart_str buf = {0};
+	git_diff_line line = {0};
+	char old_id[GIT_OID_HEXSZ + 1], new_id[GIT_OID_HEXSZ + 1], mode[64];
+	int error;
+
+	git_oid_tostr(old_id, 8, &delta->old_file.oid);
+	git_oid_tostr(new_id, 8, &delta->new_file.oid);
+	smart_str_appends(&buf, "diff --git a/");
+	smart_str_appends(&buf, delta->old_file.path);
+	smart_str_appends(&buf, " b/");
+	smart_str_appends(&buf, delta->new_file.path);
+	smart_str_appendc(&buf, '\n');
+	if (delta->old_file.mode == delta->new_file.mode) {
+		snprintf(mode, sizeof(mode), "index %s..%s %o\n", old_id, new_id, delta->old_file.mode);
+		smart_str_appends(&buf, mode);
+	} else {
+		if (delta->old_file.mode == 0) {
+			snprintf(mode, sizeof(mode), "new file mode %o\n", delta->new_file.mode);
+		} else if (delta->new_file.mode == 0) {
+			snprintf(mode, sizeof(mode), "deleted file mode %o\n", delta->old_file.mode);
+		} else {
+			snprintf(mode, sizeof(mode), "old mode %o\nnew mode %o\n", delta->old_file.mode, delta->new_file.mode);
+		}
+		smart_str_appends(&buf, mode);
+		snprintf(mode, sizeof(mode), "index %s..%s\n", old_id, new_id);
+		smart_str_appends(&buf, mode);
+	}
+	line.origin = GIT_DIFF_LINE_FILE_HDR;
+	line.old_lineno = line.new_lineno = -1;
+	line.content_offset = -1;
+	line.content = buf.c;
+	line.content_len = buf.len;
+	error = line_cb(delta, NULL, &line, payload);
+	buf.len = 0;
+	if (!error) {
+		smart_str_appends(&buf, "Binary files ");
+		smart_str_appends(&buf, delta->old_file.mode ? "a/" : "");
+		smart_str_appends(&buf, delta->old_file.mode ? delta->old_file.path : "/dev/null");
+		smart_str_appends(&buf, " and ");
+		smart_str_appends(&buf, delta->new_file.mode ? "b/" : "");
+		smart_str_appends(&buf, delta->new_file.mode ? delta->new_file.path : "/dev/null");
+		smart_str_appends(&buf, " differ\n");
+		line.origin = GIT_DIFF_LINE_BINARY;
+		line.content = buf.c;
+		line.content_len = buf.len;
+		error = line_cb(delta, NULL, &line, payload);
+	}
+	smart_str_free(&buf);
+	return error ? GIT_EUSER : 0;
+}
+
+/* git_diff_foreach and git_diff_print (format > 0) with the budget of the diff applied.
+   a file over the budget is passed on as libgit2 passes one over max_size: flagged binary,
+   without hunks or lines. only the patch format prints file content, the others go straight through */
+static int php_git2_diff_walk(git_diff *diff, const php_git2_diff_budget *budget, long format,
+	git_diff_file_cb file_cb, git_diff_hunk_cb hunk_cb, git_diff_line_cb line_cb, void *payload)
+{
+	git_patch *patch = NULL;
+	const git_diff_delta *delta;
+	git_diff_delta flagged;
+	size_t i, count;
+	long started = php_git2_now_ms();
+	int error = 0, too_large;
+
+	if (format > 0 && format != GIT_DIFF_FORMAT_PATCH) {
+		return git_diff_print(diff, format, line_cb, payload);
+	}
+	if (budget == NULL) {
+		return format > 0 ? git_diff_print(diff, format, line_cb, payload) : git_diff_foreach(diff, file_cb, hunk_cb, line_cb, payload);
+	}
+
+	count = git_diff_num_deltas(diff);
+	for (i = 0; i < count && !error; i++) {
+		delta = git_diff_get_delta(diff, i);
+		too_large = php_git2_diff_budget_exceeded(budget, delta, started);
+		if (!too_large) {
+			if ((error = git_patch_from_diff(&patch, diff, i)) < 0) {
+				break;
+			}
+			if (patch == NULL) {
+				continue;
+			}
+			too_large = php_git2_diff_budget_lines_exceeded(budget, patch);
+			if (!too_large) {
+				if (format > 0) {
+					error = git_patch_print(patch, line_cb, payload);
+				} else {
+					error = php_git2_diff_patch_foreach(patch, (float)i / count, file_cb, hunk_cb, line_cb, payload);
+				}
+			}
+			git_patch_free(patch);
+			patch = NULL;
+			if (!too_large) {
+				continue;
+			}
+		}
+		if (format > 0) {
+			error = php_git2_diff_print_too_large(delta, line_cb, payload);
+		} else {
+			flagged = *delta;
+			flagged.flags |= GIT_DIFF_FLAG_BINARY;
+			error = file_cb(&flagged, (float)i / count, payload) ? GIT_EUSER : 0;
+		}
+	}
+	return error;
+}
+
 
 /* {{{ proto long git_diff_foreach(resource $diff, Callable $file_cb, Callable $hunk_cb, Callable $line_cb,  $payload)
- */
+  a file over the budget of the diff reaches $file_cb flagged binary, without hunks or lines */
 PHP_FUNCTION(git_diff_foreach)
 {
 	int result = 0;
@@ -340,7 +915,8 @@ PHP_FUNCTION(git_diff_foreach)
 		&line_fci, &line_fcc
 	);
 
-	result = git_diff_foreach(PHP_GIT2_V(_diff, diff), php_git2_git_diff_file_cb, php_git2_git_diff_hunk_cb, php_git2_git_diff_line_cb, cb);
+	result = php_git2_diff_walk(PHP_GIT2_V(_diff, diff), (php_git2_diff_budget*)_diff->priv, 0,
+		php_git2_git_diff_file_cb, php_git2_git_diff_hunk_cb, php_git2_git_diff_line_cb, cb);
 	php_git2_multi_cb_free(cb);
 	RETURN_LONG(result);
 }
@@ -364,7 +940,7 @@ PHP_FUNCTION(git_diff_status_char)
 /* }}} */
 
 /* {{{ proto long git_diff_print(resource $diff, long $format, Callable $print_cb,  $payload)
- */
+  a file over the budget of the diff is printed as a binary one */
 PHP_FUNCTION(git_diff_print)
 {
 	int result = 0;
@@ -384,7 +960,8 @@ PHP_FUNCTION(git_diff_print)
 	if (php_git2_multi_cb_init(&cb, payload TSRMLS_CC, 3, &empty_fcall_info, &empty_fcall_info_cache, &empty_fcall_info, &empty_fcall_info_cache, &fci, &fcc)) {
 		RETURN_FALSE;
 	}
-	result = git_diff_print(PHP_GIT2_V(_diff, diff), format, php_git2_git_diff_line_cb, cb);
+	result = php_git2_diff_walk(PHP_GIT2_V(_diff, diff), (php_git2_diff_budget*)_diff->priv, format,
+		NULL, NULL, php_git2_git_diff_line_cb, cb);
 	php_git2_multi_cb_free(cb);
 	RETURN_LONG(result);
 }
@@ -467,3 +1044,934 @@ PHP_FUNCTION(git_diff_blob_to_buffer)
 	RETURN_LONG(result);
 }
 /* }}} */
+
+static zval *php_git2_diff_stats_row(zval *files, const git_diff_delta *delta)
+{
+	zval *row;
+	char status;
+
+	MAKE_STD_ZVAL(row);
+	array_init(row);
+	status = git_diff_status_char(delta->status);
+	add_assoc_string_ex(row, ZEND_STRS("path"), (char*)delta->new_file.path, 1);
+	add_assoc_string_ex(row, ZEND_STRS("old_path"), (char*)delta->old_file.path, 1);
+	add_assoc_stringl_ex(row, ZEND_STRS("status"), &status, 1, 1);
+	add_assoc_bool_ex(row, ZEND_STRS("binary"), (delta->flags & GIT_DIFF_FLAG_BINARY) != 0);
+	add_next_index_zval(files, row);
+	return row;
+}
+
+/* {{{ proto array git_diff_stats(resource $diff[, bool $name_only])
+  returns per file path, old_path, status, binary, too_large, additions and deletions plus the totals.
+  with $name_only no content is diffed and the line counts are left out */
+PHP_FUNCTION(git_diff_stats)
+{
+	int error = 0;
+	zval *diff = NULL, *files = NULL, *row = NULL;
+	php_git2_t *_diff = NULL;
+	php_git2_diff_budget *budget = NULL;
+	git_patch *patch = NULL;
+	const git_diff_delta *delta;
+	zend_bool name_only = 0;
+	size_t i, count, context, additions, deletions, total_additions = 0, total_deletions = 0;
+	long started = php_git2_now_ms();
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r|b", &diff, &name_only) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_diff, php_git2_t*, &diff, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	budget = (php_git2_diff_budget*)_diff->priv;
+	count = git_diff_num_deltas(PHP_GIT2_V(_diff, diff));
+	MAKE_STD_ZVAL(files);
+	array_init_size(files, count);
+
+	for (i = 0; i < count && !error; i++) {
+		delta = git_diff_get_delta(PHP_GIT2_V(_diff, diff), i);
+		if (name_only) {
+			php_git2_diff_stats_row(files, delta);
+			continue;
+		}
+		if (php_git2_diff_budget_exceeded(budget, delta, started)) {
+			row = php_git2_diff_stats_row(files, delta);
+			add_assoc_bool_ex(row, ZEND_STRS("too_large"), 1);
+			continue;
+		}
+		/* one file at a time, nothing but the counters reaches php */
+		error = git_patch_from_diff(&patch, PHP_GIT2_V(_diff, diff), i);
+		if (error || patch == NULL) {
+			continue;
+		}
+		row = php_git2_diff_stats_row(files, git_patch_get_delta(patch));
+		if (php_git2_diff_budget_lines_exceeded(budget, patch)) {
+			add_assoc_bool_ex(row, ZEND_STRS("too_large"), 1);
+		} else {
+			git_patch_line_stats(&context, &additions, &deletions, patch);
+			add_assoc_bool_ex(row, ZEND_STRS("too_large"), 0);
+			add_assoc_long_ex(row, ZEND_STRS("additions"), additions);
+			add_assoc_long_ex(row, ZEND_STRS("deletions"), deletions);
+			total_additions += additions;
+			total_deletions += deletions;
+		}
+		git_patch_free(patch);
+	}
+	if (php_git2_check_error(error, "git_diff_stats" TSRMLS_CC)) {
+		zval_ptr_dtor(&files);
+		RETURN_FALSE;
+	}
+
+	array_init(return_value);
+	add_assoc_zval_ex(return_value, ZEND_STRS("files"), files);
+	add_assoc_long_ex(return_value, ZEND_STRS("files_changed"), count);
+	if (!name_only) {
+		add_assoc_long_ex(return_value, ZEND_STRS("insertions"), total_additions);
+		add_assoc_long_ex(return_value, ZEND_STRS("deletions"), total_deletions);
+	}
+}
+/* }}} */
+
+typedef struct php_git2_tree_paths_t {
+	git_repository *repo;
+	git_strarray *pathspec;
+	git_pathspec *ps;
+	zval *result;
+	char path[MAXPATHLEN];
+} php_git2_tree_paths_t;
+
+/* git sorts tree entries as if subtree names ended with a slash */
+static int php_git2_tree_paths_cmp(const git_tree_entry *a, const git_tree_entry *b)
+{
+	const char *a_name = git_tree_entry_name(a), *b_name = git_tree_entry_name(b);
+	size_t a_len = strlen(a_name), b_len = strlen(b_name), len = a_len < b_len ? a_len : b_len;
+	unsigned char a_next, b_next;
+	int cmp;
+
+	cmp = memcmp(a_name, b_name, len);
+	if (cmp != 0) {
+		return cmp;
+	}
+	a_next = a_len > len ? a_name[len] : (git_tree_entry_type(a) == GIT_OBJ_TREE ? '/' : '\0');
+	b_next = b_len > len ? b_name[len] : (git_tree_entry_type(b) == GIT_OBJ_TREE ? '/' : '\0');
+	return (int)a_next - (int)b_next;
+}
+
+/* only literal pathspecs can rule out a whole subtree */
+static int php_git2_tree_paths_wants_dir(php_git2_tree_paths_t *ctx, size_t dir_len)
+{
+	size_t i, spec_len;
+	const char *spec;
+
+	if (ctx->ps == NULL) {
+		return 1;
+	}
+	for (i = 0; i < ctx->pathspec->count; i++) {
+		spec = ctx->pathspec->strings[i];
+		spec_len = strlen(spec);
+		if (strpbrk(spec, "*?[\\") != NULL) {
+			return 1;
+		}
+		if (strncmp(spec, ctx->path, spec_len < dir_len ? spec_len : dir_len) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void php_git2_tree_paths_emit(php_git2_tree_paths_t *ctx, size_t path_len, char status)
+{
+	if (ctx->ps != NULL && !git_pathspec_matches_path(ctx->ps, 0, ctx->path)) {
+		return;
+	}
+	add_assoc_stringl_ex(ctx->result, ctx->path, path_len + 1, &status, 1, 1);
+}
+
+static int php_git2_tree_paths_walk(php_git2_tree_paths_t *ctx, git_tree *old_tree, git_tree *new_tree, size_t prefix_len);
+
+static int php_git2_tree_paths_descend(php_git2_tree_paths_t *ctx, const git_tree_entry *old_entry, const git_tree_entry *new_entry, size_t path_len)
+{
+	git_tree *old_tree = NULL, *new_tree = NULL;
+	int error = 0;
+
+	if (path_len + 1 >= MAXPATHLEN) {
+		return 0;
+	}
+	ctx->path[path_len++] = '/';
+	ctx->path[path_len] = '\0';
+	if (!php_git2_tree_paths_wants_dir(ctx, path_len)) {
+		return 0;
+	}
+	if (old_entry != NULL) {
+		error = git_tree_lookup(&old_tree, ctx->repo, git_tree_entry_id(old_entry));
+	}
+	if (!error && new_entry != NULL) {
+		error = git_tree_lookup(&new_tree, ctx->repo, git_tree_entry_id(new_entry));
+	}
+	if (!error) {
+		error = php_git2_tree_paths_walk(ctx, old_tree, new_tree, path_len);
+	}
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+	return error;
+}
+
+static int php_git2_tree_paths_walk(php_git2_tree_paths_t *ctx, git_tree *old_tree, git_tree *new_tree, size_t prefix_len)
+{
+	const git_tree_entry *old_entry, *new_entry;
+	size_t old_count, new_count, i = 0, j = 0, name_len, path_len;
+	int cmp, error = 0;
+	const char *name;
+	char status;
+
+	old_count = old_tree ? git_tree_entrycount(old_tree) : 0;
+	new_count = new_tree ? git_tree_entrycount(new_tree) : 0;
+
+	while (!error && (i < old_count || j < new_count)) {
+		old_entry = i < old_count ? git_tree_entry_byindex(old_tree, i) : NULL;
+		new_entry = j < new_count ? git_tree_entry_byindex(new_tree, j) : NULL;
+		if (old_entry == NULL) {
+			cmp = 1;
+		} else if (new_entry == NULL) {
+			cmp = -1;
+		} else {
+			cmp = php_git2_tree_paths_cmp(old_entry, new_entry);
+		}
+		if (cmp < 0) {
+			new_entry = NULL;
+			i++;
+		} else if (cmp > 0) {
+			old_entry = NULL;
+			j++;
+		} else {
+			i++;
+			j++;
+			if (git_oid_equal(git_tree_entry_id(old_entry), git_tree_entry_id(new_entry)) &&
+				git_tree_entry_filemode(old_entry) == git_tree_entry_filemode(new_entry)) {
+				/* identical blob or whole identical subtree */
+				continue;
+			}
+		}
+
+		name = git_tree_entry_name(old_entry ? old_entry : new_entry);
+		name_len = strlen(name);
+		if (prefix_len + name_len >= MAXPATHLEN) {
+			continue;
+		}
+		memcpy(ctx->path + prefix_len, name, name_len + 1);
+		path_len = prefix_len + name_len;
+
+		if (git_tree_entry_type(old_entry ? old_entry : new_entry) == GIT_OBJ_TREE) {
+			error = php_git2_tree_paths_descend(ctx, old_entry, new_entry, path_len);
+			continue;
+		}
+		if (old_entry == NULL) {
+			status = 'A';
+		} else if (new_entry == NULL) {
+			status = 'D';
+		} else if ((git_tree_entry_filemode(old_entry) & 0170000) != (git_tree_entry_filemode(new_entry) & 0170000)) {
+			status = 'T';
+		} else {
+			status = 'M';
+		}
+		php_git2_tree_paths_emit(ctx, path_len, status);
+	}
+	return error;
+}
+
+/* {{{ proto array git_diff_tree_paths(resource $repo, resource $old_tree, resource $new_tree[, array $pathspec])
+  returns path => status character (A, D, M, T) for every changed file without loading any blob.
+  either tree may be null */
+PHP_FUNCTION(git_diff_tree_paths)
+{
+	zval *repo = NULL, *old_tree = NULL, *new_tree = NULL, *pathspec = NULL;
+	php_git2_t *_repo = NULL, *_old_tree = NULL, *_new_tree = NULL;
+	php_git2_tree_paths_t ctx;
+	git_strarray paths = {0};
+	int error = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rr!r!|a", &repo, &old_tree, &new_tree, &pathspec) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (old_tree != NULL) {
+		ZEND_FETCH_RESOURCE(_old_tree, php_git2_t*, &old_tree, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	}
+	if (new_tree != NULL) {
+		ZEND_FETCH_RESOURCE(_new_tree, php_git2_t*, &new_tree, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	}
+
+	memset(&ctx, 0, sizeof(php_git2_tree_paths_t));
+	ctx.repo = PHP_GIT2_V(_repo, repository);
+	php_git2_array_to_strarray(&paths, pathspec TSRMLS_CC);
+	if (paths.count > 0) {
+		ctx.pathspec = &paths;
+		error = git_pathspec_new(&ctx.ps, &paths);
+	}
+	if (!error) {
+		array_init(return_value);
+		ctx.result = return_value;
+		error = php_git2_tree_paths_walk(&ctx,
+			_old_tree ? PHP_GIT2_V(_old_tree, tree) : NULL,
+			_new_tree ? PHP_GIT2_V(_new_tree, tree) : NULL, 0);
+	}
+	if (ctx.ps != NULL) {
+		git_pathspec_free(ctx.ps);
+	}
+	if (paths.count > 0) {
+		php_git2_strarray_free(&paths);
+	}
+	if (php_git2_check_error(error, "git_diff_tree_paths" TSRMLS_CC)) {
+		if (ctx.result != NULL) {
+			zval_dtor(return_value);
+		}
+		RETURN_FALSE;
+	}
+}
+/* }}} */
+
+typedef struct php_git2_diff_limits_t {
+	long max_files;
+	long max_lines_per_file;
+	long max_bytes;
+	long context;
+	zend_bool intraline;
+	long bytes;
+} php_git2_diff_limits_t;
+
+#define PHP_GIT2_INTRALINE_MAX_TOKENS 256
+
+/* words (including any non ascii byte), runs of blanks, or single punctuation characters */
+static size_t php_git2_diff_tokenize(const char *content, size_t len, size_t *offsets, size_t *lengths)
+{
+	size_t n = 0, i = 0, start;
+	unsigned char c;
+
+	while (len > 0 && (content[len - 1] == '\n' || content[len - 1] == '\r')) {
+		len--;
+	}
+	while (i < len) {
+		if (n == PHP_GIT2_INTRALINE_MAX_TOKENS) {
+			return (size_t)-1;
+		}
+		start = i;
+		c = (unsigned char)content[i];
+		if (isalnum(c) || c == '_' || c >= 0x80) {
+			while (i < len && (isalnum((unsigned char)content[i]) || content[i] == '_' || (unsigned char)content[i] >= 0x80)) {
+				i++;
+			}
+		} else if (c == ' ' || c == '\t') {
+			while (i < len && (content[i] == ' ' || content[i] == '\t')) {
+				i++;
+			}
+		} else {
+			i++;
+		}
+		offsets[n] = start;
+		lengths[n] = i - start;
+		n++;
+	}
+	return n;
+}
+
+static zval *php_git2_diff_spans_to_array(const unsigned char *changed, const size_t *offsets, const size_t *lengths, size_t n)
+{
+	zval *spans, *span;
+	size_t i, start;
+
+	MAKE_STD_ZVAL(spans);
+	array_init(spans);
+	for (i = 0; i < n;) {
+		if (!changed[i]) {
+			i++;
+			continue;
+		}
+		start = i;
+		while (i < n && changed[i]) {
+			i++;
+		}
+		MAKE_STD_ZVAL(span);
+		array_init(span);
+		add_next_index_long(span, offsets[start]);
+		add_next_index_long(span, offsets[i - 1] + lengths[i - 1] - offsets[start]);
+		add_next_index_zval(spans, span);
+	}
+	return spans;
+}
+
+/* changed token spans of a removed line and the added line replacing it, from their longest common subsequence */
+static int php_git2_diff_intraline(const git_diff_line *old_line, const git_diff_line *new_line, zval **old_spans, zval **new_spans)
+{
+	size_t old_offsets[PHP_GIT2_INTRALINE_MAX_TOKENS], old_lengths[PHP_GIT2_INTRALINE_MAX_TOKENS];
+	size_t new_offsets[PHP_GIT2_INTRALINE_MAX_TOKENS], new_lengths[PHP_GIT2_INTRALINE_MAX_TOKENS];
+	unsigned char old_changed[PHP_GIT2_INTRALINE_MAX_TOKENS], new_changed[PHP_GIT2_INTRALINE_MAX_TOKENS];
+	unsigned short *lcs;
+	size_t n, m, i, j, width;
+
+	n = php_git2_diff_tokenize(old_line->content, old_line->content_len, old_offsets, old_lengths);
+	m = php_git2_diff_tokenize(new_line->content, new_line->content_len, new_offsets, new_lengths);
+	if (n == (size_t)-1 || m == (size_t)-1) {
+		return -1;
+	}
+
+#define PHP_GIT2_TOKEN_EQ(i, j) (old_lengths[i] == new_lengths[j] && \
+	memcmp(old_line->content + old_offsets[i], new_line->content + new_offsets[j], old_lengths[i]) == 0)
+
+	width = m + 1;
+	lcs = (unsigned short*)ecalloc((n + 1) * width, sizeof(unsigned short));
+	for (i = n; i-- > 0;) {
+		for (j = m; j-- > 0;) {
+			if (PHP_GIT2_TOKEN_EQ(i, j)) {
+				lcs[i * width + j] = lcs[(i + 1) * width + j + 1] + 1;
+			} else {
+				lcs[i * width + j] = MAX(lcs[(i + 1) * width + j], lcs[i * width + j + 1]);
+			}
+		}
+	}
+	memset(old_changed, 1, n);
+	memset(new_changed, 1, m);
+	for (i = 0, j = 0; i < n && j < m;) {
+		if (PHP_GIT2_TOKEN_EQ(i, j)) {
+			old_changed[i++] = 0;
+			new_changed[j++] = 0;
+		} else if (lcs[(i + 1) * width + j] >= lcs[i * width + j + 1]) {
+			i++;
+		} else {
+			j++;
+		}
+	}
+	efree(lcs);
+#undef PHP_GIT2_TOKEN_EQ
+
+	*old_spans = php_git2_diff_spans_to_array(old_changed, old_offsets, old_lengths, n);
+	*new_spans = php_git2_diff_spans_to_array(new_changed, new_offsets, new_lengths, m);
+	return 0;
+}
+
+/* pairs the n-th removed line of a block with the n-th added line that follows it */
+static void php_git2_diff_pair_lines(git_patch *patch, size_t hunk_idx, size_t count, long *partner)
+{
+	const git_diff_line *line;
+	size_t i = 0, del_start, del_end, add_end, k;
+
+	for (k = 0; k < count; k++) {
+		partner[k] = -1;
+	}
+	while (i < count) {
+		git_patch_get_line_in_hunk(&line, patch, hunk_idx, i);
+		if (line->origin != GIT_DIFF_LINE_DELETION) {
+			i++;
+			continue;
+		}
+		del_start = i;
+		while (i < count && (git_patch_get_line_in_hunk(&line, patch, hunk_idx, i), line->origin == GIT_DIFF_LINE_DELETION)) {
+			i++;
+		}
+		del_end = i;
+		while (i < count && (git_patch_get_line_in_hunk(&line, patch, hunk_idx, i), line->origin == GIT_DIFF_LINE_ADDITION)) {
+			i++;
+		}
+		add_end = i;
+		for (k = 0; del_start + k < del_end && del_end + k < add_end; k++) {
+			partner[del_start + k] = del_end + k;
+			partner[del_end + k] = del_start + k;
+		}
+	}
+}
+
+/* returns 1 when the file was cut short by one of the limits */
+static int php_git2_diff_hunk_lines_to_array(git_patch *patch, size_t hunk_idx, zval *lines, php_git2_diff_limits_t *limits, long *file_lines)
+{
+	const git_diff_line *line, *other;
+	size_t i, count, *distance = NULL, last;
+	zval *row, **spans = NULL, *old_spans, *new_spans;
+	long *partner = NULL;
+	int truncated = 0;
+
+	count = git_patch_num_lines_in_hunk(patch, hunk_idx);
+	if (limits->intraline && count > 0) {
+		partner = (long*)safe_emalloc(count, sizeof(long), 0);
+		spans = (zval**)ecalloc(count, sizeof(zval*));
+		php_git2_diff_pair_lines(patch, hunk_idx, count, partner);
+	}
+	if (limits->context >= 0 && count > 0) {
+		/* distance of every line to the nearest change, in either direction */
+		distance = (size_t*)safe_emalloc(count, sizeof(size_t), 0);
+		last = (size_t)-1;
+		for (i = 0; i < count; i++) {
+			git_patch_get_line_in_hunk(&line, patch, hunk_idx, i);
+			if (line->origin != GIT_DIFF_LINE_CONTEXT) {
+				last = i;
+			}
+			distance[i] = last == (size_t)-1 ? (size_t)-1 : i - last;
+		}
+		last = (size_t)-1;
+		for (i = count; i-- > 0;) {
+			git_patch_get_line_in_hunk(&line, patch, hunk_idx, i);
+			if (line->origin != GIT_DIFF_LINE_CONTEXT) {
+				last = i;
+			}
+			if (last != (size_t)-1 && last - i < distance[i]) {
+				distance[i] = last - i;
+			}
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		git_patch_get_line_in_hunk(&line, patch, hunk_idx, i);
+		if (distance != NULL && line->origin == GIT_DIFF_LINE_CONTEXT && distance[i] > (size_t)limits->context) {
+			continue;
+		}
+		if (limits->max_lines_per_file > 0 && *file_lines >= limits->max_lines_per_file) {
+			truncated = 1;
+			break;
+		}
+		if (limits->max_bytes > 0 && limits->bytes + (long)line->content_len > limits->max_bytes) {
+			/* the byte budget is spent for every following file too */
+			limits->bytes = limits->max_bytes;
+			truncated = 1;
+			break;
+		}
+		MAKE_STD_ZVAL(row);
+		array_init(row);
+		add_assoc_stringl_ex(row, ZEND_STRS("origin"), (char*)&line->origin, 1, 1);
+		add_assoc_long_ex(row, ZEND_STRS("old_lineno"), line->old_lineno);
+		add_assoc_long_ex(row, ZEND_STRS("new_lineno"), line->new_lineno);
+		add_assoc_stringl_ex(row, ZEND_STRS("content"), (char*)line->content, line->content_len, 1);
+		if (partner != NULL && partner[i] >= 0) {
+			if (spans[i] == NULL) {
+				/* the removed line comes first, its partner picks the spans up later */
+				git_patch_get_line_in_hunk(&other, patch, hunk_idx, partner[i]);
+				if (php_git2_diff_intraline(line, other, &old_spans, &new_spans) == 0) {
+					spans[i] = old_spans;
+					spans[partner[i]] = new_spans;
+				}
+			}
+			if (spans[i] != NULL) {
+				add_assoc_zval_ex(row, ZEND_STRS("spans"), spans[i]);
+				spans[i] = NULL;
+			}
+		}
+		add_next_index_zval(lines, row);
+		limits->bytes += line->content_len;
+		(*file_lines)++;
+	}
+	if (distance != NULL) {
+		efree(distance);
+	}
+	if (partner != NULL) {
+		for (i = 0; i < count; i++) {
+			if (spans[i] != NULL) {
+				zval_ptr_dtor(&spans[i]);
+			}
+		}
+		efree(spans);
+		efree(partner);
+	}
+	return truncated;
+}
+
+/* a file skipped by the diff budget: no hunks and no line counts */
+static void php_git2_diff_too_large_to_array(const git_diff_delta *delta, zval **out TSRMLS_DC)
+{
+	zval *result, *hunks;
+	char status = git_diff_status_char(delta->status);
+
+	MAKE_STD_ZVAL(result);
+	array_init(result);
+	add_assoc_string_ex(result, ZEND_STRS("old_path"), (char*)delta->old_file.path, 1);
+	add_assoc_string_ex(result, ZEND_STRS("new_path"), (char*)delta->new_file.path, 1);
+	add_assoc_stringl_ex(result, ZEND_STRS("status"), &status, 1, 1);
+	add_assoc_bool_ex(result, ZEND_STRS("binary"), (delta->flags & GIT_DIFF_FLAG_BINARY) != 0);
+	MAKE_STD_ZVAL(hunks);
+	array_init(hunks);
+	add_assoc_zval_ex(result, ZEND_STRS("hunks"), hunks);
+	add_assoc_bool_ex(result, ZEND_STRS("truncated"), 1);
+	add_assoc_bool_ex(result, ZEND_STRS("too_large"), 1);
+
+	*out = result;
+}
+
+static int php_git2_diff_patch_to_array(git_patch *patch, zval **out, php_git2_diff_limits_t *limits TSRMLS_DC)
+{
+	const git_diff_delta *delta = git_patch_get_delta(patch);
+	const git_diff_hunk *hunk;
+	size_t i, count, context = 0, additions = 0, deletions = 0, lines_in_hunk;
+	zval *result, *hunks, *row, *lines;
+	long file_lines = 0;
+	int truncated = 0;
+	char status;
+
+	git_patch_line_stats(&context, &additions, &deletions, patch);
+	status = git_diff_status_char(delta->status);
+
+	MAKE_STD_ZVAL(result);
+	array_init(result);
+	add_assoc_string_ex(result, ZEND_STRS("old_path"), (char*)delta->old_file.path, 1);
+	add_assoc_string_ex(result, ZEND_STRS("new_path"), (char*)delta->new_file.path, 1);
+	add_assoc_stringl_ex(result, ZEND_STRS("status"), &status, 1, 1);
+	add_assoc_bool_ex(result, ZEND_STRS("binary"), (delta->flags & GIT_DIFF_FLAG_BINARY) != 0);
+	add_assoc_long_ex(result, ZEND_STRS("additions"), additions);
+	add_assoc_long_ex(result, ZEND_STRS("deletions"), deletions);
+
+	MAKE_STD_ZVAL(hunks);
+	array_init(hunks);
+	count = git_patch_num_hunks(patch);
+	for (i = 0; i < count && !truncated; i++) {
+		git_patch_get_hunk(&hunk, &lines_in_hunk, patch, i);
+
+		MAKE_STD_ZVAL(row);
+		array_init(row);
+		add_assoc_long_ex(row, ZEND_STRS("old_start"), hunk->old_start);
+		add_assoc_long_ex(row, ZEND_STRS("old_lines"), hunk->old_lines);
+		add_assoc_long_ex(row, ZEND_STRS("new_start"), hunk->new_start);
+		add_assoc_long_ex(row, ZEND_STRS("new_lines"), hunk->new_lines);
+		add_assoc_stringl_ex(row, ZEND_STRS("header"), (char*)hunk->header, hunk->header_len, 1);
+
+		MAKE_STD_ZVAL(lines);
+		array_init(lines);
+		truncated = php_git2_diff_hunk_lines_to_array(patch, i, lines, limits, &file_lines);
+		add_assoc_zval_ex(row, ZEND_STRS("lines"), lines);
+		add_next_index_zval(hunks, row);
+	}
+	add_assoc_zval_ex(result, ZEND_STRS("hunks"), hunks);
+	add_assoc_bool_ex(result, ZEND_STRS("truncated"), truncated);
+	add_assoc_bool_ex(result, ZEND_STRS("too_large"), 0);
+
+	*out = result;
+	return truncated;
+}
+
+/* {{{ proto array git_diff_to_array(resource $diff[, long $max_files[, long $max_lines_per_file[, long $max_bytes[, long $context[, bool $intraline]]]]])
+  builds files, hunks and lines in one go. zero means no limit; a negative context keeps every context line.
+  files cut short are marked truncated, and so is the whole result once max_files or max_bytes stops it.
+  with $intraline paired removed and added lines carry `spans`, [offset, length] of the changed words */
+PHP_FUNCTION(git_diff_to_array)
+{
+	zval *diff = NULL, *files = NULL, *file = NULL;
+	php_git2_t *_diff = NULL;
+	php_git2_diff_limits_t limits = {0, 0, 0, -1, 0, 0};
+	php_git2_diff_budget *budget = NULL;
+	git_patch *patch = NULL;
+	size_t i, count;
+	int error = 0, truncated = 0;
+	long started = php_git2_now_ms();
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r|llllb", &diff, &limits.max_files, &limits.max_lines_per_file, &limits.max_bytes, &limits.context, &limits.intraline) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_diff, php_git2_t*, &diff, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	budget = (php_git2_diff_budget*)_diff->priv;
+	count = git_diff_num_deltas(PHP_GIT2_V(_diff, diff));
+
+	MAKE_STD_ZVAL(files);
+	array_init(files);
+	for (i = 0; i < count; i++) {
+		if ((limits.max_files > 0 && i >= (size_t)limits.max_files) ||
+			(limits.max_bytes > 0 && limits.bytes >= limits.max_bytes)) {
+			truncated = 1;
+			break;
+		}
+		if (php_git2_diff_budget_exceeded(budget, git_diff_get_delta(PHP_GIT2_V(_diff, diff), i), started)) {
+			php_git2_diff_too_large_to_array(git_diff_get_delta(PHP_GIT2_V(_diff, diff), i), &file TSRMLS_CC);
+			add_next_index_zval(files, file);
+			continue;
+		}
+		error = git_patch_from_diff(&patch, PHP_GIT2_V(_diff, diff), i);
+		if (error) {
+			break;
+		}
+		if (patch == NULL) {
+			/* unchanged file */
+			continue;
+		}
+		if (php_git2_diff_budget_lines_exceeded(budget, patch)) {
+			php_git2_diff_too_large_to_array(git_patch_get_delta(patch), &file TSRMLS_CC);
+			add_next_index_zval(files, file);
+			git_patch_free(patch);
+			continue;
+		}
+		if (php_git2_diff_patch_to_array(patch, &file, &limits TSRMLS_CC) &&
+			limits.max_bytes > 0 && limits.bytes >= limits.max_bytes) {
+			truncated = 1;
+		}
+		add_next_index_zval(files, file);
+		git_patch_free(patch);
+		if (truncated) {
+			break;
+		}
+	}
+	if (php_git2_check_error(error, "git_diff_to_array" TSRMLS_CC)) {
+		zval_ptr_dtor(&files);
+		RETURN_FALSE;
+	}
+
+	array_init(return_value);
+	add_assoc_zval_ex(return_value, ZEND_STRS("files"), files);
+	add_assoc_long_ex(return_value, ZEND_STRS("total_files"), count);
+	add_assoc_bool_ex(return_value, ZEND_STRS("truncated"), truncated);
+}
+/* }}} */
+
+#define PHP_GIT2_DIFF_MAX_THREADS 20
+
+/* filled by the workers with malloc'ed memory only, turned into zvals afterwards */
+typedef struct php_git2_diff_patch_result {
+	int done;
+	int error;
+	int binary;
+	int too_large;
+	char *text;
+	/* giterr state is per thread, the message of a failed worker is copied here */
+	int error_class;
+	char *error_message;
+	size_t additions;
+	size_t deletions;
+} php_git2_diff_patch_result;
+
+typedef struct php_git2_diff_patch_job {
+	git_diff *diff;
+	const php_git2_diff_budget *budget;
+	long started;
+	php_git2_diff_patch_result *results;
+	size_t count;
+	size_t next;
+	int stats_only;
+#ifndef PHP_WIN32
+	pthread_mutex_t lock;
+#endif
+} php_git2_diff_patch_job;
+
+static void php_git2_diff_patch_generate(php_git2_diff_patch_job *job, size_t idx)
+{
+	php_git2_diff_patch_result *result = &job->results[idx];
+	git_patch *patch = NULL;
+	const git_error *error;
+	size_t context = 0;
+
+	result->done = 1;
+	if (php_git2_diff_budget_exceeded(job->budget, git_diff_get_delta(job->diff, idx), job->started)) {
+		result->too_large = 1;
+		return;
+	}
+	result->error = git_patch_from_diff(&patch, job->diff, idx);
+	if (result->error || patch == NULL) {
+		goto done;
+	}
+	if (php_git2_diff_budget_lines_exceeded(job->budget, patch)) {
+		result->too_large = 1;
+		git_patch_free(patch);
+		return;
+	}
+	git_patch_line_stats(&context, &result->additions, &result->deletions, patch);
+	result->binary = (git_patch_get_delta(patch)->flags & GIT_DIFF_FLAG_BINARY) != 0;
+	if (!job->stats_only) {
+		result->error = git_patch_to_str(&result->text, patch);
+	}
+	git_patch_free(patch);
+
+done:
+	if (result->error && (error = giterr_last()) != NULL && error->message != NULL) {
+		result->error_class = error->klass;
+		result->error_message = strdup(error->message);
+	}
+}
+
+static void *php_git2_diff_patch_worker(void *arg)
+{
+	php_git2_diff_patch_job *job = (php_git2_diff_patch_job*)arg;
+	size_t idx;
+
+	for (;;) {
+#ifndef PHP_WIN32
+		pthread_mutex_lock(&job->lock);
+#endif
+		while (job->next < job->count && job->results[job->next].done) {
+			job->next++;
+		}
+		idx = job->next++;
+#ifndef PHP_WIN32
+		pthread_mutex_unlock(&job->lock);
+#endif
+		if (idx >= job->count) {
+			break;
+		}
+		php_git2_diff_patch_generate(job, idx);
+	}
+	return NULL;
+}
+
+/* libgit2 fills its attribute and diff driver caches lazily and without locks.
+ * generate the first file of every directory and extension up front so the
+ * workers only ever read those caches. */
+static void php_git2_diff_patch_warmup(php_git2_diff_patch_job *job)
+{
+	HashTable seen;
+	const git_diff_delta *delta;
+	const char *path, *slash, *dot;
+	char key[MAXPATHLEN];
+	size_t i;
+
+	zend_hash_init(&seen, 64, NULL, NULL, 0);
+	for (i = 0; i < job->count; i++) {
+		delta = git_diff_get_delta(job->diff, i);
+		path = delta->new_file.path ? delta->new_file.path : delta->old_file.path;
+		slash = strrchr(path, '/');
+		dot = strrchr(slash ? slash : path, '.');
+		snprintf(key, sizeof(key), "%.*s%s", slash ? (int)(slash - path) : 0, path, dot ? dot : "");
+		if (zend_hash_add_empty_element(&seen, key, strlen(key) + 1) == SUCCESS) {
+			php_git2_diff_patch_generate(job, i);
+		}
+	}
+	zend_hash_destroy(&seen);
+}
+
+/* {{{ proto array git_diff_patches(resource $diff[, long $threads[, bool $stats_only]])
+  generates the patch of every delta, on $threads threads (default 1, 0 for one per cpu).
+  libgit2 has to be built with -DTHREADSAFE=ON for that, otherwise the deltas are done one
+  after the other on the calling thread. the result is in delta order, one row of path,
+  status, binary, additions, deletions and patch (null with $stats_only) */
+PHP_FUNCTION(git_diff_patches)
+{
+	zval *diff = NULL, *row = NULL;
+	php_git2_t *_diff = NULL;
+	php_git2_diff_patch_job job;
+	const git_diff_delta *delta;
+	long threads = 1;
+	zend_bool stats_only = 0;
+	size_t i;
+	int error = 0;
+	char status;
+#ifndef PHP_WIN32
+	pthread_t *tids;
+	int *started;
+#endif
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r|lb", &diff, &threads, &stats_only) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_diff, php_git2_t*, &diff, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	memset(&job, 0, sizeof(php_git2_diff_patch_job));
+	job.diff = PHP_GIT2_V(_diff, diff);
+	job.budget = (php_git2_diff_budget*)_diff->priv;
+	job.started = php_git2_now_ms();
+	job.count = git_diff_num_deltas(job.diff);
+	job.stats_only = stats_only;
+	job.results = (php_git2_diff_patch_result*)ecalloc(job.count ? job.count : 1, sizeof(php_git2_diff_patch_result));
+
+	if (threads <= 0) {
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (threads > PHP_GIT2_DIFF_MAX_THREADS) {
+		threads = PHP_GIT2_DIFF_MAX_THREADS;
+	}
+	if (threads < 1 || !(git_libgit2_capabilities() & GIT_CAP_THREADS)) {
+		/* without THREADSAFE libgit2 shares its error and cache state unlocked */
+		threads = 1;
+	}
+
+	php_git2_diff_patch_warmup(&job);
+#ifndef PHP_WIN32
+	pthread_mutex_init(&job.lock, NULL);
+	tids = (pthread_t*)safe_emalloc(threads, sizeof(pthread_t), 0);
+	started = (int*)ecalloc(threads, sizeof(int));
+	for (i = 1; i < threads; i++) {
+		started[i] = pthread_create(&tids[i], NULL, php_git2_diff_patch_worker, &job) == 0;
+	}
+	php_git2_diff_patch_worker(&job);
+	for (i = 1; i < threads; i++) {
+		if (started[i]) {
+			pthread_join(tids[i], NULL);
+		}
+	}
+	efree(started);
+	efree(tids);
+	pthread_mutex_destroy(&job.lock);
+#else
+	php_git2_diff_patch_worker(&job);
+#endif
+
+	array_init_size(return_value, job.count);
+	for (i = 0; i < job.count; i++) {
+		if (job.results[i].error && !error) {
+			error = job.results[i].error;
+			if (job.results[i].error_message != NULL) {
+				giterr_set_str(job.results[i].error_class, job.results[i].error_message);
+			}
+		}
+		if (job.results[i].error_message != NULL) {
+			free(job.results[i].error_message);
+		}
+		delta = git_diff_get_delta(job.diff, i);
+		status = git_diff_status_char(delta->status);
+
+		MAKE_STD_ZVAL(row);
+		array_init(row);
+		add_assoc_string_ex(row, ZEND_STRS("path"), (char*)delta->new_file.path, 1);
+		add_assoc_stringl_ex(row, ZEND_STRS("status"), &status, 1, 1);
+		add_assoc_bool_ex(row, ZEND_STRS("binary"), job.results[i].binary);
+		add_assoc_bool_ex(row, ZEND_STRS("too_large"), job.results[i].too_large);
+		add_assoc_long_ex(row, ZEND_STRS("additions"), job.results[i].additions);
+		add_assoc_long_ex(row, ZEND_STRS("deletions"), job.results[i].deletions);
+		if (job.results[i].text != NULL) {
+			add_assoc_string_ex(row, ZEND_STRS("patch"), job.results[i].text, 1);
+			free(job.results[i].text);
+		} else {
+			add_assoc_null_ex(row, ZEND_STRS("patch"));
+		}
+		add_next_index_zval(return_value, row);
+	}
+	efree(job.results);
+
+	if (php_git2_check_error(error, "git_diff_patches" TSRMLS_CC)) {
+		zval_dtor(return_value);
+		RETURN_FALSE;
+	}
+}
+/* }}} */
+
+/* {{{ proto long git_diff_write(resource $diff, resource $stream, long $format)
+  prints the diff straight into a php stream through a fixed size buffer, a file over the
+  budget of the diff as a binary one. returns the number of bytes written or false */
+PHP_FUNCTION(git_diff_write)
+{
+	int error = 0;
+	zval *diff = NULL, *zstream = NULL;
+	php_git2_t *_diff = NULL;
+	php_git2_stream_writer *writer;
+	php_stream *stream;
+	long format = GIT_DIFF_FORMAT_PATCH;
+	size_t written;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rr|l", &diff, &zstream, &format) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_diff, php_git2_t*, &diff, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	php_stream_from_zval(stream, &zstream);
+
+	writer = (php_git2_stream_writer*)emalloc(sizeof(php_git2_stream_writer));
+	php_git2_stream_writer_init(writer, stream);
+	error = php_git2_diff_walk(PHP_GIT2_V(_diff, diff), (php_git2_diff_budget*)_diff->priv, format,
+		NULL, NULL, php_git2_stream_writer_diff_line_cb, writer);
+	if (php_git2_stream_writer_flush(writer) && !error) {
+		error = GIT_EUSER;
+	}
+	written = writer->written;
+	efree(writer);
+	if (error == GIT_EUSER) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "failed to write to stream");
+		RETURN_FALSE;
+	}
+	if (php_git2_check_error(error, "git_diff_write" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_LONG(written);
+}
+/* }}} */
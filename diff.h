@@ -26,6 +26,43 @@
 #ifndef PHP_GIT2_DIFF_H
 #define PHP_GIT2_DIFF_H
 
+/* at most this many signatures are kept in memory, and this many scores */
+#define PHP_GIT2_SIMILARITY_MAX_SIGS 4096
+#define PHP_GIT2_SIMILARITY_MAX_SCORES 65536
+
+/* what libgit2 gets as a signature: its own hashsig, either shared with the cache or owned.
+   a blob with scores in the cache keeps its content instead and is hashed only when one of
+   its pairs is not known */
+typedef struct php_git2_similarity_sig {
+	git_oid oid;
+	int cacheable;
+	git_hashsig *hashsig;
+	int owned;
+	char *path;
+	char *content;
+	size_t content_len;
+} php_git2_similarity_sig;
+
+/* blob oid => libgit2 hashsig in memory, and blob pair => score, which is what is kept in
+   $GIT_DIR since a hashsig is opaque. libgit2 looks blobs up before asking for their
+   signature, so a hit saves the hashing, not the read */
+typedef struct php_git2_similarity_cache {
+	HashTable sigs;
+	HashTable scores;
+	HashTable known;
+	char *path;
+	int dirty;
+	git_hashsig_option_t option;
+	long hits;
+	long misses;
+	long uncached;
+	long score_hits;
+	long hashed_bytes;
+	long saved_bytes;
+} php_git2_similarity_cache;
+
+void php_git2_similarity_cache_free(php_git2_similarity_cache *cache);
+
 ZEND_BEGIN_ARG_INFO_EX(arginfo_git_diff_free, 0, 0, 1)
 	ZEND_ARG_INFO(0, diff)
 ZEND_END_ARG_INFO()
@@ -139,6 +176,52 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_git_diff_blob_to_buffer, 0, 0, 10)
 	ZEND_ARG_INFO(1, payload)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_diff_stats, 0, 0, 1)
+	ZEND_ARG_INFO(0, diff)
+	ZEND_ARG_INFO(0, name_only)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_diff_tree_paths, 0, 0, 3)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, old_tree)
+	ZEND_ARG_INFO(0, new_tree)
+	ZEND_ARG_INFO(0, pathspec)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_diff_to_array, 0, 0, 1)
+	ZEND_ARG_INFO(0, diff)
+	ZEND_ARG_INFO(0, max_files)
+	ZEND_ARG_INFO(0, max_lines_per_file)
+	ZEND_ARG_INFO(0, max_bytes)
+	ZEND_ARG_INFO(0, context)
+	ZEND_ARG_INFO(0, intraline)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_diff_patches, 0, 0, 1)
+	ZEND_ARG_INFO(0, diff)
+	ZEND_ARG_INFO(0, threads)
+	ZEND_ARG_INFO(0, stats_only)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_diff_similarity_cache_new, 0, 0, 1)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, persist)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_diff_similarity_cache_save, 0, 0, 1)
+	ZEND_ARG_INFO(0, cache)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_diff_similarity_cache_stats, 0, 0, 1)
+	ZEND_ARG_INFO(0, cache)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_diff_write, 0, 0, 2)
+	ZEND_ARG_INFO(0, diff)
+	ZEND_ARG_INFO(0, stream)
+	ZEND_ARG_INFO(0, format)
+ZEND_END_ARG_INFO()
+
 /* {{{ proto void git_diff_free(diff)
 */
 PHP_FUNCTION(git_diff_free);
@@ -211,5 +294,36 @@ PHP_FUNCTION(git_diff_blobs);
 */
 PHP_FUNCTION(git_diff_blob_to_buffer);
 
+/* {{{ proto array git_diff_stats(diff[, name_only])
+*/
+PHP_FUNCTION(git_diff_stats);
+
+/* {{{ proto array git_diff_tree_paths(repo, old_tree, new_tree[, pathspec])
+*/
+PHP_FUNCTION(git_diff_tree_paths);
+
+/* {{{ proto array git_diff_to_array(diff[, max_files, max_lines_per_file, max_bytes, context, intraline])
+*/
+PHP_FUNCTION(git_diff_to_array);
+
+/* {{{ proto array git_diff_patches(diff[, threads, stats_only])
+*/
+PHP_FUNCTION(git_diff_patches);
+
+/* {{{ proto resource git_diff_similarity_cache_new(repo[, persist])
+*/
+PHP_FUNCTION(git_diff_similarity_cache_new);
+
+/* {{{ proto bool git_diff_similarity_cache_save(cache)
+*/
+PHP_FUNCTION(git_diff_similarity_cache_save);
+
+/* {{{ proto array git_diff_similarity_cache_stats(cache)
+*/
+PHP_FUNCTION(git_diff_similarity_cache_stats);
+
+/* {{{ proto long git_diff_write(diff, stream[, format])
+*/
+PHP_FUNCTION(git_diff_write);
 
 #endif
\ No newline at end of file
@@ -2,6 +2,14 @@
 #include "php_git2_priv.h"
 #include "helper.h"
 
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <errno.h>
+#ifndef PHP_WIN32
+#include <pthread.h>
+#endif
+
 static zval* datetime_instantiate(zend_class_entry *pce, zval *object TSRMLS_DC)
 {
 #if PHP_VERSION_ID <= 50304
@@ -631,21 +639,184 @@ void php_git2_array_to_git_diff_options(git_diff_options *options, zval *array T
 {
 	git_diff_options_init(options, GIT_DIFF_OPTIONS_VERSION);
 
-	options->version = php_git2_read_arrval_long(array, ZEND_STRS("version") TSRMLS_CC);
+	options->version = php_git2_read_arrval_long2(array, ZEND_STRS("version"), GIT_DIFF_OPTIONS_VERSION TSRMLS_CC);
 	options->flags = php_git2_read_arrval_long(array, ZEND_STRS("flags") TSRMLS_CC);
 	options->ignore_submodules = php_git2_read_arrval_long(array, ZEND_STRS("ignore_submodules") TSRMLS_CC);
 
 	php_git2_array_to_strarray(&options->pathspec, php_git2_read_arrval(array, ZEND_STRS("pathspec") TSRMLS_CC) TSRMLS_CC);
 	// TODO(chobie): support notify cb
 
-	options->context_lines = php_git2_read_arrval_long(array, ZEND_STRS("context_lines") TSRMLS_CC);
-	options->interhunk_lines = php_git2_read_arrval_long(array, ZEND_STRS("interhunk_lines") TSRMLS_CC);
-	options->oid_abbrev = php_git2_read_arrval_long(array, ZEND_STRS("oid_abbrev") TSRMLS_CC);
-	options->max_size = php_git2_read_arrval_long(array, ZEND_STRS("max_size") TSRMLS_CC);
+	options->context_lines = php_git2_read_arrval_long2(array, ZEND_STRS("context_lines"), options->context_lines TSRMLS_CC);
+	options->interhunk_lines = php_git2_read_arrval_long2(array, ZEND_STRS("interhunk_lines"), options->interhunk_lines TSRMLS_CC);
+	options->oid_abbrev = php_git2_read_arrval_long2(array, ZEND_STRS("oid_abbrev"), options->oid_abbrev TSRMLS_CC);
+	/* blobs over max_file_bytes are not diffed by libgit2 either */
+	options->max_size = php_git2_read_arrval_long2(array, ZEND_STRS("max_size"),
+		php_git2_read_arrval_long2(array, ZEND_STRS("max_file_bytes"), options->max_size TSRMLS_CC) TSRMLS_CC);
 	options->old_prefix = php_git2_read_arrval_string(array, ZEND_STRS("old_prefix") TSRMLS_CC);
 	options->new_prefix = php_git2_read_arrval_string(array, ZEND_STRS("new_prefix") TSRMLS_CC);
 }
 
+/* `deadline_ms`, `max_file_lines` and `max_file_bytes` next to the diff options, NULL when none is set */
+php_git2_diff_budget *php_git2_array_to_diff_budget(zval *array TSRMLS_DC)
+{
+	php_git2_diff_budget budget, *result;
+
+	budget.deadline_ms = php_git2_read_arrval_long(array, ZEND_STRS("deadline_ms") TSRMLS_CC);
+	budget.max_file_lines = php_git2_read_arrval_long(array, ZEND_STRS("max_file_lines") TSRMLS_CC);
+	budget.max_file_bytes = php_git2_read_arrval_long(array, ZEND_STRS("max_file_bytes") TSRMLS_CC);
+	if (budget.deadline_ms <= 0 && budget.max_file_lines <= 0 && budget.max_file_bytes <= 0) {
+		return NULL;
+	}
+	result = (php_git2_diff_budget*)emalloc(sizeof(php_git2_diff_budget));
+	memcpy(result, &budget, sizeof(php_git2_diff_budget));
+	return result;
+}
+
+long php_git2_now_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/* value as a long, converted on a copy so arrays the caller passed in stay untouched */
+long php_git2_zval_to_long(zval *value)
+{
+	zval tmp;
+
+	if (Z_TYPE_P(value) == IS_LONG) {
+		return Z_LVAL_P(value);
+	}
+	tmp = *value;
+	zval_copy_ctor(&tmp);
+	convert_to_long(&tmp);
+	return Z_LVAL(tmp);
+}
+
+/* position of name in names, -1 when it is not one of them */
+int php_git2_field_lookup(const char **names, int count, const char *name, int name_len)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (strlen(names[i]) == name_len && memcmp(names[i], name, name_len) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* sets wanted[i] for every entry of fields naming names[i]. unknown names and values that
+   are not strings are skipped with a warning naming kind. returns the number of fields set,
+   0 when fields is NULL or empty so the caller can apply its defaults */
+int php_git2_fields_parse(int *wanted, zval *fields, const char **names, int count, const char *kind TSRMLS_DC)
+{
+	HashPosition pos;
+	zval **value;
+	int field, selected = 0;
+
+	if (fields == NULL) {
+		return 0;
+	}
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(fields), &pos);
+		zend_hash_get_current_data_ex(Z_ARRVAL_P(fields), (void **)&value, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(Z_ARRVAL_P(fields), &pos)) {
+		if (Z_TYPE_PP(value) != IS_STRING) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "%s field names must be strings", kind);
+			continue;
+		}
+		field = php_git2_field_lookup(names, count, Z_STRVAL_PP(value), Z_STRLEN_PP(value));
+		if (field < 0) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "unknown %s field `%s`", kind, Z_STRVAL_PP(value));
+			continue;
+		}
+		if (!wanted[field]) {
+			wanted[field] = 1;
+			selected++;
+		}
+	}
+	return selected;
+}
+
+/* replaces path with data through "<path>.lock": the lock is created exclusively so a
+   concurrent writer fails instead of sharing it, and it is synced before the rename.
+   a lock older than PHP_GIT2_LOCK_STALE_SECONDS was left by a writer that died and is
+   removed once. returns -1 with the reason in giterr_last() when a live writer holds the
+   lock or anything fails, the lock is removed then */
+int php_git2_lockfile_write(const char *path, const char *data, size_t len)
+{
+	char lock[MAXPATHLEN];
+	struct stat st;
+	ssize_t written;
+	int fd;
+
+	if (snprintf(lock, sizeof(lock), "%s.lock", path) >= sizeof(lock)) {
+		giterr_set_str(GITERR_OS, "lock file path too long");
+		return -1;
+	}
+	fd = open(lock, O_CREAT | O_EXCL | O_WRONLY, 0666);
+	if (fd < 0 && errno == EEXIST && lstat(lock, &st) == 0 &&
+		time(NULL) - st.st_mtime > PHP_GIT2_LOCK_STALE_SECONDS && unlink(lock) == 0) {
+		fd = open(lock, O_CREAT | O_EXCL | O_WRONLY, 0666);
+	}
+	if (fd < 0) {
+		giterr_set_str(GITERR_OS, errno == EEXIST ?
+			"another writer holds the lock file" : "failed to create the lock file");
+		return -1;
+	}
+	while (len > 0) {
+		written = write(fd, data, len);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			break;
+		}
+		data += written;
+		len -= written;
+	}
+	if (len > 0 || fsync(fd) != 0) {
+		close(fd);
+		unlink(lock);
+		giterr_set_str(GITERR_OS, "failed to write the lock file");
+		return -1;
+	}
+	if (close(fd) != 0 || rename(lock, path) != 0) {
+		unlink(lock);
+		giterr_set_str(GITERR_OS, "failed to rename the lock file into place");
+		return -1;
+	}
+	return 0;
+}
+
+/* checked before the content of a delta is loaded */
+int php_git2_diff_budget_exceeded(const php_git2_diff_budget *budget, const git_diff_delta *delta, long started_ms)
+{
+	if (budget == NULL) {
+		return 0;
+	}
+	if (budget->deadline_ms > 0 && php_git2_now_ms() - started_ms >= budget->deadline_ms) {
+		return 1;
+	}
+	if (budget->max_file_bytes > 0 &&
+		(delta->old_file.size > (git_off_t)budget->max_file_bytes || delta->new_file.size > (git_off_t)budget->max_file_bytes)) {
+		return 1;
+	}
+	return 0;
+}
+
+int php_git2_diff_budget_lines_exceeded(const php_git2_diff_budget *budget, const git_patch *patch)
+{
+	size_t context = 0, additions = 0, deletions = 0;
+
+	if (budget == NULL || budget->max_file_lines <= 0) {
+		return 0;
+	}
+	git_patch_line_stats(&context, &additions, &deletions, patch);
+	return context + additions + deletions > (size_t)budget->max_file_lines;
+}
+
 void php_git2_git_diff_options_free(git_diff_options *options)
 {
 	if (options->pathspec.count > 0) {
@@ -784,3 +955,329 @@ void php_git2_git_transfer_progress_to_array(git_transfer_progress *progress, zv
 
 	*out = result;
 }
+
+#define PHP_GIT2_PRELOAD_MAX_THREADS 20
+#define PHP_GIT2_PRELOAD_THREAD_COST 500
+
+typedef struct php_git2_preload_worker {
+	php_git2_preload_t *preload;
+	const git_index_entry **entries;
+	const char *workdir;
+	size_t start;
+	size_t end;
+} php_git2_preload_worker;
+
+/* runs without the engine: no emalloc, no zvals. */
+static void *php_git2_preload_worker_run(void *data)
+{
+	php_git2_preload_worker *worker = (php_git2_preload_worker*)data;
+	const git_index_entry *entry;
+	php_git2_preload_stat *result;
+	struct stat st;
+	char path[MAXPATHLEN];
+	size_t i;
+
+	for (i = worker->start; i < worker->end; i++) {
+		result = &worker->preload->stats[i];
+		entry = worker->entries[i];
+		if (entry == NULL || git_index_entry_stage(entry) != 0) {
+			continue;
+		}
+		if (snprintf(path, sizeof(path), "%s%s", worker->workdir, entry->path) >= sizeof(path)) {
+			continue;
+		}
+		if (lstat(path, &st) != 0) {
+			continue;
+		}
+
+		result->valid = 1;
+		result->ctime = st.st_ctime;
+		result->mtime = st.st_mtime;
+		result->dev = st.st_dev;
+		result->ino = st.st_ino;
+		result->uid = st.st_uid;
+		result->gid = st.st_gid;
+		result->file_size = st.st_size;
+		result->changed = (entry->mtime.seconds != (git_time_t)st.st_mtime ||
+			entry->ctime.seconds != (git_time_t)st.st_ctime ||
+			entry->file_size != (git_off_t)st.st_size ||
+			entry->ino != (unsigned int)st.st_ino);
+	}
+
+	return NULL;
+}
+
+int php_git2_preload_index(php_git2_preload_t **out, git_repository *repo, git_index *index, long threads TSRMLS_DC)
+{
+	php_git2_preload_t *preload;
+	php_git2_preload_worker *workers;
+	const git_index_entry **entries;
+	const char *workdir;
+	size_t count, chunk, i;
+#ifndef PHP_WIN32
+	pthread_t *tids;
+#endif
+
+	*out = NULL;
+	workdir = git_repository_workdir(repo);
+	if (workdir == NULL) {
+		return 0;
+	}
+
+	count = git_index_entrycount(index);
+	if (threads <= 0) {
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (threads > PHP_GIT2_PRELOAD_MAX_THREADS) {
+		threads = PHP_GIT2_PRELOAD_MAX_THREADS;
+	}
+	if (threads > count / PHP_GIT2_PRELOAD_THREAD_COST) {
+		threads = count / PHP_GIT2_PRELOAD_THREAD_COST;
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	preload = (php_git2_preload_t*)emalloc(sizeof(php_git2_preload_t));
+	preload->count = count;
+	preload->stats = (php_git2_preload_stat*)safe_emalloc(count, sizeof(php_git2_preload_stat), 0);
+	memset(preload->stats, 0, sizeof(php_git2_preload_stat) * count);
+
+	/* git_index_get_byindex() sorts the entries on first use, so the workers
+	   only see pointers taken here on the calling thread */
+	entries = (const git_index_entry**)safe_emalloc(count ? count : 1, sizeof(git_index_entry*), 0);
+	for (i = 0; i < count; i++) {
+		entries[i] = git_index_get_byindex(index, i);
+	}
+
+	workers = (php_git2_preload_worker*)safe_emalloc(threads, sizeof(php_git2_preload_worker), 0);
+	chunk = (count + threads - 1) / threads;
+	for (i = 0; i < threads; i++) {
+		workers[i].preload = preload;
+		workers[i].entries = entries;
+		workers[i].workdir = workdir;
+		workers[i].start = MIN(i * chunk, count);
+		workers[i].end = MIN((i + 1) * chunk, count);
+	}
+
+#ifndef PHP_WIN32
+	tids = (pthread_t*)safe_emalloc(threads, sizeof(pthread_t), 0);
+	for (i = 1; i < threads; i++) {
+		if (pthread_create(&tids[i], NULL, php_git2_preload_worker_run, &workers[i]) != 0) {
+			/* could not spawn, do that chunk ourselves */
+			php_git2_preload_worker_run(&workers[i]);
+			workers[i].end = workers[i].start;
+		}
+	}
+	php_git2_preload_worker_run(&workers[0]);
+	for (i = 1; i < threads; i++) {
+		if (workers[i].end != workers[i].start) {
+			pthread_join(tids[i], NULL);
+		}
+	}
+	efree(tids);
+#else
+	for (i = 0; i < threads; i++) {
+		php_git2_preload_worker_run(&workers[i]);
+	}
+#endif
+	efree(workers);
+	efree(entries);
+
+	*out = preload;
+	return 0;
+}
+
+/* stores the preloaded stat data of the clean entries and writes the index; only called when
+   the caller asked for it, status itself never writes. returns the number of refreshed entries */
+int php_git2_preload_refresh(php_git2_preload_t *preload, git_index *index, git_status_list *list TSRMLS_DC)
+{
+	HashTable dirty;
+	const git_status_entry *status;
+	const git_index_entry *entry;
+	git_index_entry refreshed;
+	php_git2_preload_stat *stat;
+	time_t now = time(NULL);
+	size_t i, count;
+	int updated = 0, error = 0;
+
+	count = git_status_list_entrycount(list);
+	zend_hash_init(&dirty, count, NULL, NULL, 0);
+	for (i = 0; i < count; i++) {
+		status = git_status_byindex(list, i);
+		if (status->index_to_workdir != NULL) {
+			zend_hash_add_empty_element(&dirty, status->index_to_workdir->old_file.path,
+				strlen(status->index_to_workdir->old_file.path) + 1);
+		}
+	}
+
+	for (i = 0; i < preload->count && i < git_index_entrycount(index); i++) {
+		stat = &preload->stats[i];
+		/* an entry touched within the current second is racily clean, leave it to the next run */
+		if (!stat->valid || !stat->changed || stat->mtime >= now) {
+			continue;
+		}
+		entry = git_index_get_byindex(index, i);
+		if (entry == NULL || git_index_entry_stage(entry) != 0 ||
+			zend_hash_exists(&dirty, entry->path, strlen(entry->path) + 1)) {
+			continue;
+		}
+
+		memcpy(&refreshed, entry, sizeof(git_index_entry));
+		refreshed.ctime.seconds = stat->ctime;
+		refreshed.ctime.nanoseconds = 0;
+		refreshed.mtime.seconds = stat->mtime;
+		refreshed.mtime.nanoseconds = 0;
+		refreshed.dev = stat->dev;
+		refreshed.ino = stat->ino;
+		refreshed.uid = stat->uid;
+		refreshed.gid = stat->gid;
+		refreshed.file_size = stat->file_size;
+		/* git_index_add replaces the entry in place, so the entry order is unchanged */
+		error = git_index_add(index, &refreshed);
+		if (error) {
+			break;
+		}
+		updated++;
+	}
+	zend_hash_destroy(&dirty);
+
+	if (!error && updated > 0) {
+		error = git_index_write(index);
+	}
+	return error ? error : updated;
+}
+
+void php_git2_preload_free(php_git2_preload_t *preload)
+{
+	if (preload == NULL) {
+		return;
+	}
+	efree(preload->stats);
+	efree(preload);
+}
+
+void php_git2_stream_writer_init(php_git2_stream_writer *writer, php_stream *stream)
+{
+	writer->stream = stream;
+	writer->len = 0;
+	writer->written = 0;
+	writer->failed = 0;
+}
+
+int php_git2_stream_writer_flush(php_git2_stream_writer *writer)
+{
+	size_t offset = 0, n;
+	TSRMLS_FETCH();
+
+	while (offset < writer->len && !writer->failed) {
+		n = php_stream_write(writer->stream, writer->buf + offset, writer->len - offset);
+		if (n == 0) {
+			writer->failed = 1;
+			break;
+		}
+		offset += n;
+	}
+	writer->written += offset;
+	writer->len = 0;
+	return writer->failed ? -1 : 0;
+}
+
+int php_git2_stream_writer_write(php_git2_stream_writer *writer, const char *data, size_t len)
+{
+	size_t chunk;
+
+	while (len > 0) {
+		if (writer->len == PHP_GIT2_STREAM_BUFFER_SIZE && php_git2_stream_writer_flush(writer)) {
+			return -1;
+		}
+		chunk = MIN(len, PHP_GIT2_STREAM_BUFFER_SIZE - writer->len);
+		memcpy(writer->buf + writer->len, data, chunk);
+		writer->len += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+	return writer->failed ? -1 : 0;
+}
+
+int php_git2_pkt_write(php_git2_stream_writer *writer, const char *data, size_t len)
+{
+	char header[5];
+
+	if (len + 4 > PHP_GIT2_PKT_MAX) {
+		return -1;
+	}
+	snprintf(header, sizeof(header), "%04x", (unsigned int)(len + 4));
+	if (php_git2_stream_writer_write(writer, header, 4)) {
+		return -1;
+	}
+	return php_git2_stream_writer_write(writer, data, len);
+}
+
+int php_git2_pkt_flush(php_git2_stream_writer *writer)
+{
+	return php_git2_stream_writer_write(writer, "0000", 4);
+}
+
+void php_git2_sideband_writer_init(php_git2_sideband_writer *sideband, php_git2_stream_writer *writer, char band)
+{
+	sideband->writer = writer;
+	sideband->band = band;
+	sideband->len = 0;
+}
+
+int php_git2_sideband_writer_flush(php_git2_sideband_writer *sideband)
+{
+	char header[6];
+
+	if (sideband->len == 0) {
+		return 0;
+	}
+	snprintf(header, sizeof(header), "%04x", (unsigned int)(sideband->len + 5));
+	header[4] = sideband->band;
+	if (php_git2_stream_writer_write(sideband->writer, header, 5) ||
+		php_git2_stream_writer_write(sideband->writer, sideband->buf, sideband->len)) {
+		return -1;
+	}
+	sideband->len = 0;
+	return 0;
+}
+
+int php_git2_sideband_writer_write(php_git2_sideband_writer *sideband, const char *data, size_t len)
+{
+	size_t chunk;
+
+	while (len > 0) {
+		if (sideband->len == PHP_GIT2_SIDEBAND_DATA_MAX && php_git2_sideband_writer_flush(sideband)) {
+			return -1;
+		}
+		chunk = MIN(len, PHP_GIT2_SIDEBAND_DATA_MAX - sideband->len);
+		memcpy(sideband->buf + sideband->len, data, chunk);
+		sideband->len += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+int php_git2_stream_writer_diff_line_cb(
+	const git_diff_delta *delta,
+	const git_diff_hunk *hunk,
+	const git_diff_line *line,
+	void *payload)
+{
+	php_git2_stream_writer *writer = (php_git2_stream_writer*)payload;
+
+	/* the printer leaves the origin of content lines to the callback */
+	if (line->origin == GIT_DIFF_LINE_CONTEXT ||
+		line->origin == GIT_DIFF_LINE_ADDITION ||
+		line->origin == GIT_DIFF_LINE_DELETION) {
+		if (php_git2_stream_writer_write(writer, &line->origin, 1)) {
+			return GIT_EUSER;
+		}
+	}
+	if (php_git2_stream_writer_write(writer, line->content, line->content_len)) {
+		return GIT_EUSER;
+	}
+	return 0;
+}
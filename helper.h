@@ -75,6 +75,32 @@ void php_git2_diff_delta_to_array(git_diff_delta *delta, zval **out TSRMLS_DC);
 
 void php_git2_array_to_git_diff_options(git_diff_options *options, zval *array TSRMLS_DC);
 
+/* limits applied when the content of a diff is generated by the extension */
+typedef struct php_git2_diff_budget {
+	long deadline_ms;
+	long max_file_lines;
+	long max_file_bytes;
+} php_git2_diff_budget;
+
+php_git2_diff_budget *php_git2_array_to_diff_budget(zval *array TSRMLS_DC);
+
+long php_git2_now_ms(void);
+
+/* a lock file this old is taken to be left behind by a writer that died */
+#define PHP_GIT2_LOCK_STALE_SECONDS 600
+
+int php_git2_lockfile_write(const char *path, const char *data, size_t len);
+
+long php_git2_zval_to_long(zval *value);
+
+int php_git2_field_lookup(const char **names, int count, const char *name, int name_len);
+
+int php_git2_fields_parse(int *wanted, zval *fields, const char **names, int count, const char *kind TSRMLS_DC);
+
+int php_git2_diff_budget_exceeded(const php_git2_diff_budget *budget, const git_diff_delta *delta, long started_ms);
+
+int php_git2_diff_budget_lines_exceeded(const php_git2_diff_budget *budget, const git_patch *patch);
+
 void php_git2_git_diff_options_free(git_diff_options *options);
 
 void php_git2_git_diff_options_to_array(git_diff_options *options, zval **out TSRMLS_DC);
@@ -100,4 +126,97 @@ void php_git2_fcall_info_wrapper(zval *target, zend_fcall_info **out_fci, zend_f
 
 void php_git2_fcall_info_wrapper2(zval *target, zend_fcall_info *fci, zend_fcall_info_cache *fcc TSRMLS_DC);
 
+typedef struct php_git2_preload_stat {
+	int valid;
+	int changed;
+	git_time_t ctime;
+	git_time_t mtime;
+	unsigned int dev;
+	unsigned int ino;
+	unsigned int uid;
+	unsigned int gid;
+	git_off_t file_size;
+} php_git2_preload_stat;
+
+typedef struct php_git2_preload_t {
+	size_t count;
+	php_git2_preload_stat *stats;
+} php_git2_preload_t;
+
+int php_git2_preload_index(php_git2_preload_t **out, git_repository *repo, git_index *index, long threads TSRMLS_DC);
+
+int php_git2_preload_refresh(php_git2_preload_t *preload, git_index *index, git_status_list *list TSRMLS_DC);
+
+void php_git2_preload_free(php_git2_preload_t *preload);
+
+/* inotify watcher attached to a repository resource by git_repository_watch */
+typedef struct php_git2_watcher {
+	int fd;
+	char *workdir;
+	char *excludes[2]; /* $GIT_DIR/info/exclude and core.excludesfile, either may be NULL */
+	int overflow; /* events were lost, the watches are rebuilt on the next full scan */
+	int incomplete; /* a directory could not be watched, incremental status is off for good */
+	int primed;
+	unsigned int flags;
+	HashTable watches;
+	HashTable exclude_watches; /* wd => basename of the exclude file in that directory */
+	HashTable dirty;
+	HashTable last_status;
+	long events;
+	long overflows;
+	long rebuilds;
+	long full_scans;
+	long incremental_scans;
+} php_git2_watcher;
+
+void php_git2_watcher_drain(php_git2_watcher *watcher);
+
+void php_git2_watcher_rebuild(php_git2_watcher *watcher);
+
+void php_git2_watcher_free(php_git2_watcher *watcher);
+
+#define PHP_GIT2_STREAM_BUFFER_SIZE 65536
+
+/* fixed size buffer in front of a php stream, output stays constant in memory */
+typedef struct php_git2_stream_writer {
+	php_stream *stream;
+	size_t len;
+	size_t written;
+	int failed;
+	char buf[PHP_GIT2_STREAM_BUFFER_SIZE];
+} php_git2_stream_writer;
+
+void php_git2_stream_writer_init(php_git2_stream_writer *writer, php_stream *stream);
+
+int php_git2_stream_writer_write(php_git2_stream_writer *writer, const char *data, size_t len);
+
+int php_git2_stream_writer_flush(php_git2_stream_writer *writer);
+
+#define PHP_GIT2_PKT_MAX 65520
+#define PHP_GIT2_SIDEBAND_DATA_MAX (PHP_GIT2_PKT_MAX - 5)
+
+/* collects payload for one side-band-64k channel and frames it into pkt-lines */
+typedef struct php_git2_sideband_writer {
+	php_git2_stream_writer *writer;
+	char band;
+	size_t len;
+	char buf[PHP_GIT2_SIDEBAND_DATA_MAX];
+} php_git2_sideband_writer;
+
+int php_git2_pkt_write(php_git2_stream_writer *writer, const char *data, size_t len);
+
+int php_git2_pkt_flush(php_git2_stream_writer *writer);
+
+void php_git2_sideband_writer_init(php_git2_sideband_writer *sideband, php_git2_stream_writer *writer, char band);
+
+int php_git2_sideband_writer_write(php_git2_sideband_writer *sideband, const char *data, size_t len);
+
+int php_git2_sideband_writer_flush(php_git2_sideband_writer *sideband);
+
+int php_git2_stream_writer_diff_line_cb(
+	const git_diff_delta *delta,
+	const git_diff_hunk *hunk,
+	const git_diff_line *line,
+	void *payload);
+
 #endif
\ No newline at end of file
@@ -94,6 +94,24 @@ static void php_git2_index_entry_to_array(const git_index_entry *entry, zval **r
 	*result = tmp;
 }
 
+static void php_git2_index_preload(git_index *index TSRMLS_DC)
+{
+	php_git2_preload_t *preload = NULL;
+	git_repository *repo = NULL;
+
+	if (!GIT2G(preload_index)) {
+		return;
+	}
+	repo = git_index_owner(index);
+	if (repo == NULL || git_repository_is_bare(repo)) {
+		return;
+	}
+	/* warms the stat cache for the per-entry lstat() done by libgit2 */
+	if (!php_git2_preload_index(&preload, repo, index, GIT2G(preload_threads) TSRMLS_CC)) {
+		php_git2_preload_free(preload);
+	}
+}
+
 /* {{{ proto resource git_index_open(index_path)
 */
 PHP_FUNCTION(git_index_open)
@@ -586,6 +604,7 @@ PHP_FUNCTION(git_index_add_all)
 	if (php_git2_cb_init(&cb, &fci, &fcc, payload TSRMLS_CC)) {
 		RETURN_FALSE;
 	}
+	php_git2_index_preload(PHP_GIT2_V(_index, index) TSRMLS_CC);
 	result = git_index_add_all(PHP_GIT2_V(_index, index), pathspec, flags, php_git2_index_matched_path_cb, cb);
 	php_git2_cb_free(cb);
 	php_git2_strarray_free(&_pathspec);
@@ -646,6 +665,7 @@ PHP_FUNCTION(git_index_update_all)
 	if (php_git2_cb_init(&cb, &fci, &fcc, payload TSRMLS_CC)) {
 		RETURN_FALSE;
 	}
+	php_git2_index_preload(PHP_GIT2_V(_index, index) TSRMLS_CC);
 	result = git_index_update_all(PHP_GIT2_V(_index, index), pathspec, php_git2_index_matched_path_cb, cb);
 	php_git2_cb_free(cb);
 	php_git2_strarray_free(&_pathspec);
@@ -864,3 +884,278 @@ PHP_FUNCTION(git_index_conflict_iterator_free)
 	zval_ptr_dtor(&iterator);
 }
 /* }}} */
+
+enum {
+	PHP_GIT2_INDEX_FIELD_PATH = 0,
+	PHP_GIT2_INDEX_FIELD_OID,
+	PHP_GIT2_INDEX_FIELD_MODE,
+	PHP_GIT2_INDEX_FIELD_STAGE,
+	PHP_GIT2_INDEX_FIELD_FILE_SIZE,
+	PHP_GIT2_INDEX_FIELD_FLAGS,
+	PHP_GIT2_INDEX_FIELD_FLAGS_EXTENDED,
+	PHP_GIT2_INDEX_FIELD_CTIME,
+	PHP_GIT2_INDEX_FIELD_MTIME,
+	PHP_GIT2_INDEX_FIELD_DEV,
+	PHP_GIT2_INDEX_FIELD_INO,
+	PHP_GIT2_INDEX_FIELD_UID,
+	PHP_GIT2_INDEX_FIELD_GID,
+	PHP_GIT2_INDEX_FIELD_MAX
+};
+
+static const char *php_git2_index_field_names[PHP_GIT2_INDEX_FIELD_MAX] = {
+	"path", "oid", "mode", "stage", "file_size", "flags", "flags_extended",
+	"ctime", "mtime", "dev", "ino", "uid", "gid"
+};
+
+/* {{{ proto array git_index_entries(resource $index[, array $fields])
+  returns the requested entry fields column by column: array("path" => array(...), "oid" => array(...)).
+  ctime and mtime columns hold seconds. defaults to path, oid and mode. */
+PHP_FUNCTION(git_index_entries)
+{
+	zval *index = NULL, *fields = NULL;
+	zval *columns[PHP_GIT2_INDEX_FIELD_MAX] = {0};
+	php_git2_t *_index = NULL;
+	const git_index_entry *entry = NULL;
+	int wanted[PHP_GIT2_INDEX_FIELD_MAX] = {0};
+	size_t count = 0, i = 0;
+	int field = 0;
+	char buf[GIT2_OID_HEXSIZE] = {0};
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r|a", &index, &fields) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_index, php_git2_t*, &index, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	count = git_index_entrycount(PHP_GIT2_V(_index, index));
+	array_init(return_value);
+
+	if (php_git2_fields_parse(wanted, fields, php_git2_index_field_names, PHP_GIT2_INDEX_FIELD_MAX, "index entry" TSRMLS_CC) == 0) {
+		wanted[PHP_GIT2_INDEX_FIELD_PATH] = 1;
+		wanted[PHP_GIT2_INDEX_FIELD_OID] = 1;
+		wanted[PHP_GIT2_INDEX_FIELD_MODE] = 1;
+	}
+
+	for (field = 0; field < PHP_GIT2_INDEX_FIELD_MAX; field++) {
+		if (wanted[field]) {
+			MAKE_STD_ZVAL(columns[field]);
+			array_init_size(columns[field], count);
+			add_assoc_zval(return_value, php_git2_index_field_names[field], columns[field]);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		entry = git_index_get_byindex(PHP_GIT2_V(_index, index), i);
+		if (entry == NULL) {
+			break;
+		}
+
+		if (columns[PHP_GIT2_INDEX_FIELD_PATH]) {
+			add_next_index_string(columns[PHP_GIT2_INDEX_FIELD_PATH], entry->path, 1);
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_OID]) {
+			git_oid_fmt(buf, &entry->oid);
+			add_next_index_stringl(columns[PHP_GIT2_INDEX_FIELD_OID], buf, GIT_OID_HEXSZ, 1);
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_MODE]) {
+			add_next_index_long(columns[PHP_GIT2_INDEX_FIELD_MODE], entry->mode);
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_STAGE]) {
+			add_next_index_long(columns[PHP_GIT2_INDEX_FIELD_STAGE], git_index_entry_stage(entry));
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_FILE_SIZE]) {
+			add_next_index_long(columns[PHP_GIT2_INDEX_FIELD_FILE_SIZE], entry->file_size);
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_FLAGS]) {
+			add_next_index_long(columns[PHP_GIT2_INDEX_FIELD_FLAGS], entry->flags);
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_FLAGS_EXTENDED]) {
+			add_next_index_long(columns[PHP_GIT2_INDEX_FIELD_FLAGS_EXTENDED], entry->flags_extended);
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_CTIME]) {
+			add_next_index_long(columns[PHP_GIT2_INDEX_FIELD_CTIME], entry->ctime.seconds);
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_MTIME]) {
+			add_next_index_long(columns[PHP_GIT2_INDEX_FIELD_MTIME], entry->mtime.seconds);
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_DEV]) {
+			add_next_index_long(columns[PHP_GIT2_INDEX_FIELD_DEV], entry->dev);
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_INO]) {
+			add_next_index_long(columns[PHP_GIT2_INDEX_FIELD_INO], entry->ino);
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_UID]) {
+			add_next_index_long(columns[PHP_GIT2_INDEX_FIELD_UID], entry->uid);
+		}
+		if (columns[PHP_GIT2_INDEX_FIELD_GID]) {
+			add_next_index_long(columns[PHP_GIT2_INDEX_FIELD_GID], entry->gid);
+		}
+	}
+}
+/* }}} */
+
+typedef struct php_git2_index_batch_entry {
+	git_index_entry entry;
+	size_t ordinal;
+} php_git2_index_batch_entry;
+
+static void php_git2_index_read_time(git_index_time *time, zval **value TSRMLS_DC)
+{
+	if (Z_TYPE_PP(value) == IS_ARRAY) {
+		time->seconds = php_git2_read_arrval_long(*value, ZEND_STRS("seconds") TSRMLS_CC);
+		time->nanoseconds = php_git2_read_arrval_long(*value, ZEND_STRS("nanoseconds") TSRMLS_CC);
+	} else {
+		time->seconds = php_git2_zval_to_long(*value);
+	}
+}
+
+/* walks the row once instead of looking up every known key */
+static int php_git2_index_row_to_entry(git_index_entry *entry, zval *row TSRMLS_DC)
+{
+	HashPosition pos;
+	zval **value;
+	char *key;
+	uint key_len;
+	ulong index;
+	int field, has_oid = 0;
+
+	memset(entry, '\0', sizeof(git_index_entry));
+
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(row), &pos);
+		zend_hash_get_current_data_ex(Z_ARRVAL_P(row), (void **)&value, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(Z_ARRVAL_P(row), &pos)) {
+		if (zend_hash_get_current_key_ex(Z_ARRVAL_P(row), &key, &key_len, &index, 0, &pos) != HASH_KEY_IS_STRING) {
+			continue;
+		}
+		field = php_git2_field_lookup(php_git2_index_field_names, PHP_GIT2_INDEX_FIELD_MAX, key, key_len - 1);
+		switch (field) {
+			case PHP_GIT2_INDEX_FIELD_PATH:
+				if (Z_TYPE_PP(value) == IS_STRING) {
+					entry->path = Z_STRVAL_PP(value);
+				}
+				break;
+			case PHP_GIT2_INDEX_FIELD_OID:
+				if (Z_TYPE_PP(value) == IS_STRING &&
+					git_oid_fromstrn(&entry->oid, Z_STRVAL_PP(value), Z_STRLEN_PP(value)) == GIT_OK) {
+					has_oid = 1;
+				}
+				break;
+			case PHP_GIT2_INDEX_FIELD_CTIME:
+				php_git2_index_read_time(&entry->ctime, value TSRMLS_CC);
+				break;
+			case PHP_GIT2_INDEX_FIELD_MTIME:
+				php_git2_index_read_time(&entry->mtime, value TSRMLS_CC);
+				break;
+			case PHP_GIT2_INDEX_FIELD_MODE:
+				entry->mode = php_git2_zval_to_long(*value);
+				break;
+			case PHP_GIT2_INDEX_FIELD_FILE_SIZE:
+				entry->file_size = php_git2_zval_to_long(*value);
+				break;
+			case PHP_GIT2_INDEX_FIELD_FLAGS:
+				entry->flags = php_git2_zval_to_long(*value);
+				break;
+			case PHP_GIT2_INDEX_FIELD_FLAGS_EXTENDED:
+				entry->flags_extended = php_git2_zval_to_long(*value);
+				break;
+			case PHP_GIT2_INDEX_FIELD_DEV:
+				entry->dev = php_git2_zval_to_long(*value);
+				break;
+			case PHP_GIT2_INDEX_FIELD_INO:
+				entry->ino = php_git2_zval_to_long(*value);
+				break;
+			case PHP_GIT2_INDEX_FIELD_UID:
+				entry->uid = php_git2_zval_to_long(*value);
+				break;
+			case PHP_GIT2_INDEX_FIELD_GID:
+				entry->gid = php_git2_zval_to_long(*value);
+				break;
+			default:
+				break;
+		}
+	}
+
+	return has_oid && entry->path != NULL;
+}
+
+static int php_git2_index_batch_compare(const void *a, const void *b TSRMLS_DC)
+{
+	const php_git2_index_batch_entry *left = (const php_git2_index_batch_entry*)a;
+	const php_git2_index_batch_entry *right = (const php_git2_index_batch_entry*)b;
+	int result;
+
+	result = strcmp(left->entry.path, right->entry.path);
+	if (result == 0) {
+		result = git_index_entry_stage(&left->entry) - git_index_entry_stage(&right->entry);
+	}
+	if (result == 0) {
+		result = (left->ordinal < right->ordinal) ? -1 : (left->ordinal > right->ordinal);
+	}
+	return result;
+}
+
+/* {{{ proto long git_index_add_many(resource $index, array $entries)
+  entries use the same keys as git_index_add; ctime and mtime may be given as seconds.
+  the batch is sorted and de-duplicated (last one wins), then added in path order through
+  git_index_add so the index stays close to sorted between the inserts. */
+PHP_FUNCTION(git_index_add_many)
+{
+	zval *index = NULL, *entries = NULL, **row = NULL;
+	php_git2_t *_index = NULL;
+	php_git2_index_batch_entry *batch = NULL;
+	git_index_entry *sorted = NULL;
+	HashPosition pos;
+	size_t count = 0, skipped = 0, i = 0, unique = 0, added = 0;
+	int error = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"ra", &index, &entries) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_index, php_git2_t*, &index, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (zend_hash_num_elements(Z_ARRVAL_P(entries)) == 0) {
+		RETURN_LONG(0);
+	}
+
+	batch = (php_git2_index_batch_entry*)safe_emalloc(zend_hash_num_elements(Z_ARRVAL_P(entries)), sizeof(php_git2_index_batch_entry), 0);
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(entries), &pos);
+		zend_hash_get_current_data_ex(Z_ARRVAL_P(entries), (void **)&row, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(Z_ARRVAL_P(entries), &pos)) {
+		if (Z_TYPE_PP(row) != IS_ARRAY || !php_git2_index_row_to_entry(&batch[count].entry, *row TSRMLS_CC)) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "entry %ld requires path and oid", (long)(count + skipped));
+			skipped++;
+			continue;
+		}
+		batch[count].ordinal = count;
+		count++;
+	}
+
+	zend_qsort(batch, count, sizeof(php_git2_index_batch_entry), php_git2_index_batch_compare TSRMLS_CC);
+	sorted = (git_index_entry*)safe_emalloc(count ? count : 1, sizeof(git_index_entry), 0);
+
+	/* drop all but the last entry per path and stage, keeping the sorted order */
+	for (i = 0; i < count; i++) {
+		if (i + 1 < count &&
+			strcmp(batch[i].entry.path, batch[i + 1].entry.path) == 0 &&
+			git_index_entry_stage(&batch[i].entry) == git_index_entry_stage(&batch[i + 1].entry)) {
+			continue;
+		}
+		sorted[unique++] = batch[i].entry;
+	}
+	/* git_index_add() keeps stage handling and the tree cache to libgit2; fed in path order
+	   each insert lands at the end of the sorted run, so its re-sort stays cheap */
+	for (i = 0; i < unique && error == 0; i++) {
+		if ((error = git_index_add(PHP_GIT2_V(_index, index), &sorted[i])) == 0) {
+			added++;
+		}
+	}
+	efree(sorted);
+	efree(batch);
+
+	if (php_git2_check_error(error, "git_index_add_many" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_LONG(added);
+}
+/* }}} */
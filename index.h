@@ -167,6 +167,16 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_git_index_conflict_iterator_free, 0, 0, 1)
 	ZEND_ARG_INFO(0, iterator)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_index_entries, 0, 0, 1)
+	ZEND_ARG_INFO(0, index)
+	ZEND_ARG_INFO(0, fields)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_index_add_many, 0, 0, 2)
+	ZEND_ARG_INFO(0, index)
+	ZEND_ARG_INFO(0, entries)
+ZEND_END_ARG_INFO()
+
 /* {{{ proto resource git_index_open(index_path)
 */
 PHP_FUNCTION(git_index_open);
@@ -303,3 +313,10 @@ PHP_FUNCTION(git_index_conflict_next);
 */
 PHP_FUNCTION(git_index_conflict_iterator_free);
 
+/* {{{ proto array git_index_entries(index, fields)
+*/
+PHP_FUNCTION(git_index_entries);
+
+/* {{{ proto long git_index_add_many(index, entries)
+*/
+PHP_FUNCTION(git_index_add_many);
@@ -1,70 +1,409 @@
 #include "php_git2.h"
 #include "php_git2_priv.h"
 #include "indexer.h"
+#include "php_network.h"
 
-/* {{{ proto resource git_indexer_new(string $path, long $mode, resource $odb,  $progress_cb,  $progress_cb_payload)
- */
+#define PHP_GIT2_INDEXER_PROGRESS_INTERVAL 100
+
+/* calls the php progress callback at most every interval_ms, and always when forced */
+static int php_git2_indexer_progress_report(php_git2_indexer_progress *progress, int force)
+{
+	zval *param_stats = NULL, *retval_ptr = NULL;
+	git_transfer_progress stats;
+	long now, retval = 0;
+
+	if (progress->cb == NULL) {
+		return 0;
+	}
+	now = php_git2_now_ms();
+	if (!force && now - progress->last_ms < progress->interval_ms) {
+		return 0;
+	}
+	progress->last_ms = now;
+	/* the append worker may be copying newer stats in */
+#ifndef PHP_WIN32
+	if (progress->lock != NULL) {
+		pthread_mutex_lock(progress->lock);
+		memcpy(&stats, &progress->stats, sizeof(git_transfer_progress));
+		pthread_mutex_unlock(progress->lock);
+	} else
+#endif
+	memcpy(&stats, &progress->stats, sizeof(git_transfer_progress));
+	{
+		GIT2_TSRMLS_SET(progress->cb->tsrm_ls)
+
+		Z_ADDREF_P(progress->cb->payload);
+		php_git2_git_transfer_progress_to_array(&stats, &param_stats TSRMLS_CC);
+		if (php_git2_call_function_v(progress->cb->fci, progress->cb->fcc TSRMLS_CC, &retval_ptr, 2,
+			&param_stats, &progress->cb->payload)) {
+			return GIT_EUSER;
+		}
+		if (retval_ptr) {
+			convert_to_long(retval_ptr);
+			retval = Z_LVAL_P(retval_ptr);
+			zval_ptr_dtor(&retval_ptr);
+		}
+	}
+	return retval;
+}
+
+static int php_git2_indexer_progress_cb(const git_transfer_progress *stats, void *payload)
+{
+	php_git2_indexer_progress *progress = (php_git2_indexer_progress*)payload;
+
+#ifndef PHP_WIN32
+	if (progress->lock != NULL) {
+		/* called on the append worker, php is reached later from the calling thread */
+		pthread_mutex_lock(progress->lock);
+		memcpy(&progress->stats, stats, sizeof(git_transfer_progress));
+		progress->pending = 1;
+		pthread_mutex_unlock(progress->lock);
+		return 0;
+	}
+#endif
+	memcpy(&progress->stats, stats, sizeof(git_transfer_progress));
+	return php_git2_indexer_progress_report(progress, 0);
+}
+
+void php_git2_indexer_progress_free(php_git2_indexer_progress *progress)
+{
+	if (progress->cb != NULL) {
+		php_git2_cb_free(progress->cb);
+	}
+	efree(progress);
+}
+
+/* {{{ proto resource git_indexer_new(string $path, long $mode, resource $odb, Callable $progress_cb, $progress_cb_payload[, long $progress_interval_ms])
+  $odb and $progress_cb may be null. progress is reported at most every $progress_interval_ms (100 by default) */
 PHP_FUNCTION(git_indexer_new)
 {
 	php_git2_t *result = NULL, *_odb = NULL;
+	php_git2_indexer_progress *progress;
 	git_indexer *out = NULL;
 	char *path = NULL;
 	int path_len = 0, error = 0;
-	long mode = 0;
+	long mode = 0, interval = PHP_GIT2_INDEXER_PROGRESS_INTERVAL;
 	zval *odb = NULL, *progress_cb_payload = NULL;
 	zend_fcall_info fci = empty_fcall_info;
 	zend_fcall_info_cache fcc = empty_fcall_info_cache;
-	php_git2_cb_t *cb = NULL;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
-		"slrfz", &path, &path_len, &mode, &odb, &fci, &fcc, &progress_cb_payload) == FAILURE) {
+		"slr!f!z|l", &path, &path_len, &mode, &odb, &fci, &fcc, &progress_cb_payload, &interval) == FAILURE) {
 		return;
 	}
 
-	ZEND_FETCH_RESOURCE(_odb, php_git2_t*, &odb, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
-	if (php_git2_cb_init(&cb, &fci, &fcc, progress_cb_payload TSRMLS_CC)) {
+	if (odb != NULL) {
+		ZEND_FETCH_RESOURCE(_odb, php_git2_t*, &odb, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	}
+	progress = (php_git2_indexer_progress*)ecalloc(1, sizeof(php_git2_indexer_progress));
+	progress->interval_ms = interval;
+	if (ZEND_FCI_INITIALIZED(fci) && php_git2_cb_init(&progress->cb, &fci, &fcc, progress_cb_payload TSRMLS_CC)) {
+		efree(progress);
 		RETURN_FALSE;
 	}
-	//error = git_indexer_new(&out, path, mode, PHP_GIT2_V(_odb, odb), progress_cb, cb);
+	error = git_indexer_new(&out, path, mode, _odb ? PHP_GIT2_V(_odb, odb) : NULL, php_git2_indexer_progress_cb, progress);
 	if (php_git2_check_error(error, "git_indexer_new" TSRMLS_CC)) {
+		php_git2_indexer_progress_free(progress);
 		RETURN_FALSE;
 	}
 	if (php_git2_make_resource(&result, PHP_GIT2_TYPE_INDEXER, out, 1 TSRMLS_CC)) {
+		git_indexer_free(out);
+		php_git2_indexer_progress_free(progress);
 		RETURN_FALSE;
 	}
+	result->priv = progress;
 	ZVAL_RESOURCE(return_value, GIT2_RVAL_P(result));
 }
 /* }}} */
 
-/* {{{ proto long git_indexer_append(resource $idx,  $data, long $size,  $stats)
+/* {{{ proto bool git_indexer_append(resource $idx, string $data)
  */
 PHP_FUNCTION(git_indexer_append)
 {
+	zval *idx = NULL;
+	php_git2_t *_idx = NULL;
+	php_git2_indexer_progress *progress;
+	char *data = NULL;
+	int data_len = 0, error = 0;
 
-//	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
-//		"r<void>l<git_transfer_progress>", &idx, &data, &size, &stats) == FAILURE) {
-//		return;
-//	}
-//
-//	ZEND_FETCH_RESOURCE(_idx, php_git2_t*, &idx, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
-//	result = git_indexer_append(PHP_GIT2_V(_idx, indexer), data, size, stats);
-//	RETURN_LONG(result);
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rs", &idx, &data, &data_len) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_idx, php_git2_t*, &idx, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	progress = (php_git2_indexer_progress*)_idx->priv;
+	error = git_indexer_append(PHP_GIT2_V(_idx, indexer), data, data_len, &progress->work);
+	if (php_git2_check_error(error, "git_indexer_append" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_TRUE;
 }
 /* }}} */
 
-/* {{{ proto long git_indexer_commit(resource $idx,  $stats)
- */
+/* reads the next chunk into buf, n is 0 at the end of the stream. an empty read before the end
+   (a non blocking pipe or socket) waits until the stream is readable again instead of spinning,
+   for at most PHP_GIT2_INDEXER_READ_TIMEOUT_MS. returns -1 with the reason in giterr_last() */
+static int php_git2_indexer_read(php_stream *stream, char *buf, size_t chunk, size_t *n TSRMLS_DC)
+{
+	php_socket_t fd;
+	int ready;
+
+	for (;;) {
+		*n = php_stream_read(stream, buf, chunk);
+		if (*n > 0 || php_stream_eof(stream)) {
+			return 0;
+		}
+		if (php_stream_cast(stream, PHP_STREAM_AS_FD_FOR_SELECT | PHP_STREAM_CAST_INTERNAL, (void**)&fd, 0) != SUCCESS) {
+			giterr_set_str(GITERR_INDEXER, "the stream returned no data before its end and cannot be waited on");
+			return -1;
+		}
+		ready = php_pollfd_for_ms(fd, PHP_POLLREADABLE, PHP_GIT2_INDEXER_READ_TIMEOUT_MS);
+		if (ready == 0) {
+			giterr_set_str(GITERR_INDEXER, "timed out waiting for pack data");
+			return -1;
+		}
+		if (ready < 0) {
+			giterr_set_str(GITERR_OS, "failed to wait for pack data");
+			return -1;
+		}
+	}
+}
+
+#ifndef PHP_WIN32
+/* two buffers: php fills one from the stream while a worker feeds the other to the indexer */
+typedef struct php_git2_indexer_pipe {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	git_indexer *indexer;
+	php_git2_indexer_progress *progress;
+	char *buf[2];
+	size_t len[2];
+	int full[2];
+	int done;
+	int error;
+	char *message;
+} php_git2_indexer_pipe;
+
+static void *php_git2_indexer_pipe_worker(void *arg)
+{
+	php_git2_indexer_pipe *pipe = (php_git2_indexer_pipe*)arg;
+	const git_error *e;
+	int slot = 0, error;
+
+	pthread_mutex_lock(&pipe->lock);
+	for (;;) {
+		while (!pipe->full[slot] && !pipe->done) {
+			pthread_cond_wait(&pipe->cond, &pipe->lock);
+		}
+		if (!pipe->full[slot]) {
+			break;
+		}
+		pthread_mutex_unlock(&pipe->lock);
+		error = git_indexer_append(pipe->indexer, pipe->buf[slot], pipe->len[slot], &pipe->progress->work);
+		pthread_mutex_lock(&pipe->lock);
+		pipe->full[slot] = 0;
+		if (error != 0) {
+			e = giterr_last();
+			pipe->error = error;
+			pipe->message = (e && e->message) ? strdup(e->message) : NULL;
+			pthread_cond_broadcast(&pipe->cond);
+			break;
+		}
+		pthread_cond_broadcast(&pipe->cond);
+		slot ^= 1;
+	}
+	pthread_mutex_unlock(&pipe->lock);
+	return NULL;
+}
+
+static int php_git2_indexer_append_pipelined(git_indexer *indexer, php_git2_indexer_progress *progress,
+	php_stream *stream, size_t chunk, size_t *total TSRMLS_DC)
+{
+	php_git2_indexer_pipe pipe;
+	pthread_t tid;
+	size_t n;
+	int slot = 0, error = 0, pending;
+
+	memset(&pipe, 0, sizeof(pipe));
+	pipe.buf[0] = (char*)malloc(chunk);
+	pipe.buf[1] = (char*)malloc(chunk);
+	if (pipe.buf[0] == NULL || pipe.buf[1] == NULL) {
+		free(pipe.buf[0]);
+		free(pipe.buf[1]);
+		return -1;
+	}
+	pipe.indexer = indexer;
+	pipe.progress = progress;
+	pthread_mutex_init(&pipe.lock, NULL);
+	pthread_cond_init(&pipe.cond, NULL);
+	progress->lock = &pipe.lock;
+	if (pthread_create(&tid, NULL, php_git2_indexer_pipe_worker, &pipe) != 0) {
+		progress->lock = NULL;
+		pthread_cond_destroy(&pipe.cond);
+		pthread_mutex_destroy(&pipe.lock);
+		free(pipe.buf[0]);
+		free(pipe.buf[1]);
+		return -1;
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&pipe.lock);
+		while (pipe.full[slot] && !pipe.error) {
+			pthread_cond_wait(&pipe.cond, &pipe.lock);
+		}
+		pending = progress->pending;
+		progress->pending = 0;
+		error = pipe.error;
+		pthread_mutex_unlock(&pipe.lock);
+		if (error != 0) {
+			break;
+		}
+		if (pending && (error = php_git2_indexer_progress_report(progress, 0)) != 0) {
+			break;
+		}
+		if ((error = php_git2_indexer_read(stream, pipe.buf[slot], chunk, &n TSRMLS_CC)) != 0 || n == 0) {
+			break;
+		}
+		*total += n;
+		pthread_mutex_lock(&pipe.lock);
+		pipe.len[slot] = n;
+		pipe.full[slot] = 1;
+		pthread_cond_broadcast(&pipe.cond);
+		pthread_mutex_unlock(&pipe.lock);
+		slot ^= 1;
+	}
+
+	pthread_mutex_lock(&pipe.lock);
+	pipe.done = 1;
+	pthread_cond_broadcast(&pipe.cond);
+	pthread_mutex_unlock(&pipe.lock);
+	pthread_join(tid, NULL);
+	progress->lock = NULL;
+
+	if (error == 0 && pipe.error != 0) {
+		error = pipe.error;
+	}
+	if (pipe.message != NULL) {
+		giterr_set_str(GITERR_INDEXER, pipe.message);
+		free(pipe.message);
+	}
+	if (error == 0 && progress->pending) {
+		progress->pending = 0;
+		error = php_git2_indexer_progress_report(progress, 0);
+	}
+	pthread_cond_destroy(&pipe.cond);
+	pthread_mutex_destroy(&pipe.lock);
+	free(pipe.buf[0]);
+	free(pipe.buf[1]);
+	return error;
+}
+#endif
+
+/* feeds indexer from stream until its end in chunk sized reads. with threads > 1
+   reading the next chunk overlaps with indexing the last one */
+int php_git2_indexer_append_from_stream(git_indexer *indexer, php_git2_indexer_progress *progress,
+	php_stream *stream, size_t chunk, long threads, size_t *total TSRMLS_DC)
+{
+	size_t n;
+	char *buf;
+	int error = 0;
+
+#ifndef PHP_WIN32
+	if (threads > 1) {
+		return php_git2_indexer_append_pipelined(indexer, progress, stream, chunk, total TSRMLS_CC);
+	}
+#endif
+	buf = (char*)emalloc(chunk);
+	for (;;) {
+		if ((error = php_git2_indexer_read(stream, buf, chunk, &n TSRMLS_CC)) != 0 || n == 0) {
+			break;
+		}
+		*total += n;
+		error = git_indexer_append(indexer, buf, n, &progress->work);
+		if (error != 0) {
+			break;
+		}
+	}
+	efree(buf);
+	return error;
+}
+
+/* {{{ proto long git_indexer_append_stream(resource $idx, resource $stream[, long $chunk_size[, long $threads]])
+  feeds the indexer from a php stream until its end in $chunk_size reads (1MiB by default).
+  with $threads > 1 reading the next chunk overlaps with indexing the last one. a non blocking
+  stream is waited on for up to 30 seconds at a time. returns the bytes consumed */
+PHP_FUNCTION(git_indexer_append_stream)
+{
+	zval *idx = NULL, *zstream = NULL;
+	php_git2_t *_idx = NULL;
+	php_stream *stream;
+	long chunk = PHP_GIT2_INDEXER_CHUNK_SIZE, threads = 2;
+	size_t total = 0;
+	int error = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rr|ll", &idx, &zstream, &chunk, &threads) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_idx, php_git2_t*, &idx, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	php_stream_from_zval(stream, &zstream);
+	if (chunk <= 0) {
+		chunk = PHP_GIT2_INDEXER_CHUNK_SIZE;
+	}
+
+	error = php_git2_indexer_append_from_stream(PHP_GIT2_V(_idx, indexer), (php_git2_indexer_progress*)_idx->priv,
+		stream, chunk, threads, &total TSRMLS_CC);
+	if (php_git2_check_error(error, "git_indexer_append_stream" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_LONG(total);
+}
+/* }}} */
+
+/* {{{ proto array git_indexer_commit(resource $idx)
+  resolves the deltas and writes the index, then reports the final progress */
 PHP_FUNCTION(git_indexer_commit)
 {
+	zval *idx = NULL, *stats = NULL;
+	php_git2_t *_idx = NULL;
+	php_git2_indexer_progress *progress;
+	int error = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &idx) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_idx, php_git2_t*, &idx, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	progress = (php_git2_indexer_progress*)_idx->priv;
+	error = git_indexer_commit(PHP_GIT2_V(_idx, indexer), &progress->work);
+	if (php_git2_check_error(error, "git_indexer_commit" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	memcpy(&progress->stats, &progress->work, sizeof(git_transfer_progress));
+	php_git2_indexer_progress_report(progress, 1);
+	php_git2_git_transfer_progress_to_array(&progress->stats, &stats TSRMLS_CC);
+	RETURN_ZVAL(stats, 0, 1);
+}
+/* }}} */
+
+/* {{{ proto array git_indexer_stats(resource $idx)
+ */
+PHP_FUNCTION(git_indexer_stats)
+{
+	zval *idx = NULL, *stats = NULL;
+	php_git2_t *_idx = NULL;
 
-//	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
-//		"r<git_transfer_progress>", &idx, &stats) == FAILURE) {
-//		return;
-//	}
-//
-//	ZEND_FETCH_RESOURCE(_idx, php_git2_t*, &idx, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
-//	result = git_indexer_commit(PHP_GIT2_V(_idx, indexer), stats);
-//	RETURN_LONG(result);
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &idx) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_idx, php_git2_t*, &idx, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	php_git2_git_transfer_progress_to_array(&((php_git2_indexer_progress*)_idx->priv)->work, &stats TSRMLS_CC);
+	RETURN_ZVAL(stats, 0, 1);
 }
 /* }}} */
 
@@ -26,25 +26,58 @@
 #ifndef PHP_GIT2_INDEXER_H
 #define PHP_GIT2_INDEXER_H
 
-ZEND_BEGIN_ARG_INFO_EX(arginfo_git_indexer_new, 0, 0, 6)
-	ZEND_ARG_INFO(0, out)
+#ifndef PHP_WIN32
+#include <pthread.h>
+#endif
+
+#define PHP_GIT2_INDEXER_CHUNK_SIZE (1024 * 1024)
+#define PHP_GIT2_INDEXER_READ_TIMEOUT_MS 30000
+
+/* progress of an indexer resource; work is what libgit2 updates, stats the last copy handed to php */
+typedef struct php_git2_indexer_progress {
+	php_git2_cb_t *cb;
+	long interval_ms;
+	long last_ms;
+	git_transfer_progress work;
+	git_transfer_progress stats;
+	int pending;
+#ifndef PHP_WIN32
+	pthread_mutex_t *lock;
+#endif
+} php_git2_indexer_progress;
+
+void php_git2_indexer_progress_free(php_git2_indexer_progress *progress);
+
+int php_git2_indexer_append_from_stream(git_indexer *indexer, php_git2_indexer_progress *progress,
+	php_stream *stream, size_t chunk, long threads, size_t *total TSRMLS_DC);
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_indexer_new, 0, 0, 5)
 	ZEND_ARG_INFO(0, path)
 	ZEND_ARG_INFO(0, mode)
 	ZEND_ARG_INFO(0, odb)
 	ZEND_ARG_INFO(0, progress_cb)
 	ZEND_ARG_INFO(0, progress_cb_payload)
+	ZEND_ARG_INFO(0, progress_interval_ms)
 ZEND_END_ARG_INFO()
 
-ZEND_BEGIN_ARG_INFO_EX(arginfo_git_indexer_append, 0, 0, 4)
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_indexer_append, 0, 0, 2)
 	ZEND_ARG_INFO(0, idx)
 	ZEND_ARG_INFO(0, data)
-	ZEND_ARG_INFO(0, size)
-	ZEND_ARG_INFO(0, stats)
 ZEND_END_ARG_INFO()
 
-ZEND_BEGIN_ARG_INFO_EX(arginfo_git_indexer_commit, 0, 0, 2)
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_indexer_append_stream, 0, 0, 2)
+	ZEND_ARG_INFO(0, idx)
+	ZEND_ARG_INFO(0, stream)
+	ZEND_ARG_INFO(0, chunk_size)
+	ZEND_ARG_INFO(0, threads)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_indexer_commit, 0, 0, 1)
+	ZEND_ARG_INFO(0, idx)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_indexer_stats, 0, 0, 1)
 	ZEND_ARG_INFO(0, idx)
-	ZEND_ARG_INFO(0, stats)
 ZEND_END_ARG_INFO()
 
 ZEND_BEGIN_ARG_INFO_EX(arginfo_git_indexer_hash, 0, 0, 1)
@@ -55,18 +88,26 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_git_indexer_free, 0, 0, 1)
 	ZEND_ARG_INFO(0, idx)
 ZEND_END_ARG_INFO()
 
-/* {{{ proto resource git_indexer_new(string $path, long $mode, resource $odb,  $progress_cb,  $progress_cb_payload)
+/* {{{ proto resource git_indexer_new(string $path, long $mode, resource $odb,  $progress_cb,  $progress_cb_payload[, long $progress_interval_ms])
  */
 PHP_FUNCTION(git_indexer_new);
 
-/* {{{ proto long git_indexer_append(resource $idx,  $data, long $size,  $stats)
+/* {{{ proto bool git_indexer_append(resource $idx, string $data)
  */
 PHP_FUNCTION(git_indexer_append);
 
-/* {{{ proto long git_indexer_commit(resource $idx,  $stats)
+/* {{{ proto long git_indexer_append_stream(resource $idx, resource $stream[, long $chunk_size[, long $threads]])
+ */
+PHP_FUNCTION(git_indexer_append_stream);
+
+/* {{{ proto array git_indexer_commit(resource $idx)
  */
 PHP_FUNCTION(git_indexer_commit);
 
+/* {{{ proto array git_indexer_stats(resource $idx)
+ */
+PHP_FUNCTION(git_indexer_stats);
+
 /* {{{ proto resource git_indexer_hash(resource $idx)
  */
 PHP_FUNCTION(git_indexer_hash);
@@ -1,6 +1,10 @@
 #include "php_git2.h"
 #include "php_git2_priv.h"
 #include "packbuilder.h"
+#include "bitmap.h"
+#include "ext/standard/sha1.h"
+#include <sys/stat.h>
+#include <zlib.h>
 
 static int php_git2_git_packbuilder_progress(
 	int stage,
@@ -82,6 +86,18 @@ static int php_git2_git_transfer_progress_callback(const git_transfer_progress *
 	return retval;
 }
 
+static php_git2_packbuilder_state *php_git2_packbuilder_state_get(php_git2_t *pb)
+{
+	php_git2_packbuilder_state *state;
+
+	if (pb->priv == NULL) {
+		state = (php_git2_packbuilder_state*)ecalloc(1, sizeof(php_git2_packbuilder_state));
+		state->compression = -1;
+		pb->priv = state;
+	}
+	return (php_git2_packbuilder_state*)pb->priv;
+}
+
 /* {{{ proto resource git_packbuilder_new(resource $repo)
  */
 PHP_FUNCTION(git_packbuilder_new)
@@ -161,6 +177,7 @@ PHP_FUNCTION(git_packbuilder_insert_tree)
 	php_git2_t *_pb = NULL;
 	char *id = NULL;
 	git_oid __id = {0};
+	long start;
 	
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
 		"rs", &pb, &id, &id_len) == FAILURE) {
@@ -171,7 +188,9 @@ PHP_FUNCTION(git_packbuilder_insert_tree)
 	if (git_oid_fromstrn(&__id, id, id_len)) {
 		RETURN_FALSE;
 	}
+	start = php_git2_now_ms();
 	result = git_packbuilder_insert_tree(PHP_GIT2_V(_pb, packbuilder), &__id);
+	php_git2_packbuilder_state_get(_pb)->insert_ms += php_git2_now_ms() - start;
 	RETURN_LONG(result);
 }
 /* }}} */
@@ -185,6 +204,7 @@ PHP_FUNCTION(git_packbuilder_insert_commit)
 	php_git2_t *_pb = NULL;
 	char *id = NULL;
 	git_oid __id = {0};
+	long start;
 	
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
 		"rs", &pb, &id, &id_len) == FAILURE) {
@@ -195,13 +215,56 @@ PHP_FUNCTION(git_packbuilder_insert_commit)
 	if (git_oid_fromstrn(&__id, id, id_len)) {
 		RETURN_FALSE;
 	}
+	start = php_git2_now_ms();
 	result = git_packbuilder_insert_commit(PHP_GIT2_V(_pb, packbuilder), &__id);
+	php_git2_packbuilder_state_get(_pb)->insert_ms += php_git2_now_ms() - start;
 	RETURN_LONG(result);
 }
 /* }}} */
 
+/* {{{ proto long git_packbuilder_insert_range(resource $pb, resource $repo, string $range)
+  inserts everything reachable from "<rev>" or "<from>..<to>", history and trees included.
+  with a .bitmap next to a pack the set is ORed together from commit bitmaps instead of
+  walked. returns the number of objects in the builder */
+PHP_FUNCTION(git_packbuilder_insert_range)
+{
+	zval *pb = NULL, *repo = NULL;
+	php_git2_t *_pb = NULL, *_repo = NULL;
+	php_git2_bitmap_index *index = NULL;
+	php_git2_bitmap_reach reach;
+	char *range = NULL;
+	int range_len = 0, error = 0;
+	long start;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rrs", &pb, &repo, &range, &range_len) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_pb, php_git2_t*, &pb, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	start = php_git2_now_ms();
+	if (php_git2_bitmap_index_open(&index, PHP_GIT2_V(_repo, repository) TSRMLS_CC)) {
+		giterr_clear();
+		index = NULL;
+	}
+	error = php_git2_bitmap_reach_range(&reach, index, PHP_GIT2_V(_repo, repository), range);
+	if (error == 0) {
+		error = php_git2_bitmap_reach_insert(&reach, index, PHP_GIT2_V(_repo, repository), PHP_GIT2_V(_pb, packbuilder));
+		php_git2_bitmap_reach_free(&reach);
+	}
+	php_git2_bitmap_index_free(index);
+	php_git2_packbuilder_state_get(_pb)->insert_ms += php_git2_now_ms() - start;
+	if (php_git2_check_error(error, "git_packbuilder_insert_range" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_LONG(git_packbuilder_object_count(PHP_GIT2_V(_pb, packbuilder)));
+}
+/* }}} */
+
 /* {{{ proto long git_packbuilder_write(resource $pb, string $path, long $mode,  $progress_cb,  $progress_cb_payload)
- */
+  libgit2's own write unless git_packbuilder_set_options() set a compression level, then the
+  pack is recompressed and counted on its way into the indexer */
 PHP_FUNCTION(git_packbuilder_write)
 {
 	int result = 0, path_len = 0;
@@ -222,7 +285,8 @@ PHP_FUNCTION(git_packbuilder_write)
 	if (php_git2_cb_init(&cb, &fci, &fcc, progress_cb_payload TSRMLS_CC)) {
 		RETURN_FALSE;
 	}
-	result = git_packbuilder_write(PHP_GIT2_V(_pb, packbuilder), path, mode, php_git2_git_transfer_progress_callback, cb);
+	result = php_git2_packbuilder_write_pack(PHP_GIT2_V(_pb, packbuilder), php_git2_packbuilder_state_get(_pb),
+		path, mode, php_git2_git_transfer_progress_callback, cb);
 	php_git2_cb_free(cb);
 	RETURN_LONG(result);
 }
@@ -235,6 +299,7 @@ PHP_FUNCTION(git_packbuilder_hash)
 	const git_oid  *result = NULL;
 	zval *pb = NULL;
 	php_git2_t *_pb = NULL;
+	php_git2_packbuilder_state *state;
 	char __result[GIT2_OID_HEXSIZE] = {0};
 	
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
@@ -243,20 +308,533 @@ PHP_FUNCTION(git_packbuilder_hash)
 	}
 	
 	ZEND_FETCH_RESOURCE(_pb, php_git2_t*, &pb, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
-	result = git_packbuilder_hash(PHP_GIT2_V(_pb, packbuilder));
+	state = php_git2_packbuilder_state_get(_pb);
+	result = state->has_pack_id ? &state->pack_id : git_packbuilder_hash(PHP_GIT2_V(_pb, packbuilder));
 	git_oid_fmt(__result, result);
 	RETURN_STRING(__result, 1);
 }
 /* }}} */
 
+#define PHP_GIT2_PACK_OBJ_OFS_DELTA 6
+#define PHP_GIT2_PACK_OBJ_REF_DELTA 7
+#define PHP_GIT2_PACK_SCRATCH_SIZE 65536
+
+enum {
+	PHP_GIT2_PACK_STAGE_HEADER,
+	PHP_GIT2_PACK_STAGE_OBJECT,
+	PHP_GIT2_PACK_STAGE_OFS,
+	PHP_GIT2_PACK_STAGE_REF,
+	PHP_GIT2_PACK_STAGE_DATA,
+	PHP_GIT2_PACK_STAGE_TRAILER,
+	PHP_GIT2_PACK_STAGE_DONE
+};
+
+typedef struct php_git2_packbuilder_sink php_git2_packbuilder_sink;
+
+/* follows the pack libgit2 streams out object by object to count whole objects and deltas.
+   with a compression level set every object is inflated and deflated again at that level,
+   ofs-delta distances and the trailer are rewritten to match the new sizes */
+typedef struct php_git2_pack_rewriter {
+	php_git2_packbuilder_state *state;
+	int recompress;
+	int stage;
+	unsigned char header[32];
+	size_t header_len;
+	uint32_t objects;
+	uint32_t seen;
+	int type;
+	uint64_t in_offset;
+	uint64_t out_offset;
+	uint64_t object_in;
+	uint64_t object_out;
+	uint64_t *in_offsets;
+	uint64_t *out_offsets;
+	size_t offsets_alloc;
+	z_stream inflater;
+	z_stream deflater;
+	PHP_SHA1_CTX sha;
+	unsigned char scratch[PHP_GIT2_PACK_SCRATCH_SIZE];
+	unsigned char deflated[PHP_GIT2_PACK_SCRATCH_SIZE];
+} php_git2_pack_rewriter;
+
+/* where the pack goes: an indexer writing it to disk, a php callback, or a stream */
+struct php_git2_packbuilder_sink {
+	git_indexer *indexer;
+	git_transfer_progress *indexer_stats;
+	php_git2_cb_t *cb;
+	php_git2_stream_writer *writer;
+	php_git2_sideband_writer *sideband;
+	php_git2_pack_rewriter *rewriter;
+	php_git2_packbuilder_state *state;
+	long first_ms;
+};
+
+static int php_git2_packbuilder_sink_out(php_git2_packbuilder_sink *sink, const char *buf, size_t size)
+{
+	if (sink->indexer != NULL) {
+		return git_indexer_append(sink->indexer, buf, size, sink->indexer_stats);
+	}
+	if (sink->cb != NULL) {
+		return php_git2_git_packbuilder_foreach_cb((void*)buf, size, sink->cb);
+	}
+	if (sink->sideband != NULL) {
+		return php_git2_sideband_writer_write(sink->sideband, buf, size) ? GIT_EUSER : 0;
+	}
+	return php_git2_stream_writer_write(sink->writer, buf, size) ? GIT_EUSER : 0;
+}
+
+static int php_git2_pack_rewriter_emit(php_git2_packbuilder_sink *sink, const unsigned char *buf, size_t size)
+{
+	php_git2_pack_rewriter *rw = sink->rewriter;
+
+	if (size == 0) {
+		return 0;
+	}
+	if (rw->recompress) {
+		PHP_SHA1Update(&rw->sha, buf, size);
+	}
+	rw->out_offset += size;
+	rw->state->bytes_written += size;
+	return php_git2_packbuilder_sink_out(sink, (const char*)buf, size);
+}
+
+static int php_git2_pack_rewriter_fail(const char *message)
+{
+	giterr_set_str(GITERR_ZLIB, message);
+	return -1;
+}
+
+/* output offset of the object that started at in in libgit2's stream */
+static int php_git2_pack_rewriter_base(php_git2_pack_rewriter *rw, uint64_t in, uint64_t *out)
+{
+	size_t lo = 0, hi = rw->seen, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (rw->in_offsets[mid] == in) {
+			*out = rw->out_offsets[mid];
+			return 0;
+		}
+		if (rw->in_offsets[mid] < in) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return -1;
+}
+
+static int php_git2_pack_rewriter_object_end(php_git2_packbuilder_sink *sink)
+{
+	php_git2_pack_rewriter *rw = sink->rewriter;
+	int ret;
+
+	if (rw->recompress) {
+		do {
+			rw->deflater.next_out = rw->deflated;
+			rw->deflater.avail_out = sizeof(rw->deflated);
+			ret = deflate(&rw->deflater, Z_FINISH);
+			if (ret != Z_OK && ret != Z_STREAM_END) {
+				return php_git2_pack_rewriter_fail("failed to recompress pack object");
+			}
+			if (php_git2_pack_rewriter_emit(sink, rw->deflated, sizeof(rw->deflated) - rw->deflater.avail_out)) {
+				return GIT_EUSER;
+			}
+		} while (ret != Z_STREAM_END);
+		deflateReset(&rw->deflater);
+	}
+	inflateReset(&rw->inflater);
+	if (rw->type == PHP_GIT2_PACK_OBJ_OFS_DELTA || rw->type == PHP_GIT2_PACK_OBJ_REF_DELTA) {
+		rw->state->deltas_computed++;
+	} else {
+		rw->state->objects_whole++;
+	}
+	rw->seen++;
+	rw->stage = rw->seen < rw->objects ? PHP_GIT2_PACK_STAGE_OBJECT : PHP_GIT2_PACK_STAGE_TRAILER;
+	rw->header_len = 0;
+	return 0;
+}
+
+/* inflates object data from buf, returns the bytes that belonged to this object or -1 */
+static long php_git2_pack_rewriter_data(php_git2_packbuilder_sink *sink, const unsigned char *buf, size_t size)
+{
+	php_git2_pack_rewriter *rw = sink->rewriter;
+	size_t used;
+	int ret, end = 0;
+
+	rw->inflater.next_in = (Bytef*)buf;
+	rw->inflater.avail_in = (uInt)size;
+	while (!end && (rw->inflater.avail_in > 0 || rw->recompress)) {
+		rw->inflater.next_out = rw->scratch;
+		rw->inflater.avail_out = sizeof(rw->scratch);
+		ret = inflate(&rw->inflater, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END) {
+			end = 1;
+		} else if (ret == Z_BUF_ERROR && rw->inflater.avail_in == 0) {
+			break;
+		} else if (ret != Z_OK) {
+			return php_git2_pack_rewriter_fail("corrupt object in pack stream");
+		}
+		if (rw->recompress) {
+			rw->deflater.next_in = rw->scratch;
+			rw->deflater.avail_in = sizeof(rw->scratch) - rw->inflater.avail_out;
+			while (rw->deflater.avail_in > 0) {
+				rw->deflater.next_out = rw->deflated;
+				rw->deflater.avail_out = sizeof(rw->deflated);
+				if (deflate(&rw->deflater, Z_NO_FLUSH) == Z_STREAM_ERROR) {
+					return php_git2_pack_rewriter_fail("failed to recompress pack object");
+				}
+				if (php_git2_pack_rewriter_emit(sink, rw->deflated, sizeof(rw->deflated) - rw->deflater.avail_out)) {
+					return -1;
+				}
+			}
+			if (rw->inflater.avail_in == 0 && rw->inflater.avail_out != 0) {
+				break;
+			}
+		}
+	}
+	used = size - rw->inflater.avail_in;
+	if (used == 0 && !end) {
+		return php_git2_pack_rewriter_fail("corrupt object in pack stream");
+	}
+	if (!rw->recompress && php_git2_pack_rewriter_emit(sink, buf, used)) {
+		return -1;
+	}
+	if (end && php_git2_pack_rewriter_object_end(sink)) {
+		return -1;
+	}
+	return (long)used;
+}
+
+static int php_git2_pack_rewriter_object_header(php_git2_packbuilder_sink *sink)
+{
+	php_git2_pack_rewriter *rw = sink->rewriter;
+
+	if (rw->seen == rw->offsets_alloc) {
+		rw->offsets_alloc = rw->offsets_alloc ? rw->offsets_alloc * 2 : 1024;
+		rw->in_offsets = (uint64_t*)erealloc(rw->in_offsets, sizeof(uint64_t) * rw->offsets_alloc);
+		rw->out_offsets = (uint64_t*)erealloc(rw->out_offsets, sizeof(uint64_t) * rw->offsets_alloc);
+	}
+	rw->in_offsets[rw->seen] = rw->object_in;
+	rw->out_offsets[rw->seen] = rw->object_out;
+	rw->type = (rw->header[0] >> 4) & 7;
+	if (php_git2_pack_rewriter_emit(sink, rw->header, rw->header_len)) {
+		return GIT_EUSER;
+	}
+	rw->header_len = 0;
+	switch (rw->type) {
+		case PHP_GIT2_PACK_OBJ_OFS_DELTA:
+			rw->stage = PHP_GIT2_PACK_STAGE_OFS;
+			break;
+		case PHP_GIT2_PACK_OBJ_REF_DELTA:
+			rw->stage = PHP_GIT2_PACK_STAGE_REF;
+			break;
+		default:
+			rw->stage = PHP_GIT2_PACK_STAGE_DATA;
+			break;
+	}
+	return 0;
+}
+
+/* re-encodes the ofs-delta distance for the rewritten offsets */
+static int php_git2_pack_rewriter_ofs(php_git2_packbuilder_sink *sink)
+{
+	php_git2_pack_rewriter *rw = sink->rewriter;
+	unsigned char encoded[16];
+	uint64_t distance, base_out;
+	size_t i, pos;
+
+	if (!rw->recompress) {
+		return php_git2_pack_rewriter_emit(sink, rw->header, rw->header_len) ? GIT_EUSER : 0;
+	}
+	distance = rw->header[0] & 0x7f;
+	for (i = 1; i < rw->header_len; i++) {
+		distance = ((distance + 1) << 7) | (rw->header[i] & 0x7f);
+	}
+	if (distance > rw->object_in || php_git2_pack_rewriter_base(rw, rw->object_in - distance, &base_out)) {
+		return php_git2_pack_rewriter_fail("ofs-delta base outside of the pack stream");
+	}
+	distance = rw->object_out - base_out;
+	pos = sizeof(encoded) - 1;
+	encoded[pos] = (unsigned char)(distance & 0x7f);
+	while (distance >>= 7) {
+		encoded[--pos] = (unsigned char)(0x80 | (--distance & 0x7f));
+	}
+	return php_git2_pack_rewriter_emit(sink, encoded + pos, sizeof(encoded) - pos) ? GIT_EUSER : 0;
+}
+
+static int php_git2_pack_rewriter_feed(php_git2_packbuilder_sink *sink, const unsigned char *buf, size_t size)
+{
+	php_git2_pack_rewriter *rw = sink->rewriter;
+	unsigned char digest[20];
+	long used;
+	int error;
+
+	while (size > 0) {
+		used = 1;
+		switch (rw->stage) {
+			case PHP_GIT2_PACK_STAGE_HEADER:
+				rw->header[rw->header_len++] = *buf;
+				if (rw->header_len == 12) {
+					rw->objects = ((uint32_t)rw->header[8] << 24) | ((uint32_t)rw->header[9] << 16) |
+						((uint32_t)rw->header[10] << 8) | (uint32_t)rw->header[11];
+					if (php_git2_pack_rewriter_emit(sink, rw->header, 12)) {
+						return GIT_EUSER;
+					}
+					rw->header_len = 0;
+					rw->stage = rw->objects ? PHP_GIT2_PACK_STAGE_OBJECT : PHP_GIT2_PACK_STAGE_TRAILER;
+				}
+				break;
+			case PHP_GIT2_PACK_STAGE_OBJECT:
+				if (rw->header_len == 0) {
+					rw->object_in = rw->in_offset;
+					rw->object_out = rw->out_offset;
+				}
+				if (rw->header_len == sizeof(rw->header)) {
+					return php_git2_pack_rewriter_fail("corrupt object header in pack stream");
+				}
+				rw->header[rw->header_len++] = *buf;
+				if (!(*buf & 0x80) && (error = php_git2_pack_rewriter_object_header(sink))) {
+					return error;
+				}
+				break;
+			case PHP_GIT2_PACK_STAGE_OFS:
+				if (rw->header_len == 10) {
+					return php_git2_pack_rewriter_fail("corrupt ofs-delta in pack stream");
+				}
+				rw->header[rw->header_len++] = *buf;
+				if (!(*buf & 0x80)) {
+					if ((error = php_git2_pack_rewriter_ofs(sink))) {
+						return error;
+					}
+					rw->header_len = 0;
+					rw->stage = PHP_GIT2_PACK_STAGE_DATA;
+				}
+				break;
+			case PHP_GIT2_PACK_STAGE_REF:
+				rw->header[rw->header_len++] = *buf;
+				if (rw->header_len == GIT_OID_RAWSZ) {
+					if (php_git2_pack_rewriter_emit(sink, rw->header, GIT_OID_RAWSZ)) {
+						return GIT_EUSER;
+					}
+					rw->header_len = 0;
+					rw->stage = PHP_GIT2_PACK_STAGE_DATA;
+				}
+				break;
+			case PHP_GIT2_PACK_STAGE_DATA:
+				if ((used = php_git2_pack_rewriter_data(sink, buf, size)) < 0) {
+					return GIT_EUSER;
+				}
+				break;
+			case PHP_GIT2_PACK_STAGE_TRAILER:
+				rw->header[rw->header_len++] = *buf;
+				if (rw->header_len == 20) {
+					if (rw->recompress) {
+						PHP_SHA1Final(digest, &rw->sha);
+						rw->recompress = 0;
+						error = php_git2_pack_rewriter_emit(sink, digest, 20);
+					} else {
+						error = php_git2_pack_rewriter_emit(sink, rw->header, 20);
+					}
+					if (error) {
+						return GIT_EUSER;
+					}
+					rw->stage = PHP_GIT2_PACK_STAGE_DONE;
+				}
+				break;
+			default:
+				return php_git2_pack_rewriter_fail("trailing data after pack stream");
+		}
+		buf += used;
+		size -= used;
+		rw->in_offset += used;
+	}
+	return 0;
+}
+
+static php_git2_pack_rewriter *php_git2_pack_rewriter_new(php_git2_packbuilder_state *state)
+{
+	php_git2_pack_rewriter *rw;
+
+	rw = (php_git2_pack_rewriter*)ecalloc(1, sizeof(php_git2_pack_rewriter));
+	rw->state = state;
+	rw->stage = PHP_GIT2_PACK_STAGE_HEADER;
+	if (inflateInit(&rw->inflater) != Z_OK) {
+		efree(rw);
+		return NULL;
+	}
+	if (state->compression >= 0) {
+		if (deflateInit(&rw->deflater, (int)state->compression) != Z_OK) {
+			inflateEnd(&rw->inflater);
+			efree(rw);
+			return NULL;
+		}
+		rw->recompress = 1;
+		PHP_SHA1Init(&rw->sha);
+	}
+	return rw;
+}
+
+static void php_git2_pack_rewriter_free(php_git2_pack_rewriter *rw)
+{
+	inflateEnd(&rw->inflater);
+	if (rw->state->compression >= 0) {
+		deflateEnd(&rw->deflater);
+	}
+	if (rw->in_offsets != NULL) {
+		efree(rw->in_offsets);
+		efree(rw->out_offsets);
+	}
+	efree(rw);
+}
+
+static int php_git2_packbuilder_sink_cb(void *buf, size_t size, void *payload)
+{
+	php_git2_packbuilder_sink *sink = (php_git2_packbuilder_sink*)payload;
+
+	if (sink->first_ms == 0) {
+		sink->first_ms = php_git2_now_ms();
+	}
+	if (sink->rewriter != NULL) {
+		return php_git2_pack_rewriter_feed(sink, (const unsigned char*)buf, size);
+	}
+	if (sink->state != NULL) {
+		sink->state->bytes_written += size;
+	}
+	return php_git2_packbuilder_sink_out(sink, (const char*)buf, size);
+}
+
+/* runs git_packbuilder_foreach into sink. with state the bytes and the time until the first
+   byte (deltification) and of the write itself are recorded; only when a compression level is
+   set does the pack go through the rewriter, which also counts whole objects and deltas */
+static int php_git2_packbuilder_run(git_packbuilder *pb, php_git2_packbuilder_state *state, php_git2_packbuilder_sink *sink)
+{
+	long start, end;
+	int error;
+
+	sink->state = state;
+	if (state != NULL && state->compression >= 0 && (sink->rewriter = php_git2_pack_rewriter_new(state)) == NULL) {
+		giterr_set_str(GITERR_ZLIB, "failed to initialize zlib");
+		return -1;
+	}
+	start = php_git2_now_ms();
+	error = git_packbuilder_foreach(pb, php_git2_packbuilder_sink_cb, sink);
+	end = php_git2_now_ms();
+	if (sink->rewriter != NULL) {
+		if (error == 0 && sink->rewriter->stage != PHP_GIT2_PACK_STAGE_DONE) {
+			error = php_git2_pack_rewriter_fail("truncated pack stream");
+		}
+		php_git2_pack_rewriter_free(sink->rewriter);
+		sink->rewriter = NULL;
+	}
+	if (state != NULL) {
+		if (sink->first_ms == 0) {
+			sink->first_ms = end;
+		}
+		state->delta_ms += sink->first_ms - start;
+		state->write_ms += end - sink->first_ms;
+	}
+	return error;
+}
+
+/* writes the pack into writer, framed as side-band-64k channel 1 when sideband is set.
+   state is as for php_git2_packbuilder_run. the caller flushes the writer */
+int php_git2_packbuilder_write_stream(git_packbuilder *pb, php_git2_packbuilder_state *state, php_git2_stream_writer *writer, int sideband)
+{
+	php_git2_packbuilder_sink sink;
+	php_git2_sideband_writer *band = NULL;
+	int error;
+
+	memset(&sink, 0, sizeof(sink));
+	sink.writer = writer;
+	if (sideband) {
+		band = (php_git2_sideband_writer*)emalloc(sizeof(php_git2_sideband_writer));
+		php_git2_sideband_writer_init(band, writer, 1);
+		sink.sideband = band;
+	}
+	error = php_git2_packbuilder_run(pb, state, &sink);
+	if (band != NULL) {
+		if (error == 0 && php_git2_sideband_writer_flush(band)) {
+			error = GIT_EUSER;
+		}
+		efree(band);
+	}
+	return error;
+}
+
+/* git_packbuilder_write itself unless a compression level is set; then the stream goes through
+   the rewriter on its way to the indexer so the pack on disk is recompressed and counted like
+   a streamed one */
+int php_git2_packbuilder_write_pack(git_packbuilder *pb, php_git2_packbuilder_state *state, const char *path, unsigned int mode,
+	git_transfer_progress_callback progress_cb, void *progress_cb_payload)
+{
+	php_git2_packbuilder_sink sink;
+	git_transfer_progress stats;
+	git_indexer *indexer = NULL;
+	char pack[MAXPATHLEN], hex[GIT_OID_HEXSZ + 1];
+	struct stat st;
+	long start;
+	int error;
+
+	if (state == NULL || state->compression < 0) {
+		start = php_git2_now_ms();
+		error = git_packbuilder_write(pb, path, mode, progress_cb, progress_cb_payload);
+		if (error == 0 && state != NULL) {
+			state->write_ms += php_git2_now_ms() - start;
+			state->has_pack_id = 0;
+			git_oid_tostr(hex, sizeof(hex), git_packbuilder_hash(pb));
+			snprintf(pack, sizeof(pack), "%s/pack-%s.pack", path, hex);
+			if (stat(pack, &st) == 0) {
+				state->bytes_written += st.st_size;
+			}
+		}
+		return error;
+	}
+	memset(&sink, 0, sizeof(sink));
+	memset(&stats, 0, sizeof(stats));
+	if ((error = git_indexer_new(&indexer, path, mode, NULL, progress_cb, progress_cb_payload))) {
+		return error;
+	}
+	sink.indexer = indexer;
+	sink.indexer_stats = &stats;
+	error = php_git2_packbuilder_run(pb, state, &sink);
+	if (error == 0) {
+		error = git_indexer_commit(indexer, &stats);
+	}
+	if (error == 0 && state != NULL) {
+		git_oid_cpy(&state->pack_id, git_indexer_hash(indexer));
+		state->has_pack_id = 1;
+	}
+	git_indexer_free(indexer);
+	return error;
+}
+
+void php_git2_packbuilder_state_to_array(php_git2_packbuilder_state *state, zval *out)
+{
+	zval *time = NULL;
+
+	add_assoc_long_ex(out, ZEND_STRS("objects_whole"), state->objects_whole);
+	add_assoc_long_ex(out, ZEND_STRS("deltas_computed"), state->deltas_computed);
+	add_assoc_long_ex(out, ZEND_STRS("reused_objects"), 0);
+	add_assoc_long_ex(out, ZEND_STRS("reused_deltas"), 0);
+	add_assoc_long_ex(out, ZEND_STRS("bytes_written"), state->bytes_written);
+	add_assoc_long_ex(out, ZEND_STRS("compression"), state->compression);
+	MAKE_STD_ZVAL(time);
+	array_init(time);
+	add_assoc_long_ex(time, ZEND_STRS("insert"), state->insert_ms);
+	add_assoc_long_ex(time, ZEND_STRS("delta"), state->delta_ms);
+	add_assoc_long_ex(time, ZEND_STRS("write"), state->write_ms);
+	add_assoc_zval_ex(out, ZEND_STRS("time"), time);
+}
 
 /* {{{ proto long git_packbuilder_foreach(resource $pb, Callable $cb,  $payload)
- */
+  the pack is recompressed and counted as for git_packbuilder_write_stream() */
 PHP_FUNCTION(git_packbuilder_foreach)
 {
 	int result = 0;
 	zval *pb = NULL, *payload = NULL;
 	php_git2_t *_pb = NULL;
+	php_git2_packbuilder_sink sink;
 	zend_fcall_info fci = empty_fcall_info;
 	zend_fcall_info_cache fcc = empty_fcall_info_cache;
 	php_git2_cb_t *cb = NULL;
@@ -270,12 +848,140 @@ PHP_FUNCTION(git_packbuilder_foreach)
 	if (php_git2_cb_init(&cb, &fci, &fcc, payload TSRMLS_CC)) {
 		RETURN_FALSE;
 	}
-	result = git_packbuilder_foreach(PHP_GIT2_V(_pb, packbuilder), php_git2_git_packbuilder_foreach_cb, cb);
+	memset(&sink, 0, sizeof(sink));
+	sink.cb = cb;
+	result = php_git2_packbuilder_run(PHP_GIT2_V(_pb, packbuilder), php_git2_packbuilder_state_get(_pb), &sink);
 	php_git2_cb_free(cb);
 	RETURN_LONG(result);
 }
 /* }}} */
 
+/* {{{ proto long git_packbuilder_write_stream(resource $pb, resource $stream[, bool $sideband])
+  writes the pack straight into $stream through a 64KiB buffer. with $sideband it is framed as
+  side-band-64k channel 1 pkt-lines and ended by a flush-pkt, as upload-pack sends it.
+  objects are recompressed when git_packbuilder_set_options() asked for a compression level.
+  returns the number of bytes written or false */
+PHP_FUNCTION(git_packbuilder_write_stream)
+{
+	zval *pb = NULL, *zstream = NULL;
+	php_git2_t *_pb = NULL;
+	php_git2_stream_writer *writer;
+	php_stream *stream;
+	zend_bool sideband = 0;
+	size_t written;
+	int error = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rr|b", &pb, &zstream, &sideband) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_pb, php_git2_t*, &pb, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	php_stream_from_zval(stream, &zstream);
+
+	writer = (php_git2_stream_writer*)emalloc(sizeof(php_git2_stream_writer));
+	php_git2_stream_writer_init(writer, stream);
+	error = php_git2_packbuilder_write_stream(PHP_GIT2_V(_pb, packbuilder), php_git2_packbuilder_state_get(_pb), writer, sideband);
+	if (error == 0 && sideband && php_git2_pkt_flush(writer)) {
+		error = GIT_EUSER;
+	}
+	if (php_git2_stream_writer_flush(writer) && !error) {
+		error = GIT_EUSER;
+	}
+	written = writer->written;
+	efree(writer);
+	if (error == GIT_EUSER) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "failed to write to stream");
+		RETURN_FALSE;
+	}
+	if (php_git2_check_error(error, "git_packbuilder_write_stream" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_LONG(written);
+}
+/* }}} */
+
+/* {{{ proto bool git_packbuilder_set_options(resource $pb, array $options)
+  threads: delta search threads. compression: zlib level 0-9 objects are recompressed at
+  while git_packbuilder_write(), git_packbuilder_foreach() or git_packbuilder_write_stream()
+  write them, -1 keeps libgit2's level.
+  window, depth, delta_reuse and max_delta_cache are fixed inside the linked libgit2 and are
+  refused with a warning. returns false when any option was refused */
+PHP_FUNCTION(git_packbuilder_set_options)
+{
+	zval *pb = NULL, *options = NULL, **value;
+	php_git2_t *_pb = NULL;
+	php_git2_packbuilder_state *state;
+	HashPosition pos;
+	char *key;
+	uint key_len;
+	ulong num;
+	long lval;
+	int ok = 1;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"ra", &pb, &options) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_pb, php_git2_t*, &pb, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	state = php_git2_packbuilder_state_get(_pb);
+
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(options), &pos);
+		zend_hash_get_current_data_ex(Z_ARRVAL_P(options), (void**)&value, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(Z_ARRVAL_P(options), &pos)) {
+		if (zend_hash_get_current_key_ex(Z_ARRVAL_P(options), &key, &key_len, &num, 0, &pos) != HASH_KEY_IS_STRING) {
+			continue;
+		}
+		if (strcmp(key, "threads") == 0) {
+			lval = php_git2_zval_to_long(*value);
+			git_packbuilder_set_threads(PHP_GIT2_V(_pb, packbuilder), lval < 0 ? 0 : lval);
+		} else if (strcmp(key, "compression") == 0) {
+			lval = php_git2_zval_to_long(*value);
+			if (lval < -1 || lval > 9) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, "compression must be between -1 and 9");
+				ok = 0;
+				continue;
+			}
+			state->compression = lval;
+		} else if (strcmp(key, "window") == 0 || strcmp(key, "depth") == 0 ||
+			strcmp(key, "delta_reuse") == 0 || strcmp(key, "max_delta_cache") == 0) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "%s is not adjustable in the linked libgit2", key);
+			ok = 0;
+		} else {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "unknown packbuilder option %s", key);
+			ok = 0;
+		}
+	}
+	RETURN_BOOL(ok);
+}
+/* }}} */
+
+/* {{{ proto array git_packbuilder_stats(resource $pb)
+  what the last writes did: objects written whole, deltas computed, objects and deltas
+  reused from existing packs (libgit2 recomputes every delta, so these stay 0), bytes
+  written and milliseconds spent inserting, deltifying and writing. whole objects and deltas
+  are only counted while a compression level is set, the pack is not parsed otherwise */
+PHP_FUNCTION(git_packbuilder_stats)
+{
+	zval *pb = NULL;
+	php_git2_t *_pb = NULL;
+	php_git2_packbuilder_state *state;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &pb) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_pb, php_git2_t*, &pb, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	state = php_git2_packbuilder_state_get(_pb);
+
+	array_init(return_value);
+	add_assoc_long_ex(return_value, ZEND_STRS("objects"), git_packbuilder_object_count(PHP_GIT2_V(_pb, packbuilder)));
+	php_git2_packbuilder_state_to_array(state, return_value);
+}
+/* }}} */
+
 /* {{{ proto long git_packbuilder_object_count(resource $pb)
  */
 PHP_FUNCTION(git_packbuilder_object_count)
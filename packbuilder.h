@@ -26,6 +26,24 @@
 #ifndef PHP_GIT2_PACKBUILDER_H
 #define PHP_GIT2_PACKBUILDER_H
 
+/* tuning and counters of a packbuilder resource */
+typedef struct php_git2_packbuilder_state {
+	long compression; /* zlib level objects are recompressed at, -1 keeps libgit2's */
+	long objects_whole;
+	long deltas_computed;
+	long bytes_written;
+	long insert_ms;
+	long delta_ms;
+	long write_ms;
+	git_oid pack_id; /* name of the last pack written to disk, which recompression changes */
+	int has_pack_id;
+} php_git2_packbuilder_state;
+
+int php_git2_packbuilder_write_stream(git_packbuilder *pb, php_git2_packbuilder_state *state, php_git2_stream_writer *writer, int sideband);
+int php_git2_packbuilder_write_pack(git_packbuilder *pb, php_git2_packbuilder_state *state, const char *path, unsigned int mode,
+	git_transfer_progress_callback progress_cb, void *progress_cb_payload);
+void php_git2_packbuilder_state_to_array(php_git2_packbuilder_state *state, zval *out);
+
 ZEND_BEGIN_ARG_INFO_EX(arginfo_git_packbuilder_new, 0, 0, 1)
 	ZEND_ARG_INFO(0, repo)
 ZEND_END_ARG_INFO()
@@ -87,6 +105,27 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_git_packbuilder_free, 0, 0, 1)
 	ZEND_ARG_INFO(0, pb)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_packbuilder_write_stream, 0, 0, 2)
+	ZEND_ARG_INFO(0, pb)
+	ZEND_ARG_INFO(0, stream)
+	ZEND_ARG_INFO(0, sideband)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_packbuilder_insert_range, 0, 0, 3)
+	ZEND_ARG_INFO(0, pb)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, range)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_packbuilder_set_options, 0, 0, 2)
+	ZEND_ARG_INFO(0, pb)
+	ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_packbuilder_stats, 0, 0, 1)
+	ZEND_ARG_INFO(0, pb)
+ZEND_END_ARG_INFO()
+
 /* {{{ proto resource git_packbuilder_new(repo)
 */
 PHP_FUNCTION(git_packbuilder_new);
@@ -135,4 +174,20 @@ PHP_FUNCTION(git_packbuilder_set_callbacks);
 */
 PHP_FUNCTION(git_packbuilder_free);
 
+/* {{{ proto long git_packbuilder_write_stream(pb, stream[, sideband])
+*/
+PHP_FUNCTION(git_packbuilder_write_stream);
+
+/* {{{ proto long git_packbuilder_insert_range(pb, repo, range)
+*/
+PHP_FUNCTION(git_packbuilder_insert_range);
+
+/* {{{ proto bool git_packbuilder_set_options(pb, options)
+*/
+PHP_FUNCTION(git_packbuilder_set_options);
+
+/* {{{ proto array git_packbuilder_stats(pb)
+*/
+PHP_FUNCTION(git_packbuilder_stats);
+
 #endif
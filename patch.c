@@ -325,3 +325,41 @@ PHP_FUNCTION(git_patch_to_str)
 	free(string);
 }
 /* }}} */
+
+/* {{{ proto long git_patch_write(resource $patch, resource $stream)
+  returns the number of bytes written or false */
+PHP_FUNCTION(git_patch_write)
+{
+	int error = 0;
+	zval *patch = NULL, *zstream = NULL;
+	php_git2_t *_patch = NULL;
+	php_git2_stream_writer *writer;
+	php_stream *stream;
+	size_t written;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rr", &patch, &zstream) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_patch, php_git2_t*, &patch, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	php_stream_from_zval(stream, &zstream);
+
+	writer = (php_git2_stream_writer*)emalloc(sizeof(php_git2_stream_writer));
+	php_git2_stream_writer_init(writer, stream);
+	error = git_patch_print(PHP_GIT2_V(_patch, patch), php_git2_stream_writer_diff_line_cb, writer);
+	if (php_git2_stream_writer_flush(writer) && !error) {
+		error = GIT_EUSER;
+	}
+	written = writer->written;
+	efree(writer);
+	if (error == GIT_EUSER) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "failed to write to stream");
+		RETURN_FALSE;
+	}
+	if (php_git2_check_error(error, "git_patch_write" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_LONG(written);
+}
+/* }}} */
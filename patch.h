@@ -101,6 +101,11 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_git_patch_to_str, 0, 0, 1)
 	ZEND_ARG_INFO(0, patch)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_patch_write, 0, 0, 2)
+	ZEND_ARG_INFO(0, patch)
+	ZEND_ARG_INFO(0, stream)
+ZEND_END_ARG_INFO()
+
 /* {{{ proto resource git_patch_from_diff(diff, idx)
 */
 PHP_FUNCTION(git_patch_from_diff);
@@ -153,4 +158,8 @@ PHP_FUNCTION(git_patch_print);
 */
 PHP_FUNCTION(git_patch_to_str);
 
+/* {{{ proto long git_patch_write(patch, stream)
+*/
+PHP_FUNCTION(git_patch_write);
+
 #endif
\ No newline at end of file
@@ -66,7 +66,9 @@
 #include "push.h"
 #include "refspec.h"
 #include "graph.h"
+#include "serve.h"
 #include "blame.h"
+#include "bitmap.h"
 
 int git2_resource_handle;
 
@@ -118,6 +120,18 @@ void static destruct_git2(zend_rsrc_list_entry *rsrc TSRMLS_DC)
 			case PHP_GIT2_TYPE_FILTER_LIST:
 				git_filter_list_free(PHP_GIT2_V(resource, filter_list));
 				break;
+			case PHP_GIT2_TYPE_INDEXER:
+				git_indexer_free(PHP_GIT2_V(resource, indexer));
+				break;
+			case PHP_GIT2_TYPE_SIMILARITY_CACHE:
+				php_git2_similarity_cache_free(PHP_GIT2_V(resource, similarity_cache));
+				break;
+			case PHP_GIT2_TYPE_CHANGED_PATHS:
+				php_git2_changed_paths_free(PHP_GIT2_V(resource, changed_paths));
+				break;
+			case PHP_GIT2_TYPE_BLAME_CACHE:
+				php_git2_blame_cache_free(PHP_GIT2_V(resource, blame_cache));
+				break;
 			case PHP_GIT2_TYPE_ODB_BACKEND:
 			{
 				php_git2_odb_backend *backend = (php_git2_odb_backend*)PHP_GIT2_V(resource, odb_backend);
@@ -129,6 +143,35 @@ void static destruct_git2(zend_rsrc_list_entry *rsrc TSRMLS_DC)
 		}
 	}
 
+	if (resource->priv != NULL) {
+		switch (resource->type) {
+			case PHP_GIT2_TYPE_TREEBUILDER:
+				php_git2_treebuilder_children_free((HashTable*)resource->priv);
+				break;
+			case PHP_GIT2_TYPE_STATUS_LIST:
+				php_git2_status_untracked_free((php_git2_status_untracked*)resource->priv);
+				break;
+			case PHP_GIT2_TYPE_REPOSITORY:
+				php_git2_watcher_free((php_git2_watcher*)resource->priv);
+				break;
+			case PHP_GIT2_TYPE_DIFF:
+				efree(resource->priv);
+				break;
+			case PHP_GIT2_TYPE_REVWALK:
+				php_git2_revwalk_limit_free((php_git2_revwalk_limit*)resource->priv);
+				break;
+			case PHP_GIT2_TYPE_BLAME:
+				php_git2_blame_result_free((php_git2_blame_result*)resource->priv);
+				break;
+			case PHP_GIT2_TYPE_INDEXER:
+				php_git2_indexer_progress_free((php_git2_indexer_progress*)resource->priv);
+				break;
+			case PHP_GIT2_TYPE_PACKBUILDER:
+				efree(resource->priv);
+				break;
+		}
+	}
+
 	efree(resource);
 }
 
@@ -291,6 +334,18 @@ int php_git2_make_resource(php_git2_t **out, enum php_git2_resource_type type, v
 		case PHP_GIT2_TYPE_PUSH:
 			PHP_GIT2_V(result, push) = (git_push*)resource;
 			break;
+		case PHP_GIT2_TYPE_INDEXER:
+			PHP_GIT2_V(result, indexer) = (git_indexer*)resource;
+			break;
+		case PHP_GIT2_TYPE_SIMILARITY_CACHE:
+			PHP_GIT2_V(result, similarity_cache) = (php_git2_similarity_cache*)resource;
+			break;
+		case PHP_GIT2_TYPE_CHANGED_PATHS:
+			PHP_GIT2_V(result, changed_paths) = (php_git2_changed_paths*)resource;
+			break;
+		case PHP_GIT2_TYPE_BLAME_CACHE:
+			PHP_GIT2_V(result, blame_cache) = (php_git2_blame_cache*)resource;
+			break;
 		case PHP_GIT2_TYPE_FILTER:
 			PHP_GIT2_V(result, filter) = (git_filter*)resource;
 			break;
@@ -390,6 +445,12 @@ static zend_function_entry php_git2_functions[] = {
 	PHP_FE(git_repository_set_namespace, arginfo_git_repository_set_namespace)
 	PHP_FE(git_repository_is_shallow, arginfo_git_repository_is_shallow)
 	PHP_FE(git_repository_init_options_new, NULL)
+	PHP_FE(git_repository_watch, arginfo_git_repository_watch)
+	PHP_FE(git_repository_unwatch, arginfo_git_repository_unwatch)
+	PHP_FE(git_repository_watch_stats, arginfo_git_repository_watch_stats)
+	PHP_FE(git_repository_count_objects, arginfo_git_repository_count_objects)
+	PHP_FE(git_repository_write_bitmap, arginfo_git_repository_write_bitmap)
+	PHP_FE(git_repository_repack, arginfo_git_repository_repack)
 
 	/* index */
 	PHP_FE(git_index_open, arginfo_git_index_open)
@@ -426,6 +487,8 @@ static zend_function_entry php_git2_functions[] = {
 	PHP_FE(git_index_conflict_iterator_new, arginfo_git_index_conflict_iterator_new)
 	PHP_FE(git_index_conflict_next, arginfo_git_index_conflict_next)
 	PHP_FE(git_index_conflict_iterator_free, arginfo_git_index_conflict_iterator_free)
+	PHP_FE(git_index_entries, arginfo_git_index_entries)
+	PHP_FE(git_index_add_many, arginfo_git_index_add_many)
 
 	/* object */
 	PHP_FE(git_object_lookup, arginfo_git_object_lookup)
@@ -534,6 +597,8 @@ static zend_function_entry php_git2_functions[] = {
 	PHP_FE(git_treebuilder_remove, arginfo_git_treebuilder_remove)
 	PHP_FE(git_treebuilder_filter, arginfo_git_treebuilder_filter)
 	PHP_FE(git_treebuilder_write, arginfo_git_treebuilder_write)
+	PHP_FE(git_treebuilder_insert_path, arginfo_git_treebuilder_insert_path)
+	PHP_FE(git_treebuilder_write_recursive, arginfo_git_treebuilder_write_recursive)
 
 	/* blob */
 	PHP_FE(git_blob_create_frombuffer, arginfo_git_blob_create_frombuffer)
@@ -567,6 +632,11 @@ static zend_function_entry php_git2_functions[] = {
 	PHP_FE(git_revwalk_simplify_first_parent, arginfo_git_revwalk_simplify_first_parent)
 	PHP_FE(git_revwalk_free, arginfo_git_revwalk_free)
 	PHP_FE(git_revwalk_repository, arginfo_git_revwalk_repository)
+	PHP_FE(git_revwalk_limit_path, arginfo_git_revwalk_limit_path)
+	PHP_FE(git_revwalk_changed_paths_new, arginfo_git_revwalk_changed_paths_new)
+	PHP_FE(git_revwalk_changed_paths_update, arginfo_git_revwalk_changed_paths_update)
+	PHP_FE(git_revwalk_changed_paths_save, arginfo_git_revwalk_changed_paths_save)
+	PHP_FE(git_revwalk_changed_paths_stats, arginfo_git_revwalk_changed_paths_stats)
 
 	/* config */
 	PHP_FE(git_config_find_global, arginfo_git_config_find_global)
@@ -674,6 +744,8 @@ static zend_function_entry php_git2_functions[] = {
 	PHP_FE(git_status_list_free, arginfo_git_status_list_free)
 	PHP_FE(git_status_should_ignore, arginfo_git_status_should_ignore)
 	PHP_FE(git_status_options_new, NULL)
+	PHP_FE(git_status_list_untracked_stats, arginfo_git_status_list_untracked_stats)
+	PHP_FE(git_status_list_to_array, arginfo_git_status_list_to_array)
 
 	/* transport */
 	PHP_FE(git_transport_new, arginfo_git_transport_new)
@@ -705,6 +777,14 @@ static zend_function_entry php_git2_functions[] = {
 	PHP_FE(git_diff_print, arginfo_git_diff_print)
 	PHP_FE(git_diff_blobs, arginfo_git_diff_blobs)
 	PHP_FE(git_diff_blob_to_buffer, arginfo_git_diff_blob_to_buffer)
+	PHP_FE(git_diff_stats, arginfo_git_diff_stats)
+	PHP_FE(git_diff_tree_paths, arginfo_git_diff_tree_paths)
+	PHP_FE(git_diff_to_array, arginfo_git_diff_to_array)
+	PHP_FE(git_diff_patches, arginfo_git_diff_patches)
+	PHP_FE(git_diff_similarity_cache_new, arginfo_git_diff_similarity_cache_new)
+	PHP_FE(git_diff_similarity_cache_save, arginfo_git_diff_similarity_cache_save)
+	PHP_FE(git_diff_similarity_cache_stats, arginfo_git_diff_similarity_cache_stats)
+	PHP_FE(git_diff_write, arginfo_git_diff_write)
 
 	/* checkout */
 	PHP_FE(git_checkout_head, arginfo_git_checkout_head)
@@ -740,7 +820,9 @@ static zend_function_entry php_git2_functions[] = {
 	/* indexer */
 	PHP_FE(git_indexer_new, arginfo_git_indexer_new)
 	PHP_FE(git_indexer_append, arginfo_git_indexer_append)
+	PHP_FE(git_indexer_append_stream, arginfo_git_indexer_append_stream)
 	PHP_FE(git_indexer_commit, arginfo_git_indexer_commit)
+	PHP_FE(git_indexer_stats, arginfo_git_indexer_stats)
 	PHP_FE(git_indexer_hash, arginfo_git_indexer_hash)
 	PHP_FE(git_indexer_free, arginfo_git_indexer_free)
 
@@ -773,6 +855,7 @@ static zend_function_entry php_git2_functions[] = {
 	PHP_FE(git_patch_size, arginfo_git_patch_size)
 	PHP_FE(git_patch_print, arginfo_git_patch_print)
 	PHP_FE(git_patch_to_str, arginfo_git_patch_to_str)
+	PHP_FE(git_patch_write, arginfo_git_patch_write)
 
 	/* merge */
 	PHP_FE(git_merge_base, arginfo_git_merge_base)
@@ -879,9 +962,13 @@ static zend_function_entry php_git2_functions[] = {
 	PHP_FE(git_packbuilder_insert, arginfo_git_packbuilder_insert)
 	PHP_FE(git_packbuilder_insert_tree, arginfo_git_packbuilder_insert_tree)
 	PHP_FE(git_packbuilder_insert_commit, arginfo_git_packbuilder_insert_commit)
+	PHP_FE(git_packbuilder_insert_range, arginfo_git_packbuilder_insert_range)
 	PHP_FE(git_packbuilder_write, arginfo_git_packbuilder_write)
 	PHP_FE(git_packbuilder_hash, arginfo_git_packbuilder_hash)
 	PHP_FE(git_packbuilder_foreach, arginfo_git_packbuilder_foreach)
+	PHP_FE(git_packbuilder_write_stream, arginfo_git_packbuilder_write_stream)
+	PHP_FE(git_packbuilder_set_options, arginfo_git_packbuilder_set_options)
+	PHP_FE(git_packbuilder_stats, arginfo_git_packbuilder_stats)
 	PHP_FE(git_packbuilder_object_count, arginfo_git_packbuilder_object_count)
 	PHP_FE(git_packbuilder_written, arginfo_git_packbuilder_written)
 	PHP_FE(git_packbuilder_set_callbacks, arginfo_git_packbuilder_set_callbacks)
@@ -981,6 +1068,16 @@ static zend_function_entry php_git2_functions[] = {
 	PHP_FE(git_blame_buffer, arginfo_git_blame_buffer)
 	PHP_FE(git_blame_free, arginfo_git_blame_free)
 	PHP_FE(git_blame_options_new, arginfo_git_blame_options_new)
+	PHP_FE(git_blame_to_array, arginfo_git_blame_to_array)
+	PHP_FE(git_blame_cache_new, arginfo_git_blame_cache_new)
+	PHP_FE(git_blame_cache_prewarm, arginfo_git_blame_cache_prewarm)
+	PHP_FE(git_blame_cache_save, arginfo_git_blame_cache_save)
+	PHP_FE(git_blame_cache_stats, arginfo_git_blame_cache_stats)
+	PHP_FE(git_blame_file_stream, arginfo_git_blame_file_stream)
+
+	/* serve */
+	PHP_FE(git_upload_pack_serve, arginfo_git_upload_pack_serve)
+	PHP_FE(git_receive_pack_serve, arginfo_git_receive_pack_serve)
 
 	/* misc */
 	PHP_FE(git_resource_type, arginfo_git_resource_type)
@@ -1007,14 +1104,18 @@ PHP_MINFO_FUNCTION(git2)
 
 PHP_INI_BEGIN()
 	STD_PHP_INI_BOOLEAN("git2.dummy", "1", PHP_INI_ALL, OnUpdateLong, dummy, zend_git2_globals, git2_globals)
+	STD_PHP_INI_BOOLEAN("git2.preload_index", "0", PHP_INI_ALL, OnUpdateBool, preload_index, zend_git2_globals, git2_globals)
+	STD_PHP_INI_ENTRY("git2.preload_threads", "0", PHP_INI_ALL, OnUpdateLong, preload_threads, zend_git2_globals, git2_globals)
 PHP_INI_END()
 
 static PHP_GINIT_FUNCTION(git2)
 {
+	git2_globals->bitmap_indexes = NULL;
 }
 
 static PHP_GSHUTDOWN_FUNCTION(git2)
 {
+	php_git2_bitmap_cache_destroy(git2_globals->bitmap_indexes);
 }
 
 
@@ -1074,6 +1175,9 @@ PHP_MINIT_FUNCTION(git2)
 	REGISTER_LONG_CONSTANT("GIT_TYPE_FILTER_LIST", PHP_GIT2_TYPE_FILTER_LIST, CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("GIT_TYPE_FILTER_SOURCE", PHP_GIT2_TYPE_FILTER_SOURCE, CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("GIT_TYPE_DIFF_LINE", PHP_GIT2_TYPE_DIFF_LINE, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("GIT_TYPE_SIMILARITY_CACHE", PHP_GIT2_TYPE_SIMILARITY_CACHE, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("GIT_TYPE_CHANGED_PATHS", PHP_GIT2_TYPE_CHANGED_PATHS, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("GIT_TYPE_BLAME_CACHE", PHP_GIT2_TYPE_BLAME_CACHE, CONST_CS | CONST_PERSISTENT);
 
 	/* git_ref_t */
 	REGISTER_LONG_CONSTANT("GIT_REF_INVALID", GIT_REF_INVALID, CONST_CS | CONST_PERSISTENT);
@@ -53,6 +53,7 @@
 #include "git2/trace.h"
 #include "git2/sys/filter.h"
 #include "git2/sys/odb_backend.h"
+#include "git2/sys/hashsig.h"
 
 #include "date/php_date.h"
 
@@ -66,6 +67,9 @@ extern zend_module_entry git2_module_entry;
 
 ZEND_BEGIN_MODULE_GLOBALS(git2)
 	long dummy;
+	zend_bool preload_index;
+	long preload_threads;
+	HashTable *bitmap_indexes; /* pack checksum -> php_git2_bitmap_index*, see bitmap.c */
 ZEND_END_MODULE_GLOBALS(git2)
 
 ZEND_EXTERN_MODULE_GLOBALS(git2)
@@ -138,6 +142,9 @@ enum php_git2_resource_type {
 	PHP_GIT2_TYPE_PUSH,
 	PHP_GIT2_TYPE_REFSPEC,
 	PHP_GIT2_TYPE_INDEXER,
+	PHP_GIT2_TYPE_SIMILARITY_CACHE,
+	PHP_GIT2_TYPE_CHANGED_PATHS,
+	PHP_GIT2_TYPE_BLAME_CACHE,
 	PHP_GIT2_TYPE_FILTER, /* for conventional reason */
 };
 
@@ -192,11 +199,15 @@ typedef struct php_git2_t {
 		git_push *push;
 		git_refspec *refspec;
 		git_indexer *indexer;
+		struct php_git2_similarity_cache *similarity_cache;
+		struct php_git2_changed_paths *changed_paths;
+		struct php_git2_blame_cache *blame_cache;
 		git_filter *filter;
 	} v;
 	int should_free_v;
 	int resource_id;
 	int mutable;
+	void *priv;
 } php_git2_t;
 
 typedef struct php_git2_cb_t {
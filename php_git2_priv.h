@@ -77,6 +77,7 @@ do {\
 	val->should_free_v = 0;\
 	val->type = 0;\
 	val->mutable = 0;\
+	val->priv = NULL;\
 } while (0);\
 
 
@@ -86,6 +87,7 @@ do {\
 	val->should_free_v = 0;\
 	val->type = 0;\
 	val->mutable = 0;\
+	val->priv = NULL;\
 } while (0);\
 
 #define GIT2_OID_HEXSIZE (GIT_OID_HEXSZ+1)
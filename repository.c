@@ -1,6 +1,16 @@
 #include "php_git2.h"
 #include "php_git2_priv.h"
 #include "repository.h"
+#include "bitmap.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
 
 static void php_git2_array_to_git_repository_init_options(git_repository_init_options *opts, zval *array TSRMLS_DC)
 {
@@ -937,4 +947,1158 @@ PHP_FUNCTION(git_repository_init_options_new)
 	php_git2_git_repository_init_options_to_array(&opts, &result TSRMLS_CC);
 	RETURN_ZVAL(result, 0, 1);
 }
-/* }}} */
\ No newline at end of file
+/* }}} */
+
+#ifdef HAVE_SYS_INOTIFY_H
+#define PHP_GIT2_WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+	IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+static void php_git2_watcher_path_free(void *data)
+{
+	efree(*(char**)data);
+}
+
+/* rel is a workdir relative directory path, "" or ending with '/' */
+static void php_git2_watcher_add(php_git2_watcher *watcher, const char *workdir, const char *rel, int mark_dirty)
+{
+	char full[MAXPATHLEN], child[MAXPATHLEN], *stored;
+	struct dirent *de;
+	struct stat st;
+	DIR *dh;
+	int wd;
+
+	snprintf(full, sizeof(full), "%s%s", workdir, rel);
+	wd = inotify_add_watch(watcher->fd, full, PHP_GIT2_WATCH_MASK);
+	if (wd < 0) {
+		/* out of watches: changes below full would go unnoticed */
+		watcher->incomplete = 1;
+		return;
+	}
+	stored = estrdup(rel);
+	zend_hash_index_update(&watcher->watches, wd, (void*)&stored, sizeof(char*), NULL);
+
+	dh = opendir(full);
+	if (dh == NULL) {
+		return;
+	}
+	while ((de = readdir(dh)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0 || strcmp(de->d_name, ".git") == 0) {
+			continue;
+		}
+		snprintf(child, sizeof(child), "%s%s", full, de->d_name);
+		if (lstat(child, &st) != 0) {
+			continue;
+		}
+		snprintf(child, sizeof(child), "%s%s", rel, de->d_name);
+		if (S_ISDIR(st.st_mode)) {
+			strlcat(child, "/", sizeof(child));
+			php_git2_watcher_add(watcher, workdir, child, mark_dirty);
+		} else if (mark_dirty) {
+			zend_hash_add_empty_element(&watcher->dirty, child, strlen(child) + 1);
+		}
+	}
+	closedir(dh);
+}
+
+/* watches the directory of each exclude file, editors tend to replace the file itself */
+static void php_git2_watcher_add_excludes(php_git2_watcher *watcher)
+{
+	char dir[MAXPATHLEN], *slash, *base;
+	int i, wd;
+
+	for (i = 0; i < 2; i++) {
+		if (watcher->excludes[i] == NULL) {
+			continue;
+		}
+		strlcpy(dir, watcher->excludes[i], sizeof(dir));
+		slash = strrchr(dir, '/');
+		if (slash == NULL) {
+			continue;
+		}
+		*slash = '\0';
+		wd = inotify_add_watch(watcher->fd, dir, PHP_GIT2_WATCH_MASK);
+		if (wd < 0) {
+			watcher->incomplete = 1;
+			continue;
+		}
+		base = estrdup(slash + 1);
+		zend_hash_index_update(&watcher->exclude_watches, wd, (void*)&base, sizeof(char*), NULL);
+	}
+}
+
+static char *php_git2_watcher_excludesfile(git_repository *repo)
+{
+	char path[MAXPATHLEN], *home;
+	const char *value = NULL;
+	git_config *config = NULL;
+
+	if (git_repository_config(&config, repo) != 0) {
+		giterr_clear();
+		return NULL;
+	}
+	if (git_config_get_string(&value, config, "core.excludesfile") != 0 || value == NULL || *value == '\0') {
+		giterr_clear();
+		git_config_free(config);
+		return NULL;
+	}
+	if (strncmp(value, "~/", 2) == 0 && (home = getenv("HOME")) != NULL) {
+		snprintf(path, sizeof(path), "%s%s", home, value + 1);
+	} else {
+		strlcpy(path, value, sizeof(path));
+	}
+	git_config_free(config);
+	return estrdup(path);
+}
+
+static int php_git2_watcher_new(php_git2_watcher **out, git_repository *repo)
+{
+	php_git2_watcher *watcher;
+	char path[MAXPATHLEN];
+
+	watcher = (php_git2_watcher*)ecalloc(1, sizeof(php_git2_watcher));
+	watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watcher->fd < 0) {
+		efree(watcher);
+		return -1;
+	}
+	zend_hash_init(&watcher->watches, 64, NULL, php_git2_watcher_path_free, 0);
+	zend_hash_init(&watcher->exclude_watches, 2, NULL, php_git2_watcher_path_free, 0);
+	zend_hash_init(&watcher->dirty, 64, NULL, NULL, 0);
+	zend_hash_init(&watcher->last_status, 64, NULL, NULL, 0);
+	watcher->workdir = estrdup(git_repository_workdir(repo));
+	snprintf(path, sizeof(path), "%sinfo/exclude", git_repository_path(repo));
+	watcher->excludes[0] = estrdup(path);
+	watcher->excludes[1] = php_git2_watcher_excludesfile(repo);
+	php_git2_watcher_add(watcher, watcher->workdir, "", 0);
+	php_git2_watcher_add_excludes(watcher);
+
+	*out = watcher;
+	return 0;
+}
+
+/* drops every watch and walks the working directory again, for after events were lost */
+void php_git2_watcher_rebuild(php_git2_watcher *watcher)
+{
+	int fd;
+
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		watcher->incomplete = 1;
+		return;
+	}
+	close(watcher->fd);
+	watcher->fd = fd;
+	zend_hash_clean(&watcher->watches);
+	zend_hash_clean(&watcher->exclude_watches);
+	php_git2_watcher_add(watcher, watcher->workdir, "", 0);
+	php_git2_watcher_add_excludes(watcher);
+	watcher->overflow = 0;
+	watcher->rebuilds++;
+}
+
+void php_git2_watcher_drain(php_git2_watcher *watcher)
+{
+	char buf[64 * 1024], path[MAXPATHLEN], **dir;
+	const struct inotify_event *event;
+	ssize_t len;
+	char *p;
+
+	while ((len = read(watcher->fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event*)p;
+			watcher->events++;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				watcher->overflow = 1;
+				watcher->overflows++;
+				continue;
+			}
+			if (event->mask & IN_IGNORED) {
+				if (zend_hash_index_exists(&watcher->exclude_watches, event->wd)) {
+					zend_hash_index_del(&watcher->exclude_watches, event->wd);
+					watcher->overflow = 1;
+				}
+				zend_hash_index_del(&watcher->watches, event->wd);
+				continue;
+			}
+			if (zend_hash_index_find(&watcher->exclude_watches, event->wd, (void**)&dir) == SUCCESS &&
+				(event->len == 0 || strcmp(event->name, *dir) == 0)) {
+				/* what is ignored changed everywhere, and the directory may need watching again */
+				watcher->overflow = 1;
+			}
+			if (zend_hash_index_find(&watcher->watches, event->wd, (void**)&dir) != SUCCESS) {
+				continue;
+			}
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+				/* tracked files below it vanished without events of their own */
+				watcher->overflow = 1;
+				continue;
+			}
+			if (event->len == 0 || strcmp(event->name, ".git") == 0) {
+				continue;
+			}
+
+			snprintf(path, sizeof(path), "%s%s", *dir, event->name);
+			if (event->mask & IN_ISDIR) {
+				if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+					strlcat(path, "/", sizeof(path));
+					php_git2_watcher_add(watcher, watcher->workdir, path, 1);
+				} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+					watcher->overflow = 1;
+				}
+				continue;
+			}
+			zend_hash_add_empty_element(&watcher->dirty, path, strlen(path) + 1);
+		}
+	}
+}
+
+void php_git2_watcher_free(php_git2_watcher *watcher)
+{
+	if (watcher == NULL) {
+		return;
+	}
+	close(watcher->fd);
+	zend_hash_destroy(&watcher->watches);
+	zend_hash_destroy(&watcher->exclude_watches);
+	zend_hash_destroy(&watcher->dirty);
+	zend_hash_destroy(&watcher->last_status);
+	efree(watcher->workdir);
+	if (watcher->excludes[0] != NULL) {
+		efree(watcher->excludes[0]);
+	}
+	if (watcher->excludes[1] != NULL) {
+		efree(watcher->excludes[1]);
+	}
+	efree(watcher);
+}
+#else
+void php_git2_watcher_drain(php_git2_watcher *watcher)
+{
+}
+
+void php_git2_watcher_rebuild(php_git2_watcher *watcher)
+{
+}
+
+void php_git2_watcher_free(php_git2_watcher *watcher)
+{
+}
+#endif
+
+/* {{{ proto bool git_repository_watch(resource $repo)
+  attaches an inotify watcher to this repository resource. git_status_foreach and
+  git_status_foreach_ext called through it only look at paths changed since the previous
+  status (plus the index) and report what a full scan would. git_status_list_new always
+  does the full scan, its entries carry oids. lost events, edits to .gitignore or the
+  exclude files and new untracked directories make the next status a full scan; a
+  directory that cannot be watched turns incremental status off for the life of the watcher. */
+PHP_FUNCTION(git_repository_watch)
+{
+	zval *repo = NULL;
+	php_git2_t *_repo = NULL;
+#ifdef HAVE_SYS_INOTIFY_H
+	php_git2_watcher *watcher = NULL;
+#endif
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &repo) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (_repo->priv != NULL) {
+		RETURN_TRUE;
+	}
+	if (git_repository_is_bare(PHP_GIT2_V(_repo, repository))) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "bare repositories have nothing to watch");
+		RETURN_FALSE;
+	}
+#ifdef HAVE_SYS_INOTIFY_H
+	if (php_git2_watcher_new(&watcher, PHP_GIT2_V(_repo, repository))) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "inotify_init failed: %s", strerror(errno));
+		RETURN_FALSE;
+	}
+	_repo->priv = watcher;
+	RETURN_TRUE;
+#else
+	php_error_docref(NULL TSRMLS_CC, E_WARNING, "git_repository_watch requires inotify");
+	RETURN_FALSE;
+#endif
+}
+/* }}} */
+
+/* {{{ proto void git_repository_unwatch(resource $repo)
+ */
+PHP_FUNCTION(git_repository_unwatch)
+{
+	zval *repo = NULL;
+	php_git2_t *_repo = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &repo) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	php_git2_watcher_free((php_git2_watcher*)_repo->priv);
+	_repo->priv = NULL;
+}
+/* }}} */
+
+/* {{{ proto array git_repository_watch_stats(resource $repo)
+ */
+PHP_FUNCTION(git_repository_watch_stats)
+{
+	zval *repo = NULL;
+	php_git2_t *_repo = NULL;
+	php_git2_watcher *watcher = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &repo) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	watcher = (php_git2_watcher*)_repo->priv;
+	if (watcher == NULL) {
+		RETURN_FALSE;
+	}
+	php_git2_watcher_drain(watcher);
+
+	array_init(return_value);
+	add_assoc_long_ex(return_value, ZEND_STRS("watches"), zend_hash_num_elements(&watcher->watches));
+	add_assoc_long_ex(return_value, ZEND_STRS("events"), watcher->events);
+	add_assoc_long_ex(return_value, ZEND_STRS("overflows"), watcher->overflows);
+	add_assoc_long_ex(return_value, ZEND_STRS("rebuilds"), watcher->rebuilds);
+	add_assoc_bool_ex(return_value, ZEND_STRS("incomplete"), watcher->incomplete);
+	add_assoc_long_ex(return_value, ZEND_STRS("dirty"), zend_hash_num_elements(&watcher->dirty));
+	add_assoc_long_ex(return_value, ZEND_STRS("full_scans"), watcher->full_scans);
+	add_assoc_long_ex(return_value, ZEND_STRS("incremental_scans"), watcher->incremental_scans);
+}
+/* }}} */
+
+/* {{{ proto array git_repository_count_objects(resource $repo, string $range)
+  counts the objects reachable from "<rev>" or "<from>..<to>" per type. with a .bitmap next
+  to a pack the answer comes from ORing its commit bitmaps, only history past the bitmapped
+  commits is walked. returns array(commits, trees, blobs, tags, total, bitmap) */
+PHP_FUNCTION(git_repository_count_objects)
+{
+	zval *repo = NULL;
+	php_git2_t *_repo = NULL;
+	php_git2_bitmap_index *index = NULL;
+	php_git2_bitmap_reach reach;
+	char *range = NULL;
+	int range_len = 0, error = 0;
+	long counts[4];
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rs", &repo, &range, &range_len) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (php_git2_bitmap_index_open(&index, PHP_GIT2_V(_repo, repository) TSRMLS_CC)) {
+		/* no usable bitmap: the same walk without one */
+		giterr_clear();
+		index = NULL;
+	}
+	error = php_git2_bitmap_reach_range(&reach, index, PHP_GIT2_V(_repo, repository), range);
+	if (error == 0) {
+		php_git2_bitmap_reach_count(&reach, index, counts);
+		php_git2_bitmap_reach_free(&reach);
+	}
+	php_git2_bitmap_index_free(index);
+	if (php_git2_check_error(error, "git_repository_count_objects" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+
+	array_init(return_value);
+	add_assoc_long_ex(return_value, ZEND_STRS("commits"), counts[0]);
+	add_assoc_long_ex(return_value, ZEND_STRS("trees"), counts[1]);
+	add_assoc_long_ex(return_value, ZEND_STRS("blobs"), counts[2]);
+	add_assoc_long_ex(return_value, ZEND_STRS("tags"), counts[3]);
+	add_assoc_long_ex(return_value, ZEND_STRS("total"), counts[0] + counts[1] + counts[2] + counts[3]);
+	add_assoc_bool_ex(return_value, ZEND_STRS("bitmap"), index != NULL);
+}
+/* }}} */
+
+/* {{{ proto long git_repository_write_bitmap(resource $repo[, string $pack_path])
+  writes pack-*.bitmap next to $pack_path, by default the only pack in objects/pack. the pack
+  has to hold everything reachable from the refs, as after a full repack.
+  returns the number of commits that got a bitmap */
+PHP_FUNCTION(git_repository_write_bitmap)
+{
+	zval *repo = NULL;
+	php_git2_t *_repo = NULL;
+	char *pack_path = NULL, *found = NULL;
+	int pack_path_len = 0, error = 0;
+	long selected = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r|s", &repo, &pack_path, &pack_path_len) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (pack_path == NULL) {
+		error = php_git2_bitmap_pack_path(&found, PHP_GIT2_V(_repo, repository), 0 TSRMLS_CC);
+		pack_path = found;
+	}
+	if (error == 0) {
+		error = php_git2_bitmap_write(PHP_GIT2_V(_repo, repository), pack_path, &selected);
+	}
+	if (found != NULL) {
+		efree(found);
+	}
+	if (php_git2_check_error(error, "git_repository_write_bitmap" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_LONG(selected);
+}
+/* }}} */
+
+#define PHP_GIT2_REPACK_PROGRESS_INTERVAL 100
+#define PHP_GIT2_REPACK_EXPIRE 1209600
+/* as git gc's gc.pid: a repack.lock this old was left by a repack that died */
+#define PHP_GIT2_REPACK_LOCK_STALE 43200
+
+typedef struct php_git2_repack {
+	git_repository *repo;
+	git_packbuilder *pb;      /* NULL on a dry run */
+	HashTable packed;         /* raw id of every object going into the new pack */
+	HashTable loose;          /* raw id -> size of every loose object file */
+	char **packs;             /* old packs, without the ".pack" suffix */
+	size_t pack_count;
+	long pack_bytes;
+	long loose_bytes;
+	php_git2_cb_t *cb;
+	long last_ms;
+} php_git2_repack;
+
+typedef struct php_git2_repack_loosen {
+	php_git2_repack *rp;
+	git_odb *pack;
+	git_odb *loose;
+	long *loosened;
+} php_git2_repack_loosen;
+
+typedef struct php_git2_repack_tips {
+	git_oid *ids;
+	size_t count;
+	size_t alloc;
+} php_git2_repack_tips;
+
+static long php_git2_repack_file_size(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		return 0;
+	}
+	return (long)st.st_size;
+}
+
+/* calls progress_cb(stage, current, total, payload) at most every interval, and always when forced.
+   a non-zero return aborts the repack */
+static int php_git2_repack_progress(php_git2_repack *rp, const char *stage, long current, long total, int force)
+{
+	zval *param_stage = NULL, *param_current = NULL, *param_total = NULL, *retval_ptr = NULL;
+	long now, retval = 0;
+
+	if (rp->cb == NULL) {
+		return 0;
+	}
+	now = php_git2_now_ms();
+	if (!force && now - rp->last_ms < PHP_GIT2_REPACK_PROGRESS_INTERVAL) {
+		return 0;
+	}
+	rp->last_ms = now;
+	{
+		GIT2_TSRMLS_SET(rp->cb->tsrm_ls)
+
+		MAKE_STD_ZVAL(param_stage);
+		MAKE_STD_ZVAL(param_current);
+		MAKE_STD_ZVAL(param_total);
+		ZVAL_STRING(param_stage, stage, 1);
+		ZVAL_LONG(param_current, current);
+		ZVAL_LONG(param_total, total);
+		Z_ADDREF_P(rp->cb->payload);
+		if (php_git2_call_function_v(rp->cb->fci, rp->cb->fcc TSRMLS_CC, &retval_ptr, 4,
+			&param_stage, &param_current, &param_total, &rp->cb->payload)) {
+			return GIT_EUSER;
+		}
+		if (retval_ptr) {
+			convert_to_long(retval_ptr);
+			retval = Z_LVAL_P(retval_ptr);
+			zval_ptr_dtor(&retval_ptr);
+		}
+	}
+	if (retval) {
+		giterr_set_str(GITERR_INVALID, "repack aborted by the progress callback");
+		return GIT_EUSER;
+	}
+	return 0;
+}
+
+static int php_git2_repack_write_progress_cb(const git_transfer_progress *stats, void *payload)
+{
+	php_git2_repack *rp = (php_git2_repack*)payload;
+
+	return php_git2_repack_progress(rp, "writing", stats->indexed_objects, stats->total_objects,
+		stats->indexed_objects == stats->total_objects);
+}
+
+/* returns 1 when id was not going into the new pack yet */
+static int php_git2_repack_mark(php_git2_repack *rp, const git_oid *id)
+{
+	char one = 1;
+
+	return zend_hash_add(&rp->packed, (char*)id->id, GIT_OID_RAWSZ, &one, sizeof(char), NULL) == SUCCESS;
+}
+
+static int php_git2_repack_add(php_git2_repack *rp, const git_oid *id, const char *name)
+{
+	if (!php_git2_repack_mark(rp, id)) {
+		return 0;
+	}
+	if (rp->pb != NULL) {
+		return git_packbuilder_insert(rp->pb, id, name);
+	}
+	return 0;
+}
+
+/* only marks: the objects go into the builder through php_git2_bitmap_reach_insert, which
+   knows their paths */
+static int php_git2_repack_reach_cb(const git_oid *id, git_otype type, void *payload)
+{
+	php_git2_repack *rp = (php_git2_repack*)payload;
+
+	php_git2_repack_mark(rp, id);
+	return php_git2_repack_progress(rp, "counting", zend_hash_num_elements(&rp->packed), 0, 0);
+}
+
+/* every objects/xx/<38 hex> file */
+static void php_git2_repack_scan_loose(php_git2_repack *rp, const char *objects TSRMLS_DC)
+{
+	php_stream *dir;
+	php_stream_dirent entry;
+	char hex[GIT_OID_HEXSZ + 1], *path, *file;
+	git_oid id;
+	long size;
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		spprintf(&path, 0, "%s%02x", objects, i);
+		dir = php_stream_opendir(path, 0, NULL);
+		if (dir == NULL) {
+			efree(path);
+			continue;
+		}
+		while (php_stream_readdir(dir, &entry)) {
+			if (strlen(entry.d_name) != GIT_OID_HEXSZ - 2) {
+				continue;
+			}
+			snprintf(hex, sizeof(hex), "%02x%s", i, entry.d_name);
+			if (git_oid_fromstr(&id, hex)) {
+				giterr_clear();
+				continue;
+			}
+			spprintf(&file, 0, "%s/%s", path, entry.d_name);
+			size = php_git2_repack_file_size(file);
+			efree(file);
+			zend_hash_update(&rp->loose, (char*)id.id, GIT_OID_RAWSZ, &size, sizeof(long), NULL);
+			rp->loose_bytes += size;
+		}
+		php_stream_closedir(dir);
+		efree(path);
+	}
+}
+
+/* objects/pack/*.pack with an .idx and without a .keep next to them */
+static void php_git2_repack_scan_packs(php_git2_repack *rp, const char *objects TSRMLS_DC)
+{
+	php_stream *dir;
+	php_stream_dirent entry;
+	struct stat st;
+	char *path, *base, *file;
+	size_t len;
+
+	spprintf(&path, 0, "%spack", objects);
+	dir = php_stream_opendir(path, 0, NULL);
+	if (dir == NULL) {
+		efree(path);
+		return;
+	}
+	while (php_stream_readdir(dir, &entry)) {
+		len = strlen(entry.d_name);
+		if (len <= 5 || strncmp(entry.d_name, "pack-", 5) != 0 || strcmp(entry.d_name + len - 5, ".pack") != 0) {
+			continue;
+		}
+		spprintf(&base, 0, "%s/%.*s", path, (int)(len - 5), entry.d_name);
+		spprintf(&file, 0, "%s.keep", base);
+		if (stat(file, &st) == 0) {
+			efree(file);
+			efree(base);
+			continue;
+		}
+		efree(file);
+		/* no .idx yet: still being written, e.g. by a push */
+		spprintf(&file, 0, "%s.idx", base);
+		if (stat(file, &st) != 0) {
+			efree(file);
+			efree(base);
+			continue;
+		}
+		efree(file);
+		spprintf(&file, 0, "%s.pack", base);
+		rp->pack_bytes += php_git2_repack_file_size(file);
+		efree(file);
+		rp->packs = (char**)erealloc(rp->packs, sizeof(char*) * (rp->pack_count + 1));
+		rp->packs[rp->pack_count++] = base;
+	}
+	php_stream_closedir(dir);
+	efree(path);
+}
+
+static void php_git2_repack_tips_push(php_git2_repack_tips *tips, const git_oid *id)
+{
+	if (tips->count == tips->alloc) {
+		tips->alloc = tips->alloc ? tips->alloc * 2 : 64;
+		tips->ids = (git_oid*)erealloc(tips->ids, sizeof(git_oid) * tips->alloc);
+	}
+	git_oid_cpy(&tips->ids[tips->count++], id);
+}
+
+/* the old and new ids of every entry of name's reflog that are still around */
+static void php_git2_repack_reflog_tips(php_git2_repack_tips *tips, git_repository *repo, git_odb *odb, const char *name)
+{
+	git_reflog *reflog = NULL;
+	const git_reflog_entry *entry;
+	const git_oid *id;
+	size_t i, count;
+	int n;
+
+	if (git_reflog_read(&reflog, repo, name) != 0) {
+		giterr_clear();
+		return;
+	}
+	count = git_reflog_entrycount(reflog);
+	for (i = 0; i < count; i++) {
+		entry = git_reflog_entry_byindex(reflog, i);
+		for (n = 0; n < 2; n++) {
+			id = n ? git_reflog_entry_id_new(entry) : git_reflog_entry_id_old(entry);
+			if (!git_oid_iszero(id) && git_odb_exists(odb, id)) {
+				php_git2_repack_tips_push(tips, id);
+			}
+		}
+	}
+	git_reflog_free(reflog);
+}
+
+/* every ref and HEAD plus what their reflogs still mention, as git gc keeps it: a repack
+   must not take away what "git reflog" shows. annotated tags are peeled while walking */
+static int php_git2_repack_reach(php_git2_repack *rp, php_git2_bitmap_index *index, php_git2_bitmap_reach *reach)
+{
+	php_git2_repack_tips tips = {0};
+	git_strarray names = {0};
+	git_odb *odb = NULL;
+	git_oid id;
+	size_t i;
+	int error;
+
+	if ((error = git_repository_odb(&odb, rp->repo))) {
+		return error;
+	}
+	if ((error = git_reference_list(&names, rp->repo))) {
+		git_odb_free(odb);
+		return error;
+	}
+	for (i = 0; i < names.count; i++) {
+		if (git_reference_name_to_id(&id, rp->repo, names.strings[i]) == 0) {
+			php_git2_repack_tips_push(&tips, &id);
+		} else {
+			giterr_clear();
+		}
+		php_git2_repack_reflog_tips(&tips, rp->repo, odb, names.strings[i]);
+	}
+	if (git_reference_name_to_id(&id, rp->repo, "HEAD") == 0) {
+		php_git2_repack_tips_push(&tips, &id);
+	} else {
+		/* unborn HEAD */
+		giterr_clear();
+	}
+	php_git2_repack_reflog_tips(&tips, rp->repo, odb, "HEAD");
+	git_strarray_free(&names);
+	git_odb_free(odb);
+	error = php_git2_bitmap_reach_init(reach, index, rp->repo, tips.ids, tips.count);
+	if (tips.ids != NULL) {
+		efree(tips.ids);
+	}
+	return error;
+}
+
+/* the blobs the index stages, which may be in no commit yet */
+static int php_git2_repack_index(php_git2_repack *rp)
+{
+	git_index *index = NULL;
+	git_odb *odb = NULL;
+	const git_index_entry *entry;
+	size_t i, count;
+	int error = 0;
+
+	if (git_repository_is_bare(rp->repo)) {
+		return 0;
+	}
+	if (git_repository_index(&index, rp->repo) != 0) {
+		giterr_clear();
+		return 0;
+	}
+	if ((error = git_repository_odb(&odb, rp->repo)) == 0) {
+		count = git_index_entrycount(index);
+		for (i = 0; i < count && error == 0; i++) {
+			entry = git_index_get_byindex(index, i);
+			/* submodule commits live in the submodule's repository */
+			if (entry->mode == GIT_FILEMODE_COMMIT || !git_odb_exists(odb, &entry->oid)) {
+				continue;
+			}
+			error = php_git2_repack_add(rp, &entry->oid, entry->path);
+		}
+		git_odb_free(odb);
+	}
+	git_index_free(index);
+	return error;
+}
+
+/* removes dir and whatever an interrupted write left inside */
+static void php_git2_repack_rmdir(const char *path TSRMLS_DC)
+{
+	php_stream *dir;
+	php_stream_dirent entry;
+	char *file;
+
+	dir = php_stream_opendir(path, 0, NULL);
+	if (dir != NULL) {
+		while (php_stream_readdir(dir, &entry)) {
+			if (strcmp(entry.d_name, ".") == 0 || strcmp(entry.d_name, "..") == 0) {
+				continue;
+			}
+			spprintf(&file, 0, "%s/%s", path, entry.d_name);
+			VCWD_UNLINK(file);
+			efree(file);
+		}
+		php_stream_closedir(dir);
+	}
+	VCWD_RMDIR(path);
+}
+
+/* moves pack-<name>.{pack,bitmap,idx} from tmp into objects/pack. the .idx goes last:
+   packs are found through their index, so readers see the new pack complete or not at all */
+static int php_git2_repack_install(const char *tmp, const char *pack_dir, const char *name, int with_bitmap)
+{
+	static const char *suffixes[] = {".pack", ".bitmap", ".idx"};
+	char *from, *to;
+	int i, error = 0;
+
+	for (i = 0; i < 3 && error == 0; i++) {
+		if (i == 1 && !with_bitmap) {
+			continue;
+		}
+		spprintf(&from, 0, "%s/pack-%s%s", tmp, name, suffixes[i]);
+		spprintf(&to, 0, "%s/pack-%s%s", pack_dir, name, suffixes[i]);
+		if (VCWD_RENAME(from, to) != 0) {
+			giterr_set_str(GITERR_OS, "failed to move the new pack into place");
+			error = -1;
+		}
+		efree(from);
+		efree(to);
+	}
+	return error;
+}
+
+static int php_git2_repack_loosen_cb(const git_oid *id, void *payload)
+{
+	php_git2_repack_loosen *loosen = (php_git2_repack_loosen*)payload;
+	git_odb_object *object = NULL;
+	git_oid written;
+	int error;
+
+	if (zend_hash_exists(&loosen->rp->packed, (char*)id->id, GIT_OID_RAWSZ) || git_odb_exists(loosen->loose, id)) {
+		return 0;
+	}
+	if ((error = git_odb_read(&object, loosen->pack, id)) == 0) {
+		error = git_odb_write(&written, loosen->loose, git_odb_object_data(object),
+			git_odb_object_size(object), git_odb_object_type(object));
+		git_odb_object_free(object);
+	}
+	if (error == 0) {
+		(*loosen->loosened)++;
+	}
+	return error;
+}
+
+/* writes every object of an old pack that the new pack does not hold out as a loose object,
+   as git repack -A does, so an object a ref came to point at during the repack outlives the
+   pack. loose is an odb with only the loose backend, git_odb_write skips objects a pack has */
+static int php_git2_repack_loosen_pack(php_git2_repack *rp, git_odb *loose, const char *base, long *loosened)
+{
+	php_git2_repack_loosen loosen;
+	git_odb_backend *backend = NULL;
+	char *idx;
+	int error;
+
+	spprintf(&idx, 0, "%s.idx", base);
+	error = git_odb_backend_one_pack(&backend, idx);
+	efree(idx);
+	if (error) {
+		return error;
+	}
+	loosen.rp = rp;
+	loosen.loose = loose;
+	loosen.loosened = loosened;
+	if ((error = git_odb_new(&loosen.pack)) == 0 && (error = git_odb_add_backend(loosen.pack, backend, 1)) == 0) {
+		backend = NULL;
+		error = git_odb_foreach(loosen.pack, php_git2_repack_loosen_cb, &loosen);
+	}
+	if (backend != NULL) {
+		backend->free(backend);
+	}
+	git_odb_free(loosen.pack);
+	return error;
+}
+
+/* deletes loose objects that went into the new pack and, after a full repack, the old packs
+   last modified more than expire seconds ago once what the new pack left out of them is
+   loose. a younger pack may hold objects a concurrent push or fetch installed but has not
+   pointed a ref at yet and stays as it is */
+static int php_git2_repack_prune(php_git2_repack *rp, const char *objects, const char *keep, int full,
+	long expire, long *pruned_loose, long *pruned_packs, long *kept_packs, long *loosened)
+{
+	struct stat st;
+	time_t cutoff = time(NULL) - expire;
+	HashPosition pos;
+	git_odb *loose = NULL;
+	git_odb_backend *backend = NULL;
+	char *key, *path, hex[GIT_OID_HEXSZ + 1];
+	uint key_len;
+	ulong num;
+	git_oid id;
+	long done = 0, total;
+	size_t i;
+	int error = 0;
+
+	total = zend_hash_num_elements(&rp->loose) + (full ? rp->pack_count : 0);
+	for (zend_hash_internal_pointer_reset_ex(&rp->loose, &pos);
+		error == 0 && zend_hash_get_current_key_ex(&rp->loose, &key, &key_len, &num, 0, &pos) == HASH_KEY_IS_STRING;
+		zend_hash_move_forward_ex(&rp->loose, &pos)) {
+		done++;
+		if (!zend_hash_exists(&rp->packed, key, key_len)) {
+			continue;
+		}
+		git_oid_fromraw(&id, (const unsigned char*)key);
+		git_oid_fmt(hex, &id);
+		hex[GIT_OID_HEXSZ] = '\0';
+		spprintf(&path, 0, "%s%.2s/%s", objects, hex, hex + 2);
+		if (VCWD_UNLINK(path) == 0) {
+			(*pruned_loose)++;
+		}
+		efree(path);
+		error = php_git2_repack_progress(rp, "pruning", done, total, 0);
+	}
+	for (i = 0; full && error == 0 && i < rp->pack_count; i++) {
+		done++;
+		if (keep != NULL && strcmp(rp->packs[i], keep) == 0) {
+			continue;
+		}
+		spprintf(&path, 0, "%s.pack", rp->packs[i]);
+		if (expire > 0 && stat(path, &st) == 0 && st.st_mtime > cutoff) {
+			efree(path);
+			(*kept_packs)++;
+			continue;
+		}
+		efree(path);
+		if (loose == NULL) {
+			if ((error = git_odb_new(&loose)) == 0 && (error = git_odb_backend_loose(&backend, objects, -1, 1)) == 0 &&
+				(error = git_odb_add_backend(loose, backend, 1)) != 0) {
+				backend->free(backend);
+			}
+			if (error) {
+				break;
+			}
+		}
+		if ((error = php_git2_repack_loosen_pack(rp, loose, rp->packs[i], loosened))) {
+			break;
+		}
+		/* index first so the pack stops being found before its data disappears */
+		spprintf(&path, 0, "%s.idx", rp->packs[i]);
+		VCWD_UNLINK(path);
+		efree(path);
+		spprintf(&path, 0, "%s.pack", rp->packs[i]);
+		VCWD_UNLINK(path);
+		efree(path);
+		spprintf(&path, 0, "%s.bitmap", rp->packs[i]);
+		VCWD_UNLINK(path);
+		efree(path);
+		(*pruned_packs)++;
+		error = php_git2_repack_progress(rp, "pruning", done, total, 0);
+	}
+	if (loose != NULL) {
+		git_odb_free(loose);
+	}
+	if (error == 0) {
+		error = php_git2_repack_progress(rp, "pruning", total, total, 1);
+	}
+	return error;
+}
+
+/* {{{ proto array git_repository_repack(resource $repo[, array $options[, Callable $progress_cb[, $progress_cb_payload]]])
+  packs everything reachable from the refs and HEAD into one new pack, or with incremental only
+  the loose objects. a full repack also keeps what the reflogs and the index still refer to.
+  the pack and its .idx (and .bitmap) are written aside and moved in index last, then the
+  loose objects it holds and, after a full repack, the old packs older than expire are
+  deleted, the objects of theirs the new pack left out written loose first as git repack -A
+  -d does. packs with a .keep file or without an .idx yet are left alone and unreachable loose
+  objects are kept, git prune expires them. objects/pack/repack.lock keeps a second repack
+  out meanwhile; one older than twelve hours was left by a repack that died and is removed.
+  options: incremental, bitmap (full repacks only), prune (default true), expire (seconds,
+  default two weeks, 0 deletes every old pack), threads, dry_run.
+  $progress_cb(string $stage, long $current, long $total, $payload) is called for the
+  counting, writing, bitmap and pruning stages, returning non-zero aborts.
+  returns array(objects, loose_objects, packs_before, bytes, pack, bitmap, pruned_loose,
+  pruned_packs, kept_packs, loosened, dry_run). on a dry run nothing is written and bytes is an upper bound
+  estimated from the sizes of the loose objects and packs the new pack would replace */
+PHP_FUNCTION(git_repository_repack)
+{
+	zval *repo = NULL, *options = NULL, *progress_cb_payload = NULL;
+	php_git2_t *_repo = NULL;
+	php_git2_repack rp;
+	php_git2_bitmap_index *index = NULL;
+	php_git2_bitmap_reach reach;
+	zend_fcall_info fci = empty_fcall_info;
+	zend_fcall_info_cache fcc = empty_fcall_info_cache;
+	HashPosition pos;
+	git_odb *odb = NULL;
+	git_oid id;
+	char *key, *objects = NULL, *pack_dir = NULL, *tmp = NULL, *installed = NULL, *file, *lock = NULL;
+	char name[GIT_OID_HEXSZ + 1] = {0};
+	uint key_len;
+	ulong num;
+	long *size, bytes = 0, selected = -1, pruned_loose = 0, pruned_packs = 0, kept_packs = 0, loosened = 0, objects_count, loose_count;
+	long expire = PHP_GIT2_REPACK_EXPIRE;
+	int incremental = 0, with_bitmap = 0, prune = 1, dry_run = 0, own_payload = 0, error = 0, fd;
+	struct stat st;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r|a!f!z", &repo, &options, &fci, &fcc, &progress_cb_payload) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (options != NULL) {
+		incremental = php_git2_read_arrval_long2(options, ZEND_STRS("incremental"), 0 TSRMLS_CC) != 0;
+		with_bitmap = php_git2_read_arrval_long2(options, ZEND_STRS("bitmap"), 0 TSRMLS_CC) != 0;
+		prune = php_git2_read_arrval_long2(options, ZEND_STRS("prune"), 1 TSRMLS_CC) != 0;
+		dry_run = php_git2_read_arrval_long2(options, ZEND_STRS("dry_run"), 0 TSRMLS_CC) != 0;
+		expire = php_git2_read_arrval_long2(options, ZEND_STRS("expire"), PHP_GIT2_REPACK_EXPIRE TSRMLS_CC);
+	}
+	if (incremental && with_bitmap) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "bitmaps need a full repack, ignoring bitmap");
+		with_bitmap = 0;
+	}
+
+	memset(&rp, 0, sizeof(rp));
+	rp.repo = PHP_GIT2_V(_repo, repository);
+	zend_hash_init(&rp.packed, 1024, NULL, NULL, 0);
+	zend_hash_init(&rp.loose, 1024, NULL, NULL, 0);
+	if (ZEND_FCI_INITIALIZED(fci)) {
+		if (progress_cb_payload == NULL) {
+			MAKE_STD_ZVAL(progress_cb_payload);
+			ZVAL_NULL(progress_cb_payload);
+			own_payload = 1;
+		}
+		php_git2_cb_init(&rp.cb, &fci, &fcc, progress_cb_payload TSRMLS_CC);
+	}
+	spprintf(&objects, 0, "%sobjects/", git_repository_path(rp.repo));
+	spprintf(&pack_dir, 0, "%spack", objects);
+
+	if (!dry_run) {
+		/* O_EXCL as git's own lockfiles: two repacks would delete each other's packs */
+		VCWD_MKDIR(pack_dir, 0777);
+		spprintf(&lock, 0, "%s/repack.lock", pack_dir);
+		fd = open(lock, O_CREAT | O_EXCL | O_WRONLY, 0666);
+		if (fd < 0 && errno == EEXIST && lstat(lock, &st) == 0 &&
+			time(NULL) - st.st_mtime > PHP_GIT2_REPACK_LOCK_STALE && unlink(lock) == 0) {
+			php_error_docref(NULL TSRMLS_CC, E_NOTICE, "removed a stale objects/pack/repack.lock");
+			fd = open(lock, O_CREAT | O_EXCL | O_WRONLY, 0666);
+		}
+		if (fd < 0) {
+			efree(lock);
+			lock = NULL;
+			giterr_set_str(GITERR_OS, "another repack is running, objects/pack/repack.lock exists");
+			error = GIT_ELOCKED;
+			goto done;
+		}
+		close(fd);
+	}
+	php_git2_repack_scan_loose(&rp, objects TSRMLS_CC);
+	php_git2_repack_scan_packs(&rp, objects TSRMLS_CC);
+	if (!dry_run) {
+		if ((error = git_packbuilder_new(&rp.pb, rp.repo))) {
+			goto done;
+		}
+		if (options != NULL) {
+			git_packbuilder_set_threads(rp.pb, php_git2_read_arrval_long2(options, ZEND_STRS("threads"), 0 TSRMLS_CC));
+		}
+	}
+
+	/* counting */
+	if (incremental) {
+		for (zend_hash_internal_pointer_reset_ex(&rp.loose, &pos);
+			error == 0 && zend_hash_get_current_key_ex(&rp.loose, &key, &key_len, &num, 0, &pos) == HASH_KEY_IS_STRING;
+			zend_hash_move_forward_ex(&rp.loose, &pos)) {
+			git_oid_fromraw(&id, (const unsigned char*)key);
+			/* loose objects come without a path */
+			if ((error = php_git2_repack_add(&rp, &id, NULL)) == 0) {
+				error = php_git2_repack_progress(&rp, "counting", zend_hash_num_elements(&rp.packed), 0, 0);
+			}
+		}
+	} else {
+		if (php_git2_bitmap_index_open(&index, rp.repo TSRMLS_CC)) {
+			giterr_clear();
+			index = NULL;
+		}
+		if ((error = php_git2_repack_reach(&rp, index, &reach)) == 0) {
+			error = php_git2_bitmap_reach_foreach(&reach, index, php_git2_repack_reach_cb, &rp);
+			if (error == 0 && rp.pb != NULL) {
+				error = php_git2_bitmap_reach_insert(&reach, index, rp.repo, rp.pb);
+			}
+			php_git2_bitmap_reach_free(&reach);
+		}
+		php_git2_bitmap_index_free(index);
+		if (error == 0) {
+			error = php_git2_repack_index(&rp);
+		}
+	}
+	objects_count = zend_hash_num_elements(&rp.packed);
+	if (error || (error = php_git2_repack_progress(&rp, "counting", objects_count, objects_count, 1))) {
+		goto done;
+	}
+
+	if (dry_run) {
+		/* the new pack holds at most what it replaces: the packed loose files plus the old packs */
+		for (zend_hash_internal_pointer_reset_ex(&rp.loose, &pos);
+			zend_hash_get_current_key_ex(&rp.loose, &key, &key_len, &num, 0, &pos) == HASH_KEY_IS_STRING;
+			zend_hash_move_forward_ex(&rp.loose, &pos)) {
+			if (zend_hash_exists(&rp.packed, key, key_len) &&
+				zend_hash_get_current_data_ex(&rp.loose, (void**)&size, &pos) == SUCCESS) {
+				bytes += *size;
+			}
+		}
+		if (!incremental) {
+			bytes += rp.pack_bytes;
+		}
+		goto done;
+	}
+	if (objects_count == 0) {
+		goto done;
+	}
+
+	/* writing, aside in objects/pack/tmp-repack-<ms> */
+	spprintf(&tmp, 0, "%s/tmp-repack-%ld", pack_dir, php_git2_now_ms());
+	VCWD_MKDIR(pack_dir, 0777);
+	if (VCWD_MKDIR(tmp, 0777) != 0) {
+		giterr_set_str(GITERR_OS, "failed to create a temporary pack directory");
+		error = -1;
+		goto done;
+	}
+	if ((error = git_packbuilder_write(rp.pb, tmp, 0, php_git2_repack_write_progress_cb, &rp))) {
+		goto done;
+	}
+	git_oid_fmt(name, git_packbuilder_hash(rp.pb));
+	if (with_bitmap) {
+		spprintf(&file, 0, "%s/pack-%s.pack", tmp, name);
+		if ((error = php_git2_repack_progress(&rp, "bitmap", 0, 1, 1)) == 0) {
+			error = php_git2_bitmap_write(rp.repo, file, &selected);
+		}
+		efree(file);
+		if (error || (error = php_git2_repack_progress(&rp, "bitmap", 1, 1, 1))) {
+			goto done;
+		}
+	}
+	if ((error = php_git2_repack_install(tmp, pack_dir, name, with_bitmap))) {
+		goto done;
+	}
+	spprintf(&installed, 0, "%s/pack-%s", pack_dir, name);
+	spprintf(&file, 0, "%s.pack", installed);
+	bytes = php_git2_repack_file_size(file);
+	efree(file);
+	if ((error = git_repository_odb(&odb, rp.repo)) == 0) {
+		error = git_odb_refresh(odb);
+		git_odb_free(odb);
+	}
+	if (error == 0 && prune) {
+		error = php_git2_repack_prune(&rp, objects, installed, !incremental, expire,
+			&pruned_loose, &pruned_packs, &kept_packs, &loosened);
+	}
+
+done:
+	if (tmp != NULL) {
+		php_git2_repack_rmdir(tmp TSRMLS_CC);
+		efree(tmp);
+	}
+	if (rp.pb != NULL) {
+		git_packbuilder_free(rp.pb);
+	}
+	if (lock != NULL) {
+		VCWD_UNLINK(lock);
+		efree(lock);
+	}
+	objects_count = zend_hash_num_elements(&rp.packed);
+	loose_count = zend_hash_num_elements(&rp.loose);
+	zend_hash_destroy(&rp.packed);
+	zend_hash_destroy(&rp.loose);
+	for (num = 0; num < rp.pack_count; num++) {
+		efree(rp.packs[num]);
+	}
+	if (rp.packs != NULL) {
+		efree(rp.packs);
+	}
+	if (rp.cb != NULL) {
+		php_git2_cb_free(rp.cb);
+	}
+	if (own_payload) {
+		zval_ptr_dtor(&progress_cb_payload);
+	}
+	efree(objects);
+	efree(pack_dir);
+	if (php_git2_check_error(error, "git_repository_repack" TSRMLS_CC)) {
+		if (installed != NULL) {
+			efree(installed);
+		}
+		RETURN_FALSE;
+	}
+
+	array_init(return_value);
+	add_assoc_long_ex(return_value, ZEND_STRS("objects"), objects_count);
+	add_assoc_long_ex(return_value, ZEND_STRS("loose_objects"), loose_count);
+	add_assoc_long_ex(return_value, ZEND_STRS("packs_before"), rp.pack_count);
+	add_assoc_long_ex(return_value, ZEND_STRS("bytes"), bytes);
+	if (installed != NULL) {
+		spprintf(&file, 0, "%s.pack", installed);
+		add_assoc_string_ex(return_value, ZEND_STRS("pack"), file, 0);
+		efree(installed);
+	} else {
+		add_assoc_null_ex(return_value, ZEND_STRS("pack"));
+	}
+	if (selected >= 0) {
+		add_assoc_long_ex(return_value, ZEND_STRS("bitmap"), selected);
+	} else {
+		add_assoc_bool_ex(return_value, ZEND_STRS("bitmap"), 0);
+	}
+	add_assoc_long_ex(return_value, ZEND_STRS("pruned_loose"), pruned_loose);
+	add_assoc_long_ex(return_value, ZEND_STRS("pruned_packs"), pruned_packs);
+	add_assoc_long_ex(return_value, ZEND_STRS("kept_packs"), kept_packs);
+	add_assoc_long_ex(return_value, ZEND_STRS("loosened"), loosened);
+	add_assoc_bool_ex(return_value, ZEND_STRS("dry_run"), dry_run);
+}
+/* }}} */
@@ -181,6 +181,35 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_git_repository_is_shallow, 0, 0, 1)
 	ZEND_ARG_INFO(0, repo)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_repository_watch, 0, 0, 1)
+	ZEND_ARG_INFO(0, repo)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_repository_unwatch, 0, 0, 1)
+	ZEND_ARG_INFO(0, repo)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_repository_watch_stats, 0, 0, 1)
+	ZEND_ARG_INFO(0, repo)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_repository_count_objects, 0, 0, 2)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, range)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_repository_write_bitmap, 0, 0, 1)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, pack_path)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_repository_repack, 0, 0, 1)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, options)
+	ZEND_ARG_INFO(0, progress_cb)
+	ZEND_ARG_INFO(0, progress_cb_payload)
+ZEND_END_ARG_INFO()
+
 /* {{{ proto resource git_repository_new()
 */
 PHP_FUNCTION(git_repository_new);
@@ -321,4 +350,28 @@ PHP_FUNCTION(git_repository_is_shallow);
 */
 PHP_FUNCTION(git_repository_init_options_new);
 
+/* {{{ proto bool git_repository_watch(repo)
+*/
+PHP_FUNCTION(git_repository_watch);
+
+/* {{{ proto void git_repository_unwatch(repo)
+*/
+PHP_FUNCTION(git_repository_unwatch);
+
+/* {{{ proto array git_repository_watch_stats(repo)
+*/
+PHP_FUNCTION(git_repository_watch_stats);
+
+/* {{{ proto array git_repository_count_objects(repo, range)
+*/
+PHP_FUNCTION(git_repository_count_objects);
+
+/* {{{ proto long git_repository_write_bitmap(repo[, pack_path])
+*/
+PHP_FUNCTION(git_repository_write_bitmap);
+
+/* {{{ proto array git_repository_repack(repo[, options[, progress_cb[, progress_cb_payload]]])
+*/
+PHP_FUNCTION(git_repository_repack);
+
 #endif
\ No newline at end of file
@@ -228,14 +228,16 @@ PHP_FUNCTION(git_revwalk_hide_ref)
 
 
 /* {{{ proto string git_revwalk_next(walk)
+  skips commits not touching the path set by git_revwalk_limit_path
 */
 PHP_FUNCTION(git_revwalk_next)
 {
 	zval *walk;
 	php_git2_t *_walk;
+	php_git2_revwalk_limit *limit;
 	git_oid id = {0};
 	char out[GIT2_OID_HEXSIZE] = {0};
-	int error = 0;
+	int error = 0, touched;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
 		"r", &walk) == FAILURE) {
@@ -243,7 +245,17 @@ PHP_FUNCTION(git_revwalk_next)
 	}
 
 	ZEND_FETCH_RESOURCE(_walk, php_git2_t*, &walk, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
-	error = git_revwalk_next(&id, PHP_GIT2_V(_walk, revwalk));
+	limit = (php_git2_revwalk_limit*)_walk->priv;
+	while ((error = git_revwalk_next(&id, PHP_GIT2_V(_walk, revwalk))) == 0 && limit != NULL) {
+		touched = php_git2_changed_paths_touches(limit->changed_paths,
+			git_revwalk_repository(PHP_GIT2_V(_walk, revwalk)), &id, limit->path, 0);
+		if (touched > 0) {
+			break;
+		}
+		if (php_git2_check_error(touched, "git_revwalk_next" TSRMLS_CC)) {
+			RETURN_FALSE;
+		}
+	}
 	if (error == GIT_ITEROVER) {
 		RETURN_FALSE;
 	}
@@ -351,3 +363,472 @@ PHP_FUNCTION(git_revwalk_repository)
 	ZVAL_RESOURCE(return_value, result->resource_id);
 }
 
+
+#define PHP_GIT2_CHANGED_PATHS_MAGIC "PGCP1"
+#define PHP_GIT2_BLOOM_BITS_PER_PATH 10
+#define PHP_GIT2_BLOOM_HASHES 7
+#define PHP_GIT2_BLOOM_MAX_PATHS 512
+#define PHP_GIT2_BLOOM_MAX_BITS (PHP_GIT2_BLOOM_MAX_PATHS * PHP_GIT2_BLOOM_BITS_PER_PATH + 64)
+#define PHP_GIT2_BLOOM_SIZE(nbits) (offsetof(php_git2_bloom, bits) + (nbits) / 8 + 1)
+
+/* two fnv-1a hashes with different offsets, combined by double hashing */
+static void php_git2_bloom_hashes(const char *path, size_t len, unsigned int *h1, unsigned int *h2)
+{
+	unsigned int a = 2166136261U, b = 0x9747b28cU;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		a = (a ^ (unsigned char)path[i]) * 16777619U;
+		b = (b ^ (unsigned char)path[i]) * 16777619U;
+	}
+	*h1 = a;
+	*h2 = b | 1;
+}
+
+static void php_git2_bloom_add(php_git2_bloom *bloom, const char *path, size_t len)
+{
+	unsigned int h1, h2, bit, i;
+
+	php_git2_bloom_hashes(path, len, &h1, &h2);
+	for (i = 0; i < PHP_GIT2_BLOOM_HASHES; i++) {
+		bit = (h1 + i * h2) % bloom->nbits;
+		bloom->bits[bit / 8] |= 1 << (bit % 8);
+	}
+}
+
+static int php_git2_bloom_contains(const php_git2_bloom *bloom, const char *path, size_t len)
+{
+	unsigned int h1, h2, bit, i;
+
+	if (bloom->nbits == 0) {
+		return 1;
+	}
+	php_git2_bloom_hashes(path, len, &h1, &h2);
+	for (i = 0; i < PHP_GIT2_BLOOM_HASHES; i++) {
+		bit = (h1 + i * h2) % bloom->nbits;
+		if (!(bloom->bits[bit / 8] & (1 << (bit % 8)))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* changed paths against the first parent, with every leading directory, go into one filter */
+static int php_git2_changed_paths_index(php_git2_changed_paths *changed_paths, git_repository *repo, git_commit *commit)
+{
+	git_commit *parent = NULL;
+	git_tree *tree = NULL, *parent_tree = NULL;
+	git_diff *diff = NULL;
+	const git_diff_delta *delta;
+	php_git2_bloom *bloom;
+	HashTable paths;
+	HashPosition pos;
+	char *key, dummy = 0;
+	uint key_len;
+	ulong num_key;
+	size_t i, n, len;
+	unsigned int nbits = 0;
+	int error;
+
+	error = git_commit_tree(&tree, commit);
+	if (error == 0 && git_commit_parentcount(commit) > 0) {
+		error = git_commit_parent(&parent, commit, 0);
+		if (error == 0) {
+			error = git_commit_tree(&parent_tree, parent);
+		}
+	}
+	if (error == 0) {
+		error = git_diff_tree_to_tree(&diff, repo, parent_tree, tree, NULL);
+	}
+	git_tree_free(parent_tree);
+	git_commit_free(parent);
+	git_tree_free(tree);
+	if (error != 0) {
+		return error;
+	}
+
+	zend_hash_init(&paths, 16, NULL, NULL, 0);
+	n = git_diff_num_deltas(diff);
+	for (i = 0; i < n && zend_hash_num_elements(&paths) <= PHP_GIT2_BLOOM_MAX_PATHS; i++) {
+		delta = git_diff_get_delta(diff, i);
+		key = (char*)delta->new_file.path;
+		zend_hash_update(&paths, key, strlen(key), (void*)&dummy, sizeof(char), NULL);
+		for (len = strlen(key); len > 0; len--) {
+			if (key[len] == '/') {
+				zend_hash_update(&paths, key, len, (void*)&dummy, sizeof(char), NULL);
+			}
+		}
+	}
+	git_diff_free(diff);
+
+	if (zend_hash_num_elements(&paths) <= PHP_GIT2_BLOOM_MAX_PATHS) {
+		nbits = (zend_hash_num_elements(&paths) * PHP_GIT2_BLOOM_BITS_PER_PATH + 63) / 64 * 64;
+		if (nbits == 0) {
+			nbits = 64;
+		}
+	}
+	bloom = (php_git2_bloom*)ecalloc(1, PHP_GIT2_BLOOM_SIZE(nbits));
+	bloom->nbits = nbits;
+	if (nbits > 0) {
+		for (zend_hash_internal_pointer_reset_ex(&paths, &pos);
+			zend_hash_get_current_key_ex(&paths, &key, &key_len, &num_key, 0, &pos) == HASH_KEY_IS_STRING;
+			zend_hash_move_forward_ex(&paths, &pos)) {
+			php_git2_bloom_add(bloom, key, key_len);
+		}
+	}
+	zend_hash_destroy(&paths);
+
+	zend_hash_update(&changed_paths->filters, (char*)git_commit_id(commit)->id, GIT_OID_RAWSZ,
+		(void*)bloom, PHP_GIT2_BLOOM_SIZE(nbits), NULL);
+	efree(bloom);
+	changed_paths->dirty = 1;
+	return 0;
+}
+
+static int php_git2_revwalk_entry_id(git_oid *out, git_commit *commit, const char *path)
+{
+	git_tree *tree = NULL;
+	git_tree_entry *entry = NULL;
+	int error;
+
+	memset(out, 0, sizeof(git_oid));
+	error = git_commit_tree(&tree, commit);
+	if (error != 0) {
+		return error;
+	}
+	error = git_tree_entry_bypath(&entry, tree, path);
+	if (error == 0) {
+		git_oid_cpy(out, git_tree_entry_id(entry));
+		git_tree_entry_free(entry);
+	} else if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = 0;
+	}
+	git_tree_free(tree);
+	return error;
+}
+
+/* a commit touches a path when the path differs from every parent, as git log -- path sees it,
+   or from the first parent alone with first_parent */
+static int php_git2_revwalk_touches(git_repository *repo, const git_oid *id, const char *path, int first_parent)
+{
+	git_commit *commit = NULL, *parent = NULL;
+	git_oid own, theirs;
+	unsigned int i, n;
+	int error, touched;
+
+	error = git_commit_lookup(&commit, repo, id);
+	if (error == 0) {
+		error = php_git2_revwalk_entry_id(&own, commit, path);
+	}
+	if (error != 0) {
+		git_commit_free(commit);
+		return error;
+	}
+
+	n = git_commit_parentcount(commit);
+	if (first_parent && n > 1) {
+		n = 1;
+	}
+	touched = n == 0 ? !git_oid_iszero(&own) : 1;
+	for (i = 0; i < n && touched; i++) {
+		error = git_commit_parent(&parent, commit, i);
+		if (error == 0) {
+			error = php_git2_revwalk_entry_id(&theirs, parent, path);
+			git_commit_free(parent);
+		}
+		if (error != 0) {
+			break;
+		}
+		if (git_oid_equal(&own, &theirs)) {
+			touched = 0;
+		}
+	}
+	git_commit_free(commit);
+	return error != 0 ? error : touched;
+}
+
+int php_git2_changed_paths_touches(php_git2_changed_paths *changed_paths, git_repository *repo, const git_oid *id, const char *path, int first_parent)
+{
+	php_git2_bloom *bloom;
+	int maybe = 0, touched;
+
+	if (changed_paths != NULL &&
+		zend_hash_find(&changed_paths->filters, (char*)id->id, GIT_OID_RAWSZ, (void**)&bloom) == SUCCESS) {
+		if (!php_git2_bloom_contains(bloom, path, strlen(path))) {
+			changed_paths->filtered++;
+			return 0;
+		}
+		maybe = bloom->nbits > 0;
+	}
+	touched = php_git2_revwalk_touches(repo, id, path, first_parent);
+	if (changed_paths != NULL) {
+		changed_paths->checked++;
+		if (maybe && touched == 0) {
+			changed_paths->false_positives++;
+		}
+	}
+	return touched;
+}
+
+static void php_git2_changed_paths_load(php_git2_changed_paths *changed_paths)
+{
+	char magic[sizeof(PHP_GIT2_CHANGED_PATHS_MAGIC) - 1], oid[GIT_OID_RAWSZ];
+	php_git2_bloom *bloom;
+	unsigned int nbits;
+	FILE *fp;
+
+	fp = fopen(changed_paths->path, "rb");
+	if (fp == NULL) {
+		return;
+	}
+	if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+		memcmp(magic, PHP_GIT2_CHANGED_PATHS_MAGIC, sizeof(magic)) == 0) {
+		while (fread(oid, 1, sizeof(oid), fp) == sizeof(oid) &&
+			fread(&nbits, 1, sizeof(nbits), fp) == sizeof(nbits) &&
+			nbits % 8 == 0 && nbits <= PHP_GIT2_BLOOM_MAX_BITS) {
+			bloom = (php_git2_bloom*)ecalloc(1, PHP_GIT2_BLOOM_SIZE(nbits));
+			bloom->nbits = nbits;
+			if (fread(bloom->bits, 1, nbits / 8, fp) != nbits / 8) {
+				efree(bloom);
+				break;
+			}
+			zend_hash_update(&changed_paths->filters, oid, sizeof(oid), (void*)bloom, PHP_GIT2_BLOOM_SIZE(nbits), NULL);
+			efree(bloom);
+		}
+	}
+	fclose(fp);
+}
+
+static int php_git2_changed_paths_save(php_git2_changed_paths *changed_paths)
+{
+	php_git2_bloom *bloom;
+	HashPosition pos;
+	char *key;
+	uint key_len;
+	ulong num_key;
+	smart_str out = {0};
+	int error = 0;
+
+	if (changed_paths->path == NULL || !changed_paths->dirty) {
+		return 0;
+	}
+	smart_str_appendl(&out, PHP_GIT2_CHANGED_PATHS_MAGIC, sizeof(PHP_GIT2_CHANGED_PATHS_MAGIC) - 1);
+	for (zend_hash_internal_pointer_reset_ex(&changed_paths->filters, &pos);
+		zend_hash_get_current_data_ex(&changed_paths->filters, (void**)&bloom, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&changed_paths->filters, &pos)) {
+		zend_hash_get_current_key_ex(&changed_paths->filters, &key, &key_len, &num_key, 0, &pos);
+		smart_str_appendl(&out, key, GIT_OID_RAWSZ);
+		smart_str_appendl(&out, (const char*)&bloom->nbits, sizeof(bloom->nbits));
+		smart_str_appendl(&out, (const char*)bloom->bits, bloom->nbits / 8);
+	}
+	if (php_git2_lockfile_write(changed_paths->path, out.c, out.len)) {
+		error = -1;
+	} else {
+		changed_paths->dirty = 0;
+	}
+	smart_str_free(&out);
+	return error;
+}
+
+void php_git2_changed_paths_free(php_git2_changed_paths *changed_paths)
+{
+	php_git2_changed_paths_save(changed_paths);
+	zend_hash_destroy(&changed_paths->filters);
+	if (changed_paths->path != NULL) {
+		efree(changed_paths->path);
+	}
+	efree(changed_paths);
+}
+
+void php_git2_revwalk_limit_free(php_git2_revwalk_limit *limit)
+{
+	TSRMLS_FETCH();
+
+	if (limit->changed_paths != NULL) {
+		zend_list_delete(limit->changed_paths_id);
+	}
+	efree(limit->path);
+	efree(limit);
+}
+
+/* {{{ proto bool git_revwalk_limit_path(resource $walk, string $path[, resource $changed_paths])
+  git_revwalk_next only returns commits touching $path from now on. commits in the
+  $changed_paths index are mostly rejected by their filter without reading any tree */
+PHP_FUNCTION(git_revwalk_limit_path)
+{
+	zval *walk = NULL, *changed_paths = NULL;
+	php_git2_t *_walk = NULL, *_changed_paths = NULL;
+	php_git2_revwalk_limit *limit;
+	char *path = NULL;
+	int path_len = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rs|r!", &walk, &path, &path_len, &changed_paths) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_walk, php_git2_t*, &walk, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (changed_paths != NULL) {
+		ZEND_FETCH_RESOURCE(_changed_paths, php_git2_t*, &changed_paths, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+		if (_changed_paths->type != PHP_GIT2_TYPE_CHANGED_PATHS) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "changed_paths expects a git_revwalk_changed_paths_new resource");
+			RETURN_FALSE;
+		}
+	}
+	while (path_len > 0 && path[path_len - 1] == '/') {
+		path_len--;
+	}
+	if (path_len == 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "path must not be empty");
+		RETURN_FALSE;
+	}
+
+	if (_walk->priv != NULL) {
+		php_git2_revwalk_limit_free((php_git2_revwalk_limit*)_walk->priv);
+	}
+	limit = (php_git2_revwalk_limit*)ecalloc(1, sizeof(php_git2_revwalk_limit));
+	limit->path = estrndup(path, path_len);
+	if (_changed_paths != NULL) {
+		limit->changed_paths = PHP_GIT2_V(_changed_paths, changed_paths);
+		limit->changed_paths_id = GIT2_RVAL_P(_changed_paths);
+		zend_list_addref(limit->changed_paths_id);
+	}
+	_walk->priv = limit;
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto resource git_revwalk_changed_paths_new(resource $repo[, bool $persist])
+  creates a commit oid => changed paths bloom filter index.
+  with $persist it is loaded from and written back to $GIT_DIR/php_git2_changed_paths */
+PHP_FUNCTION(git_revwalk_changed_paths_new)
+{
+	zval *repo = NULL;
+	php_git2_t *_repo = NULL, *result = NULL;
+	php_git2_changed_paths *changed_paths;
+	zend_bool persist = 0;
+	char path[MAXPATHLEN];
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r|b", &repo, &persist) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	changed_paths = (php_git2_changed_paths*)ecalloc(1, sizeof(php_git2_changed_paths));
+	zend_hash_init(&changed_paths->filters, 1024, NULL, NULL, 0);
+	if (persist) {
+		snprintf(path, sizeof(path), "%sphp_git2_changed_paths", git_repository_path(PHP_GIT2_V(_repo, repository)));
+		changed_paths->path = estrdup(path);
+		php_git2_changed_paths_load(changed_paths);
+	}
+	if (php_git2_make_resource(&result, PHP_GIT2_TYPE_CHANGED_PATHS, changed_paths, 1 TSRMLS_CC)) {
+		php_git2_changed_paths_free(changed_paths);
+		RETURN_FALSE;
+	}
+	ZVAL_RESOURCE(return_value, GIT2_RVAL_P(result));
+}
+/* }}} */
+
+/* {{{ proto long git_revwalk_changed_paths_update(resource $changed_paths, resource $repo[, string $glob])
+  indexes the commits reachable from $glob (default "refs/*") that are not indexed yet,
+  meant to run after pushes. returns the number of commits added */
+PHP_FUNCTION(git_revwalk_changed_paths_update)
+{
+	zval *changed_paths = NULL, *repo = NULL;
+	php_git2_t *_changed_paths = NULL, *_repo = NULL;
+	php_git2_changed_paths *_c;
+	git_revwalk *walk = NULL;
+	git_commit *commit = NULL;
+	git_oid id;
+	char *glob = "refs/*";
+	int glob_len = 0, error = 0;
+	long added = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rr|s", &changed_paths, &repo, &glob, &glob_len) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_changed_paths, php_git2_t*, &changed_paths, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (_changed_paths->type != PHP_GIT2_TYPE_CHANGED_PATHS) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "changed_paths expects a git_revwalk_changed_paths_new resource");
+		RETURN_FALSE;
+	}
+	_c = PHP_GIT2_V(_changed_paths, changed_paths);
+
+	error = git_revwalk_new(&walk, PHP_GIT2_V(_repo, repository));
+	if (error == 0) {
+		error = git_revwalk_push_glob(walk, glob);
+	}
+	while (error == 0 && (error = git_revwalk_next(&id, walk)) == 0) {
+		if (zend_hash_exists(&_c->filters, (char*)id.id, GIT_OID_RAWSZ)) {
+			continue;
+		}
+		error = git_commit_lookup(&commit, PHP_GIT2_V(_repo, repository), &id);
+		if (error == 0) {
+			error = php_git2_changed_paths_index(_c, PHP_GIT2_V(_repo, repository), commit);
+			git_commit_free(commit);
+		}
+		if (error == 0) {
+			added++;
+		}
+	}
+	git_revwalk_free(walk);
+	if (error == GIT_ITEROVER) {
+		error = 0;
+	}
+	if (php_git2_check_error(error, "git_revwalk_changed_paths_update" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_LONG(added);
+}
+/* }}} */
+
+/* {{{ proto bool git_revwalk_changed_paths_save(resource $changed_paths)
+ */
+PHP_FUNCTION(git_revwalk_changed_paths_save)
+{
+	zval *changed_paths = NULL;
+	php_git2_t *_changed_paths = NULL;
+	int error = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &changed_paths) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_changed_paths, php_git2_t*, &changed_paths, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	error = php_git2_changed_paths_save(PHP_GIT2_V(_changed_paths, changed_paths));
+	if (php_git2_check_error(error, "git_revwalk_changed_paths_save" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto array git_revwalk_changed_paths_stats(resource $changed_paths)
+ */
+PHP_FUNCTION(git_revwalk_changed_paths_stats)
+{
+	zval *changed_paths = NULL;
+	php_git2_t *_changed_paths = NULL;
+	php_git2_changed_paths *_c;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &changed_paths) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_changed_paths, php_git2_t*, &changed_paths, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	_c = PHP_GIT2_V(_changed_paths, changed_paths);
+	array_init(return_value);
+	add_assoc_long_ex(return_value, ZEND_STRS("commits"), zend_hash_num_elements(&_c->filters));
+	add_assoc_long_ex(return_value, ZEND_STRS("filtered"), _c->filtered);
+	add_assoc_long_ex(return_value, ZEND_STRS("checked"), _c->checked);
+	add_assoc_long_ex(return_value, ZEND_STRS("false_positives"), _c->false_positives);
+	add_assoc_bool_ex(return_value, ZEND_STRS("persistent"), _c->path != NULL);
+}
+/* }}} */
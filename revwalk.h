@@ -26,6 +26,33 @@
 #ifndef PHP_GIT2_REVWALK_H
 #define PHP_GIT2_REVWALK_H
 
+/* paths touched by one commit against its first parent; nbits 0 means too many to index */
+typedef struct php_git2_bloom {
+	unsigned int nbits;
+	unsigned char bits[1];
+} php_git2_bloom;
+
+/* commit oid => php_git2_bloom, optionally kept in $GIT_DIR */
+typedef struct php_git2_changed_paths {
+	HashTable filters;
+	char *path;
+	int dirty;
+	long filtered;
+	long checked;
+	long false_positives;
+} php_git2_changed_paths;
+
+/* path limiting state kept on a revwalk resource */
+typedef struct php_git2_revwalk_limit {
+	char *path;
+	php_git2_changed_paths *changed_paths;
+	int changed_paths_id;
+} php_git2_revwalk_limit;
+
+void php_git2_changed_paths_free(php_git2_changed_paths *changed_paths);
+void php_git2_revwalk_limit_free(php_git2_revwalk_limit *limit);
+int php_git2_changed_paths_touches(php_git2_changed_paths *changed_paths, git_repository *repo, const git_oid *id, const char *path, int first_parent);
+
 ZEND_BEGIN_ARG_INFO_EX(arginfo_git_revwalk_new, 0, 0, 1)
 	ZEND_ARG_INFO(0, repo)
 ZEND_END_ARG_INFO()
@@ -98,6 +125,31 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_git_revwalk_repository, 0, 0, 1)
 	ZEND_ARG_INFO(0, walk)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_revwalk_limit_path, 0, 0, 2)
+	ZEND_ARG_INFO(0, walk)
+	ZEND_ARG_INFO(0, path)
+	ZEND_ARG_INFO(0, changed_paths)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_revwalk_changed_paths_new, 0, 0, 1)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, persist)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_revwalk_changed_paths_update, 0, 0, 2)
+	ZEND_ARG_INFO(0, changed_paths)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, glob)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_revwalk_changed_paths_save, 0, 0, 1)
+	ZEND_ARG_INFO(0, changed_paths)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_revwalk_changed_paths_stats, 0, 0, 1)
+	ZEND_ARG_INFO(0, changed_paths)
+ZEND_END_ARG_INFO()
+
 /* {{{ proto long git_revwalk_new(repo)
 */
 PHP_FUNCTION(git_revwalk_new);
@@ -162,5 +214,24 @@ PHP_FUNCTION(git_revwalk_free);
 */
 PHP_FUNCTION(git_revwalk_repository);
 
+/* {{{ proto bool git_revwalk_limit_path(walk, path[, changed_paths])
+*/
+PHP_FUNCTION(git_revwalk_limit_path);
+
+/* {{{ proto resource git_revwalk_changed_paths_new(repo[, persist])
+*/
+PHP_FUNCTION(git_revwalk_changed_paths_new);
+
+/* {{{ proto long git_revwalk_changed_paths_update(changed_paths, repo[, glob])
+*/
+PHP_FUNCTION(git_revwalk_changed_paths_update);
+
+/* {{{ proto bool git_revwalk_changed_paths_save(changed_paths)
+*/
+PHP_FUNCTION(git_revwalk_changed_paths_save);
+
+/* {{{ proto array git_revwalk_changed_paths_stats(changed_paths)
+*/
+PHP_FUNCTION(git_revwalk_changed_paths_stats);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,1581 @@
+#include "php_git2.h"
+#include "php_git2_priv.h"
+#include "serve.h"
+#include "indexer.h"
+#include "packbuilder.h"
+#include "bitmap.h"
+#include "git2/sys/repository.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#define PHP_GIT2_UPLOAD_PACK_CAPS "multi_ack_detailed side-band-64k ofs-delta no-progress agent=php-git2"
+#define PHP_GIT2_RECEIVE_PACK_CAPS "report-status delete-refs atomic side-band-64k ofs-delta agent=php-git2"
+
+typedef struct php_git2_pkt_reader {
+	php_stream *stream;
+	size_t len;
+	char buf[PHP_GIT2_PKT_MAX + 1];
+} php_git2_pkt_reader;
+
+typedef struct php_git2_oid_list {
+	git_oid *ids;
+	size_t count;
+	size_t alloc;
+} php_git2_oid_list;
+
+typedef struct php_git2_upload_pack {
+	git_repository *repo;
+	php_git2_pkt_reader *reader;
+	php_git2_stream_writer *writer;
+	php_git2_oid_list wants;
+	php_git2_oid_list common;
+	git_oid *want_commits; /* the wants peeled to commits, for the "ready" check */
+	unsigned char *reached; /* per want: a common commit is among its ancestors */
+	size_t unreached;
+	int multi_ack; /* 0: none, 1: multi_ack, 2: multi_ack_detailed */
+	int sideband;
+	int no_progress;
+	int streaming; /* side-band is live once the final ACK/NAK went out */
+	long haves;
+	long objects;
+	int pack_sent;
+	long threads;
+	php_git2_packbuilder_state pack; /* compression asked for and what the pack write did */
+} php_git2_upload_pack;
+
+typedef struct php_git2_receive_command {
+	git_oid old_id;
+	git_oid new_id;
+	char *ref;
+	char *error; /* ng reason, NULL while the command is fine */
+	int applied;
+	int lock_fd; /* <ref>.lock held while the batch is applied, -1 otherwise */
+} php_git2_receive_command;
+
+typedef struct php_git2_receive_pack {
+	git_repository *repo;
+	php_git2_pkt_reader *reader;
+	php_git2_stream_writer *writer;
+	php_git2_receive_command *commands;
+	size_t count;
+	size_t alloc;
+	int report_status;
+	int sideband;
+	char *unpack_error;
+	long objects;
+	int applied;
+	long rollback_failed;
+	char *quarantine; /* objects directory the pushed pack waits in until it is accepted */
+	char pack_name[GIT_OID_HEXSZ + 1];
+	git_repository *quarantine_repo; /* a second handle that also reads the quarantine, for the checks and pre_receive */
+} php_git2_receive_pack;
+
+static void php_git2_oid_list_push(php_git2_oid_list *list, const git_oid *id)
+{
+	if (list->count == list->alloc) {
+		list->alloc = list->alloc ? list->alloc * 2 : 16;
+		list->ids = (git_oid*)erealloc(list->ids, sizeof(git_oid) * list->alloc);
+	}
+	git_oid_cpy(&list->ids[list->count++], id);
+}
+
+static int php_git2_oid_list_contains(php_git2_oid_list *list, const git_oid *id)
+{
+	size_t i;
+
+	for (i = 0; i < list->count; i++) {
+		if (git_oid_equal(&list->ids[i], id)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void php_git2_oid_list_free(php_git2_oid_list *list)
+{
+	if (list->ids != NULL) {
+		efree(list->ids);
+	}
+	list->ids = NULL;
+	list->count = list->alloc = 0;
+}
+
+static int php_git2_serve_read(php_stream *stream, char *buf, size_t len TSRMLS_DC)
+{
+	size_t n;
+
+	while (len > 0) {
+		n = php_stream_read(stream, buf, len);
+		if (n == 0) {
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* reads one pkt-line into reader->buf with the trailing newline stripped.
+   returns 1 for a data pkt, 0 for a flush-pkt and -1 on eof or a malformed length */
+static int php_git2_pkt_read(php_git2_pkt_reader *reader TSRMLS_DC)
+{
+	char header[4];
+	size_t len = 0;
+	int i;
+
+	reader->len = 0;
+	reader->buf[0] = '\0';
+	if (php_git2_serve_read(reader->stream, header, 4 TSRMLS_CC)) {
+		return -1;
+	}
+	for (i = 0; i < 4; i++) {
+		if (!isxdigit((unsigned char)header[i])) {
+			return -1;
+		}
+		len = (len << 4) | (isdigit((unsigned char)header[i]) ? header[i] - '0' : (tolower((unsigned char)header[i]) - 'a' + 10));
+	}
+	if (len == 0) {
+		return 0;
+	}
+	if (len < 4 || len > PHP_GIT2_PKT_MAX) {
+		return -1;
+	}
+	len -= 4;
+	if (php_git2_serve_read(reader->stream, reader->buf, len TSRMLS_CC)) {
+		return -1;
+	}
+	if (len > 0 && reader->buf[len - 1] == '\n') {
+		len--;
+	}
+	reader->buf[len] = '\0';
+	reader->len = len;
+	return 1;
+}
+
+/* space separated capability lookup, "agent=x" style entries match on their key */
+static int php_git2_serve_has_cap(const char *caps, const char *name)
+{
+	size_t name_len = strlen(name), len;
+	const char *end;
+
+	while (caps != NULL && *caps) {
+		while (*caps == ' ') {
+			caps++;
+		}
+		end = strchr(caps, ' ');
+		len = end ? (size_t)(end - caps) : strlen(caps);
+		if (len >= name_len && memcmp(caps, name, name_len) == 0 && (len == name_len || caps[name_len] == '=')) {
+			return 1;
+		}
+		caps = end;
+	}
+	return 0;
+}
+
+static int php_git2_serve_pkt_printf(php_git2_stream_writer *writer, const char *format, ...)
+{
+	char line[PHP_GIT2_PKT_MAX];
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	len = vsnprintf(line, sizeof(line) - 4, format, args);
+	va_end(args);
+	if (len < 0 || len >= (int)sizeof(line) - 4) {
+		return -1;
+	}
+	return php_git2_pkt_write(writer, line, len);
+}
+
+static int php_git2_serve_advertise_ref(php_git2_stream_writer *writer, const git_oid *id, const char *name, const char *caps, int *first)
+{
+	char hex[GIT_OID_HEXSZ + 1];
+	int error;
+
+	git_oid_tostr(hex, sizeof(hex), id);
+	if (*first) {
+		error = php_git2_serve_pkt_printf(writer, "%s %s%c%s\n", hex, name, '\0', caps);
+		*first = 0;
+	} else {
+		error = php_git2_serve_pkt_printf(writer, "%s %s\n", hex, name);
+	}
+	return error;
+}
+
+typedef int (*php_git2_serve_ref_cb)(const git_oid *id, const char *name, void *payload);
+
+/* calls cb for every ref that resolves, upload-pack also gets HEAD first and peeled tags
+   as "<name>^{}". a non-zero return from cb stops the walk and is returned */
+static int php_git2_serve_foreach_ref(git_repository *repo, int upload, php_git2_serve_ref_cb cb, void *payload)
+{
+	git_strarray names = {0};
+	git_object *object = NULL, *peeled = NULL;
+	git_oid id;
+	char peeled_name[1024];
+	size_t i;
+	int error = 0;
+
+	if (upload && git_reference_name_to_id(&id, repo, "HEAD") == 0) {
+		if ((error = cb(&id, "HEAD", payload))) {
+			return error;
+		}
+	}
+	giterr_clear();
+	error = git_reference_list(&names, repo);
+	if (error) {
+		return error;
+	}
+	for (i = 0; i < names.count; i++) {
+		if (git_reference_name_to_id(&id, repo, names.strings[i]) != 0) {
+			/* dangling symbolic refs are not advertised */
+			giterr_clear();
+			continue;
+		}
+		if ((error = cb(&id, names.strings[i], payload))) {
+			break;
+		}
+		if (!upload || strncmp(names.strings[i], "refs/tags/", sizeof("refs/tags/") - 1) != 0) {
+			continue;
+		}
+		if (git_object_lookup(&object, repo, &id, GIT_OBJ_ANY) != 0) {
+			giterr_clear();
+			continue;
+		}
+		if (git_object_type(object) == GIT_OBJ_TAG && git_tag_peel(&peeled, (git_tag*)object) == 0) {
+			snprintf(peeled_name, sizeof(peeled_name), "%s^{}", names.strings[i]);
+			error = cb(git_object_id(peeled), peeled_name, payload);
+			git_object_free(peeled);
+		}
+		git_object_free(object);
+		if (error) {
+			break;
+		}
+	}
+	git_strarray_free(&names);
+	return error;
+}
+
+typedef struct php_git2_serve_advertisement {
+	php_git2_stream_writer *writer;
+	const char *caps;
+	int first;
+} php_git2_serve_advertisement;
+
+static int php_git2_serve_advertise_cb(const git_oid *id, const char *name, void *payload)
+{
+	php_git2_serve_advertisement *ad = (php_git2_serve_advertisement*)payload;
+
+	return php_git2_serve_advertise_ref(ad->writer, id, name, ad->caps, &ad->first) ? GIT_EUSER : 0;
+}
+
+/* writes the ref advertisement terminated by a flush-pkt: every ref, the first one carrying
+   the capability list. upload-pack also gets HEAD first and peeled tags as "<name>^{}".
+   service_header prepends the "# service=" block smart http expects in front of info/refs */
+static int php_git2_serve_advertise(php_git2_stream_writer *writer, git_repository *repo, const char *service, const char *caps, int service_header, int upload)
+{
+	php_git2_serve_advertisement ad;
+	git_reference *head = NULL;
+	git_oid id;
+	char *head_caps = NULL;
+	int error = 0;
+
+	if (service_header) {
+		if (php_git2_serve_pkt_printf(writer, "# service=%s\n", service) || php_git2_pkt_flush(writer)) {
+			return GIT_EUSER;
+		}
+	}
+
+	head_caps = estrdup(caps);
+	if (upload && git_reference_lookup(&head, repo, "HEAD") == 0) {
+		if (git_reference_type(head) == GIT_REF_SYMBOLIC) {
+			efree(head_caps);
+			spprintf(&head_caps, 0, "%s symref=HEAD:%s", caps, git_reference_symbolic_target(head));
+		}
+		git_reference_free(head);
+	}
+
+	ad.writer = writer;
+	ad.caps = head_caps;
+	ad.first = 1;
+	error = php_git2_serve_foreach_ref(repo, upload, php_git2_serve_advertise_cb, &ad);
+	if (error == 0 && ad.first) {
+		/* empty repository: advertise the capabilities alone */
+		memset(&id, 0, sizeof(id));
+		if (php_git2_serve_advertise_ref(writer, &id, "capabilities^{}", head_caps, &ad.first)) {
+			error = GIT_EUSER;
+		}
+	}
+	if (error == 0 && php_git2_pkt_flush(writer)) {
+		error = GIT_EUSER;
+	}
+	efree(head_caps);
+	return error;
+}
+
+static int php_git2_upload_pack_tip_cb(const git_oid *id, const char *name, void *payload)
+{
+	zend_hash_add_empty_element((HashTable*)payload, (char*)id->id, GIT_OID_RAWSZ);
+	return 0;
+}
+
+/* sends a fatal message the client prints before giving up: band 3 once
+   side-band is negotiated, an ERR pkt otherwise */
+static void php_git2_upload_pack_fail(php_git2_upload_pack *up, const char *message)
+{
+	if (up->streaming) {
+		php_git2_serve_pkt_printf(up->writer, "%c%s\n", 3, message);
+	} else {
+		php_git2_serve_pkt_printf(up->writer, "ERR %s\n", message);
+	}
+}
+
+static int php_git2_upload_pack_parse_oid(git_oid *id, const char *line, size_t prefix)
+{
+	if (strlen(line) < prefix + GIT_OID_HEXSZ) {
+		return -1;
+	}
+	if (line[prefix + GIT_OID_HEXSZ] != '\0' && line[prefix + GIT_OID_HEXSZ] != ' ') {
+		return -1;
+	}
+	return git_oid_fromstrn(id, line + prefix, GIT_OID_HEXSZ);
+}
+
+/* reads the want block up to its flush-pkt. returns 1 when the client wants nothing */
+static int php_git2_upload_pack_wants(php_git2_upload_pack *up TSRMLS_DC)
+{
+	HashTable tips;
+	git_oid id;
+	char hex[GIT_OID_HEXSZ + 1], message[64 + GIT_OID_HEXSZ];
+	const char *caps;
+	int ret, error = 0;
+
+	/* like git upload-pack without uploadpack.allowAnySHA1InWant: only what the advertisement
+	   listed, recomputed here since a stateless request comes without it */
+	zend_hash_init(&tips, 64, NULL, NULL, 0);
+	if (php_git2_serve_foreach_ref(up->repo, 1, php_git2_upload_pack_tip_cb, &tips)) {
+		zend_hash_destroy(&tips);
+		php_git2_upload_pack_fail(up, "upload-pack: failed to list refs");
+		return -1;
+	}
+	for (;;) {
+		ret = php_git2_pkt_read(up->reader TSRMLS_CC);
+		if (ret < 0) {
+			error = -1;
+			break;
+		}
+		if (ret == 0) {
+			break;
+		}
+		if (strncmp(up->reader->buf, "want ", 5) != 0 || php_git2_upload_pack_parse_oid(&id, up->reader->buf, 5)) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "unexpected line in want list: %s", up->reader->buf);
+			php_git2_upload_pack_fail(up, "upload-pack: protocol error, expected want");
+			error = -1;
+			break;
+		}
+		if (up->wants.count == 0) {
+			caps = up->reader->buf + 5 + GIT_OID_HEXSZ;
+			if (php_git2_serve_has_cap(caps, "multi_ack_detailed")) {
+				up->multi_ack = 2;
+			} else if (php_git2_serve_has_cap(caps, "multi_ack")) {
+				up->multi_ack = 1;
+			}
+			up->sideband = php_git2_serve_has_cap(caps, "side-band-64k");
+			up->no_progress = php_git2_serve_has_cap(caps, "no-progress");
+		}
+		if (!zend_hash_exists(&tips, (char*)id.id, GIT_OID_RAWSZ)) {
+			git_oid_tostr(hex, sizeof(hex), &id);
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "client wants %s, which is not advertised", hex);
+			snprintf(message, sizeof(message), "upload-pack: not our ref %s", hex);
+			php_git2_upload_pack_fail(up, message);
+			error = -1;
+			break;
+		}
+		if (!php_git2_oid_list_contains(&up->wants, &id)) {
+			php_git2_oid_list_push(&up->wants, &id);
+		}
+	}
+	zend_hash_destroy(&tips);
+	if (error) {
+		return error;
+	}
+	return up->wants.count == 0 ? 1 : 0;
+}
+
+/* peels the wants to commits; a want that is no commit never holds the "ready" back,
+   as in git upload-pack's ok_to_give_up */
+static void php_git2_upload_pack_reach_init(php_git2_upload_pack *up)
+{
+	git_object *object = NULL, *peeled = NULL;
+	size_t i;
+
+	up->want_commits = (git_oid*)safe_emalloc(up->wants.count, sizeof(git_oid), 0);
+	up->reached = (unsigned char*)ecalloc(up->wants.count, 1);
+	up->unreached = up->wants.count;
+	for (i = 0; i < up->wants.count; i++) {
+		if (git_object_lookup(&object, up->repo, &up->wants.ids[i], GIT_OBJ_ANY) == 0 &&
+			git_object_peel(&peeled, object, GIT_OBJ_COMMIT) == 0) {
+			git_oid_cpy(&up->want_commits[i], git_object_id(peeled));
+		} else {
+			giterr_clear();
+			up->reached[i] = 1;
+			up->unreached--;
+		}
+		git_object_free(peeled);
+		git_object_free(object);
+		peeled = object = NULL;
+	}
+}
+
+/* marks the wants that have the new common commit id among their ancestors */
+static void php_git2_upload_pack_reach(php_git2_upload_pack *up, const git_oid *id)
+{
+	git_oid base;
+	size_t i;
+
+	for (i = 0; i < up->wants.count && up->unreached > 0; i++) {
+		if (up->reached[i]) {
+			continue;
+		}
+		if (git_oid_equal(&up->want_commits[i], id) ||
+			(git_merge_base(&base, up->repo, &up->want_commits[i], id) == 0 && git_oid_equal(&base, id))) {
+			up->reached[i] = 1;
+			up->unreached--;
+		}
+		giterr_clear();
+	}
+}
+
+/* runs have rounds until "done", answering each round the way git upload-pack does: with
+   multi_ack_detailed "ACK <id> ready" tells the client once every want has a common ancestor,
+   so it can stop sending haves. returns 1 when the negotiation finished, 0 when a stateless
+   round ended without it */
+static int php_git2_upload_pack_negotiate(php_git2_upload_pack *up, int stateless TSRMLS_DC)
+{
+	git_odb *odb = NULL;
+	git_oid id;
+	char hex[GIT_OID_HEXSZ + 1], last[GIT_OID_HEXSZ + 1] = {0};
+	int ret, error = 0, got_common = 0, got_other = 0;
+
+	if (git_repository_odb(&odb, up->repo)) {
+		return -1;
+	}
+	php_git2_upload_pack_reach_init(up);
+	for (;;) {
+		ret = php_git2_pkt_read(up->reader TSRMLS_CC);
+		if (ret < 0) {
+			/* a stateless clone may end the request right after the want block */
+			error = (stateless && up->haves == 0) ? 1 : -1;
+			break;
+		}
+		if (ret == 0) {
+			if (up->multi_ack == 2 && got_common && !got_other && up->unreached == 0 &&
+				php_git2_serve_pkt_printf(up->writer, "ACK %s ready\n", last)) {
+				error = -1;
+				break;
+			}
+			if (up->multi_ack || up->common.count == 0) {
+				if (php_git2_pkt_write(up->writer, "NAK\n", 4)) {
+					error = -1;
+					break;
+				}
+			}
+			if (stateless) {
+				error = 0;
+				break;
+			}
+			if (php_git2_stream_writer_flush(up->writer)) {
+				error = -1;
+				break;
+			}
+			got_common = got_other = 0;
+			continue;
+		}
+		if (strcmp(up->reader->buf, "done") == 0) {
+			error = 1;
+			break;
+		}
+		if (strncmp(up->reader->buf, "have ", 5) != 0 || php_git2_upload_pack_parse_oid(&id, up->reader->buf, 5)) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "unexpected line in have list: %s", up->reader->buf);
+			php_git2_upload_pack_fail(up, "upload-pack: protocol error, expected have or done");
+			error = -1;
+			break;
+		}
+		up->haves++;
+		git_oid_tostr(hex, sizeof(hex), &id);
+		if (!git_odb_exists(odb, &id)) {
+			/* they have what we do not */
+			got_other = 1;
+			ret = 0;
+			if (up->multi_ack == 2 && up->unreached == 0) {
+				ret = php_git2_serve_pkt_printf(up->writer, "ACK %s ready\n", hex);
+			} else if (up->multi_ack == 1 && up->unreached == 0) {
+				ret = php_git2_serve_pkt_printf(up->writer, "ACK %s continue\n", hex);
+			}
+			if (ret) {
+				error = -1;
+				break;
+			}
+			continue;
+		}
+		if (php_git2_oid_list_contains(&up->common, &id)) {
+			continue;
+		}
+		got_common = 1;
+		memcpy(last, hex, sizeof(last));
+		php_git2_oid_list_push(&up->common, &id);
+		php_git2_upload_pack_reach(up, &id);
+		if (up->multi_ack == 2) {
+			ret = php_git2_serve_pkt_printf(up->writer, "ACK %s common\n", hex);
+		} else if (up->multi_ack == 1) {
+			ret = php_git2_serve_pkt_printf(up->writer, "ACK %s continue\n", hex);
+		} else if (up->common.count == 1) {
+			ret = php_git2_serve_pkt_printf(up->writer, "ACK %s\n", hex);
+		} else {
+			ret = 0;
+		}
+		if (ret) {
+			error = -1;
+			break;
+		}
+	}
+	git_odb_free(odb);
+	return error;
+}
+
+/* adds a tree and everything below it to seen, and to the pack unless pb is NULL.
+   subtrees already in seen are skipped whole, so edges shared with the client cost nothing */
+static int php_git2_upload_pack_tree(git_packbuilder *pb, git_repository *repo, const git_oid *id, const char *name, HashTable *seen)
+{
+	git_tree *tree = NULL;
+	const git_tree_entry *entry;
+	const git_oid *entry_id;
+	size_t i, count;
+	char flag = 1;
+	int error = 0;
+
+	if (zend_hash_exists(seen, (char*)id->id, GIT_OID_RAWSZ)) {
+		return 0;
+	}
+	zend_hash_add(seen, (char*)id->id, GIT_OID_RAWSZ, &flag, sizeof(char), NULL);
+	if (pb != NULL && (error = git_packbuilder_insert(pb, id, name))) {
+		return error;
+	}
+	if ((error = git_tree_lookup(&tree, repo, id))) {
+		return error;
+	}
+	count = git_tree_entrycount(tree);
+	for (i = 0; i < count && error == 0; i++) {
+		entry = git_tree_entry_byindex(tree, i);
+		entry_id = git_tree_entry_id(entry);
+		switch (git_tree_entry_type(entry)) {
+			case GIT_OBJ_TREE:
+				error = php_git2_upload_pack_tree(pb, repo, entry_id, git_tree_entry_name(entry), seen);
+				break;
+			case GIT_OBJ_BLOB:
+				if (zend_hash_exists(seen, (char*)entry_id->id, GIT_OID_RAWSZ)) {
+					break;
+				}
+				zend_hash_add(seen, (char*)entry_id->id, GIT_OID_RAWSZ, &flag, sizeof(char), NULL);
+				if (pb != NULL) {
+					error = git_packbuilder_insert(pb, entry_id, git_tree_entry_name(entry));
+				}
+				break;
+			default:
+				/* gitlinks live in other repositories */
+				break;
+		}
+	}
+	git_tree_free(tree);
+	return error;
+}
+
+/* fills pb with everything reachable from the wants but not from the common haves.
+   the trees of the edge commits (hidden parents of commits being sent) are marked as
+   seen first, so only objects the client cannot have are packed */
+static int php_git2_upload_pack_build(php_git2_upload_pack *up, git_packbuilder *pb)
+{
+	git_revwalk *walk = NULL;
+	git_object *object = NULL, *target = NULL;
+	git_commit *commit = NULL, *parent = NULL;
+	php_git2_oid_list commits = {0};
+	HashTable seen, sending;
+	git_otype type;
+	git_oid id;
+	size_t i, n, parents;
+	char flag = 1;
+	int error = 0;
+
+	zend_hash_init(&seen, 1024, NULL, NULL, 0);
+	zend_hash_init(&sending, 256, NULL, NULL, 0);
+
+	if ((error = git_revwalk_new(&walk, up->repo))) {
+		goto done;
+	}
+	git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME);
+
+	for (i = 0; i < up->wants.count; i++) {
+		if ((error = git_object_lookup(&object, up->repo, &up->wants.ids[i], GIT_OBJ_ANY))) {
+			goto done;
+		}
+		/* annotated tags travel with their targets */
+		while (git_object_type(object) == GIT_OBJ_TAG) {
+			if ((error = git_packbuilder_insert(pb, git_object_id(object), NULL)) ||
+				(error = git_tag_target(&target, (git_tag*)object))) {
+				git_object_free(object);
+				goto done;
+			}
+			git_object_free(object);
+			object = target;
+		}
+		type = git_object_type(object);
+		git_oid_cpy(&id, git_object_id(object));
+		git_object_free(object);
+		object = NULL;
+		if (type == GIT_OBJ_COMMIT) {
+			error = git_revwalk_push(walk, &id);
+		} else if (type == GIT_OBJ_TREE) {
+			error = php_git2_upload_pack_tree(pb, up->repo, &id, NULL, &seen);
+		} else if (!zend_hash_exists(&seen, (char*)id.id, GIT_OID_RAWSZ)) {
+			zend_hash_add(&seen, (char*)id.id, GIT_OID_RAWSZ, &flag, sizeof(char), NULL);
+			error = git_packbuilder_insert(pb, &id, NULL);
+		}
+		if (error) {
+			goto done;
+		}
+	}
+
+	for (i = 0; i < up->common.count; i++) {
+		if (git_commit_lookup(&commit, up->repo, &up->common.ids[i]) != 0) {
+			/* common non-commits do not limit the walk */
+			giterr_clear();
+			continue;
+		}
+		git_commit_free(commit);
+		commit = NULL;
+		if ((error = git_revwalk_hide(walk, &up->common.ids[i]))) {
+			goto done;
+		}
+	}
+
+	while ((error = git_revwalk_next(&id, walk)) == 0) {
+		php_git2_oid_list_push(&commits, &id);
+		zend_hash_add(&sending, (char*)id.id, GIT_OID_RAWSZ, &flag, sizeof(char), NULL);
+	}
+	if (error != GIT_ITEROVER) {
+		goto done;
+	}
+	error = 0;
+
+	for (i = 0; i < commits.count && error == 0; i++) {
+		if ((error = git_commit_lookup(&commit, up->repo, &commits.ids[i]))) {
+			break;
+		}
+		parents = git_commit_parentcount(commit);
+		for (n = 0; n < parents && error == 0; n++) {
+			if (zend_hash_exists(&sending, (char*)git_commit_parent_id(commit, n)->id, GIT_OID_RAWSZ)) {
+				continue;
+			}
+			if (git_commit_parent(&parent, commit, n) != 0) {
+				/* the client has it even if we do not: nothing to mark */
+				giterr_clear();
+				continue;
+			}
+			error = php_git2_upload_pack_tree(NULL, up->repo, git_commit_tree_id(parent), NULL, &seen);
+			git_commit_free(parent);
+		}
+		git_commit_free(commit);
+		commit = NULL;
+	}
+
+	for (i = 0; i < commits.count && error == 0; i++) {
+		if ((error = git_commit_lookup(&commit, up->repo, &commits.ids[i]))) {
+			break;
+		}
+		error = git_packbuilder_insert(pb, &commits.ids[i], NULL);
+		if (error == 0) {
+			error = php_git2_upload_pack_tree(pb, up->repo, git_commit_tree_id(commit), NULL, &seen);
+		}
+		git_commit_free(commit);
+		commit = NULL;
+	}
+
+done:
+	if (walk != NULL) {
+		git_revwalk_free(walk);
+	}
+	php_git2_oid_list_free(&commits);
+	zend_hash_destroy(&sending);
+	zend_hash_destroy(&seen);
+	return error;
+}
+
+/* the object set from the reachability bitmaps: reach(wants) minus reach(common haves).
+   GIT_ENOTFOUND when no usable bitmap is around, the caller walks instead */
+static int php_git2_upload_pack_build_bitmap(php_git2_upload_pack *up, git_packbuilder *pb TSRMLS_DC)
+{
+	php_git2_bitmap_index *index = NULL;
+	php_git2_bitmap_reach reach, hidden;
+	int error;
+
+	if (php_git2_bitmap_index_open(&index, up->repo TSRMLS_CC)) {
+		return GIT_ENOTFOUND;
+	}
+	if ((error = php_git2_bitmap_reach_init(&reach, index, up->repo, up->wants.ids, up->wants.count)) == 0) {
+		if (up->common.count > 0) {
+			error = php_git2_bitmap_reach_init(&hidden, index, up->repo, up->common.ids, up->common.count);
+			if (error == 0) {
+				php_git2_bitmap_reach_subtract(&reach, &hidden);
+				php_git2_bitmap_reach_free(&hidden);
+			}
+		}
+		if (error == 0) {
+			error = php_git2_bitmap_reach_insert(&reach, index, up->repo, pb);
+		}
+		php_git2_bitmap_reach_free(&reach);
+	}
+	php_git2_bitmap_index_free(index);
+	return error;
+}
+
+/* answers the final round and streams the pack */
+static int php_git2_upload_pack_send(php_git2_upload_pack *up TSRMLS_DC)
+{
+	git_packbuilder *pb = NULL;
+	char hex[GIT_OID_HEXSZ + 1];
+	int error;
+
+	if ((error = git_packbuilder_new(&pb, up->repo))) {
+		php_git2_upload_pack_fail(up, "upload-pack: failed to create the pack");
+		return error;
+	}
+	git_packbuilder_set_threads(pb, up->threads);
+	up->pack.insert_ms = php_git2_now_ms();
+	error = php_git2_upload_pack_build_bitmap(up, pb TSRMLS_CC);
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = php_git2_upload_pack_build(up, pb);
+	}
+	if (error) {
+		git_packbuilder_free(pb);
+		php_git2_upload_pack_fail(up, "upload-pack: failed to compute the object set");
+		return error;
+	}
+	up->pack.insert_ms = php_git2_now_ms() - up->pack.insert_ms;
+
+	if (up->common.count > 0) {
+		if (up->multi_ack) {
+			git_oid_tostr(hex, sizeof(hex), &up->common.ids[up->common.count - 1]);
+			error = php_git2_serve_pkt_printf(up->writer, "ACK %s\n", hex);
+		}
+	} else {
+		error = php_git2_pkt_write(up->writer, "NAK\n", 4);
+	}
+	up->objects = git_packbuilder_object_count(pb);
+	up->streaming = up->sideband;
+	if (error == 0 && up->sideband && !up->no_progress) {
+		error = php_git2_serve_pkt_printf(up->writer, "%cCounting objects: %ld, done.\n", 2, up->objects);
+	}
+	if (error == 0) {
+		error = php_git2_packbuilder_write_stream(pb, &up->pack, up->writer, up->sideband);
+	}
+	if (error == 0 && up->sideband && php_git2_pkt_flush(up->writer)) {
+		error = GIT_EUSER;
+	}
+	if (error == 0) {
+		up->pack_sent = 1;
+	}
+	git_packbuilder_free(pb);
+	return error;
+}
+
+/* {{{ proto array git_upload_pack_serve(resource $repo, resource $in, resource $out[, array $options])
+  serves one upload-pack exchange in process: reads the want/have negotiation from $in,
+  answers it and streams the pack into $out. smart http is stateless, so each POST is one
+  call; a round without "done" is answered with ACK/NAK only and the client comes back.
+  options: advertise (write the info/refs advertisement to $out and return),
+  stateless_rpc (default true; false runs every round over the same $in/$out pair and
+  advertises first, as git:// and ssh do), threads and compression as for
+  git_packbuilder_set_options().
+  as git upload-pack does by default, only ref tips and peeled tags may be wanted, anything
+  else is refused with "not our ref".
+  returns array(wants, haves, common, objects, bytes, pack_sent, pack) or false, pack being
+  the git_packbuilder_stats() of the pack sent */
+PHP_FUNCTION(git_upload_pack_serve)
+{
+	zval *repo = NULL, *zin = NULL, *zout = NULL, *options = NULL, *tmp, *pack = NULL;
+	php_git2_t *_repo = NULL;
+	php_stream *in, *out;
+	php_git2_upload_pack up = {0};
+	int stateless = 1, advertise = 0, ret, error = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rrr|a", &repo, &zin, &zout, &options) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	php_stream_from_zval(in, &zin);
+	php_stream_from_zval(out, &zout);
+
+	if (options != NULL) {
+		if ((tmp = php_git2_read_arrval(options, ZEND_STRS("advertise") TSRMLS_CC)) != NULL) {
+			advertise = zend_is_true(tmp);
+		}
+		if ((tmp = php_git2_read_arrval(options, ZEND_STRS("stateless_rpc") TSRMLS_CC)) != NULL) {
+			stateless = zend_is_true(tmp);
+		}
+	}
+	up.threads = options ? php_git2_read_arrval_long2(options, ZEND_STRS("threads"), 0 TSRMLS_CC) : 0;
+	up.pack.compression = options ? php_git2_read_arrval_long2(options, ZEND_STRS("compression"), -1 TSRMLS_CC) : -1;
+	if (up.pack.compression < -1 || up.pack.compression > 9) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "compression must be between -1 and 9");
+		RETURN_FALSE;
+	}
+	if (up.threads < 0) {
+		up.threads = 0;
+	}
+
+	up.repo = PHP_GIT2_V(_repo, repository);
+	up.reader = (php_git2_pkt_reader*)emalloc(sizeof(php_git2_pkt_reader));
+	up.reader->stream = in;
+	up.writer = (php_git2_stream_writer*)emalloc(sizeof(php_git2_stream_writer));
+	php_git2_stream_writer_init(up.writer, out);
+
+	if (advertise || !stateless) {
+		error = php_git2_serve_advertise(up.writer, up.repo, "git-upload-pack", PHP_GIT2_UPLOAD_PACK_CAPS, advertise && stateless, 1);
+	}
+	if (error == 0 && !(advertise && stateless)) {
+		ret = php_git2_upload_pack_wants(&up TSRMLS_CC);
+		if (ret < 0) {
+			error = GIT_EUSER;
+		} else if (ret == 0) {
+			ret = php_git2_upload_pack_negotiate(&up, stateless TSRMLS_CC);
+			if (ret < 0) {
+				error = GIT_EUSER;
+			} else if (ret == 1) {
+				error = php_git2_upload_pack_send(&up TSRMLS_CC);
+			}
+		}
+	}
+	if (php_git2_stream_writer_flush(up.writer) && !error) {
+		error = GIT_EUSER;
+	}
+
+	array_init(return_value);
+	add_assoc_long_ex(return_value, ZEND_STRS("wants"), up.wants.count);
+	add_assoc_long_ex(return_value, ZEND_STRS("haves"), up.haves);
+	add_assoc_long_ex(return_value, ZEND_STRS("common"), up.common.count);
+	add_assoc_long_ex(return_value, ZEND_STRS("objects"), up.objects);
+	add_assoc_long_ex(return_value, ZEND_STRS("bytes"), up.writer->written);
+	add_assoc_bool_ex(return_value, ZEND_STRS("pack_sent"), up.pack_sent);
+	MAKE_STD_ZVAL(pack);
+	array_init(pack);
+	add_assoc_long_ex(pack, ZEND_STRS("objects"), up.objects);
+	php_git2_packbuilder_state_to_array(&up.pack, pack);
+	add_assoc_zval_ex(return_value, ZEND_STRS("pack"), pack);
+
+	php_git2_oid_list_free(&up.wants);
+	php_git2_oid_list_free(&up.common);
+	if (up.want_commits != NULL) {
+		efree(up.want_commits);
+		efree(up.reached);
+	}
+	efree(up.reader);
+	efree(up.writer);
+
+	if (error == GIT_EUSER) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "upload-pack failed: protocol error or stream failure");
+		zval_dtor(return_value);
+		RETURN_FALSE;
+	}
+	if (php_git2_check_error(error, "git_upload_pack_serve" TSRMLS_CC)) {
+		zval_dtor(return_value);
+		RETURN_FALSE;
+	}
+}
+/* }}} */
+
+/* reads the command list "<old> <new> <ref>" up to its flush-pkt, the first one carrying
+   the client capabilities after a NUL */
+static int php_git2_receive_pack_commands(php_git2_receive_pack *rp TSRMLS_DC)
+{
+	php_git2_receive_command *command;
+	const char *line, *nul;
+	int ret;
+
+	for (;;) {
+		ret = php_git2_pkt_read(rp->reader TSRMLS_CC);
+		if (ret < 0) {
+			return -1;
+		}
+		if (ret == 0) {
+			return 0;
+		}
+		line = rp->reader->buf;
+		nul = memchr(line, '\0', rp->reader->len);
+		if (nul != NULL && rp->count == 0) {
+			rp->report_status = php_git2_serve_has_cap(nul + 1, "report-status");
+			rp->sideband = php_git2_serve_has_cap(nul + 1, "side-band-64k");
+		}
+		if (strlen(line) < GIT_OID_HEXSZ * 2 + 3 || line[GIT_OID_HEXSZ] != ' ' || line[GIT_OID_HEXSZ * 2 + 1] != ' ') {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "unexpected line in command list: %s", line);
+			return -1;
+		}
+		if (rp->count == rp->alloc) {
+			rp->alloc = rp->alloc ? rp->alloc * 2 : 8;
+			rp->commands = (php_git2_receive_command*)erealloc(rp->commands, sizeof(php_git2_receive_command) * rp->alloc);
+		}
+		command = &rp->commands[rp->count];
+		memset(command, 0, sizeof(php_git2_receive_command));
+		command->lock_fd = -1;
+		if (git_oid_fromstrn(&command->old_id, line, GIT_OID_HEXSZ) ||
+			git_oid_fromstrn(&command->new_id, line + GIT_OID_HEXSZ + 1, GIT_OID_HEXSZ)) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "malformed object id in command list: %s", line);
+			return -1;
+		}
+		command->ref = estrdup(line + GIT_OID_HEXSZ * 2 + 2);
+		rp->count++;
+	}
+}
+
+/* streams the pack following the commands into a quarantine directory, objects/incoming-*,
+   through the indexer. the pack runs to the end of $in, as in a smart http request body */
+static int php_git2_receive_pack_unpack(php_git2_receive_pack *rp, php_stream *in TSRMLS_DC)
+{
+	php_git2_indexer_progress progress;
+	git_indexer *indexer = NULL;
+	git_odb *odb = NULL;
+	size_t total = 0;
+	char *pack_dir;
+	int error;
+
+	memset(&progress, 0, sizeof(progress));
+	spprintf(&rp->quarantine, 0, "%sobjects/incoming-%ld-%ld", git_repository_path(rp->repo), (long)getpid(), php_git2_now_ms());
+	spprintf(&pack_dir, 0, "%s/pack", rp->quarantine);
+	if (mkdir(rp->quarantine, 0700) != 0 || mkdir(pack_dir, 0700) != 0) {
+		efree(pack_dir);
+		giterr_set_str(GITERR_OS, "failed to create the quarantine directory");
+		return -1;
+	}
+	/* thin packs are completed from the objects the repository already has */
+	if ((error = git_repository_odb(&odb, rp->repo)) == 0) {
+		error = git_indexer_new(&indexer, pack_dir, 0, odb, NULL, NULL);
+	}
+	efree(pack_dir);
+	if (error == 0) {
+		error = php_git2_indexer_append_from_stream(indexer, &progress, in, PHP_GIT2_INDEXER_CHUNK_SIZE, 2, &total TSRMLS_CC);
+	}
+	if (error == 0 && total == 0) {
+		giterr_set_str(GITERR_INDEXER, "no pack data");
+		error = -1;
+	}
+	if (error == 0) {
+		error = git_indexer_commit(indexer, &progress.work);
+	}
+	if (error == 0) {
+		rp->objects = progress.work.received_objects;
+		git_oid_tostr(rp->pack_name, sizeof(rp->pack_name), git_indexer_hash(indexer));
+	}
+	if (indexer != NULL) {
+		git_indexer_free(indexer);
+	}
+	if (odb != NULL) {
+		git_odb_free(odb);
+	}
+	return error;
+}
+
+/* opens a second handle on the repository whose odb also reads the quarantine, so the checks
+   and pre_receive see the pushed objects while the caller's handle never does */
+static int php_git2_receive_pack_quarantine_enter(php_git2_receive_pack *rp)
+{
+	git_odb *odb = NULL;
+	char *objects;
+	int error;
+
+	if ((error = git_repository_open(&rp->quarantine_repo, git_repository_path(rp->repo)))) {
+		return error;
+	}
+	spprintf(&objects, 0, "%sobjects", git_repository_path(rp->repo));
+	error = git_odb_open(&odb, objects);
+	efree(objects);
+	if (error == 0) {
+		error = git_odb_add_disk_alternate(odb, rp->quarantine);
+	}
+	if (error == 0) {
+		git_repository_set_odb(rp->quarantine_repo, odb);
+	} else {
+		git_repository_free(rp->quarantine_repo);
+		rp->quarantine_repo = NULL;
+	}
+	if (odb != NULL) {
+		git_odb_free(odb);
+	}
+	return error;
+}
+
+static void php_git2_receive_pack_quarantine_leave(php_git2_receive_pack *rp)
+{
+	git_repository_free(rp->quarantine_repo);
+	rp->quarantine_repo = NULL;
+}
+
+/* moves the accepted pack into objects/pack, the .pack first so no reader finds an .idx
+   without its pack */
+static int php_git2_receive_pack_migrate(php_git2_receive_pack *rp)
+{
+	static const char *exts[] = {".pack", ".idx"};
+	char from[MAXPATHLEN], to[MAXPATHLEN];
+	git_odb *odb = NULL;
+	int i, error = 0;
+
+	for (i = 0; i < 2; i++) {
+		snprintf(from, sizeof(from), "%s/pack/pack-%s%s", rp->quarantine, rp->pack_name, exts[i]);
+		snprintf(to, sizeof(to), "%sobjects/pack/pack-%s%s", git_repository_path(rp->repo), rp->pack_name, exts[i]);
+		if (rename(from, to) != 0) {
+			giterr_set_str(GITERR_OS, "failed to move the pack out of quarantine");
+			return -1;
+		}
+	}
+	if ((error = git_repository_odb(&odb, rp->repo)) == 0) {
+		error = git_odb_refresh(odb);
+		git_odb_free(odb);
+	}
+	return error;
+}
+
+/* deletes whatever is left in the quarantine: everything after a rejection or an error */
+static void php_git2_receive_pack_quarantine_remove(php_git2_receive_pack *rp)
+{
+	char dir[MAXPATHLEN], path[MAXPATHLEN];
+	struct dirent *de;
+	DIR *dh;
+
+	if (rp->quarantine == NULL) {
+		return;
+	}
+	snprintf(dir, sizeof(dir), "%s/pack", rp->quarantine);
+	if ((dh = opendir(dir)) != NULL) {
+		while ((de = readdir(dh)) != NULL) {
+			if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+				continue;
+			}
+			snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+			unlink(path);
+		}
+		closedir(dh);
+	}
+	rmdir(dir);
+	rmdir(rp->quarantine);
+	efree(rp->quarantine);
+	rp->quarantine = NULL;
+}
+
+/* the ref currently has to match <old>: absent for a create, present for a delete */
+static int php_git2_receive_pack_current(git_repository *repo, php_git2_receive_command *command)
+{
+	git_oid current;
+	int exists;
+
+	exists = git_reference_name_to_id(&current, repo, command->ref) == 0;
+	giterr_clear();
+	if (git_oid_iszero(&command->old_id)) {
+		return exists ? -1 : 0;
+	}
+	return (exists && git_oid_equal(&current, &command->old_id)) ? 0 : -1;
+}
+
+static void php_git2_receive_pack_check(php_git2_receive_pack *rp)
+{
+	php_git2_receive_command *command;
+	git_odb *odb = NULL;
+	size_t i;
+
+	git_repository_odb(&odb, rp->quarantine_repo != NULL ? rp->quarantine_repo : rp->repo);
+	for (i = 0; i < rp->count; i++) {
+		command = &rp->commands[i];
+		if (rp->unpack_error != NULL) {
+			command->error = estrdup("unpacker error");
+		} else if (strncmp(command->ref, "refs/", 5) != 0 || !git_reference_is_valid_name(command->ref)) {
+			command->error = estrdup("funny refname");
+		} else if (git_oid_iszero(&command->old_id) && git_oid_iszero(&command->new_id)) {
+			command->error = estrdup("nothing to delete");
+		} else if (!git_oid_iszero(&command->new_id) && (odb == NULL || !git_odb_exists(odb, &command->new_id))) {
+			command->error = estrdup("missing necessary objects");
+		} else if (php_git2_receive_pack_current(rp->repo, command)) {
+			command->error = estrdup("stale info");
+		}
+	}
+	if (odb != NULL) {
+		git_odb_free(odb);
+	}
+}
+
+/* fails every command still marked fine: the batch is all or nothing */
+static void php_git2_receive_pack_fail_all(php_git2_receive_pack *rp, const char *reason)
+{
+	size_t i;
+
+	for (i = 0; i < rp->count; i++) {
+		if (rp->commands[i].error == NULL) {
+			rp->commands[i].error = estrdup(reason);
+		}
+	}
+}
+
+/* calls pre_receive once with every proposed update and a repository that reads the pushed
+   objects, the caller's own one when nothing was pushed. true or null accepts the batch,
+   false or a string (the reason shown to the pusher) rejects it */
+static int php_git2_receive_pack_pre_receive(php_git2_receive_pack *rp, zval *repo, zend_fcall_info *fci, zend_fcall_info_cache *fcc TSRMLS_DC)
+{
+	zval *updates = NULL, *update, *retval_ptr = NULL, *hook_repo = NULL;
+	php_git2_t *result = NULL;
+	char hex[GIT_OID_HEXSZ + 1];
+	size_t i;
+	int error;
+
+	MAKE_STD_ZVAL(updates);
+	array_init(updates);
+	for (i = 0; i < rp->count; i++) {
+		MAKE_STD_ZVAL(update);
+		array_init(update);
+		add_assoc_string_ex(update, ZEND_STRS("ref"), rp->commands[i].ref, 1);
+		git_oid_tostr(hex, sizeof(hex), &rp->commands[i].old_id);
+		add_assoc_stringl_ex(update, ZEND_STRS("old"), hex, GIT_OID_HEXSZ, 1);
+		git_oid_tostr(hex, sizeof(hex), &rp->commands[i].new_id);
+		add_assoc_stringl_ex(update, ZEND_STRS("new"), hex, GIT_OID_HEXSZ, 1);
+		add_next_index_zval(updates, update);
+	}
+	MAKE_STD_ZVAL(hook_repo);
+	if (rp->quarantine_repo != NULL &&
+		php_git2_make_resource(&result, PHP_GIT2_TYPE_REPOSITORY, rp->quarantine_repo, 1 TSRMLS_CC) == 0) {
+		/* the resource owns the handle now, a hook keeping it keeps it alive */
+		rp->quarantine_repo = NULL;
+		ZVAL_RESOURCE(hook_repo, GIT2_RVAL_P(result));
+	} else {
+		ZVAL_ZVAL(hook_repo, repo, 1, 0);
+	}
+	error = php_git2_call_function_v(fci, fcc TSRMLS_CC, &retval_ptr, 2, &updates, &hook_repo);
+	zval_ptr_dtor(&hook_repo);
+	if (error) {
+		php_git2_receive_pack_fail_all(rp, "pre-receive hook declined");
+		return -1;
+	}
+	if (retval_ptr == NULL) {
+		php_git2_receive_pack_fail_all(rp, "pre-receive hook declined");
+		return -1;
+	}
+	if (Z_TYPE_P(retval_ptr) == IS_STRING) {
+		php_git2_receive_pack_fail_all(rp, Z_STRVAL_P(retval_ptr));
+		zval_ptr_dtor(&retval_ptr);
+		return -1;
+	}
+	if (Z_TYPE_P(retval_ptr) != IS_NULL && !zend_is_true(retval_ptr)) {
+		php_git2_receive_pack_fail_all(rp, "pre-receive hook declined");
+		zval_ptr_dtor(&retval_ptr);
+		return -1;
+	}
+	zval_ptr_dtor(&retval_ptr);
+	return 0;
+}
+
+static void php_git2_receive_pack_ref_path(char *out, size_t len, git_repository *repo, const char *ref, const char *suffix)
+{
+	snprintf(out, len, "%s%s%s", git_repository_path(repo), ref, suffix);
+}
+
+/* takes <ref>.lock for every command the way git does, so no other writer can move a ref
+   between the comparison with <old> and the write */
+static int php_git2_receive_pack_lock(php_git2_receive_pack *rp)
+{
+	php_git2_receive_command *command;
+	char path[MAXPATHLEN], *slash;
+	size_t i, base = strlen(git_repository_path(rp->repo));
+
+	for (i = 0; i < rp->count; i++) {
+		command = &rp->commands[i];
+		php_git2_receive_pack_ref_path(path, sizeof(path), rp->repo, command->ref, ".lock");
+		for (slash = strchr(path + base, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+			*slash = '\0';
+			mkdir(path, 0777);
+			*slash = '/';
+		}
+		command->lock_fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0666);
+		if (command->lock_fd < 0) {
+			command->error = estrdup("failed to lock");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void php_git2_receive_pack_unlock(php_git2_receive_pack *rp)
+{
+	char path[MAXPATHLEN];
+	size_t i;
+
+	for (i = 0; i < rp->count; i++) {
+		if (rp->commands[i].lock_fd < 0) {
+			continue;
+		}
+		close(rp->commands[i].lock_fd);
+		rp->commands[i].lock_fd = -1;
+		php_git2_receive_pack_ref_path(path, sizeof(path), rp->repo, rp->commands[i].ref, ".lock");
+		unlink(path);
+	}
+}
+
+/* drops <ref> and its peeled line from packed-refs under packed-refs.lock, the way git
+   deletes a packed ref; a file without the ref is left alone */
+static int php_git2_receive_pack_unpack_ref(git_repository *repo, const char *ref)
+{
+	char path[MAXPATHLEN], lock[MAXPATHLEN], line[MAXPATHLEN + GIT_OID_HEXSZ + 2];
+	size_t ref_len = strlen(ref), len;
+	FILE *packed, *out;
+	int fd, dropped = 0, skip_peeled = 0, error = 0;
+
+	php_git2_receive_pack_ref_path(path, sizeof(path), repo, "packed-refs", "");
+	php_git2_receive_pack_ref_path(lock, sizeof(lock), repo, "packed-refs", ".lock");
+	if ((packed = fopen(path, "r")) == NULL) {
+		if (errno == ENOENT) {
+			return 0;
+		}
+		giterr_set_str(GITERR_OS, "failed to read packed-refs");
+		return -1;
+	}
+	if ((fd = open(lock, O_CREAT | O_EXCL | O_WRONLY, 0666)) < 0) {
+		fclose(packed);
+		giterr_set_str(GITERR_OS, "failed to lock packed-refs");
+		return -1;
+	}
+	out = fdopen(fd, "w");
+	if (out == NULL) {
+		close(fd);
+		error = -1;
+	}
+	while (error == 0 && fgets(line, sizeof(line), packed) != NULL) {
+		len = strlen(line);
+		if (skip_peeled && line[0] == '^') {
+			continue;
+		}
+		skip_peeled = 0;
+		if (len == GIT_OID_HEXSZ + 1 + ref_len + 1 && line[GIT_OID_HEXSZ] == ' ' &&
+			memcmp(line + GIT_OID_HEXSZ + 1, ref, ref_len) == 0 && line[len - 1] == '\n') {
+			dropped = skip_peeled = 1;
+			continue;
+		}
+		if (fwrite(line, 1, len, out) != len) {
+			error = -1;
+		}
+	}
+	if (ferror(packed)) {
+		error = -1;
+	}
+	fclose(packed);
+	if (out != NULL && (fflush(out) != 0 || fsync(fileno(out)) != 0)) {
+		error = -1;
+	}
+	if (out != NULL && fclose(out) != 0) {
+		error = -1;
+	}
+	if (error == 0 && dropped && rename(lock, path) != 0) {
+		error = -1;
+	}
+	if (error || !dropped) {
+		unlink(lock);
+	}
+	if (error) {
+		giterr_set_str(GITERR_OS, "failed to rewrite packed-refs");
+	}
+	return error;
+}
+
+/* writes <new> into the held lock and renames it over the ref, or deletes the ref */
+static int php_git2_receive_pack_commit(php_git2_receive_pack *rp, php_git2_receive_command *command)
+{
+	char path[MAXPATHLEN], lock[MAXPATHLEN], hex[GIT_OID_HEXSZ + 1];
+	int fd = command->lock_fd, error;
+
+	command->lock_fd = -1;
+	php_git2_receive_pack_ref_path(path, sizeof(path), rp->repo, command->ref, "");
+	php_git2_receive_pack_ref_path(lock, sizeof(lock), rp->repo, command->ref, ".lock");
+	if (git_oid_iszero(&command->new_id)) {
+		/* packed copy first, then the loose one, while <ref>.lock keeps other writers out;
+		   git_reference_delete would want that very lock and fail */
+		error = php_git2_receive_pack_unpack_ref(rp->repo, command->ref);
+		if (error == 0 && unlink(path) != 0 && errno != ENOENT) {
+			giterr_set_str(GITERR_OS, "failed to delete the ref");
+			error = -1;
+		}
+		close(fd);
+		unlink(lock);
+		return error;
+	}
+	git_oid_fmt(hex, &command->new_id);
+	hex[GIT_OID_HEXSZ] = '\n';
+	if (write(fd, hex, sizeof(hex)) != sizeof(hex) || fsync(fd) != 0) {
+		close(fd);
+		unlink(lock);
+		giterr_set_str(GITERR_OS, "failed to write the ref lock");
+		return -1;
+	}
+	if (close(fd) != 0 || rename(lock, path) != 0) {
+		unlink(lock);
+		giterr_set_str(GITERR_OS, "failed to rename the ref lock");
+		return -1;
+	}
+	return 0;
+}
+
+/* puts <old> back for a command applied before a later one failed */
+static int php_git2_receive_pack_restore(php_git2_receive_pack *rp, php_git2_receive_command *command)
+{
+	char path[MAXPATHLEN], hex[GIT_OID_HEXSZ + 1];
+
+	php_git2_receive_pack_ref_path(path, sizeof(path), rp->repo, command->ref, "");
+	if (git_oid_iszero(&command->old_id)) {
+		/* created by this push, so there is only the loose file */
+		return unlink(path);
+	}
+	git_oid_fmt(hex, &command->old_id);
+	hex[GIT_OID_HEXSZ] = '\n';
+	return php_git2_lockfile_write(path, hex, sizeof(hex));
+}
+
+/* applies the whole batch. libgit2 has no ref transactions, so every ref is locked first,
+   compared against <old> under the locks and only then written; the applied ones are put
+   back when a later write fails, and a ref that cannot be put back is reported */
+static void php_git2_receive_pack_apply(php_git2_receive_pack *rp TSRMLS_DC)
+{
+	php_git2_receive_command *command;
+	const git_error *e;
+	size_t i, n;
+
+	if (php_git2_receive_pack_lock(rp)) {
+		php_git2_receive_pack_unlock(rp);
+		php_git2_receive_pack_fail_all(rp, "atomic push failure");
+		return;
+	}
+	for (i = 0; i < rp->count; i++) {
+		if (php_git2_receive_pack_current(rp->repo, &rp->commands[i])) {
+			rp->commands[i].error = estrdup("stale info");
+			php_git2_receive_pack_unlock(rp);
+			php_git2_receive_pack_fail_all(rp, "atomic push failure");
+			return;
+		}
+	}
+	for (i = 0; i < rp->count; i++) {
+		command = &rp->commands[i];
+		if (php_git2_receive_pack_commit(rp, command) == 0) {
+			command->applied = 1;
+			continue;
+		}
+		e = giterr_last();
+		command->error = estrdup((e && e->message) ? e->message : "failed to update ref");
+		for (n = i; n > 0; n--) {
+			command = &rp->commands[n - 1];
+			if (php_git2_receive_pack_restore(rp, command)) {
+				php_error_docref(NULL TSRMLS_CC, E_WARNING, "could not restore %s after a failed push", command->ref);
+				command->error = estrdup("atomic push failure, ref left at the pushed value");
+				rp->rollback_failed++;
+			}
+			command->applied = 0;
+		}
+		php_git2_receive_pack_unlock(rp);
+		php_git2_receive_pack_fail_all(rp, "atomic push failure");
+		return;
+	}
+	rp->applied = 1;
+}
+
+static void php_git2_serve_smart_pkt(smart_str *buf, const char *format, ...)
+{
+	char line[PHP_GIT2_PKT_MAX], header[5];
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	len = vsnprintf(line, sizeof(line) - 4, format, args);
+	va_end(args);
+	if (len < 0 || len >= (int)sizeof(line) - 4) {
+		return;
+	}
+	snprintf(header, sizeof(header), "%04x", (unsigned int)(len + 4));
+	smart_str_appendl(buf, header, 4);
+	smart_str_appendl(buf, line, len);
+}
+
+/* sends report-status, wrapped in side-band channel 1 when the client asked for it */
+static int php_git2_receive_pack_report(php_git2_receive_pack *rp)
+{
+	php_git2_sideband_writer *band;
+	smart_str report = {0};
+	size_t i;
+	int error = 0;
+
+	if (rp->unpack_error != NULL) {
+		php_git2_serve_smart_pkt(&report, "unpack %s\n", rp->unpack_error);
+	} else {
+		php_git2_serve_smart_pkt(&report, "unpack ok\n");
+	}
+	for (i = 0; i < rp->count; i++) {
+		if (rp->commands[i].error != NULL) {
+			php_git2_serve_smart_pkt(&report, "ng %s %s\n", rp->commands[i].ref, rp->commands[i].error);
+		} else {
+			php_git2_serve_smart_pkt(&report, "ok %s\n", rp->commands[i].ref);
+		}
+	}
+	smart_str_appendl(&report, "0000", 4);
+
+	if (rp->sideband) {
+		band = (php_git2_sideband_writer*)emalloc(sizeof(php_git2_sideband_writer));
+		php_git2_sideband_writer_init(band, rp->writer, 1);
+		if (php_git2_sideband_writer_write(band, report.c, report.len) ||
+			php_git2_sideband_writer_flush(band) ||
+			php_git2_pkt_flush(rp->writer)) {
+			error = -1;
+		}
+		efree(band);
+	} else {
+		error = php_git2_stream_writer_write(rp->writer, report.c, report.len);
+	}
+	smart_str_free(&report);
+	return error;
+}
+
+/* {{{ proto array git_receive_pack_serve(resource $repo, resource $in, resource $out, Callable $pre_receive[, array $options])
+  serves one smart http receive-pack POST in process: reads the command list from $in, streams
+  the pack behind it into a quarantine directory through the indexer and calls
+  $pre_receive(array $updates, resource $repo) once with every proposed update (ref, old, new);
+  that $repo is a second handle which reads the pushed objects, the one passed in here never
+  sees them before they are accepted. true or null accepts, false or a reason string
+  rejects. an accepted pack moves into objects/pack and the updates are applied as one batch
+  under the ref locks, all or nothing; a rejected one is deleted. report-status goes to $out.
+  options: advertise (write the info/refs advertisement to $out and return; $pre_receive may be null),
+  stateless_rpc (default true; false advertises first and reads the commands from the same
+  $in, as git:// and ssh do).
+  returns array(unpack, objects, applied, rollback_failed, commands => array(ref => "ok" or reason))
+  or false. rollback_failed counts refs a failed batch could not put back */
+PHP_FUNCTION(git_receive_pack_serve)
+{
+	zval *repo = NULL, *zin = NULL, *zout = NULL, *options = NULL, *tmp, *commands;
+	php_git2_t *_repo = NULL;
+	php_stream *in, *out;
+	php_git2_receive_pack rp = {0};
+	zend_fcall_info fci = empty_fcall_info;
+	zend_fcall_info_cache fcc = empty_fcall_info_cache;
+	const git_error *e;
+	size_t i;
+	int advertise = 0, stateless = 1, needs_pack = 0, accepted, error = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rrrf!|a", &repo, &zin, &zout, &fci, &fcc, &options) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	php_stream_from_zval(in, &zin);
+	php_stream_from_zval(out, &zout);
+
+	if (options != NULL && (tmp = php_git2_read_arrval(options, ZEND_STRS("advertise") TSRMLS_CC)) != NULL) {
+		advertise = zend_is_true(tmp);
+	}
+	if (options != NULL && (tmp = php_git2_read_arrval(options, ZEND_STRS("stateless_rpc") TSRMLS_CC)) != NULL) {
+		stateless = zend_is_true(tmp);
+	}
+	if (!advertise && !ZEND_FCI_INITIALIZED(fci)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "pre_receive callback is required");
+		RETURN_FALSE;
+	}
+
+	rp.repo = PHP_GIT2_V(_repo, repository);
+	rp.reader = (php_git2_pkt_reader*)emalloc(sizeof(php_git2_pkt_reader));
+	rp.reader->stream = in;
+	rp.writer = (php_git2_stream_writer*)emalloc(sizeof(php_git2_stream_writer));
+	php_git2_stream_writer_init(rp.writer, out);
+
+	if (advertise) {
+		error = php_git2_serve_advertise(rp.writer, rp.repo, "git-receive-pack", PHP_GIT2_RECEIVE_PACK_CAPS, 1, 0);
+	} else if (!stateless && (php_git2_serve_advertise(rp.writer, rp.repo, "git-receive-pack", PHP_GIT2_RECEIVE_PACK_CAPS, 0, 0) ||
+		php_git2_stream_writer_flush(rp.writer))) {
+		error = GIT_EUSER;
+	} else if (php_git2_receive_pack_commands(&rp TSRMLS_CC)) {
+		error = GIT_EUSER;
+	} else if (rp.count > 0) {
+		for (i = 0; i < rp.count; i++) {
+			if (!git_oid_iszero(&rp.commands[i].new_id)) {
+				needs_pack = 1;
+			}
+		}
+		if (needs_pack && (php_git2_receive_pack_unpack(&rp, in TSRMLS_CC) ||
+			php_git2_receive_pack_quarantine_enter(&rp))) {
+			e = giterr_last();
+			rp.unpack_error = estrdup((e && e->message) ? e->message : "index-pack failed");
+			giterr_clear();
+		}
+		php_git2_receive_pack_check(&rp);
+		for (i = 0; i < rp.count; i++) {
+			if (rp.commands[i].error != NULL) {
+				php_git2_receive_pack_fail_all(&rp, "atomic push failure");
+				break;
+			}
+		}
+		accepted = i == rp.count && php_git2_receive_pack_pre_receive(&rp, repo, &fci, &fcc TSRMLS_CC) == 0;
+		php_git2_receive_pack_quarantine_leave(&rp);
+		if (accepted && needs_pack && php_git2_receive_pack_migrate(&rp)) {
+			php_git2_receive_pack_fail_all(&rp, "unable to migrate objects to permanent storage");
+			giterr_clear();
+			accepted = 0;
+		}
+		if (accepted) {
+			php_git2_receive_pack_apply(&rp TSRMLS_CC);
+		}
+		php_git2_receive_pack_quarantine_remove(&rp);
+		if (rp.report_status && php_git2_receive_pack_report(&rp)) {
+			error = GIT_EUSER;
+		}
+	}
+	if (php_git2_stream_writer_flush(rp.writer) && !error) {
+		error = GIT_EUSER;
+	}
+
+	array_init(return_value);
+	add_assoc_string_ex(return_value, ZEND_STRS("unpack"), rp.unpack_error ? rp.unpack_error : (char*)"ok", 1);
+	add_assoc_long_ex(return_value, ZEND_STRS("objects"), rp.objects);
+	add_assoc_bool_ex(return_value, ZEND_STRS("applied"), rp.applied);
+	add_assoc_long_ex(return_value, ZEND_STRS("rollback_failed"), rp.rollback_failed);
+	MAKE_STD_ZVAL(commands);
+	array_init(commands);
+	for (i = 0; i < rp.count; i++) {
+		add_assoc_string_ex(commands, rp.commands[i].ref, strlen(rp.commands[i].ref) + 1,
+			rp.commands[i].error ? rp.commands[i].error : (char*)"ok", 1);
+		efree(rp.commands[i].ref);
+		if (rp.commands[i].error != NULL) {
+			efree(rp.commands[i].error);
+		}
+	}
+	add_assoc_zval_ex(return_value, ZEND_STRS("commands"), commands);
+
+	if (rp.commands != NULL) {
+		efree(rp.commands);
+	}
+	if (rp.unpack_error != NULL) {
+		efree(rp.unpack_error);
+	}
+	efree(rp.reader);
+	efree(rp.writer);
+
+	if (error == GIT_EUSER) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "receive-pack failed: protocol error or stream failure");
+		zval_dtor(return_value);
+		RETURN_FALSE;
+	}
+	if (php_git2_check_error(error, "git_receive_pack_serve" TSRMLS_CC)) {
+		zval_dtor(return_value);
+		RETURN_FALSE;
+	}
+}
+/* }}} */
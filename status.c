@@ -2,6 +2,9 @@
 #include "php_git2_priv.h"
 #include "status.h"
 
+#include <sys/stat.h>
+#include <dirent.h>
+
 static void php_git2_git_status_options_to_array(git_status_options *options, zval **out TSRMLS_DC)
 {
 	zval *result, *pathspec;
@@ -21,12 +24,694 @@ static void php_git2_git_status_options_to_array(git_status_options *options, zv
 static void php_git2_array_to_git_status_options(git_status_options *options, zval *array TSRMLS_DC)
 {
 	options->version = php_git2_read_arrval_long2(array, ZEND_STRS("version"), 1 TSRMLS_CC);
-	options->show = php_git2_read_arrval_long2(array, ZEND_STRS("version"), 0 TSRMLS_CC);
-	options->flags = php_git2_read_arrval_long2(array, ZEND_STRS("version"), 0 TSRMLS_CC);
+	options->show = php_git2_read_arrval_long2(array, ZEND_STRS("show"), 0 TSRMLS_CC);
+	options->flags = php_git2_read_arrval_long2(array, ZEND_STRS("flags"), 0 TSRMLS_CC);
 
 	php_git2_array_to_strarray(&options->pathspec, php_git2_read_arrval(array, ZEND_STRS("pathspec") TSRMLS_CC) TSRMLS_CC);
 }
 
+/* `preload_index` in the options array overrides the git2.preload_index ini setting */
+static int php_git2_status_should_preload(zval *array TSRMLS_DC)
+{
+	return php_git2_read_arrval_long2(array, ZEND_STRS("preload_index"), GIT2G(preload_index) TSRMLS_CC) != 0;
+}
+
+static int php_git2_status_preload(php_git2_preload_t **out, git_index **index, git_repository *repo TSRMLS_DC)
+{
+	int error;
+
+	*out = NULL;
+	*index = NULL;
+	if (git_repository_is_bare(repo)) {
+		return 0;
+	}
+	error = git_repository_index(index, repo);
+	if (!error) {
+		/* status reloads the index from disk too, stat what it will compare against */
+		error = git_index_read(*index, 0);
+	}
+	if (!error) {
+		error = php_git2_preload_index(out, repo, *index, GIT2G(preload_threads) TSRMLS_CC);
+	}
+	if (error) {
+		git_index_free(*index);
+		*index = NULL;
+	}
+	return error;
+}
+
+#define PHP_GIT2_UNTRACKED_CACHE_FILE "php_git2_untracked_cache"
+#define PHP_GIT2_UNTRACKED_CACHE_SIGNATURE "PHPGIT2UC 1"
+
+#define PHP_GIT2_UC_NAME_DIR (1 << 0)
+#define PHP_GIT2_UC_NAME_IGNORED (1 << 1)
+
+/* readdir() result of one directory, valid while its mtime and .gitignore are unchanged */
+typedef struct php_git2_uc_dir {
+	long mtime;
+	long ignore_mtime;
+	int seen;
+	HashTable names;
+} php_git2_uc_dir;
+
+typedef struct php_git2_uc_t {
+	git_repository *repo;
+	git_index *index;
+	const char *workdir;
+	unsigned int flags;
+	long exclude_mtime;
+	HashTable dirs;
+	HashTable tracked_dirs;
+	php_git2_status_untracked *result;
+} php_git2_uc_t;
+
+static void php_git2_uc_dir_free(void *data)
+{
+	php_git2_uc_dir *dir = *(php_git2_uc_dir**)data;
+
+	zend_hash_destroy(&dir->names);
+	efree(dir);
+}
+
+static php_git2_uc_dir *php_git2_uc_dir_new(HashTable *dirs, const char *path, size_t path_len)
+{
+	php_git2_uc_dir *dir;
+
+	dir = (php_git2_uc_dir*)emalloc(sizeof(php_git2_uc_dir));
+	dir->mtime = -1;
+	dir->ignore_mtime = 0;
+	dir->seen = 0;
+	zend_hash_init(&dir->names, 8, NULL, NULL, 0);
+	zend_hash_update(dirs, path, path_len + 1, (void*)&dir, sizeof(php_git2_uc_dir*), NULL);
+	return dir;
+}
+
+static long php_git2_uc_mtime(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		return 0;
+	}
+	return (long)st.st_mtime;
+}
+
+static void php_git2_uc_path(char *out, size_t out_len, const char *base, const char *dir, const char *name)
+{
+	snprintf(out, out_len, "%s%s%s", base, dir, name);
+}
+
+static void php_git2_uc_load(php_git2_uc_t *uc)
+{
+	char path[MAXPATHLEN], line[MAXPATHLEN + 64];
+	php_git2_uc_dir *dir = NULL;
+	long mtime, ignore_mtime, flags;
+	int offset;
+	size_t len;
+	FILE *fp;
+
+	php_git2_uc_path(path, sizeof(path), git_repository_path(uc->repo), "", PHP_GIT2_UNTRACKED_CACHE_FILE);
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		return;
+	}
+	if (fgets(line, sizeof(line), fp) == NULL ||
+		strncmp(line, PHP_GIT2_UNTRACKED_CACHE_SIGNATURE, sizeof(PHP_GIT2_UNTRACKED_CACHE_SIGNATURE) - 1) != 0 ||
+		fgets(line, sizeof(line), fp) == NULL ||
+		sscanf(line, "X %ld", &mtime) != 1 || mtime != uc->exclude_mtime || mtime < 0) {
+		/* info/exclude changed, or may still change within this second: every ignored flag may be stale */
+		fclose(fp);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		len = strlen(line);
+		if (len > 0 && line[len - 1] == '\n') {
+			line[--len] = '\0';
+		}
+		if (sscanf(line, "D %ld %ld %n", &mtime, &ignore_mtime, &offset) == 2) {
+			dir = php_git2_uc_dir_new(&uc->dirs, line + offset, len - offset);
+			dir->mtime = mtime;
+			dir->ignore_mtime = ignore_mtime;
+		} else if (dir != NULL && sscanf(line, "N %ld %n", &flags, &offset) == 1) {
+			zend_hash_update(&dir->names, line + offset, len - offset + 1, (void*)&flags, sizeof(long), NULL);
+		}
+	}
+	fclose(fp);
+}
+
+static void php_git2_uc_save(php_git2_uc_t *uc)
+{
+	char path[MAXPATHLEN];
+	HashPosition pos, name_pos;
+	php_git2_uc_dir **dir;
+	long *flags;
+	char *key;
+	uint key_len;
+	ulong index;
+	smart_str out = {0};
+
+	php_git2_uc_path(path, sizeof(path), git_repository_path(uc->repo), "", PHP_GIT2_UNTRACKED_CACHE_FILE);
+
+	smart_str_appends(&out, PHP_GIT2_UNTRACKED_CACHE_SIGNATURE);
+	smart_str_appends(&out, "\nX ");
+	smart_str_append_long(&out, uc->exclude_mtime);
+	smart_str_appendc(&out, '\n');
+	for (zend_hash_internal_pointer_reset_ex(&uc->dirs, &pos);
+		zend_hash_get_current_data_ex(&uc->dirs, (void **)&dir, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&uc->dirs, &pos)) {
+		/* directories that were not reached any more are gone or became ignored */
+		if (!(*dir)->seen) {
+			continue;
+		}
+		zend_hash_get_current_key_ex(&uc->dirs, &key, &key_len, &index, 0, &pos);
+		smart_str_appends(&out, "D ");
+		smart_str_append_long(&out, (*dir)->mtime);
+		smart_str_appendc(&out, ' ');
+		smart_str_append_long(&out, (*dir)->ignore_mtime);
+		smart_str_appendc(&out, ' ');
+		smart_str_appends(&out, key);
+		smart_str_appendc(&out, '\n');
+
+		for (zend_hash_internal_pointer_reset_ex(&(*dir)->names, &name_pos);
+			zend_hash_get_current_data_ex(&(*dir)->names, (void **)&flags, &name_pos) == SUCCESS;
+			zend_hash_move_forward_ex(&(*dir)->names, &name_pos)) {
+			zend_hash_get_current_key_ex(&(*dir)->names, &key, &key_len, &index, 0, &name_pos);
+			smart_str_appends(&out, "N ");
+			smart_str_append_long(&out, *flags);
+			smart_str_appendc(&out, ' ');
+			smart_str_appends(&out, key);
+			smart_str_appendc(&out, '\n');
+		}
+	}
+
+	/* a live save holding the lock wins and this one is dropped, a stale lock is expired */
+	php_git2_lockfile_write(path, out.c != NULL ? out.c : "", out.len);
+	smart_str_free(&out);
+}
+
+static void php_git2_uc_emit(php_git2_uc_t *uc, const char *path)
+{
+	php_git2_status_untracked *result = uc->result;
+
+	if (result->count == result->size) {
+		result->size = result->size ? result->size * 2 : 64;
+		result->paths = (char**)safe_erealloc(result->paths, result->size, sizeof(char*), 0);
+	}
+	result->paths[result->count++] = estrdup(path);
+}
+
+static void php_git2_uc_read_dir(php_git2_uc_t *uc, php_git2_uc_dir *dir, const char *rel, const char *full)
+{
+	char path[MAXPATHLEN];
+	struct dirent *de;
+	struct stat st;
+	long flags;
+	int ignored, is_dir;
+	DIR *dh;
+
+	zend_hash_clean(&dir->names);
+	dh = opendir(full);
+	if (dh == NULL) {
+		return;
+	}
+	while ((de = readdir(dh)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0 || strcmp(de->d_name, ".git") == 0) {
+			continue;
+		}
+		php_git2_uc_path(path, sizeof(path), full, "", de->d_name);
+		if (lstat(path, &st) != 0) {
+			continue;
+		}
+		is_dir = S_ISDIR(st.st_mode);
+
+		php_git2_uc_path(path, sizeof(path), "", rel, de->d_name);
+		ignored = 0;
+		git_ignore_path_is_ignored(&ignored, uc->repo, path);
+
+		flags = (is_dir ? PHP_GIT2_UC_NAME_DIR : 0) | (ignored ? PHP_GIT2_UC_NAME_IGNORED : 0);
+		zend_hash_update(&dir->names, de->d_name, strlen(de->d_name) + 1, (void*)&flags, sizeof(long), NULL);
+	}
+	closedir(dh);
+}
+
+/* returns the number of untracked paths found below `rel` (a directory path ending with '/', or "") */
+static size_t php_git2_uc_scan(php_git2_uc_t *uc, const char *rel, int force, int emit)
+{
+	char full[MAXPATHLEN], child[MAXPATHLEN];
+	php_git2_uc_dir **found = NULL, *dir = NULL;
+	HashPosition pos;
+	long mtime, ignore_mtime, *flags;
+	char *name;
+	uint name_len;
+	ulong index;
+	size_t rel_len = strlen(rel), found_count = 0, sub;
+	int untracked_dir;
+
+	php_git2_uc_path(full, sizeof(full), uc->workdir, rel, "");
+	mtime = php_git2_uc_mtime(full);
+	php_git2_uc_path(child, sizeof(child), full, "", ".gitignore");
+	ignore_mtime = php_git2_uc_mtime(child);
+
+	uc->result->dirs_checked++;
+	if (zend_hash_find(&uc->dirs, rel, rel_len + 1, (void**)&found) == SUCCESS) {
+		dir = *found;
+	} else {
+		dir = php_git2_uc_dir_new(&uc->dirs, rel, rel_len);
+	}
+
+	if (ignore_mtime != dir->ignore_mtime) {
+		/* rules changed for the whole subtree */
+		force = 1;
+	}
+	if (!force && dir->mtime == mtime && mtime > 0) {
+		uc->result->dirs_skipped++;
+	} else {
+		php_git2_uc_read_dir(uc, dir, rel, full);
+		uc->result->dirs_read++;
+		/* a directory changed within the current second may change again unnoticed */
+		dir->mtime = (mtime >= (long)time(NULL)) ? -1 : mtime;
+		/* same for .gitignore, -1 never matches so the subtree is read again next time */
+		dir->ignore_mtime = (ignore_mtime >= (long)time(NULL)) ? -1 : ignore_mtime;
+	}
+	dir->seen = 1;
+
+	for (zend_hash_internal_pointer_reset_ex(&dir->names, &pos);
+		zend_hash_get_current_data_ex(&dir->names, (void **)&flags, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&dir->names, &pos)) {
+		if (*flags & PHP_GIT2_UC_NAME_IGNORED) {
+			continue;
+		}
+		zend_hash_get_current_key_ex(&dir->names, &name, &name_len, &index, 0, &pos);
+		php_git2_uc_path(child, sizeof(child), "", rel, name);
+
+		/* the index is consulted on every run, so git add / git rm never stale the cache */
+		if (git_index_get_bypath(uc->index, child, 0) != NULL) {
+			continue;
+		}
+		if (!(*flags & PHP_GIT2_UC_NAME_DIR)) {
+			if (emit) {
+				php_git2_uc_emit(uc, child);
+			}
+			found_count++;
+			continue;
+		}
+
+		strlcat(child, "/", sizeof(child));
+		untracked_dir = !zend_hash_exists(&uc->tracked_dirs, child, strlen(child) + 1);
+		if (!untracked_dir || (uc->flags & GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS)) {
+			found_count += php_git2_uc_scan(uc, child, force, emit);
+		} else {
+			/* an untracked directory is listed once, unless it only holds ignored files */
+			sub = php_git2_uc_scan(uc, child, force, 0);
+			if (sub > 0) {
+				if (emit) {
+					php_git2_uc_emit(uc, child);
+				}
+				found_count++;
+			}
+		}
+	}
+
+	return found_count;
+}
+
+static int php_git2_status_untracked_compare(const void *a, const void *b TSRMLS_DC)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int php_git2_status_untracked_collect(php_git2_status_untracked **out, git_repository *repo, unsigned int flags TSRMLS_DC)
+{
+	php_git2_uc_t uc;
+	const git_index_entry *entry;
+	char path[MAXPATHLEN], *slash, saved;
+	size_t i, count;
+	int error;
+
+	*out = NULL;
+	memset(&uc, 0, sizeof(php_git2_uc_t));
+	uc.repo = repo;
+	uc.flags = flags;
+	uc.workdir = git_repository_workdir(repo);
+	if (uc.workdir == NULL) {
+		return 0;
+	}
+	error = git_repository_index(&uc.index, repo);
+	if (!error) {
+		error = git_index_read(uc.index, 0);
+	}
+	if (error) {
+		git_index_free(uc.index);
+		return error;
+	}
+
+	zend_hash_init(&uc.tracked_dirs, 64, NULL, NULL, 0);
+	count = git_index_entrycount(uc.index);
+	for (i = 0; i < count; i++) {
+		entry = git_index_get_byindex(uc.index, i);
+		strlcpy(path, entry->path, sizeof(path));
+		for (slash = strchr(path, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+			saved = slash[1];
+			slash[1] = '\0';
+			zend_hash_add_empty_element(&uc.tracked_dirs, path, slash - path + 2);
+			slash[1] = saved;
+		}
+	}
+
+	php_git2_uc_path(path, sizeof(path), git_repository_path(repo), "", "info/exclude");
+	uc.exclude_mtime = php_git2_uc_mtime(path);
+	if (uc.exclude_mtime >= (long)time(NULL)) {
+		uc.exclude_mtime = -1;
+	}
+	zend_hash_init(&uc.dirs, 64, NULL, php_git2_uc_dir_free, 0);
+	php_git2_uc_load(&uc);
+
+	uc.result = (php_git2_status_untracked*)ecalloc(1, sizeof(php_git2_status_untracked));
+	php_git2_uc_scan(&uc, "", 0, 1);
+	php_git2_uc_save(&uc);
+
+	zend_qsort(uc.result->paths, uc.result->count, sizeof(char*), php_git2_status_untracked_compare TSRMLS_CC);
+
+	zend_hash_destroy(&uc.dirs);
+	zend_hash_destroy(&uc.tracked_dirs);
+	git_index_free(uc.index);
+
+	*out = uc.result;
+	return 0;
+}
+
+void php_git2_status_untracked_free(php_git2_status_untracked *untracked)
+{
+	size_t i;
+
+	if (untracked == NULL) {
+		return;
+	}
+	for (i = 0; i < untracked->count; i++) {
+		efree(untracked->paths[i]);
+	}
+	if (untracked->paths != NULL) {
+		efree(untracked->paths);
+	}
+	if (untracked->flags != NULL) {
+		efree(untracked->flags);
+	}
+	efree(untracked);
+}
+
+/* `untracked_cache` in the options array lets the extension find untracked files itself */
+static int php_git2_status_use_untracked_cache(zval *array, git_status_options *options TSRMLS_DC)
+{
+	if (!php_git2_read_arrval_long(array, ZEND_STRS("untracked_cache") TSRMLS_CC)) {
+		return 0;
+	}
+	if (!(options->flags & GIT_STATUS_OPT_INCLUDE_UNTRACKED) ||
+		options->pathspec.count > 0 || options->show == GIT_STATUS_SHOW_INDEX_ONLY) {
+		return 0;
+	}
+	options->flags &= ~GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+	return 1;
+}
+
+static void php_git2_status_emit(php_git2_status_untracked *result, const char *path, unsigned int flags)
+{
+	if (result->count == result->size) {
+		result->size = result->size ? result->size * 2 : 64;
+		result->paths = (char**)safe_erealloc(result->paths, result->size, sizeof(char*), 0);
+		result->flags = (unsigned int*)safe_erealloc(result->flags, result->size, sizeof(unsigned int), 0);
+	}
+	result->flags[result->count] = flags;
+	result->paths[result->count++] = estrdup(path);
+}
+
+static const char *php_git2_status_entry_path(const git_status_entry *entry)
+{
+	if (entry->index_to_workdir) {
+		return entry->index_to_workdir->old_file.path;
+	}
+	return entry->head_to_index->old_file.path;
+}
+
+/* a watched repository answers status from the paths touched since the previous call */
+static int php_git2_status_is_watched(php_git2_t *repo, git_status_options *options)
+{
+	return repo->priv != NULL && options->pathspec.count == 0 &&
+		options->show == GIT_STATUS_SHOW_INDEX_AND_WORKDIR &&
+		!(options->flags & (GIT_STATUS_OPT_RENAMES_HEAD_TO_INDEX | GIT_STATUS_OPT_RENAMES_INDEX_TO_WORKDIR));
+}
+
+static void php_git2_status_watch_remember(php_git2_watcher *watcher, const char *path, unsigned int flags)
+{
+	zend_hash_update(&watcher->last_status, path, strlen(path) + 1, (void*)&flags, sizeof(unsigned int), NULL);
+}
+
+static int php_git2_status_watch_full(git_status_list **out, php_git2_watcher *watcher, git_repository *repo, git_status_options *options)
+{
+	const git_status_entry *entry;
+	size_t i, count;
+	int error;
+
+	/* lost events may hide new directories too, so watch the tree afresh before scanning it */
+	if (watcher->overflow && !watcher->incomplete) {
+		php_git2_watcher_rebuild(watcher);
+	}
+	zend_hash_clean(&watcher->dirty);
+	error = git_status_list_new(out, repo, options);
+	if (error) {
+		return error;
+	}
+
+	zend_hash_clean(&watcher->last_status);
+	count = git_status_list_entrycount(*out);
+	for (i = 0; i < count; i++) {
+		entry = git_status_byindex(*out, i);
+		php_git2_status_watch_remember(watcher, php_git2_status_entry_path(entry), entry->status);
+	}
+	watcher->primed = 1;
+	watcher->flags = options->flags;
+	watcher->full_scans++;
+	return 0;
+}
+
+/* returns the flags of the untracked or ignored directory entry containing path, or 0 */
+static unsigned int php_git2_status_watch_carried(HashTable *carried, const char *path)
+{
+	char buf[MAXPATHLEN], *slash, saved;
+	unsigned int *flags;
+
+	strlcpy(buf, path, sizeof(buf));
+	for (slash = strchr(buf, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+		saved = slash[1];
+		slash[1] = '\0';
+		if (zend_hash_find(carried, buf, slash - buf + 2, (void**)&flags) == SUCCESS) {
+			return *flags;
+		}
+		slash[1] = saved;
+	}
+	return 0;
+}
+
+/* whether the index holds anything below dir, which ends in a slash */
+static int php_git2_status_index_has_dir(git_index *index, const char *dir)
+{
+	size_t low = 0, high = git_index_entrycount(index), middle;
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (strcmp(git_index_get_byindex(index, middle)->path, dir) < 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low < git_index_entrycount(index) &&
+		strncmp(git_index_get_byindex(index, low)->path, dir, strlen(dir)) == 0;
+}
+
+/* a full scan reports an untracked or ignored file below a directory without tracked
+   files as that directory ("dir/") unless asked to recurse, the change set cannot */
+static int php_git2_status_watch_collapses(git_index *index, const char *path, unsigned int flags, unsigned int options)
+{
+	char dir[MAXPATHLEN], *slash;
+
+	if (!((flags & GIT_STATUS_WT_NEW) && !(options & GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS)) &&
+		!((flags & GIT_STATUS_IGNORED) && !(options & GIT_STATUS_OPT_RECURSE_IGNORED_DIRS))) {
+		return 0;
+	}
+	strlcpy(dir, path, sizeof(dir));
+	slash = strrchr(dir, '/');
+	if (slash == NULL) {
+		return 0;
+	}
+	slash[1] = '\0';
+	/* the parent has no tracked files, so some directory above path is reported instead */
+	return !php_git2_status_index_has_dir(index, dir);
+}
+
+/* returns 1 when the change set cannot be trusted and a full scan is needed. the entries
+   it yields are the ones a full scan would, paths and flags only, so it is used for the
+   foreach calls and never for a git_status_list */
+static int php_git2_status_watch_incremental(php_git2_status_untracked **out, php_git2_watcher *watcher, git_repository *repo, git_status_options *options TSRMLS_DC)
+{
+	git_status_options index_options = GIT_STATUS_OPTIONS_INIT;
+	git_status_list *index_list = NULL;
+	git_index *index = NULL;
+	php_git2_status_untracked *result;
+	HashTable candidates, carried;
+	HashPosition pos;
+	char full[MAXPATHLEN], *key, **paths;
+	const char *name;
+	unsigned int *value, flags, zero = 0;
+	uint key_len;
+	ulong num_key;
+	size_t i, count;
+	struct stat st;
+	int error, rescan = 0;
+
+	*out = NULL;
+	/* HEAD to index never touches the working directory */
+	index_options.show = GIT_STATUS_SHOW_INDEX_ONLY;
+	index_options.flags = options->flags & ~(GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_INCLUDE_IGNORED);
+	error = git_status_list_new(&index_list, repo, &index_options);
+	if (error) {
+		return error;
+	}
+
+	zend_hash_init(&candidates, 64, NULL, NULL, 0);
+	zend_hash_init(&carried, 16, NULL, NULL, 0);
+
+	/* untracked directories stay as they were unless something inside them moved */
+	for (zend_hash_internal_pointer_reset_ex(&watcher->last_status, &pos);
+		zend_hash_get_current_data_ex(&watcher->last_status, (void**)&value, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&watcher->last_status, &pos)) {
+		zend_hash_get_current_key_ex(&watcher->last_status, &key, &key_len, &num_key, 0, &pos);
+		if (key[key_len - 2] == '/') {
+			snprintf(full, sizeof(full), "%s%s", git_repository_workdir(repo), key);
+			if (stat(full, &st) == 0 && S_ISDIR(st.st_mode)) {
+				zend_hash_update(&carried, key, key_len, (void*)value, sizeof(unsigned int), NULL);
+			}
+			continue;
+		}
+		zend_hash_update(&candidates, key, key_len, (void*)&zero, sizeof(unsigned int), NULL);
+	}
+
+	count = git_status_list_entrycount(index_list);
+	for (i = 0; i < count && !rescan; i++) {
+		name = php_git2_status_entry_path(git_status_byindex(index_list, i));
+		if (php_git2_status_watch_carried(&carried, name)) {
+			/* a file of an untracked directory was added */
+			rescan = 1;
+		}
+		zend_hash_update(&candidates, name, strlen(name) + 1, (void*)&zero, sizeof(unsigned int), NULL);
+	}
+	git_status_list_free(index_list);
+
+	for (zend_hash_internal_pointer_reset_ex(&watcher->dirty, &pos);
+		!rescan && zend_hash_get_current_key_ex(&watcher->dirty, &key, &key_len, &num_key, 0, &pos) == HASH_KEY_IS_STRING;
+		zend_hash_move_forward_ex(&watcher->dirty, &pos)) {
+		name = strrchr(key, '/');
+		if (strcmp(name ? name + 1 : key, ".gitignore") == 0) {
+			rescan = 1;
+			break;
+		}
+		if (!php_git2_status_watch_carried(&carried, key)) {
+			zend_hash_update(&candidates, key, key_len, (void*)&zero, sizeof(unsigned int), NULL);
+			continue;
+		}
+		/* a removal may leave the untracked directory empty, which drops it from status */
+		snprintf(full, sizeof(full), "%s%s", git_repository_workdir(repo), key);
+		if (lstat(full, &st) != 0) {
+			rescan = 1;
+		}
+	}
+
+	if (!rescan && (error = git_repository_index(&index, repo)) != 0) {
+		zend_hash_destroy(&candidates);
+		zend_hash_destroy(&carried);
+		return error;
+	}
+	if (rescan) {
+		zend_hash_destroy(&candidates);
+		zend_hash_destroy(&carried);
+		return 1;
+	}
+
+	for (zend_hash_internal_pointer_reset_ex(&carried, &pos);
+		zend_hash_get_current_data_ex(&carried, (void**)&value, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&carried, &pos)) {
+		zend_hash_get_current_key_ex(&carried, &key, &key_len, &num_key, 0, &pos);
+		zend_hash_update(&candidates, key, key_len, (void*)value, sizeof(unsigned int), NULL);
+	}
+
+	count = zend_hash_num_elements(&candidates);
+	paths = (char**)safe_emalloc(count ? count : 1, sizeof(char*), 0);
+	i = 0;
+	for (zend_hash_internal_pointer_reset_ex(&candidates, &pos);
+		zend_hash_get_current_key_ex(&candidates, &key, &key_len, &num_key, 0, &pos) == HASH_KEY_IS_STRING;
+		zend_hash_move_forward_ex(&candidates, &pos)) {
+		paths[i++] = key;
+	}
+	zend_qsort(paths, count, sizeof(char*), php_git2_status_untracked_compare TSRMLS_CC);
+
+	result = (php_git2_status_untracked*)ecalloc(1, sizeof(php_git2_status_untracked));
+	zend_hash_clean(&watcher->last_status);
+	for (i = 0; i < count && !rescan; i++) {
+		zend_hash_find(&candidates, paths[i], strlen(paths[i]) + 1, (void**)&value);
+		flags = *value;
+		if (flags == 0) {
+			if (git_status_file(&flags, repo, paths[i])) {
+				/* gone from both the index and the working directory */
+				giterr_clear();
+				continue;
+			}
+			if (flags == GIT_STATUS_CURRENT ||
+				((flags & GIT_STATUS_WT_NEW) && !(options->flags & GIT_STATUS_OPT_INCLUDE_UNTRACKED)) ||
+				((flags & GIT_STATUS_IGNORED) && !(options->flags & GIT_STATUS_OPT_INCLUDE_IGNORED))) {
+				continue;
+			}
+			if (php_git2_status_watch_collapses(index, paths[i], flags, options->flags)) {
+				rescan = 1;
+				break;
+			}
+		}
+		php_git2_status_emit(result, paths[i], flags);
+		php_git2_status_watch_remember(watcher, paths[i], flags);
+	}
+	efree(paths);
+	zend_hash_destroy(&candidates);
+	zend_hash_destroy(&carried);
+	git_index_free(index);
+	if (rescan) {
+		/* the full scan fills last_status again */
+		php_git2_status_untracked_free(result);
+		return 1;
+	}
+
+	zend_hash_clean(&watcher->dirty);
+	watcher->incremental_scans++;
+	*out = result;
+	return 0;
+}
+
+/* exactly one of list and entries is set on success */
+static int php_git2_status_watch(git_status_list **list, php_git2_status_untracked **entries, php_git2_t *repo, git_status_options *options TSRMLS_DC)
+{
+	php_git2_watcher *watcher = (php_git2_watcher*)repo->priv;
+	int error;
+
+	*list = NULL;
+	*entries = NULL;
+	php_git2_watcher_drain(watcher);
+	if (!watcher->incomplete && !watcher->overflow && watcher->primed && watcher->flags == options->flags) {
+		error = php_git2_status_watch_incremental(entries, watcher, PHP_GIT2_V(repo, repository), options TSRMLS_CC);
+		if (error <= 0) {
+			return error;
+		}
+	}
+	return php_git2_status_watch_full(list, watcher, PHP_GIT2_V(repo, repository), options);
+}
+
 static void php_git2_git_status_entry_to_array(git_status_entry *entry, zval **out TSRMLS_DC)
 {
 	zval *result, *head_to_index, *index_to_workdir;
@@ -55,6 +740,50 @@ static void php_git2_git_status_entry_to_array(git_status_entry *entry, zval **o
 	*out = result;
 }
 
+static git_delta_t php_git2_status_delta_type(unsigned int flags)
+{
+	if (flags & (GIT_STATUS_INDEX_NEW)) {
+		return GIT_DELTA_ADDED;
+	} else if (flags & GIT_STATUS_WT_NEW) {
+		return GIT_DELTA_UNTRACKED;
+	} else if (flags & (GIT_STATUS_INDEX_DELETED | GIT_STATUS_WT_DELETED)) {
+		return GIT_DELTA_DELETED;
+	} else if (flags & (GIT_STATUS_INDEX_RENAMED | GIT_STATUS_WT_RENAMED)) {
+		return GIT_DELTA_RENAMED;
+	} else if (flags & (GIT_STATUS_INDEX_TYPECHANGE | GIT_STATUS_WT_TYPECHANGE)) {
+		return GIT_DELTA_TYPECHANGE;
+	} else if (flags & GIT_STATUS_IGNORED) {
+		return GIT_DELTA_IGNORED;
+	}
+	return GIT_DELTA_MODIFIED;
+}
+
+/* entries that did not come from libgit2 carry paths and flags only, no oids */
+static void php_git2_status_untracked_to_array(const char *path, unsigned int flags, zval **out TSRMLS_DC)
+{
+	git_status_entry entry;
+	git_diff_delta head_to_index, index_to_workdir;
+	unsigned int index_flags = GIT_STATUS_INDEX_NEW | GIT_STATUS_INDEX_MODIFIED | GIT_STATUS_INDEX_DELETED |
+		GIT_STATUS_INDEX_RENAMED | GIT_STATUS_INDEX_TYPECHANGE;
+
+	memset(&head_to_index, 0, sizeof(git_diff_delta));
+	memset(&index_to_workdir, 0, sizeof(git_diff_delta));
+	head_to_index.nfiles = index_to_workdir.nfiles = 2;
+	head_to_index.old_file.path = head_to_index.new_file.path = path;
+	index_to_workdir.old_file.path = index_to_workdir.new_file.path = path;
+	head_to_index.status = php_git2_status_delta_type(flags & index_flags);
+	index_to_workdir.status = php_git2_status_delta_type(flags & ~index_flags);
+	if (index_to_workdir.status == GIT_DELTA_UNTRACKED) {
+		index_to_workdir.nfiles = 1;
+		index_to_workdir.new_file.mode = (path[strlen(path) - 1] == '/') ? GIT_FILEMODE_TREE : GIT_FILEMODE_BLOB;
+	}
+
+	entry.status = flags;
+	entry.head_to_index = (flags & index_flags) ? &head_to_index : NULL;
+	entry.index_to_workdir = (flags & ~index_flags) ? &index_to_workdir : NULL;
+	php_git2_git_status_entry_to_array(&entry, out TSRMLS_CC);
+}
+
 static int php_git2_git_status_cb(
 	const char *path, unsigned int status_flags, void *payload)
 {
@@ -79,6 +808,34 @@ static int php_git2_git_status_cb(
 	return retval;
 }
 
+static int php_git2_status_watch_foreach(php_git2_t *repo, git_status_options *options, php_git2_cb_t *cb TSRMLS_DC)
+{
+	php_git2_status_untracked *entries = NULL;
+	git_status_list *list = NULL;
+	const git_status_entry *entry;
+	size_t i, count;
+	int error;
+
+	error = php_git2_status_watch(&list, &entries, repo, options TSRMLS_CC);
+	if (error) {
+		return error;
+	}
+	if (list != NULL) {
+		count = git_status_list_entrycount(list);
+		for (i = 0; error == 0 && i < count; i++) {
+			entry = git_status_byindex(list, i);
+			error = php_git2_git_status_cb(php_git2_status_entry_path(entry), entry->status, cb);
+		}
+		git_status_list_free(list);
+	} else {
+		for (i = 0; error == 0 && i < entries->count; i++) {
+			error = php_git2_git_status_cb(entries->paths[i], entries->flags[i], cb);
+		}
+		php_git2_status_untracked_free(entries);
+	}
+	return error;
+}
+
 /* {{{ proto long git_status_foreach(resource $repo, Callable $callback,  $payload)
  */
 PHP_FUNCTION(git_status_foreach)
@@ -89,6 +846,9 @@ PHP_FUNCTION(git_status_foreach)
 	zend_fcall_info fci = empty_fcall_info;
 	zend_fcall_info_cache fcc = empty_fcall_info_cache;
 	php_git2_cb_t *cb = NULL;
+	git_status_options options = GIT_STATUS_OPTIONS_INIT;
+	php_git2_preload_t *preload = NULL;
+	git_index *index = NULL;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
 		"rfz", &repo, &fci, &fcc, &payload) == FAILURE) {
@@ -99,6 +859,19 @@ PHP_FUNCTION(git_status_foreach)
 	if (php_git2_cb_init(&cb, &fci, &fcc, payload TSRMLS_CC)) {
 		RETURN_FALSE;
 	}
+	if (_repo->priv != NULL) {
+		/* the same options git_status_foreach uses */
+		options.flags = GIT_STATUS_OPT_INCLUDE_IGNORED | GIT_STATUS_OPT_INCLUDE_UNTRACKED |
+			GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS;
+		result = php_git2_status_watch_foreach(_repo, &options, cb TSRMLS_CC);
+		php_git2_cb_free(cb);
+		RETURN_LONG(result);
+	}
+	if (GIT2G(preload_index) &&
+		!php_git2_status_preload(&preload, &index, PHP_GIT2_V(_repo, repository) TSRMLS_CC)) {
+		php_git2_preload_free(preload);
+		git_index_free(index);
+	}
 	result = git_status_foreach(PHP_GIT2_V(_repo, repository), php_git2_git_status_cb, cb);
 	php_git2_cb_free(cb);
 	RETURN_LONG(result);
@@ -116,6 +889,11 @@ PHP_FUNCTION(git_status_foreach_ext)
 	zend_fcall_info_cache fcc = empty_fcall_info_cache;
 	php_git2_cb_t *cb = NULL;
 	git_status_options options = GIT_STATUS_OPTIONS_INIT;
+	php_git2_preload_t *preload = NULL;
+	php_git2_status_untracked *untracked = NULL;
+	git_index *index = NULL;
+	int use_untracked_cache = 0;
+	size_t i;
 	
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
 		"rafz", &repo, &opts, &fci, &fcc, &payload) == FAILURE) {
@@ -127,7 +905,25 @@ PHP_FUNCTION(git_status_foreach_ext)
 	if (php_git2_cb_init(&cb, &fci, &fcc, payload TSRMLS_CC)) {
 		RETURN_FALSE;
 	}
+	if (php_git2_status_is_watched(_repo, &options)) {
+		result = php_git2_status_watch_foreach(_repo, &options, cb TSRMLS_CC);
+		php_git2_cb_free(cb);
+		RETURN_LONG(result);
+	}
+	if (php_git2_status_should_preload(opts TSRMLS_CC) &&
+		!php_git2_status_preload(&preload, &index, PHP_GIT2_V(_repo, repository) TSRMLS_CC)) {
+		php_git2_preload_free(preload);
+		git_index_free(index);
+	}
+	use_untracked_cache = php_git2_status_use_untracked_cache(opts, &options TSRMLS_CC);
 	result = git_status_foreach_ext(PHP_GIT2_V(_repo, repository), &options, php_git2_git_status_cb, cb);
+	if (result == 0 && use_untracked_cache) {
+		result = php_git2_status_untracked_collect(&untracked, PHP_GIT2_V(_repo, repository), options.flags TSRMLS_CC);
+		for (i = 0; result == 0 && untracked != NULL && i < untracked->count; i++) {
+			result = php_git2_git_status_cb(untracked->paths[i], GIT_STATUS_WT_NEW, cb);
+		}
+		php_git2_status_untracked_free(untracked);
+	}
 	php_git2_cb_free(cb);
 	if (options.pathspec.count > 0) {
 		php_git2_strarray_free(&options.pathspec);
@@ -158,14 +954,21 @@ PHP_FUNCTION(git_status_file)
 /* }}} */
 
 /* {{{ proto resource git_status_list_new(resource $repo,  $opts)
- */
+  besides the git_status_options keys, opts takes preload_index (lstat the index entries on
+  worker threads first, which only warms the attribute cache for the lstat libgit2 does per
+  entry) and refresh_index (with preload_index: write the stat data of files that turned out
+  unchanged back to the index, as "git update-index --refresh" does, so the next status does
+  not hash them again. off by default since it writes the index) */
 PHP_FUNCTION(git_status_list_new)
 {
 	php_git2_t *result = NULL, *_repo = NULL;
 	git_status_list *out = NULL;
 	zval *repo = NULL, *opts = NULL;
 	git_status_options options = GIT_STATUS_OPTIONS_INIT;
-	int error = 0;
+	php_git2_preload_t *preload = NULL;
+	php_git2_status_untracked *untracked = NULL;
+	git_index *index = NULL;
+	int error = 0, use_untracked_cache = 0;
 	
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
 		"ra", &repo, &opts) == FAILURE) {
@@ -174,7 +977,33 @@ PHP_FUNCTION(git_status_list_new)
 	
 	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	php_git2_array_to_git_status_options(&options, opts TSRMLS_CC);
-	error = git_status_list_new(&out, PHP_GIT2_V(_repo, repository), &options);
+	if (php_git2_status_is_watched(_repo, &options)) {
+		/* a list carries the oids of each entry, which only the full scan has */
+		php_git2_watcher_drain((php_git2_watcher*)_repo->priv);
+		error = php_git2_status_watch_full(&out, (php_git2_watcher*)_repo->priv, PHP_GIT2_V(_repo, repository), &options);
+	} else {
+		use_untracked_cache = php_git2_status_use_untracked_cache(opts, &options TSRMLS_CC);
+		if (php_git2_status_should_preload(opts TSRMLS_CC)) {
+			php_git2_status_preload(&preload, &index, PHP_GIT2_V(_repo, repository) TSRMLS_CC);
+		}
+		error = git_status_list_new(&out, PHP_GIT2_V(_repo, repository), &options);
+	}
+	if (!error && use_untracked_cache) {
+		error = php_git2_status_untracked_collect(&untracked, PHP_GIT2_V(_repo, repository), options.flags TSRMLS_CC);
+		if (error) {
+			git_status_list_free(out);
+		}
+	}
+	if (!error && preload != NULL && options.pathspec.count == 0 &&
+		options.show != GIT_STATUS_SHOW_INDEX_ONLY &&
+		php_git2_read_arrval_long2(opts, ZEND_STRS("refresh_index"), 0 TSRMLS_CC)) {
+		/* feed the stat data of files that turned out unchanged back into the index */
+		php_git2_preload_refresh(preload, index, out TSRMLS_CC);
+	}
+	php_git2_preload_free(preload);
+	if (index != NULL) {
+		git_index_free(index);
+	}
 	if (options.pathspec.count > 0) {
 		php_git2_strarray_free(&options.pathspec);
 	}
@@ -182,8 +1011,11 @@ PHP_FUNCTION(git_status_list_new)
 		RETURN_FALSE;
 	}
 	if (php_git2_make_resource(&result, PHP_GIT2_TYPE_STATUS_LIST, out, 1 TSRMLS_CC)) {
+		php_git2_status_untracked_free(untracked);
 		RETURN_FALSE;
 	}
+	/* untracked entries from the untracked cache follow the ones found by libgit2 */
+	result->priv = untracked;
 	ZVAL_RESOURCE(return_value, GIT2_RVAL_P(result));
 }
 /* }}} */
@@ -203,6 +1035,9 @@ PHP_FUNCTION(git_status_list_entrycount)
 	
 	ZEND_FETCH_RESOURCE(_statuslist, php_git2_t*, &statuslist, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	result = git_status_list_entrycount(PHP_GIT2_V(_statuslist, status_list));
+	if (_statuslist->priv != NULL) {
+		result += ((php_git2_status_untracked*)_statuslist->priv)->count;
+	}
 	RETURN_LONG(result);
 }
 /* }}} */
@@ -223,6 +1058,16 @@ PHP_FUNCTION(git_status_byindex)
 	
 	ZEND_FETCH_RESOURCE(_statuslist, php_git2_t*, &statuslist, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	result = git_status_byindex(PHP_GIT2_V(_statuslist, status_list), idx);
+	if (result == NULL && _statuslist->priv != NULL && idx >= 0) {
+		php_git2_status_untracked *untracked = (php_git2_status_untracked*)_statuslist->priv;
+		size_t offset = idx - git_status_list_entrycount(PHP_GIT2_V(_statuslist, status_list));
+
+		if (offset < untracked->count) {
+			php_git2_status_untracked_to_array(untracked->paths[offset],
+				untracked->flags ? untracked->flags[offset] : GIT_STATUS_WT_NEW, &out TSRMLS_CC);
+			RETURN_ZVAL(out, 0, 1);
+		}
+	}
 	if (result == NULL) {
 		RETURN_FALSE;
 	}
@@ -273,6 +1118,128 @@ PHP_FUNCTION(git_status_should_ignore)
 }
 /* }}} */
 
+enum php_git2_status_field {
+	PHP_GIT2_STATUS_FIELD_PATH = 0,
+	PHP_GIT2_STATUS_FIELD_STATUS,
+	PHP_GIT2_STATUS_FIELD_OLD_PATH,
+	PHP_GIT2_STATUS_FIELD_OLD_OID,
+	PHP_GIT2_STATUS_FIELD_NEW_OID,
+	PHP_GIT2_STATUS_FIELD_MAX
+};
+
+static const char *php_git2_status_field_names[PHP_GIT2_STATUS_FIELD_MAX] = {
+	"path", "status", "old_path", "old_oid", "new_oid"
+};
+
+static void php_git2_status_add_oid(zval *row, int field, const git_oid *oid)
+{
+	char buf[GIT2_OID_HEXSIZE] = {0};
+
+	if (oid == NULL) {
+		add_assoc_null(row, php_git2_status_field_names[field]);
+		return;
+	}
+	git_oid_fmt(buf, oid);
+	add_assoc_stringl(row, php_git2_status_field_names[field], buf, GIT_OID_HEXSZ, 1);
+}
+
+static void php_git2_status_row(zval *result, const int *wanted, const char *path, const char *old_path,
+	unsigned int status, const git_oid *old_oid, const git_oid *new_oid)
+{
+	zval *row;
+
+	MAKE_STD_ZVAL(row);
+	array_init(row);
+	if (wanted[PHP_GIT2_STATUS_FIELD_PATH]) {
+		add_assoc_string(row, "path", (char*)path, 1);
+	}
+	if (wanted[PHP_GIT2_STATUS_FIELD_STATUS]) {
+		add_assoc_long(row, "status", status);
+	}
+	if (wanted[PHP_GIT2_STATUS_FIELD_OLD_PATH]) {
+		add_assoc_string(row, "old_path", (char*)old_path, 1);
+	}
+	if (wanted[PHP_GIT2_STATUS_FIELD_OLD_OID]) {
+		php_git2_status_add_oid(row, PHP_GIT2_STATUS_FIELD_OLD_OID, old_oid);
+	}
+	if (wanted[PHP_GIT2_STATUS_FIELD_NEW_OID]) {
+		php_git2_status_add_oid(row, PHP_GIT2_STATUS_FIELD_NEW_OID, new_oid);
+	}
+	add_next_index_zval(result, row);
+}
+
+/* {{{ proto array git_status_list_to_array(resource $statuslist[, array $fields])
+  returns every entry as a row holding the requested fields
+  (path, status, old_path, old_oid, new_oid); path and status by default */
+PHP_FUNCTION(git_status_list_to_array)
+{
+	zval *statuslist = NULL, *fields = NULL;
+	php_git2_t *_statuslist = NULL;
+	php_git2_status_untracked *extra = NULL;
+	const git_status_entry *entry = NULL;
+	const git_diff_delta *first, *last;
+	int wanted[PHP_GIT2_STATUS_FIELD_MAX] = {0};
+	size_t count = 0, i = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r|a", &statuslist, &fields) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_statuslist, php_git2_t*, &statuslist, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (php_git2_fields_parse(wanted, fields, php_git2_status_field_names, PHP_GIT2_STATUS_FIELD_MAX, "status entry" TSRMLS_CC) == 0) {
+		wanted[PHP_GIT2_STATUS_FIELD_PATH] = 1;
+		wanted[PHP_GIT2_STATUS_FIELD_STATUS] = 1;
+	}
+
+	count = git_status_list_entrycount(PHP_GIT2_V(_statuslist, status_list));
+	extra = (php_git2_status_untracked*)_statuslist->priv;
+	array_init_size(return_value, count + (extra ? extra->count : 0));
+
+	for (i = 0; i < count; i++) {
+		entry = git_status_byindex(PHP_GIT2_V(_statuslist, status_list), i);
+		if (entry == NULL) {
+			break;
+		}
+		/* HEAD side comes from the first delta, working directory side from the last */
+		first = entry->head_to_index ? entry->head_to_index : entry->index_to_workdir;
+		last = entry->index_to_workdir ? entry->index_to_workdir : entry->head_to_index;
+		php_git2_status_row(return_value, wanted, last->new_file.path, first->old_file.path,
+			entry->status, &first->old_file.oid, &last->new_file.oid);
+	}
+	for (i = 0; extra != NULL && i < extra->count; i++) {
+		php_git2_status_row(return_value, wanted, extra->paths[i], extra->paths[i],
+			extra->flags ? extra->flags[i] : GIT_STATUS_WT_NEW, NULL, NULL);
+	}
+}
+/* }}} */
+
+/* {{{ proto array git_status_list_untracked_stats(resource $statuslist)
+  returns the untracked cache counters, or false when the list was built without it */
+PHP_FUNCTION(git_status_list_untracked_stats)
+{
+	zval *statuslist = NULL;
+	php_git2_t *_statuslist = NULL;
+	php_git2_status_untracked *untracked = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"r", &statuslist) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_statuslist, php_git2_t*, &statuslist, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	untracked = (php_git2_status_untracked*)_statuslist->priv;
+	if (untracked == NULL || untracked->flags != NULL) {
+		RETURN_FALSE;
+	}
+	array_init(return_value);
+	add_assoc_long_ex(return_value, ZEND_STRS("dirs_checked"), untracked->dirs_checked);
+	add_assoc_long_ex(return_value, ZEND_STRS("dirs_skipped"), untracked->dirs_skipped);
+	add_assoc_long_ex(return_value, ZEND_STRS("dirs_read"), untracked->dirs_read);
+	add_assoc_long_ex(return_value, ZEND_STRS("untracked"), untracked->count);
+}
+/* }}} */
+
 PHP_FUNCTION(git_status_options_new)
 {
 	git_status_options options = GIT_STATUS_OPTIONS_INIT;
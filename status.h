@@ -26,6 +26,20 @@
 #ifndef PHP_GIT2_STATUS_H
 #define PHP_GIT2_STATUS_H
 
+/* untracked files found through the untracked cache, or every entry of an
+ * incremental status when flags is set */
+typedef struct php_git2_status_untracked {
+	char **paths;
+	unsigned int *flags;
+	size_t count;
+	size_t size;
+	long dirs_checked;
+	long dirs_skipped;
+	long dirs_read;
+} php_git2_status_untracked;
+
+void php_git2_status_untracked_free(php_git2_status_untracked *untracked);
+
 ZEND_BEGIN_ARG_INFO_EX(arginfo_git_status_foreach, 0, 0, 3)
 	ZEND_ARG_INFO(0, repo)
 	ZEND_ARG_INFO(0, callback)
@@ -69,6 +83,15 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_git_status_should_ignore, 0, 0, 3)
 	ZEND_ARG_INFO(0, path)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_status_list_untracked_stats, 0, 0, 1)
+	ZEND_ARG_INFO(0, statuslist)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_status_list_to_array, 0, 0, 1)
+	ZEND_ARG_INFO(0, statuslist)
+	ZEND_ARG_INFO(0, fields)
+ZEND_END_ARG_INFO()
+
 /* {{{ proto long git_status_foreach(repo, callback, payload)
 */
 PHP_FUNCTION(git_status_foreach);
@@ -103,4 +126,12 @@ PHP_FUNCTION(git_status_should_ignore);
 
 PHP_FUNCTION(git_status_options_new);
 
+/* {{{ proto array git_status_list_untracked_stats(statuslist)
+*/
+PHP_FUNCTION(git_status_list_untracked_stats);
+
+/* {{{ proto array git_status_list_to_array(statuslist[, fields])
+*/
+PHP_FUNCTION(git_status_list_to_array);
+
 #endif
\ No newline at end of file
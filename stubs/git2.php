@@ -34,6 +34,12 @@ function git_repository_state($repo){}
 function git_repository_set_namespace($repo, $nmspace){}
 function git_repository_is_shallow($repo){}
 function git_repository_init_options_new(){}
+function git_repository_watch($repo){}
+function git_repository_unwatch($repo){}
+function git_repository_watch_stats($repo){}
+function git_repository_count_objects($repo, $range){}
+function git_repository_write_bitmap($repo, $pack_path){}
+function git_repository_repack($repo, $options, $progress_cb, $progress_cb_payload){}
 function git_index_open($index_path){}
 function git_index_new(){}
 function git_index_free($index){}
@@ -68,6 +74,8 @@ function git_index_has_conflicts($index){}
 function git_index_conflict_iterator_new($index){}
 function git_index_conflict_next($our_out, $their_out, $iterator){}
 function git_index_conflict_iterator_free($iterator){}
+function git_index_entries($index, $fields){}
+function git_index_add_many($index, $entries){}
 function git_object_lookup($repo, $id, $type){}
 function git_object_lookup_prefix($repo, $id, $len, $type){}
 function git_object_lookup_bypath($treeish, $path, $type){}
@@ -163,6 +171,8 @@ function git_treebuilder_insert($bld, $filename, $id, $filemode){}
 function git_treebuilder_remove($bld, $filename){}
 function git_treebuilder_filter($bld, $filter, $payload){}
 function git_treebuilder_write($repo, $bld){}
+function git_treebuilder_insert_path($repo, $bld, $path, $id, $filemode){}
+function git_treebuilder_write_recursive($repo, $bld){}
 function git_blob_create_frombuffer($repository, $buffer){}
 function git_blob_create_fromchunks($repository, $hintpath, $callback, $payload){}
 function git_blob_create_fromdisk($repository, $path){}
@@ -192,6 +202,11 @@ function git_revwalk_push_range($walk, $range){}
 function git_revwalk_simplify_first_parent($walk){}
 function git_revwalk_free($walk){}
 function git_revwalk_repository($walk){}
+function git_revwalk_limit_path($walk, $path, $changed_paths){}
+function git_revwalk_changed_paths_new($repo, $persist){}
+function git_revwalk_changed_paths_update($changed_paths, $repo, $glob){}
+function git_revwalk_changed_paths_save($changed_paths){}
+function git_revwalk_changed_paths_stats($changed_paths){}
 function git_config_find_global(){}
 function git_config_find_xdg($length){}
 function git_config_find_system($length){}
@@ -289,6 +304,8 @@ function git_status_byindex($statuslist, $idx){}
 function git_status_list_free($statuslist){}
 function git_status_should_ignore($ignored, $repo, $path){}
 function git_status_options_new(){}
+function git_status_list_untracked_stats($statuslist){}
+function git_status_list_to_array($statuslist, $fields){}
 function git_transport_new($owner, $url){}
 function git_transport_register($prefix, $priority, $cb, $param){}
 function git_transport_unregister($prefix, $priority){}
@@ -316,6 +333,14 @@ function git_diff_status_char($status){}
 function git_diff_print($diff, $format, $print_cb, $payload){}
 function git_diff_blobs($old_blob, $old_as_path, $new_blob, $new_as_path, $options, $file_cb, $hunk_cb, $line_cb, $payload){}
 function git_diff_blob_to_buffer($old_blob, $old_as_path, $buffer, $buffer_len, $buffer_as_path, $options, $file_cb, $hunk_cb, $line_cb, $payload){}
+function git_diff_stats($diff, $name_only){}
+function git_diff_tree_paths($repo, $old_tree, $new_tree, $pathspec){}
+function git_diff_to_array($diff, $max_files, $max_lines_per_file, $max_bytes, $context, $intraline){}
+function git_diff_patches($diff, $threads, $stats_only){}
+function git_diff_similarity_cache_new($repo, $persist){}
+function git_diff_similarity_cache_save($cache){}
+function git_diff_similarity_cache_stats($cache){}
+function git_diff_write($diff, $stream, $format){}
 function git_checkout_head($repo, $opts){}
 function git_checkout_index($repo, $index, $opts){}
 function git_checkout_tree($repo, $treeish, $opts){}
@@ -340,9 +365,11 @@ function git_filter_new($payload){}
 function git_ignore_add_rule($repo, $rules){}
 function git_ignore_clear_internal_rules($repo){}
 function git_ignore_path_is_ignored($ignored, $repo, $path){}
-function git_indexer_new($out, $path, $mode, $odb, $progress_cb, $progress_cb_payload){}
-function git_indexer_append($idx, $data, $size, $stats){}
-function git_indexer_commit($idx, $stats){}
+function git_indexer_new($path, $mode, $odb, $progress_cb, $progress_cb_payload, $progress_interval_ms){}
+function git_indexer_append($idx, $data){}
+function git_indexer_append_stream($idx, $stream, $chunk_size, $threads){}
+function git_indexer_commit($idx){}
+function git_indexer_stats($idx){}
 function git_indexer_hash($idx){}
 function git_indexer_free($idx){}
 function git_pathspec_new($pathspec){}
@@ -371,6 +398,7 @@ function git_patch_get_line_in_hunk($patch, $hunk_idx, $line_of_hunk){}
 function git_patch_size($patch, $include_context, $include_hunk_headers, $include_file_headers){}
 function git_patch_print($patch, $print_cb, $payload){}
 function git_patch_to_str($patch){}
+function git_patch_write($patch, $stream){}
 function git_merge_base($repo, $one, $two){}
 function git_merge_base_many($repo, $length, $input_array[]){}
 function git_merge_head_from_ref($repo, $ref){}
@@ -464,9 +492,13 @@ function git_packbuilder_set_threads($pb, $n){}
 function git_packbuilder_insert($pb, $id, $name){}
 function git_packbuilder_insert_tree($pb, $id){}
 function git_packbuilder_insert_commit($pb, $id){}
+function git_packbuilder_insert_range($pb, $repo, $range){}
 function git_packbuilder_write($pb, $path, $mode, $progress_cb, $progress_cb_payload){}
 function git_packbuilder_hash($pb){}
 function git_packbuilder_foreach($pb, $cb, $payload){}
+function git_packbuilder_write_stream($pb, $stream, $sideband){}
+function git_packbuilder_set_options($pb, $options){}
+function git_packbuilder_stats($pb){}
 function git_packbuilder_object_count($pb){}
 function git_packbuilder_written($pb){}
 function git_packbuilder_set_callbacks($pb, $progress_cb, $progress_cb_payload){}
@@ -544,6 +576,14 @@ function git_blame_file($repo, $path, $options){}
 function git_blame_buffer($reference, $buffer, $buffer_len){}
 function git_blame_free($blame){}
 function git_blame_options_new(){}
+function git_blame_to_array($blame, $fields){}
+function git_blame_cache_new($repo, $persist){}
+function git_blame_cache_prewarm($cache, $repo, $paths, $options){}
+function git_blame_cache_save($cache){}
+function git_blame_cache_stats($cache){}
+function git_blame_file_stream($repo, $path, $options, $callback, $payload){}
+function git_upload_pack_serve($repo, $in, $out, $options){}
+function git_receive_pack_serve($repo, $in, $out, $pre_receive, $options){}
 function git_resource_type($resource){}
 function git_libgit2_capabilities(){}
 function git_libgit2_version(){}
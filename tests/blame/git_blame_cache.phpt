@@ -0,0 +1,94 @@
+--TEST--
+Check for the blame_cache option of git_blame_file: hits, replays and fallbacks
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_blame_cache_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir, $file, $content)
+{
+	file_put_contents("$dir/$file", $content);
+	sh("cd " . escapeshellarg($dir) . " && git add " . escapeshellarg($file) .
+		" && git -c user.name=php -c user.email=php@example.com commit -qm " . escapeshellarg($file));
+	return sh("git -C $dir rev-parse HEAD");
+}
+
+function rows($blame)
+{
+	return json_encode(git_blame_to_array($blame));
+}
+
+function stats($cache)
+{
+	$stats = git_blame_cache_stats($cache);
+	return $stats["entries"] . " " . $stats["hits"] . " " . $stats["replays"] . " " . $stats["misses"] . " " . $stats["replayed_commits"];
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+$first = commit($dir, "a.txt", "1\n2\n3\n4\n5\n6\n");
+commit($dir, "b.txt", "b\n");
+
+$repo = git_repository_open($dir);
+$cache = git_blame_cache_new($repo);
+// a path missing at HEAD is skipped
+echo git_blame_cache_prewarm($cache, $repo, array("a.txt", "missing.txt")), " ", stats($cache), PHP_EOL;
+
+// answered from the cache as libgit2 answers it
+$blame = git_blame_file($repo, "a.txt", array("blame_cache" => $cache));
+var_dump(rows($blame) === rows(git_blame_file($repo, "a.txt", array())));
+echo stats($cache), PHP_EOL;
+
+// two commits touching the file since: replayed on top of the cached blame
+$second = commit($dir, "a.txt", "1\ntwo\n3\n4\n5\n6\n");
+commit($dir, "b.txt", "b\nb\n");
+commit($dir, "a.txt", "1\ntwo\n3\n4\nfive\n6\n");
+$blame = git_blame_file($repo, "a.txt", array("blame_cache" => $cache));
+var_dump(rows($blame) === rows(git_blame_file($repo, "a.txt", array())));
+echo stats($cache), PHP_EOL;
+git_blame_file($repo, "a.txt", array("blame_cache" => $cache));
+echo stats($cache), PHP_EOL;
+
+// oldest_commit is not cached, and the blame still starts at HEAD
+$blame = git_blame_file($repo, "a.txt", array("blame_cache" => $cache, "oldest_commit" => $first));
+$lines = 0;
+foreach (git_blame_to_array($blame)["hunks"] as $hunk) {
+	$lines += $hunk["lines"];
+}
+echo $lines, " ", stats($cache), PHP_EOL;
+
+// an older newest_commit replays from the closest cached ancestor
+$blame = git_blame_file($repo, "a.txt", array("blame_cache" => $cache, "newest_commit" => $second));
+var_dump(rows($blame) === rows(git_blame_file($repo, "a.txt", array("newest_commit" => $second))));
+echo stats($cache), PHP_EOL;
+
+// a merge touching the file is left to libgit2
+sh("git -C $dir checkout -qb side");
+commit($dir, "a.txt", "one\ntwo\n3\n4\nfive\n6\n");
+sh("git -C $dir checkout -q master");
+commit($dir, "a.txt", "1\ntwo\n3\n4\nfive\nsix\n");
+sh("git -C $dir -c user.name=php -c user.email=php@example.com merge -q --no-ff -m merge side");
+$blame = git_blame_file($repo, "a.txt", array("blame_cache" => $cache));
+var_dump(rows($blame) === rows(git_blame_file($repo, "a.txt", array())));
+echo stats($cache), PHP_EOL;
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+1 1 0 0 2 0
+bool(true)
+1 1 0 2 0
+bool(true)
+2 1 1 2 2
+2 2 1 2 2
+6 2 2 1 2 2
+bool(true)
+3 2 2 2 3
+bool(true)
+4 2 2 3 3
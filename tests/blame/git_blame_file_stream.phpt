@@ -0,0 +1,94 @@
+--TEST--
+Check for git_blame_file_stream against git_blame_file
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_blame_stream_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir, $file, $lines)
+{
+	file_put_contents("$dir/$file", is_array($lines) ? implode("\n", $lines) . "\n" : $lines);
+	sh("cd " . escapeshellarg($dir) . " && git add " . escapeshellarg($file) .
+		" && git -c user.name=php -c user.email=php@example.com commit -qm " . escapeshellarg($file));
+	return sh("git -C $dir rev-parse HEAD");
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+$lines = range(1, 10);
+$ids = array();
+$ids[commit($dir, "a.txt", $lines)] = "c1";
+$lines[2] = "three";
+$ids[$c2 = commit($dir, "a.txt", $lines)] = "c2";
+commit($dir, "b.txt", "b\n");
+sh("git -C $dir checkout -qb side");
+$side = $lines;
+$side[7] = "eight";
+$ids[commit($dir, "a.txt", $side)] = "side";
+sh("git -C $dir checkout -q master");
+$lines[4] = "five";
+$ids[$m = commit($dir, "a.txt", $lines)] = "m";
+sh("git -C $dir -c user.name=php -c user.email=php@example.com merge -q --no-ff -m merge side");
+$lines = explode("\n", trim(file_get_contents("$dir/a.txt")));
+$lines[3] = "four";
+$ids[commit($dir, "a.txt", $lines)] = "after";
+
+$repo = git_repository_open($dir);
+$rows = new ArrayObject();
+$emitted = git_blame_file_stream($repo, "a.txt", array("min_line" => 3, "max_line" => 8), function ($hunk, $rows) {
+	$rows[] = $hunk;
+	return 0;
+}, $rows);
+// newest first, the merge left to libgit2
+echo $emitted, " ", $ids[$rows[0]["final_commit_id"]], " ", $rows[0]["start"], PHP_EOL;
+
+// the window attributed as the whole file blame attributes it
+$streamed = array();
+foreach ($rows as $hunk) {
+	for ($i = 0; $i < $hunk["lines"]; $i++) {
+		$streamed[$hunk["start"] + $i] = $ids[$hunk["final_commit_id"]];
+	}
+}
+ksort($streamed);
+$expected = array();
+foreach (git_blame_to_array(git_blame_file($repo, "a.txt", array()))["hunks"] as $hunk) {
+	for ($i = 0; $i < $hunk["lines"]; $i++) {
+		if ($hunk["start"] + $i >= 3 && $hunk["start"] + $i <= 8) {
+			$expected[$hunk["start"] + $i] = $ids[$hunk["final_commit_id"]];
+		}
+	}
+}
+var_dump($streamed === $expected);
+echo implode(" ", $streamed), PHP_EOL;
+
+// oldest_commit ends the walk, what is left there is a boundary
+$rows = new ArrayObject();
+git_blame_file_stream($repo, "a.txt", array("min_line" => 3, "max_line" => 8, "newest_commit" => $m, "oldest_commit" => $c2), function ($hunk, $rows) {
+	$rows[] = $hunk;
+	return 0;
+}, $rows);
+foreach ($rows as $hunk) {
+	echo $hunk["start"], " ", $hunk["lines"], " ", $ids[$hunk["final_commit_id"]], " ", var_export($hunk["boundary"], true), PHP_EOL;
+}
+
+// a non zero return stops the walk
+echo git_blame_file_stream($repo, "a.txt", array(), function ($hunk, $payload) {
+	return 1;
+}, null), PHP_EOL;
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+5 after 4
+bool(true)
+c2 after m c1 c1 side
+5 1 m false
+3 1 c2 true
+6 3 c2 true
+1
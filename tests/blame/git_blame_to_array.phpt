@@ -0,0 +1,73 @@
+--TEST--
+Check for git_blame_to_array
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_blame_to_array_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir, $name, $date, $content)
+{
+	file_put_contents("$dir/a.txt", $content);
+	sh("cd " . escapeshellarg($dir) . " && git add a.txt && GIT_AUTHOR_DATE=" . escapeshellarg($date) .
+		" git -c user.name=$name -c user.email=$name@example.com commit -qm $name");
+	return sh("git -C $dir rev-parse HEAD");
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+$ids = array();
+$ids[commit($dir, "ann", "2001-01-01T00:00:00+0200", "1\n2\n3\n4\n5\n6\n")] = "ann";
+$ids[commit($dir, "bob", "2002-01-01T00:00:00-0500", "1\ntwo\nthree\n4\n5\n6\n")] = "bob";
+$ids[commit($dir, "cy", "2003-01-01T00:00:00+0000", "1\ntwo\nthree\n4\n5\nsix\nseven\n")] = "cy";
+
+$repo = git_repository_open($dir);
+$blame = git_blame_file($repo, "a.txt", array());
+$result = git_blame_to_array($blame);
+foreach ($result["hunks"] as $hunk) {
+	echo implode(" ", array_keys($hunk)), ": ", $hunk["start"], " ", $hunk["lines"], " ", $ids[$hunk["final_commit_id"]], " ", $hunk["time"], PHP_EOL;
+}
+// one signature per commit
+foreach ($ids as $id => $name) {
+	echo $name, " ", implode(" ", $result["signatures"][$id]), PHP_EOL;
+}
+
+// the line by line attribution git blame prints
+$lines = array();
+foreach ($result["hunks"] as $hunk) {
+	for ($i = 0; $i < $hunk["lines"]; $i++) {
+		$lines[$hunk["start"] + $i] = $hunk["final_commit_id"];
+	}
+}
+preg_match_all('/^([0-9a-f]{40}) \d+ (\d+)/m', sh("git -C $dir blame --line-porcelain a.txt"), $matches, PREG_SET_ORDER);
+$expected = array();
+foreach ($matches as $match) {
+	$expected[(int)$match[2]] = $match[1];
+}
+var_dump($lines === $expected);
+
+// other fields on request, unknown names are skipped
+$result = @git_blame_to_array($blame, array("orig_start", "orig_path", "orig_commit_id", "nope"));
+echo implode(" ", array_keys($result["hunks"][0])), PHP_EOL;
+echo $result["hunks"][0]["orig_path"], " ", $ids[$result["hunks"][0]["orig_commit_id"]], PHP_EOL;
+var_dump(count($result["signatures"]));
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+start lines final_commit_id time: 1 1 ann 978300000
+start lines final_commit_id time: 2 2 bob 1009861200
+start lines final_commit_id time: 4 2 ann 978300000
+start lines final_commit_id time: 6 2 cy 1041379200
+ann ann ann@example.com 978300000 120
+bob bob bob@example.com 1009861200 -300
+cy cy cy@example.com 1041379200 0
+bool(true)
+orig_commit_id orig_path orig_start
+a.txt ann
+int(3)
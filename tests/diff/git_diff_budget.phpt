@@ -0,0 +1,91 @@
+--TEST--
+Check for the diff budget in git_diff_print, git_diff_write and git_diff_foreach
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_diff_budget_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? implode("\n", $output) . "\n" : false;
+}
+
+function commit($dir)
+{
+	sh("cd " . escapeshellarg($dir) . " && git add -A && git -c user.name=php -c user.email=php@example.com commit -qm next");
+	return git_tree_lookup(git_repository_open($dir), trim(sh("git -C $dir rev-parse HEAD^{tree}")));
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+file_put_contents("$dir/big.txt", implode("", array_map(function ($i) { return "$i old\n"; }, range(1, 500))));
+file_put_contents("$dir/small.txt", "1\n2\n3\n");
+$old = commit($dir);
+file_put_contents("$dir/big.txt", implode("", array_map(function ($i) { return "$i new\n"; }, range(1, 500))));
+file_put_contents("$dir/small.txt", "1\n2\n3\n4\n");
+file_put_contents("$dir/added.txt", implode("", array_map(function ($i) { return "$i added\n"; }, range(1, 500))));
+$new = commit($dir);
+
+$repo = git_repository_open($dir);
+$diff = git_diff_tree_to_tree($repo, $old, $new, array("max_file_lines" => 100));
+// git prints a file it may not diff the same way
+file_put_contents("$dir/attributes", "big.txt -diff\nadded.txt -diff\n");
+$expected = shell_exec("git -C $dir -c core.attributesFile=$dir/attributes diff --no-color HEAD~1 HEAD");
+
+$text = "";
+git_diff_print($diff, GIT_DIFF_FORMAT_PATCH, function ($delta, $hunk, $line, $payload) use (&$text) {
+	$origin = $line["origin"];
+	$text .= ($origin == "+" || $origin == "-" || $origin == " " ? $origin : "") . $line["content"];
+	return 0;
+}, null);
+var_dump($text === $expected);
+
+$stream = fopen("php://memory", "w+");
+$written = git_diff_write($diff, $stream, GIT_DIFF_FORMAT_PATCH);
+rewind($stream);
+var_dump(stream_get_contents($stream) === $expected, $written === strlen($expected));
+fclose($stream);
+
+// the name formats never look at content
+$stream = fopen("php://memory", "w+");
+git_diff_write($diff, $stream, GIT_DIFF_FORMAT_NAME_STATUS);
+rewind($stream);
+echo stream_get_contents($stream);
+fclose($stream);
+
+$files = array();
+git_diff_foreach($diff, function ($delta, $progress, $payload) use (&$files) {
+	$files[$delta["new_file"]["path"]] = array(($delta["flags"] & GIT_DIFF_FLAG_BINARY) ? "binary" : "text", 0);
+	return 0;
+}, function ($delta, $hunk, $payload) use (&$files) {
+	$files[$delta["new_file"]["path"]][1]++;
+	return 0;
+}, function ($delta, $hunk, $line, $payload) {
+	return 0;
+}, null);
+foreach ($files as $path => $file) {
+	echo $path, " ", implode(" ", $file), PHP_EOL;
+}
+
+// without a budget everything is diffed
+$diff = git_diff_tree_to_tree($repo, $old, $new, array());
+$stream = fopen("php://memory", "w+");
+git_diff_write($diff, $stream, GIT_DIFF_FORMAT_PATCH);
+rewind($stream);
+var_dump(stream_get_contents($stream) === shell_exec("git -C $dir diff --no-color HEAD~1 HEAD"));
+fclose($stream);
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+A	added.txt
+M	big.txt
+M	small.txt
+added.txt binary 0
+big.txt binary 0
+small.txt text 1
+bool(true)
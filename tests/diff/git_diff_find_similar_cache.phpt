@@ -0,0 +1,98 @@
+--TEST--
+Check that git_diff_find_similar finds the same renames with and without a similarity cache
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_similarity_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir)
+{
+	sh("cd " . escapeshellarg($dir) . " && git add -A && git -c user.name=php -c user.email=php@example.com commit -qm next");
+	return git_tree_lookup(git_repository_open($dir), sh("git -C $dir rev-parse HEAD^{tree}"));
+}
+
+function renames($repo, $old, $new, $flags, $cache = null)
+{
+	$diff = git_diff_tree_to_tree($repo, $old, $new, array());
+	$options = array("flags" => $flags);
+	if ($cache !== null) {
+		$options["similarity_cache"] = $cache;
+	}
+	git_diff_find_similar($diff, $options);
+	$found = array();
+	for ($i = 0; $i < git_diff_num_deltas($diff); $i++) {
+		$delta = git_diff_get_delta($diff, $i);
+		if ($delta["status"] == GIT_DELTA_RENAMED) {
+			$found[] = $delta["old_file"]["path"] . " " . $delta["new_file"]["path"] . " " . $delta["similarity"];
+		}
+	}
+	return implode(", ", $found);
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+for ($i = 0; $i < 6; $i++) {
+	$lines = array();
+	for ($j = 0; $j < 30; $j++) {
+		$lines[] = "file $i line $j";
+	}
+	file_put_contents("$dir/a$i.txt", implode("\n", $lines) . "\n");
+}
+file_put_contents("$dir/ws.txt", implode("\n", array_map(function ($j) { return "ws line $j"; }, range(0, 29))) . "\n");
+$old = commit($dir);
+for ($i = 0; $i < 6; $i++) {
+	$lines = explode("\n", rtrim(file_get_contents("$dir/a$i.txt")));
+	for ($j = 0; $j < $i * 4; $j++) {
+		$lines[$j] = "rewritten $i $j";
+	}
+	unlink("$dir/a$i.txt");
+	file_put_contents("$dir/b$i.txt", implode("\n", $lines) . "\n");
+}
+// only whitespace changes, libgit2 pairs these up with GIT_DIFF_FIND_IGNORE_WHITESPACE only
+unlink("$dir/ws.txt");
+file_put_contents("$dir/ws2.txt", implode("\n", array_map(function ($j) { return "w s l i n e $j"; }, range(0, 29))) . "\n");
+$new = commit($dir);
+
+$repo = git_repository_open($dir);
+$flags = GIT_DIFF_FIND_RENAMES;
+$ignore = GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_IGNORE_WHITESPACE;
+$plain = renames($repo, $old, $new, $flags);
+$plain_ignore = renames($repo, $old, $new, $ignore);
+$found = explode(", ", $plain);
+echo count($found) >= 3 ? $found[0] : $plain, PHP_EOL;
+var_dump(strpos($plain_ignore, "ws.txt ws2.txt") !== false && strpos($plain, "ws.txt") === false);
+
+// libgit2's own scores, the first time and from the cache
+$cache = git_diff_similarity_cache_new($repo, true);
+var_dump(renames($repo, $old, $new, $flags, $cache) === $plain);
+var_dump(renames($repo, $old, $new, $flags, $cache) === $plain);
+var_dump(renames($repo, $old, $new, $ignore, $cache) === $plain_ignore);
+$stats = git_diff_similarity_cache_stats($cache);
+var_dump($stats["hits"] > 0, $stats["score_hits"] > 0);
+var_dump(git_diff_similarity_cache_save($cache));
+
+// a new process only has the scores: nothing is hashed again
+$cache = git_diff_similarity_cache_new($repo, true);
+var_dump(renames($repo, $old, $new, $flags, $cache) === $plain);
+$stats = git_diff_similarity_cache_stats($cache);
+echo $stats["misses"], " ", $stats["hashed_bytes"], " ", var_export($stats["score_hits"] > 0, true), " ", var_export($stats["saved_bytes"] > 0, true), PHP_EOL;
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+a0.txt b0.txt 100
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+0 0 true true
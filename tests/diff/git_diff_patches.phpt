@@ -0,0 +1,65 @@
+--TEST--
+Check for git_diff_patches on one and on several threads
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_diff_patches_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir)
+{
+	sh("cd " . escapeshellarg($dir) . " && git add -A && git -c user.name=php -c user.email=php@example.com commit -qm next");
+	return git_tree_lookup(git_repository_open($dir), sh("git -C $dir rev-parse HEAD^{tree}"));
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+for ($i = 0; $i < 40; $i++) {
+	@mkdir("$dir/d" . ($i % 4));
+	file_put_contents("$dir/d" . ($i % 4) . "/f$i." . ($i % 3 ? "txt" : "c"), str_repeat("line $i\n", $i + 1));
+}
+$old = commit($dir);
+for ($i = 0; $i < 40; $i += 2) {
+	file_put_contents("$dir/d" . ($i % 4) . "/f$i." . ($i % 3 ? "txt" : "c"), "changed $i\n", FILE_APPEND);
+}
+$new = commit($dir);
+
+$repo = git_repository_open($dir);
+$diff = git_diff_tree_to_tree($repo, $old, $new, array());
+$serial = git_diff_patches($diff);
+echo count($serial), PHP_EOL;
+
+// the same rows whatever the number of threads, and whether libgit2 can use them or not
+var_dump(git_diff_patches($diff, 4) === $serial);
+var_dump(git_diff_patches($diff, 0) === $serial);
+
+// the line counts git diff --numstat gives
+$numstat = array();
+foreach (explode("\n", sh("git -C $dir diff --numstat HEAD~1 HEAD")) as $line) {
+	list($additions, $deletions, $path) = explode("\t", $line);
+	$numstat[$path] = "$additions $deletions";
+}
+$same = true;
+foreach ($serial as $row) {
+	$same = $same && $numstat[$row["path"]] === $row["additions"] . " " . $row["deletions"] &&
+		strpos($row["patch"], "diff --git a/" . $row["path"]) === 0;
+}
+var_dump($same);
+
+// counts only
+$stats = git_diff_patches($diff, 4, true);
+echo $stats[0]["additions"], " ", var_export($stats[0]["patch"], true), PHP_EOL;
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+20
+bool(true)
+bool(true)
+bool(true)
+1 NULL
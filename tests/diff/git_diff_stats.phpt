@@ -0,0 +1,67 @@
+--TEST--
+Check for git_diff_stats
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_diff_stats_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir)
+{
+	sh("cd " . escapeshellarg($dir) . " && git add -A && git -c user.name=php -c user.email=php@example.com commit -qm next");
+	return git_tree_lookup(git_repository_open($dir), sh("git -C $dir rev-parse HEAD^{tree}"));
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+file_put_contents("$dir/a.txt", "one\ntwo\nthree\n");
+file_put_contents("$dir/b.txt", "b\n");
+file_put_contents("$dir/big.txt", str_repeat("line\n", 100));
+file_put_contents("$dir/bin.dat", "\0\1\2");
+$old = commit($dir);
+file_put_contents("$dir/a.txt", "one\n2\nthree\nfour\n");
+unlink("$dir/b.txt");
+file_put_contents("$dir/c.txt", "c\nc\n");
+file_put_contents("$dir/big.txt", str_repeat("other\n", 100));
+file_put_contents("$dir/bin.dat", "\0\3");
+$new = commit($dir);
+
+$repo = git_repository_open($dir);
+$diff = git_diff_tree_to_tree($repo, $old, $new, array());
+$stats = git_diff_stats($diff);
+foreach ($stats["files"] as $file) {
+	echo $file["path"], " ", $file["status"], " ", var_export($file["binary"], true), " ", $file["additions"], " ", $file["deletions"], PHP_EOL;
+}
+echo $stats["files_changed"], " ", $stats["insertions"], " ", $stats["deletions"], PHP_EOL;
+// the same totals as git diff --shortstat
+echo sh("git -C $dir diff --shortstat HEAD~1 HEAD"), PHP_EOL;
+
+// name only: no line counts at all
+$stats = git_diff_stats($diff, true);
+echo count($stats["files"]), " ", var_export(isset($stats["insertions"]), true), " ", var_export(isset($stats["files"][0]["additions"]), true), PHP_EOL;
+
+// a file over the line budget is flagged instead of counted
+$diff = git_diff_tree_to_tree($repo, $old, $new, array("max_file_lines" => 50));
+foreach (git_diff_stats($diff)["files"] as $file) {
+	if ($file["too_large"]) {
+		echo $file["path"], " ", var_export(isset($file["additions"]), true), PHP_EOL;
+	}
+}
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+a.txt M false 2 1
+b.txt D false 0 1
+big.txt M false 100 100
+bin.dat M true 0 0
+c.txt A false 2 0
+5 104 102
+5 files changed, 104 insertions(+), 102 deletions(-)
+5 false false
+big.txt false
@@ -0,0 +1,93 @@
+--TEST--
+Check for git_diff_to_array and its limits
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_diff_to_array_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir)
+{
+	sh("cd " . escapeshellarg($dir) . " && git add -A && git -c user.name=php -c user.email=php@example.com commit -qm next");
+	return git_tree_lookup(git_repository_open($dir), sh("git -C $dir rev-parse HEAD^{tree}"));
+}
+
+function dump($result)
+{
+	foreach ($result["files"] as $file) {
+		echo $file["new_path"], " ", $file["status"], " +", $file["additions"], " -", $file["deletions"],
+			" ", var_export($file["truncated"], true), PHP_EOL;
+		foreach ($file["hunks"] as $hunk) {
+			$origins = "";
+			foreach ($hunk["lines"] as $line) {
+				$origins .= $line["origin"];
+			}
+			echo "  @@ -", $hunk["old_start"], ",", $hunk["old_lines"], " +", $hunk["new_start"], ",", $hunk["new_lines"], " @@ [", $origins, "]", PHP_EOL;
+		}
+	}
+	echo count($result["files"]), "/", $result["total_files"], " ", var_export($result["truncated"], true), PHP_EOL;
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+$lines = array();
+for ($i = 1; $i <= 20; $i++) {
+	$lines[$i] = "l$i\n";
+}
+file_put_contents("$dir/a.txt", implode("", $lines));
+$old = commit($dir);
+$lines[2] = "two\n";
+$lines[18] = "eighteen\n";
+file_put_contents("$dir/a.txt", implode("", $lines));
+file_put_contents("$dir/b.txt", "b\nb\n");
+$new = commit($dir);
+
+$repo = git_repository_open($dir);
+$diff = git_diff_tree_to_tree($repo, $old, $new, array());
+dump(git_diff_to_array($diff));
+// the hunk ranges git prints for the same change
+echo sh("git -C $dir diff HEAD~1 HEAD -- a.txt | grep -o '^@@ [^@]* @@'"), PHP_EOL;
+
+// no context lines
+dump(git_diff_to_array($diff, 0, 0, 0, 0));
+// the first file only
+dump(git_diff_to_array($diff, 1));
+// three lines per file
+dump(git_diff_to_array($diff, 0, 3));
+// ten bytes of line content in all
+dump(git_diff_to_array($diff, 0, 0, 10));
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+a.txt M +2 -2 false
+  @@ -1,5 +1,5 @@ [ -+   ]
+  @@ -15,6 +15,6 @@ [   -+  ]
+b.txt A +2 -0 false
+  @@ -0,0 +1,2 @@ [++]
+2/2 false
+@@ -1,5 +1,5 @@
+@@ -15,6 +15,6 @@
+a.txt M +2 -2 false
+  @@ -1,5 +1,5 @@ [-+]
+  @@ -15,6 +15,6 @@ [-+]
+b.txt A +2 -0 false
+  @@ -0,0 +1,2 @@ [++]
+2/2 false
+a.txt M +2 -2 false
+  @@ -1,5 +1,5 @@ [ -+   ]
+  @@ -15,6 +15,6 @@ [   -+  ]
+1/2 true
+a.txt M +2 -2 true
+  @@ -1,5 +1,5 @@ [ -+]
+b.txt A +2 -0 false
+  @@ -0,0 +1,2 @@ [++]
+2/2 false
+a.txt M +2 -2 true
+  @@ -1,5 +1,5 @@ [ -+]
+1/2 true
@@ -0,0 +1,75 @@
+--TEST--
+Check for the intraline spans of git_diff_to_array
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_intraline_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir)
+{
+	sh("cd " . escapeshellarg($dir) . " && git add -A && git -c user.name=php -c user.email=php@example.com commit -qm next");
+	return git_tree_lookup(git_repository_open($dir), sh("git -C $dir rev-parse HEAD^{tree}"));
+}
+
+function dump($result)
+{
+	foreach ($result["files"] as $file) {
+		echo $file["new_path"], PHP_EOL;
+		foreach ($file["hunks"] as $hunk) {
+			foreach ($hunk["lines"] as $line) {
+				if ($line["origin"] == " ") {
+					continue;
+				}
+				echo "  ", $line["origin"], " ", rtrim($line["content"]);
+				if (isset($line["spans"])) {
+					foreach ($line["spans"] as $span) {
+						echo " [", implode(",", $span), "]";
+					}
+				}
+				echo PHP_EOL;
+			}
+		}
+	}
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+file_put_contents("$dir/a.txt", "the quick brown fox\na=1;\nnaïve café\nkeep\ngone one\ngone two\n");
+file_put_contents("$dir/long.txt", str_repeat("x ", 200) . "1\n");
+$old = commit($dir);
+file_put_contents("$dir/a.txt", "the slow brown dog\na=2;\nnaïve cafe\nkeep\nonly one\n");
+file_put_contents("$dir/long.txt", str_repeat("x ", 200) . "2\n");
+$new = commit($dir);
+
+$repo = git_repository_open($dir);
+$diff = git_diff_tree_to_tree($repo, $old, $new, array());
+// spans are byte offsets into the content, a line without a partner or with too many words has none
+dump(git_diff_to_array($diff, 0, 0, 0, -1, true));
+
+// and none without $intraline
+$result = git_diff_to_array($diff);
+var_dump(isset($result["files"][0]["hunks"][0]["lines"][0]["spans"]));
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+a.txt
+  - the quick brown fox [4,5] [16,3]
+  - a=1; [2,1]
+  - naïve café [7,5]
+  + the slow brown dog [4,4] [15,3]
+  + a=2; [2,1]
+  + naïve cafe [7,4]
+  - gone one [0,4]
+  - gone two
+  + only one [0,4]
+long.txt
+  - x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x 1
+  + x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x x 2
+bool(false)
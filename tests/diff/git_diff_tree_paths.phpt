@@ -0,0 +1,90 @@
+--TEST--
+Check for git_diff_tree_paths
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_tree_paths_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir)
+{
+	sh("cd " . escapeshellarg($dir) . " && git add -A && git -c user.name=php -c user.email=php@example.com commit -qm next");
+	return git_tree_lookup(git_repository_open($dir), sh("git -C $dir rev-parse HEAD^{tree}"));
+}
+
+function lines($paths)
+{
+	$lines = array();
+	foreach ($paths as $path => $status) {
+		$lines[] = "$status $path";
+	}
+	sort($lines);
+	return implode("\n", $lines);
+}
+
+/* what git diff --name-status says for the same two commits */
+function git_lines($dir, $pathspec = "")
+{
+	$lines = explode("\n", sh("git -C $dir diff --name-status --no-renames HEAD~1 HEAD -- $pathspec"));
+	$lines = array_map(function ($line) { return str_replace("\t", " ", $line); }, $lines);
+	sort($lines);
+	return implode("\n", $lines);
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+mkdir("$dir/sub");
+mkdir("$dir/d");
+mkdir("$dir/same");
+file_put_contents("$dir/a.txt", "a\n");
+file_put_contents("$dir/link.txt", "target\n");
+file_put_contents("$dir/sub/b.txt", "b\n");
+file_put_contents("$dir/sub/keep.txt", "keep\n");
+file_put_contents("$dir/d/inner.txt", "inner\n");
+file_put_contents("$dir/same/x.txt", "x\n");
+$old = commit($dir);
+file_put_contents("$dir/a.txt", "a2\n");
+unlink("$dir/link.txt");
+symlink("a.txt", "$dir/link.txt");
+unlink("$dir/sub/b.txt");
+mkdir("$dir/sub/deep");
+file_put_contents("$dir/sub/deep/c.txt", "c\n");
+// a directory replaced by a file of the same name
+unlink("$dir/d/inner.txt");
+rmdir("$dir/d");
+file_put_contents("$dir/d", "now a file\n");
+$new = commit($dir);
+
+$repo = git_repository_open($dir);
+$paths = git_diff_tree_paths($repo, $old, $new);
+echo lines($paths), PHP_EOL;
+var_dump(lines($paths) === git_lines($dir));
+
+// pathspecs, literal and glob
+var_dump(lines(git_diff_tree_paths($repo, $old, $new, array("sub"))) === git_lines($dir, "sub"));
+var_dump(lines(git_diff_tree_paths($repo, $old, $new, array("*.txt"))) === git_lines($dir, "'*.txt'"));
+
+// a missing tree is the empty tree
+$added = git_diff_tree_paths($repo, null, $old);
+echo count($added), " ", implode("", array_unique(array_values($added))), PHP_EOL;
+echo count(git_diff_tree_paths($repo, $old, $old)), PHP_EOL;
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+A d
+A sub/deep/c.txt
+D d/inner.txt
+D sub/b.txt
+M a.txt
+T link.txt
+bool(true)
+bool(true)
+bool(true)
+6 A
+0
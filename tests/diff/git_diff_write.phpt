@@ -0,0 +1,74 @@
+--TEST--
+Check for git_diff_write and git_patch_write
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_diff_write_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? implode("\n", $output) . "\n" : false;
+}
+
+function commit($dir)
+{
+	sh("cd " . escapeshellarg($dir) . " && git add -A && git -c user.name=php -c user.email=php@example.com commit -qm next");
+	return git_tree_lookup(git_repository_open($dir), trim(sh("git -C $dir rev-parse HEAD^{tree}")));
+}
+
+function write($what, $format = null)
+{
+	$stream = fopen("php://memory", "w+");
+	$written = is_resource($what) && $format !== null ? git_diff_write($what, $stream, $format) : git_patch_write($what, $stream);
+	rewind($stream);
+	$text = stream_get_contents($stream);
+	fclose($stream);
+	return array($written, $text);
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+// lines starting with a digit keep git from adding function names to the hunk headers
+file_put_contents("$dir/big.txt", implode("", array_map(function ($i) { return "$i old\n"; }, range(1, 5000))));
+file_put_contents("$dir/small.txt", "1\n2\n3\n");
+$old = commit($dir);
+file_put_contents("$dir/big.txt", implode("", array_map(function ($i) { return "$i new\n"; }, range(1, 5000))));
+file_put_contents("$dir/small.txt", "1\n2\n3\n4\n");
+$new = commit($dir);
+
+$repo = git_repository_open($dir);
+$diff = git_diff_tree_to_tree($repo, $old, $new, array());
+
+// more than the 64 KiB buffer, byte for byte what git prints
+list($written, $text) = write($diff, GIT_DIFF_FORMAT_PATCH);
+var_dump($written > 65536, $written === strlen($text));
+var_dump($text === shell_exec("git -C $dir diff --no-color HEAD~1 HEAD"));
+
+list($written, $text) = write($diff, GIT_DIFF_FORMAT_NAME_STATUS);
+echo $text;
+
+// one patch, the same text as git_patch_to_str
+$patch = git_patch_from_diff($diff, 1);
+list($written, $text) = write($patch);
+var_dump($text === git_patch_to_str($patch), $written === strlen($text));
+var_dump($text === shell_exec("git -C $dir diff --no-color HEAD~1 HEAD -- small.txt"));
+
+// a stream that takes nothing
+file_put_contents("$dir/readonly", "");
+$stream = fopen("$dir/readonly", "r");
+var_dump(@git_diff_write($diff, $stream, GIT_DIFF_FORMAT_PATCH));
+fclose($stream);
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+M	big.txt
+M	small.txt
+bool(true)
+bool(true)
+bool(true)
+bool(false)
@@ -0,0 +1,52 @@
+--TEST--
+Check for git_index_add_many
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$index = git_index_new();
+$oid = "e69de29bb2d1d6434b8b29ae775ad8c2e48c5391";
+
+echo git_index_add_many($index, array(
+	array("path" => "b.txt", "oid" => $oid, "mode" => "33188"),
+	array("path" => "a.txt", "oid" => $oid, "mode" => 33188),
+	array("path" => "b.txt", "oid" => $oid, "mode" => 33261),
+)) . PHP_EOL;
+echo git_index_add_many($index, array(
+	array("path" => "0.txt", "oid" => $oid, "mode" => 33188),
+	array("path" => "a.txt", "oid" => $oid, "mode" => 33261),
+)) . PHP_EOL;
+
+$entries = git_index_entries($index, array("path", "mode"));
+echo implode(",", $entries["path"]) . PHP_EOL;
+echo implode(",", $entries["mode"]) . PHP_EOL;
+
+// names that are not strings are skipped, leaving the default columns
+$entries = @git_index_entries($index, array(1));
+echo implode(",", array_keys($entries)) . PHP_EOL;
+
+// conflict stages end up as git_index_add leaves them
+$time = array("seconds" => 0, "nanoseconds" => 0);
+$rows = array();
+foreach (array(3, 1, 2) as $stage) {
+	$rows[] = array("path" => "c.txt", "oid" => $oid, "mode" => 33188, "flags" => $stage << 12,
+		"ctime" => $time, "mtime" => $time);
+}
+$rows[] = array("path" => "d.txt", "oid" => $oid, "mode" => 33188, "ctime" => $time, "mtime" => $time);
+$many = git_index_new();
+$single = git_index_new();
+echo git_index_add_many($many, $rows) . PHP_EOL;
+foreach ($rows as $row) {
+	git_index_add($single, $row);
+}
+var_dump(git_index_entries($many, array("path", "flags")) === git_index_entries($single, array("path", "flags")));
+echo git_index_has_conflicts($many), " ", git_index_has_conflicts($single), PHP_EOL;
+--EXPECT--
+2
+2
+0.txt,a.txt,b.txt
+33188,33261,33261
+path,oid,mode
+4
+bool(true)
+1 1
@@ -0,0 +1,55 @@
+--TEST--
+Check for git_indexer_append_stream on a non blocking pipe
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_indexer_stream_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function cpu()
+{
+	$usage = getrusage();
+	return $usage["ru_utime.tv_sec"] + $usage["ru_utime.tv_usec"] / 1e6 + $usage["ru_stime.tv_sec"] + $usage["ru_stime.tv_usec"] / 1e6;
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+for ($i = 0; $i < 10; $i++) {
+	file_put_contents("$dir/f$i.txt", str_repeat("line $i\n", 100));
+}
+sh("cd " . escapeshellarg($dir) . " && git add . && git -c user.name=php -c user.email=php@example.com commit -qm init");
+sh("git -C $dir rev-list --objects --all | git -C $dir pack-objects -q --stdout > $dir/pack");
+$objects = (int)sh("git -C $dir rev-list --objects --all | wc -l");
+$half = (int)(filesize("$dir/pack") / 2);
+
+foreach (array(1, 2) as $threads) {
+	// half the pack, a pause with nothing to read, then the rest
+	$proc = proc_open("sh -c " . escapeshellarg("head -c $half $dir/pack; sleep 1; tail -c +" . ($half + 1) . " $dir/pack"),
+		array(1 => array("pipe", "w")), $pipes);
+	stream_set_blocking($pipes[1], false);
+	mkdir("$dir/out$threads");
+	$idx = git_indexer_new("$dir/out$threads", 0, null, null, null);
+	$cpu = cpu();
+	$total = git_indexer_append_stream($idx, $pipes[1], 4096, $threads);
+	// the pause is waited out, not spun through
+	var_dump($total === filesize("$dir/pack"), cpu() - $cpu < 0.5);
+	fclose($pipes[1]);
+	proc_close($proc);
+	$stats = git_indexer_commit($idx);
+	var_dump($stats["total_objects"] === $objects && $stats["indexed_objects"] === $objects);
+}
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
@@ -0,0 +1,85 @@
+--TEST--
+Check for git_packbuilder_write with and without a compression level
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_pb_write_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir, $file, $content)
+{
+	file_put_contents("$dir/$file", $content);
+	sh("cd " . escapeshellarg($dir) . " && git add " . escapeshellarg($file) .
+		" && git -c user.name=php -c user.email=php@example.com commit -qm " . escapeshellarg($file));
+}
+
+/* writes master into $out at the given level, returns the stats and the pack on disk */
+function write($repo, $out, $compression)
+{
+	mkdir($out);
+	$pb = git_packbuilder_new($repo);
+	git_packbuilder_set_options($pb, array("compression" => $compression, "threads" => 1));
+	git_packbuilder_insert_range($pb, $repo, "master");
+	$result = git_packbuilder_write($pb, $out, 0, function ($stats, $payload) {
+		return 0;
+	}, null);
+	$pack = "$out/pack-" . git_packbuilder_hash($pb) . ".pack";
+	return array($result, git_packbuilder_stats($pb), $pack);
+}
+
+/* the object and delta counts stock git reads back from the pack */
+function verify($pack)
+{
+	$idx = substr($pack, 0, -5) . ".idx";
+	if (sh("git verify-pack " . escapeshellarg($idx)) === false) {
+		return false;
+	}
+	$objects = (int)sh("git verify-pack -v " . escapeshellarg($idx) . " | grep -c -E '^[0-9a-f]{40} (commit|tree|blob|tag) '");
+	$deltas = (int)sh("git verify-pack -v " . escapeshellarg($idx) . " | grep -c -E '^[0-9a-f]{40} (commit|tree|blob|tag) +[0-9]+ [0-9]+ [0-9]+ [0-9]+ [0-9a-f]{40}$'");
+	return array($objects, $deltas);
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+for ($i = 0; $i < 8; $i++) {
+	commit($dir, "a.txt", str_repeat("line of text\n", 400) . "change $i\n");
+}
+$objects = (int)sh("git -C $dir rev-list --objects master | wc -l");
+$repo = git_repository_open($dir);
+
+// libgit2's own write: nothing is parsed, so only bytes and times are known
+list($result, $stats, $pack) = write($repo, "$dir/plain", -1);
+list($count, $deltas) = verify($pack);
+echo $result, " ", $count == $objects ? "complete" : "incomplete", " ", $deltas > 0 ? "deltas" : "no deltas", PHP_EOL;
+echo $stats["objects_whole"], " ", $stats["deltas_computed"], " ", $stats["compression"], PHP_EOL;
+var_dump($stats["bytes_written"] == filesize($pack));
+
+// recompressed at both ends of the range, ofs-delta distances and the trailer rewritten
+$sizes = array();
+foreach (array(0, 9) as $level) {
+	list($result, $stats, $pack) = write($repo, "$dir/level$level", $level);
+	list($count, $deltas) = verify($pack);
+	echo $result, " ", $count == $objects ? "complete" : "incomplete", " ",
+		$stats["objects_whole"] + $stats["deltas_computed"] == $objects ? "counted" : "miscounted", " ",
+		$stats["deltas_computed"] == $deltas ? "same deltas" : "other deltas", " ", $stats["compression"], PHP_EOL;
+	var_dump($stats["bytes_written"] == filesize($pack));
+	$sizes[$level] = filesize($pack);
+}
+var_dump($sizes[0] > $sizes[9]);
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+0 complete deltas
+0 0 -1
+bool(true)
+0 complete counted same deltas 0
+bool(true)
+0 complete counted same deltas 9
+bool(true)
+bool(true)
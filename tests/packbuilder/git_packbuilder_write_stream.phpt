@@ -0,0 +1,90 @@
+--TEST--
+Check for git_packbuilder_write_stream with and without side-band framing
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_pb_stream_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir, $file, $content)
+{
+	file_put_contents("$dir/$file", $content);
+	sh("cd " . escapeshellarg($dir) . " && git add " . escapeshellarg($file) .
+		" && git -c user.name=php -c user.email=php@example.com commit -qm " . escapeshellarg($file));
+}
+
+/* indexes a pack with stock git into an empty repository and returns its object count */
+function index_pack($dir, $pack)
+{
+	exec("rm -rf " . escapeshellarg("$dir/check"));
+	sh("git init -q --bare " . escapeshellarg("$dir/check"));
+	file_put_contents("$dir/check/in.pack", $pack);
+	if (sh("git --git-dir $dir/check index-pack --strict $dir/check/in.pack") === false) {
+		return false;
+	}
+	return (int)sh("git --git-dir $dir/check verify-pack -v $dir/check/in.idx | grep -c -E '^[0-9a-f]{40} (commit|tree|blob|tag) '");
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+for ($i = 0; $i < 5; $i++) {
+	commit($dir, "a.txt", str_repeat("line\n", 200) . "change $i\n");
+}
+$objects = (int)sh("git -C $dir rev-list --objects master | wc -l");
+$repo = git_repository_open($dir);
+
+// a plain pack, byte for byte what the stream received
+$pb = git_packbuilder_new($repo);
+echo git_packbuilder_insert_range($pb, $repo, "master") == $objects ? "inserted" : "missing", PHP_EOL;
+$stream = fopen("php://memory", "w+");
+$written = git_packbuilder_write_stream($pb, $stream);
+rewind($stream);
+$pack = stream_get_contents($stream);
+fclose($stream);
+var_dump($written === strlen($pack), substr($pack, 0, 4));
+var_dump(index_pack($dir, $pack) === $objects);
+
+// side-band-64k: channel 1 pkt-lines of at most 65520 bytes, then a flush-pkt
+$pb = git_packbuilder_new($repo);
+git_packbuilder_insert_range($pb, $repo, "master");
+$stream = fopen("php://memory", "w+");
+$written = git_packbuilder_write_stream($pb, $stream, true);
+rewind($stream);
+$framed = stream_get_contents($stream);
+fclose($stream);
+var_dump($written === strlen($framed));
+$pack = "";
+$ok = true;
+for ($offset = 0; ; $offset += $len) {
+	$len = hexdec(substr($framed, $offset, 4));
+	if ($len == 0) {
+		$ok = $ok && $offset + 4 == strlen($framed);
+		break;
+	}
+	$ok = $ok && $len <= 65520 && $framed[$offset + 4] === "\x01";
+	$pack .= substr($framed, $offset + 5, $len - 5);
+}
+var_dump($ok, index_pack($dir, $pack) === $objects);
+
+// a stream that takes nothing
+file_put_contents("$dir/readonly", "");
+$stream = fopen("$dir/readonly", "r");
+var_dump(@git_packbuilder_write_stream($pb, $stream));
+fclose($stream);
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+inserted
+bool(true)
+string(4) "PACK"
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(false)
@@ -0,0 +1,92 @@
+--TEST--
+Check for git_repository_repack
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_repack_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir, $file, $content)
+{
+	file_put_contents("$dir/$file", $content);
+	sh("cd " . escapeshellarg($dir) . " && git add " . escapeshellarg($file) .
+		" && git -c user.name=php -c user.email=php@example.com commit -qm " . escapeshellarg($file));
+}
+
+function exists($dir, $id)
+{
+	return sh("git -C $dir cat-file -e $id") !== false;
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+commit($dir, "a.txt", "a\n");
+// a commit only the reflog still knows
+commit($dir, "b.txt", "b\n");
+$reflog_only = sh("git -C $dir rev-parse HEAD");
+sh("git -C $dir reset -q --hard HEAD~1");
+// a blob only the index knows
+file_put_contents("$dir/staged.txt", "staged\n");
+sh("git -C $dir add staged.txt");
+$index_only = sh("git -C $dir rev-parse :staged.txt");
+// git keeps both in the pack it writes, the repack below replaces that pack
+sh("git -C $dir repack -adq");
+
+$repo = git_repository_open($dir);
+$result = git_repository_repack($repo, array("expire" => 0));
+echo $result["pruned_packs"], " ", $result["kept_packs"], " ", count(glob("$dir/.git/objects/pack/*.pack")), PHP_EOL;
+var_dump(exists($dir, $reflog_only));
+var_dump(exists($dir, $index_only));
+var_dump(exists($dir, "$reflog_only:b.txt"));
+var_dump(sh("git -C $dir fsck --strict") !== false);
+
+// young packs stay unless expire says otherwise
+commit($dir, "c.txt", "c\n");
+sh("git -C $dir repack -dq");
+$result = git_repository_repack($repo);
+echo $result["pruned_packs"], " ", $result["kept_packs"], PHP_EOL;
+
+// a second repack waits for the first one's lock
+touch("$dir/.git/objects/pack/repack.lock");
+var_dump(@git_repository_repack($repo));
+unlink("$dir/.git/objects/pack/repack.lock");
+var_dump(is_array(git_repository_repack($repo, array("dry_run" => true))));
+// one left by a repack that died half a day ago is stale
+touch("$dir/.git/objects/pack/repack.lock", time() - 86400);
+var_dump(is_array(@git_repository_repack($repo)));
+var_dump(file_exists("$dir/.git/objects/pack/repack.lock"));
+
+// what only an old pack held is written loose before that pack goes
+commit($dir, "d.txt", "d\n");
+$dropped = sh("git -C $dir rev-parse HEAD");
+sh("git -C $dir repack -adq");
+sh("git -C $dir reset -q --hard HEAD~1");
+sh("git -C $dir reflog expire --expire=now --all");
+$result = git_repository_repack($repo, array("expire" => 0));
+echo $result["pruned_packs"], " ", $result["loosened"], PHP_EOL;
+var_dump(file_exists("$dir/.git/objects/" . substr($dropped, 0, 2) . "/" . substr($dropped, 2)));
+var_dump(exists($dir, "$dropped:d.txt"));
+var_dump(sh("git -C $dir fsck --strict") !== false);
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+1 0 1
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+0 2
+bool(false)
+bool(true)
+bool(true)
+bool(false)
+1 3
+bool(true)
+bool(true)
+bool(true)
@@ -0,0 +1,86 @@
+--TEST--
+Check for git_repository_watch
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+<?php if (PHP_OS != "Linux") print "skip inotify only"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_watch_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+exec("git init -q " . escapeshellarg($dir));
+file_put_contents("$dir/tracked.txt", "a\n");
+exec("cd " . escapeshellarg($dir) . " && git add tracked.txt && git -c user.name=php -c user.email=php@example.com commit -qm init");
+file_put_contents("$dir/build.log", "x\n");
+
+function status_paths($repo, $flags = null)
+{
+	if ($flags === null) {
+		$flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS;
+	}
+	$paths = array();
+	git_status_foreach_ext($repo, array("flags" => $flags), function ($path, $status, $payload) use (&$paths) {
+		$paths[] = $path;
+		return 0;
+	}, null);
+	sort($paths);
+	return implode(",", $paths) . PHP_EOL;
+}
+
+$repo = git_repository_open($dir);
+var_dump(git_repository_watch($repo));
+echo status_paths($repo);
+
+file_put_contents("$dir/tracked.txt", "b\n");
+echo status_paths($repo);
+
+// exclude rules apply to paths the watcher saw no event for
+file_put_contents("$dir/.git/info/exclude", "*.log\n");
+echo status_paths($repo);
+
+// directories created after a rebuild are watched too
+mkdir("$dir/sub");
+file_put_contents("$dir/sub/new.txt", "x\n");
+echo status_paths($repo);
+
+$stats = git_repository_watch_stats($repo);
+echo $stats["full_scans"], " ", $stats["incremental_scans"], " ", $stats["rebuilds"], PHP_EOL;
+var_dump($stats["incomplete"]);
+
+// without recursion a new untracked directory is reported as "dir/", as a full scan does
+$flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+echo status_paths($repo, $flags);
+mkdir("$dir/other");
+file_put_contents("$dir/other/x.txt", "x\n");
+echo status_paths($repo, $flags);
+file_put_contents("$dir/other/y.txt", "y\n");
+echo status_paths($repo, $flags);
+
+// a status list is always a full scan with the oids of each entry
+$list = git_status_list_new($repo, array("flags" => $flags));
+$rows = array();
+foreach (git_status_list_to_array($list) as $row) {
+	$rows[$row["path"]] = $row;
+}
+ksort($rows);
+echo implode(",", array_keys($rows)), PHP_EOL;
+var_dump($rows["tracked.txt"]["old_oid"] === trim(shell_exec("git -C " . escapeshellarg($dir) . " rev-parse :tracked.txt")));
+
+$stats = git_repository_watch_stats($repo);
+echo $stats["full_scans"], " ", $stats["incremental_scans"], PHP_EOL;
+
+git_repository_unwatch($repo);
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+bool(true)
+build.log
+build.log,tracked.txt
+tracked.txt
+sub/new.txt,tracked.txt
+2 2 1
+bool(false)
+sub/,tracked.txt
+other/,sub/,tracked.txt
+other/,sub/,tracked.txt
+other/,sub/,tracked.txt
+bool(true)
+5 3
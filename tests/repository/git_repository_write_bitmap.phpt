@@ -0,0 +1,59 @@
+--TEST--
+Check for git_repository_write_bitmap
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_bitmap_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir, $file, $content)
+{
+	file_put_contents("$dir/$file", $content);
+	sh("cd " . escapeshellarg($dir) . " && git add " . escapeshellarg($file) .
+		" && git -c user.name=php -c user.email=php@example.com commit -qm " . escapeshellarg($file));
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+for ($i = 0; $i < 5; $i++) {
+	commit($dir, "f$i.txt", str_repeat("line $i\n", 50));
+}
+sh("git -C $dir checkout -qb topic HEAD~2");
+commit($dir, "topic.txt", "topic\n");
+sh("git -C $dir checkout -q master");
+sh("git -C $dir -c user.name=php -c user.email=php@example.com tag -a -m v1 v1 HEAD~1");
+sh("git -C $dir -c repack.writeBitmaps=false repack -adq");
+
+$repo = git_repository_open($dir);
+var_dump(git_repository_write_bitmap($repo) > 0);
+$bitmaps = glob("$dir/.git/objects/pack/pack-*.bitmap");
+var_dump(count($bitmaps));
+
+// stock git reads the bitmap and agrees with its own walk
+var_dump(strpos(sh("git -C $dir rev-list --test-bitmap master"), "OK!") !== false);
+var_dump(sh("git -C $dir rev-list --use-bitmap-index --count master") === sh("git -C $dir rev-list --count master"));
+var_dump(sh("git -C $dir rev-list --use-bitmap-index --objects --all | wc -l") === sh("git -C $dir rev-list --objects --all | wc -l"));
+var_dump(sh("git -C $dir verify-pack " . escapeshellarg(str_replace(".bitmap", ".idx", $bitmaps[0]))) !== false);
+
+// the extension answers from the bitmap, twice to go through the cached index
+for ($i = 0; $i < 2; $i++) {
+	$counts = git_repository_count_objects($repo, "topic");
+	echo $counts["total"] == sh("git -C $dir rev-list --objects topic | wc -l") ? "same" : "differs", " ", var_export($counts["bitmap"], true), PHP_EOL;
+}
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+bool(true)
+int(1)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+same true
+same true
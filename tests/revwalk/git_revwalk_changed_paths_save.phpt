@@ -0,0 +1,37 @@
+--TEST--
+Check for git_revwalk_changed_paths_save with a held and a stale lock
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_changed_paths_save_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+exec("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+file_put_contents("$dir/a.txt", "a\n");
+exec("cd " . escapeshellarg($dir) . " && git add . && git -c user.name=php -c user.email=php@example.com commit -qm init");
+$file = "$dir/.git/php_git2_changed_paths";
+
+$repo = git_repository_open($dir);
+$changed_paths = git_revwalk_changed_paths_new($repo, true);
+echo git_revwalk_changed_paths_update($changed_paths, $repo), PHP_EOL;
+
+// a live writer holds the lock: the save fails and says why
+touch("$file.lock");
+var_dump(@git_revwalk_changed_paths_save($changed_paths));
+var_dump(strpos(error_get_last()["message"], "holds the lock") !== false);
+var_dump(file_exists($file));
+
+// the writer died long ago: its lock is expired and the save goes through
+touch("$file.lock", time() - 3600);
+var_dump(git_revwalk_changed_paths_save($changed_paths));
+var_dump(file_exists($file), file_exists("$file.lock"));
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+1
+bool(false)
+bool(true)
+bool(false)
+bool(true)
+bool(true)
+bool(false)
@@ -0,0 +1,86 @@
+--TEST--
+Check for git_revwalk_limit_path and the changed paths index
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_limit_path_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir, $file, $content)
+{
+	@mkdir(dirname("$dir/$file"), 0777, true);
+	file_put_contents("$dir/$file", $content);
+	sh("cd " . escapeshellarg($dir) . " && git add " . escapeshellarg($file) .
+		" && git -c user.name=php -c user.email=php@example.com commit -qm " . escapeshellarg($file));
+}
+
+function walk($repo, $path, $changed_paths = null)
+{
+	$walk = git_revwalk_new($repo);
+	git_revwalk_push_head($walk);
+	git_revwalk_limit_path($walk, $path, $changed_paths);
+	$ids = array();
+	while (($id = git_revwalk_next($walk)) !== false) {
+		$ids[] = $id;
+	}
+	return implode("\n", $ids);
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+for ($i = 0; $i < 20; $i++) {
+	if ($i % 4 == 0) {
+		commit($dir, "dir/sub/a.txt", "a $i\n");
+	} else {
+		commit($dir, "x$i.txt", "x $i\n");
+	}
+}
+
+$repo = git_repository_open($dir);
+// the same commits git log lists, with and without the index
+$expected = sh("git -C $dir log --format=%H -- dir");
+var_dump(walk($repo, "dir/") === $expected);
+
+$changed_paths = git_revwalk_changed_paths_new($repo, true);
+echo git_revwalk_changed_paths_update($changed_paths, $repo), PHP_EOL;
+var_dump(walk($repo, "dir/", $changed_paths) === $expected);
+var_dump(walk($repo, "dir/sub/a.txt", $changed_paths) === sh("git -C $dir log --format=%H -- dir/sub/a.txt"));
+var_dump(walk($repo, "x3.txt", $changed_paths) === sh("git -C $dir log --format=%H -- x3.txt"));
+// every commit of the three walks is either rejected by its filter or looked at
+$stats = git_revwalk_changed_paths_stats($changed_paths);
+echo $stats["commits"], " ", $stats["filtered"] + $stats["checked"], " ", var_export($stats["filtered"] > 0, true),
+	" ", var_export($stats["false_positives"] <= $stats["checked"], true), " ", var_export($stats["persistent"], true), PHP_EOL;
+var_dump(git_revwalk_changed_paths_save($changed_paths));
+
+// a second index starts from the saved file and only adds new commits
+$changed_paths = git_revwalk_changed_paths_new($repo, true);
+$stats = git_revwalk_changed_paths_stats($changed_paths);
+echo $stats["commits"], " ", git_revwalk_changed_paths_update($changed_paths, $repo), PHP_EOL;
+commit($dir, "dir/b.txt", "b\n");
+echo git_revwalk_changed_paths_update($changed_paths, $repo), PHP_EOL;
+var_dump(walk($repo, "dir", $changed_paths) === sh("git -C $dir log --format=%H -- dir"));
+
+// not an index, or no path at all
+var_dump(@git_revwalk_limit_path(git_revwalk_new($repo), "dir", $repo));
+var_dump(@git_revwalk_limit_path(git_revwalk_new($repo), "/"));
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+bool(true)
+20
+bool(true)
+bool(true)
+bool(true)
+20 60 true true true
+bool(true)
+20 0
+1
+bool(true)
+bool(false)
+bool(false)
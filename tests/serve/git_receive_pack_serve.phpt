@@ -0,0 +1,127 @@
+--TEST--
+Check for git_receive_pack_serve
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+<?php if (!function_exists("posix_mkfifo")) print "skip posix_mkfifo not available"; ?>
+--FILE--
+<?php
+$base = sys_get_temp_dir() . "/php_git2_receive_" . getmypid();
+exec("rm -rf " . escapeshellarg($base));
+mkdir($base);
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir, $file, $content)
+{
+	file_put_contents("$dir/$file", $content);
+	sh("cd " . escapeshellarg($dir) . " && git add " . escapeshellarg($file) .
+		" && git -c user.name=php -c user.email=php@example.com commit -qm " . escapeshellarg($file));
+}
+
+/* runs git push against git_receive_pack_serve: git talks to "sh -c 'cat out & cat > in'"
+   as its receive-pack, the fifos connect that to this process */
+function push($repo, $base, $work, $pre_receive, $refspec = "master")
+{
+	$in = "$base/in";
+	$out = "$base/out";
+	@unlink($in);
+	@unlink($out);
+	posix_mkfifo($in, 0600);
+	posix_mkfifo($out, 0600);
+	$receive = "sh -c 'cat $out & cat > $in' receive-pack";
+	$proc = proc_open("git -c protocol.version=0 push -q --receive-pack=" . escapeshellarg($receive) . " file:///nonexistent " . escapeshellarg($refspec),
+		array(0 => array("file", "/dev/null", "r"), 1 => array("file", "/dev/null", "w"), 2 => array("file", "/dev/null", "w")),
+		$pipes, $work);
+	$writer = fopen($out, "w");
+	$reader = fopen($in, "r");
+	$result = git_receive_pack_serve($repo, $reader, $writer, $pre_receive, array("stateless_rpc" => false));
+	fclose($writer);
+	fclose($reader);
+	$status = proc_close($proc);
+	return array($result, $status);
+}
+
+function packs($srv)
+{
+	return count(glob("$srv/objects/pack/*.pack"));
+}
+
+$srv = "$base/srv.git";
+$work = "$base/work";
+sh("git -c init.defaultBranch=master init -q --bare " . escapeshellarg($srv));
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($work));
+commit($work, "a.txt", "a\n");
+$repo = git_repository_open($srv);
+
+// accepted: the hook already sees the pushed commit through its own handle, the caller's
+// repository only once the ref moves
+$found = $leaked = null;
+list($result, $status) = push($repo, $base, $work, function ($updates, $quarantined) use ($repo, &$found, &$leaked) {
+	$found = is_resource(git_commit_lookup($quarantined, $updates[0]["new"]));
+	$leaked = is_resource(@git_commit_lookup($repo, $updates[0]["new"]));
+	return true;
+});
+echo $status, " ", $result["unpack"], " ", var_export($result["applied"], true), " ", $result["commands"]["refs/heads/master"], PHP_EOL;
+var_dump($found, $leaked);
+var_dump(is_resource(git_commit_lookup($repo, sh("git -C $work rev-parse HEAD"))));
+var_dump(sh("git --git-dir $srv rev-parse master") === sh("git -C $work rev-parse HEAD"));
+var_dump(sh("git --git-dir $srv fsck --strict") !== false);
+var_dump(count(glob("$srv/objects/incoming-*")));
+
+// rejected: nothing of the push stays behind
+commit($work, "b.txt", "b\n");
+$before = sh("git --git-dir $srv rev-parse master");
+$count = packs($srv);
+list($result, $status) = push($repo, $base, $work, function ($updates) {
+	return "no pushes today";
+});
+echo $status == 0 ? "0" : "failed", " ", var_export($result["applied"], true), " ", $result["commands"]["refs/heads/master"], PHP_EOL;
+var_dump(sh("git --git-dir $srv rev-parse master") === $before);
+var_dump(sh("git --git-dir $srv cat-file -e " . sh("git -C $work rev-parse HEAD")) === false);
+var_dump(packs($srv) == $count);
+var_dump(count(glob("$srv/objects/incoming-*")));
+
+// a delete of a packed ref takes it out of packed-refs while its own lock is held
+sh("git -C $work branch gone");
+push($repo, $base, $work, function ($updates) {
+	return true;
+}, "gone");
+sh("git --git-dir $srv pack-refs --all");
+var_dump(strpos(file_get_contents("$srv/packed-refs"), "refs/heads/gone") !== false);
+$hook = null;
+list($result, $status) = push($repo, $base, $work, function ($updates, $hook_repo) use (&$hook) {
+	$hook = is_resource($hook_repo);
+	return true;
+}, ":gone");
+echo $status, " ", var_export($result["applied"], true), " ", $result["commands"]["refs/heads/gone"], " ", var_export($hook, true), PHP_EOL;
+var_dump(strpos(file_get_contents("$srv/packed-refs"), "refs/heads/gone") !== false);
+var_dump(file_exists("$srv/refs/heads/gone.lock") || file_exists("$srv/packed-refs.lock"));
+var_dump(sh("git --git-dir $srv rev-parse --verify -q refs/heads/gone"));
+var_dump(sh("git --git-dir $srv rev-parse master") !== false);
+var_dump(sh("git --git-dir $srv fsck --strict") !== false);
+
+exec("rm -rf " . escapeshellarg($base));
+--EXPECT--
+0 ok true ok
+bool(true)
+bool(false)
+bool(true)
+bool(true)
+bool(true)
+int(0)
+failed false no pushes today
+bool(true)
+bool(true)
+bool(true)
+int(0)
+bool(true)
+0 true ok true
+bool(false)
+bool(false)
+bool(false)
+bool(true)
+bool(true)
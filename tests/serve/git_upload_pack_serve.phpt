@@ -0,0 +1,93 @@
+--TEST--
+Check for git_upload_pack_serve
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+<?php if (!function_exists("posix_mkfifo")) print "skip posix_mkfifo not available"; ?>
+--FILE--
+<?php
+$base = sys_get_temp_dir() . "/php_git2_upload_" . getmypid();
+exec("rm -rf " . escapeshellarg($base));
+mkdir($base);
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir, $file, $content)
+{
+	file_put_contents("$dir/$file", $content);
+	sh("cd " . escapeshellarg($dir) . " && git add " . escapeshellarg($file) .
+		" && git -c user.name=php -c user.email=php@example.com commit -qm " . escapeshellarg($file));
+}
+
+/* runs stock git against git_upload_pack_serve: git talks to "sh -c 'cat out & cat > in'"
+   as its upload-pack, the fifos connect that to this process */
+function serve($repo, $base, $command, $args)
+{
+	$in = "$base/in";
+	$out = "$base/out";
+	@unlink($in);
+	@unlink($out);
+	posix_mkfifo($in, 0600);
+	posix_mkfifo($out, 0600);
+	$upload = "sh -c 'cat $out & cat > $in' upload-pack";
+	$proc = proc_open("git -c protocol.version=0 $command --upload-pack=" . escapeshellarg($upload) . " $args",
+		array(0 => array("file", "/dev/null", "r"), 1 => array("file", "/dev/null", "w"), 2 => array("file", "/dev/null", "w")),
+		$pipes, $base);
+	$writer = fopen($out, "w");
+	$reader = fopen($in, "r");
+	$result = git_upload_pack_serve($repo, $reader, $writer, array("stateless_rpc" => false));
+	fclose($writer);
+	fclose($reader);
+	$status = proc_close($proc);
+	return array($result, $status);
+}
+
+function pkt($line)
+{
+	return sprintf("%04x%s", strlen($line) + 4, $line);
+}
+
+$src = "$base/src";
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($src));
+commit($src, "a.txt", "a\n");
+sh("cd " . escapeshellarg($src) . " && git -c user.name=php -c user.email=php@example.com tag -a -m v1 v1");
+$repo = git_repository_open($src);
+
+// clone
+list($result, $status) = serve($repo, $base, "clone -q", "file:///nonexistent dst");
+echo $status, " ", var_export($result["pack_sent"], true), " ", $result["objects"], PHP_EOL;
+var_dump(sh("git -C $base/dst rev-parse HEAD") === sh("git -C $src rev-parse HEAD"));
+var_dump(sh("git -C $base/dst rev-parse v1^{}") === sh("git -C $src rev-parse HEAD"));
+var_dump(sh("git -C $base/dst fsck --strict") !== false);
+
+// fetch only sends what the clone lacks
+commit($src, "b.txt", "b\n");
+list($result, $status) = serve($repo, "$base/dst", "fetch -q", "origin");
+echo $status, " ", var_export($result["pack_sent"], true), " ", $result["objects"], PHP_EOL;
+var_dump(sh("git -C $base/dst rev-parse refs/remotes/origin/master") === sh("git -C $src rev-parse HEAD"));
+var_dump(sh("git -C $base/dst fsck --strict") !== false);
+
+// an object that exists but is no ref tip is not handed out
+$blob = sh("git -C $src rev-parse HEAD:a.txt");
+$in = fopen("php://memory", "w+");
+fwrite($in, pkt("want $blob multi_ack_detailed side-band-64k\n") . "0000" . pkt("done\n"));
+rewind($in);
+$out = fopen("php://memory", "w+");
+var_dump(@git_upload_pack_serve($repo, $in, $out));
+rewind($out);
+var_dump(strpos(stream_get_contents($out), "ERR upload-pack: not our ref $blob") !== false);
+
+exec("rm -rf " . escapeshellarg($base));
+--EXPECT--
+0 true 4
+bool(true)
+bool(true)
+bool(true)
+0 true 3
+bool(true)
+bool(true)
+bool(false)
+bool(true)
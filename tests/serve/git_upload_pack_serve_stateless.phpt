@@ -0,0 +1,90 @@
+--TEST--
+Check for the stateless negotiation of git_upload_pack_serve: ACK common, ready and the final ACK
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_upload_stateless_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+function commit($dir, $file, $content)
+{
+	file_put_contents("$dir/$file", $content);
+	sh("cd " . escapeshellarg($dir) . " && git add " . escapeshellarg($file) .
+		" && git -c user.name=php -c user.email=php@example.com commit -qm " . escapeshellarg($file));
+	return sh("git -C $dir rev-parse HEAD");
+}
+
+function pkt($line)
+{
+	return sprintf("%04x%s", strlen($line) + 4, $line);
+}
+
+/* one smart http POST: the request body in, the acknowledgements of the response out */
+function request($repo, $wants, $caps, $haves, $done, $names)
+{
+	$body = "";
+	foreach ($wants as $i => $want) {
+		$body .= pkt("want $want" . ($i == 0 ? " $caps" : "") . "\n");
+	}
+	$body .= "0000";
+	foreach ($haves as $have) {
+		$body .= pkt("have $have\n");
+	}
+	$body .= $done ? pkt("done\n") : "0000";
+	$in = fopen("php://memory", "w+");
+	fwrite($in, $body);
+	rewind($in);
+	$out = fopen("php://memory", "w+");
+	$result = git_upload_pack_serve($repo, $in, $out);
+	rewind($out);
+	$data = stream_get_contents($out);
+	$lines = array();
+	for ($offset = 0; $offset < strlen($data); $offset += max($len, 4)) {
+		$len = hexdec(substr($data, $offset, 4));
+		$line = rtrim(substr($data, $offset + 4, $len - 4), "\n");
+		if (strncmp($line, "ACK", 3) == 0 || $line === "NAK") {
+			$lines[] = strtr($line, $names);
+		}
+	}
+	echo implode(", ", $lines), " | ", var_export($result["pack_sent"], true), " ", $result["objects"], PHP_EOL;
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+$c1 = commit($dir, "a.txt", "a\n");
+$c2 = commit($dir, "b.txt", "b\n");
+sh("git -C $dir checkout -q --orphan other");
+$o1 = commit($dir, "o.txt", "o\n");
+sh("git -C $dir checkout -q master");
+$unknown = str_repeat("1", 40);
+$names = array($c1 => "c1", $unknown => "x");
+$repo = git_repository_open($dir);
+$caps = "multi_ack_detailed side-band-64k no-progress";
+
+// the first round: the common commit is enough for the want, the client hears it is ready
+request($repo, array($c2), $caps, array($c1), false, $names);
+// the next round ends with done: the final ACK and the pack with what c1 lacks
+request($repo, array($c2), $caps, array($c1), true, $names);
+// a have we lack after the ready point is answered ready, the flush then stays silent
+request($repo, array($c2), $caps, array($c1, $unknown), false, $names);
+// a want c1 does not reach keeps the client sending haves
+request($repo, array($c2, $o1), $caps, array($c1), false, $names);
+// plain multi_ack has no ready
+request($repo, array($c2), "multi_ack side-band-64k no-progress", array($c1), false, $names);
+// a clone sends no haves at all
+request($repo, array($c2), $caps, array(), true, $names);
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+ACK c1 common, ACK c1 ready, NAK | false 0
+ACK c1 common, ACK c1 | true 3
+ACK c1 common, ACK x ready, NAK | false 0
+ACK c1 common, NAK | false 0
+ACK c1 continue, NAK | false 0
+NAK | true 6
@@ -0,0 +1,39 @@
+--TEST--
+Check for git_status_list_new with preload_index and refresh_index
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_refresh_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+exec("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+for ($i = 0; $i < 20; $i++) {
+	file_put_contents("$dir/f$i.txt", "file $i\n");
+}
+exec("cd " . escapeshellarg($dir) . " && git add . && git -c user.name=php -c user.email=php@example.com commit -qm init");
+// same content, other stat data: status has to look at the content again
+touch("$dir/f3.txt", time() - 100);
+touch("$dir/f7.txt", time() - 100);
+$before = md5_file("$dir/.git/index");
+
+$repo = git_repository_open($dir);
+$list = git_status_list_new($repo, array("preload_index" => 1));
+echo git_status_list_entrycount($list), PHP_EOL;
+// status alone never writes the index
+var_dump(md5_file("$dir/.git/index") === $before);
+
+$list = git_status_list_new($repo, array("preload_index" => 1, "refresh_index" => 1));
+echo git_status_list_entrycount($list), PHP_EOL;
+clearstatcache();
+var_dump(md5_file("$dir/.git/index") !== $before);
+// the stored stat data now matches, git agrees the files are clean
+exec("git -C " . escapeshellarg($dir) . " diff-files --quiet", $output, $status);
+echo $status, PHP_EOL;
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+0
+bool(true)
+0
+bool(true)
+0
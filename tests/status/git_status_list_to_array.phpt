@@ -0,0 +1,56 @@
+--TEST--
+Check for git_status_list_to_array
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_status_to_array_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+
+function sh($command)
+{
+	exec($command . " 2>&1", $output, $status);
+	return $status == 0 ? trim(implode("\n", $output)) : false;
+}
+
+sh("git -c init.defaultBranch=master init -q " . escapeshellarg($dir));
+file_put_contents("$dir/a.txt", "a\n");
+file_put_contents("$dir/b.txt", "b\n");
+sh("cd " . escapeshellarg($dir) . " && git add . && git -c user.name=php -c user.email=php@example.com commit -qm init");
+file_put_contents("$dir/a.txt", "changed\n");
+file_put_contents("$dir/c.txt", "c\n");
+sh("git -C $dir add c.txt");
+file_put_contents("$dir/d.txt", "d\n");
+
+$repo = git_repository_open($dir);
+$list = git_status_list_new($repo, array("flags" => GIT_STATUS_OPT_INCLUDE_UNTRACKED));
+$rows = git_status_list_to_array($list);
+echo count($rows), " ", git_status_list_entrycount($list), PHP_EOL;
+usort($rows, function ($a, $b) { return strcmp($a["path"], $b["path"]); });
+foreach ($rows as $row) {
+	echo implode(" ", array_keys($row)), ": ", $row["path"], " ", $row["status"], PHP_EOL;
+}
+
+// the same rows as git_status_byindex, only the fields asked for
+$rows = array();
+foreach (git_status_list_to_array($list, array("path", "old_oid", "new_oid")) as $row) {
+	$rows[$row["path"]] = $row;
+}
+echo implode(" ", array_keys($rows["a.txt"])), PHP_EOL;
+var_dump($rows["a.txt"]["old_oid"] === sh("git -C $dir rev-parse :a.txt"));
+var_dump($rows["c.txt"]["new_oid"] === sh("git -C $dir rev-parse :c.txt"));
+
+// unknown fields are skipped with a warning, the defaults apply when none is left
+$rows = @git_status_list_to_array($list, array("size"));
+echo implode(" ", array_keys($rows[0])), PHP_EOL;
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+3 3
+path status: a.txt 256
+path status: c.txt 1
+path status: d.txt 128
+path old_oid new_oid
+bool(true)
+bool(true)
+path status
@@ -0,0 +1,55 @@
+--TEST--
+Check for git_status_list_untracked_stats
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$dir = sys_get_temp_dir() . "/php_git2_uc_" . getmypid();
+exec("rm -rf " . escapeshellarg($dir));
+exec("git init -q " . escapeshellarg($dir));
+mkdir("$dir/sub");
+file_put_contents("$dir/sub/a.txt", "a\n");
+file_put_contents("$dir/top.txt", "t\n");
+// directories changed within the current second are never trusted
+touch("$dir/sub", time() - 20);
+touch($dir, time() - 20);
+touch("$dir/.git/info/exclude", time() - 20);
+
+function untracked($repo, &$stats)
+{
+	$list = git_status_list_new($repo, array(
+		"flags" => GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS,
+		"untracked_cache" => 1,
+	));
+	$stats = git_status_list_untracked_stats($list);
+	$paths = array();
+	foreach (git_status_list_to_array($list, array("path")) as $row) {
+		$paths[] = $row["path"];
+	}
+	sort($paths);
+	return implode(",", $paths) . PHP_EOL;
+}
+
+$repo = git_repository_open($dir);
+echo untracked($repo, $stats);
+echo untracked($repo, $stats);
+var_dump($stats["dirs_read"] == 0 && $stats["dirs_skipped"] > 0);
+
+// a new file changes the mtime of its directory
+file_put_contents("$dir/sub/b.txt", "b\n");
+touch("$dir/sub", time() - 10);
+echo untracked($repo, $stats);
+var_dump($stats["dirs_read"]);
+
+// new exclude rules drop cached listings everywhere
+file_put_contents("$dir/.git/info/exclude", "a.txt\n");
+echo untracked($repo, $stats);
+
+exec("rm -rf " . escapeshellarg($dir));
+--EXPECT--
+sub/a.txt,top.txt
+sub/a.txt,top.txt
+bool(true)
+sub/a.txt,sub/b.txt,top.txt
+int(1)
+sub/b.txt,top.txt
@@ -0,0 +1,26 @@
+--TEST--
+Check for git_treebuilder_insert_path
+--SKIPIF--
+<?php if (!extension_loaded("git2")) print "skip"; ?>
+--FILE--
+<?php
+$repository = git_repository_init("/tmp/git-treebuilder-insert-path");
+$blob = git_blob_create_frombuffer($repository, "Hello World");
+
+$bld = git_treebuilder_create();
+git_treebuilder_insert_path($repository, $bld, "a/b/c.txt", $blob, GIT_FILEMODE_BLOB);
+echo git_treebuilder_write_recursive($repository, $bld) . PHP_EOL;
+
+// a/ is loaded again from the tree written above
+git_treebuilder_insert_path($repository, $bld, "a/d.txt", $blob, GIT_FILEMODE_BLOB);
+git_treebuilder_insert_path($repository, $bld, "README", $blob, GIT_FILEMODE_BLOB);
+echo git_treebuilder_write_recursive($repository, $bld) . PHP_EOL;
+
+$result = @git_treebuilder_insert_path($repository, $bld, "README/x", $blob, GIT_FILEMODE_BLOB);
+if ($result === FALSE) {
+	echo "OK" . PHP_EOL;
+}
+--EXPECT--
+eac11fba19326bf0ec0740e3b877f8f9ba375457
+a0957f4d1881e3c385f7660b1ca67ee8ba31a3c6
+OK
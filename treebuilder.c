@@ -1,6 +1,124 @@
 #include "php_git2.h"
 #include "php_git2_priv.h"
 #include "revwalk.h"
+#include "treebuilder.h"
+
+/* pending subtree of a hierarchical treebuilder. untouched subtrees stay in
+ * their parent builder as plain tree entries; a node exists only after
+ * git_treebuilder_insert_path descended into it. */
+typedef struct php_git2_treebuilder_node {
+	git_treebuilder *bld;
+	HashTable *children;
+} php_git2_treebuilder_node;
+
+static void php_git2_treebuilder_node_free(void *data)
+{
+	php_git2_treebuilder_node *node = *(php_git2_treebuilder_node**)data;
+
+	git_treebuilder_free(node->bld);
+	php_git2_treebuilder_children_free(node->children);
+	efree(node);
+}
+
+void php_git2_treebuilder_children_free(HashTable *children)
+{
+	if (children == NULL) {
+		return;
+	}
+	zend_hash_destroy(children);
+	FREE_HASHTABLE(children);
+}
+
+static int php_git2_treebuilder_child(php_git2_treebuilder_node **out, HashTable **children,
+	git_treebuilder *parent, git_repository *repo, const char *name, size_t name_len)
+{
+	php_git2_treebuilder_node **found = NULL, *node = NULL;
+	const git_tree_entry *entry = NULL;
+	git_treebuilder *bld = NULL;
+	git_tree *tree = NULL;
+	int error = 0;
+
+	if (*children == NULL) {
+		ALLOC_HASHTABLE(*children);
+		zend_hash_init(*children, 8, NULL, php_git2_treebuilder_node_free, 0);
+	}
+	if (zend_hash_find(*children, name, name_len + 1, (void**)&found) == SUCCESS) {
+		*out = *found;
+		return 0;
+	}
+
+	entry = git_treebuilder_get(parent, name);
+	if (entry != NULL) {
+		if (git_tree_entry_type(entry) != GIT_OBJ_TREE) {
+			giterr_set_str(GITERR_TREE, "path component already exists and is not a tree");
+			return GIT_EEXISTS;
+		}
+		/* load the existing subtree lazily, only when a component below it is touched */
+		error = git_tree_lookup(&tree, repo, git_tree_entry_id(entry));
+		if (error) {
+			return error;
+		}
+	}
+
+	error = git_treebuilder_create(&bld, tree);
+	git_tree_free(tree);
+	if (error) {
+		return error;
+	}
+
+	node = (php_git2_treebuilder_node*)emalloc(sizeof(php_git2_treebuilder_node));
+	node->bld = bld;
+	node->children = NULL;
+	zend_hash_add(*children, name, name_len + 1, (void**)&node, sizeof(php_git2_treebuilder_node*), NULL);
+
+	*out = node;
+	return 0;
+}
+
+static int php_git2_treebuilder_write_children(git_repository *repo, git_treebuilder *bld, HashTable *children)
+{
+	HashPosition pos;
+	php_git2_treebuilder_node **node;
+	char *name;
+	uint name_len;
+	ulong index;
+	git_oid id;
+	int error = 0;
+
+	if (children == NULL) {
+		return 0;
+	}
+
+	for (zend_hash_internal_pointer_reset_ex(children, &pos);
+		zend_hash_get_current_data_ex(children, (void **)&node, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(children, &pos)) {
+		zend_hash_get_current_key_ex(children, &name, &name_len, &index, 0, &pos);
+
+		error = php_git2_treebuilder_write_children(repo, (*node)->bld, (*node)->children);
+		if (error) {
+			return error;
+		}
+
+		if (git_treebuilder_entrycount((*node)->bld) == 0) {
+			/* git does not store empty trees */
+			if (git_treebuilder_get(bld, name) != NULL) {
+				error = git_treebuilder_remove(bld, name);
+			}
+		} else {
+			error = git_treebuilder_write(&id, repo, (*node)->bld);
+			if (!error) {
+				error = git_treebuilder_insert(NULL, bld, name, &id, GIT_FILEMODE_TREE);
+			}
+		}
+		if (error) {
+			return error;
+		}
+	}
+
+	/* written levels are referenced by id from now on */
+	zend_hash_clean(children);
+	return 0;
+}
 
 static int php_git2_treebuilder_filter_cb(const git_tree_entry *entry, void *payload)
 {
@@ -49,10 +167,10 @@ PHP_FUNCTION(git_treebuilder_create)
 		return;
 	}
 	if (source != NULL) {
+		ZEND_FETCH_RESOURCE(_source, php_git2_t*, &source, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 		tree = PHP_GIT2_V(_source, tree);
 	}
 
-	ZEND_FETCH_RESOURCE(_source, php_git2_t*, &source, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	error = git_treebuilder_create(&out, tree);
 	if (php_git2_check_error(error, "git_treebuilder_create" TSRMLS_CC)) {
 		RETURN_FALSE;
@@ -78,6 +196,8 @@ PHP_FUNCTION(git_treebuilder_clear)
 	}
 	ZEND_FETCH_RESOURCE(_bld, php_git2_t*, &bld, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
 	git_treebuilder_clear(PHP_GIT2_V(_bld, treebuilder));
+	php_git2_treebuilder_children_free((HashTable*)_bld->priv);
+	_bld->priv = NULL;
 }
 
 /* {{{ proto resource git_treebuilder_entrycount(bld)
@@ -254,3 +374,94 @@ PHP_FUNCTION(git_treebuilder_write)
 
 }
 
+/* {{{ proto bool git_treebuilder_insert_path(resource $repo, resource $bld, string $path, string $id, long $filemode)
+ */
+PHP_FUNCTION(git_treebuilder_insert_path)
+{
+	zval *repo = NULL, *bld = NULL;
+	php_git2_t *_repo = NULL, *_bld = NULL;
+	php_git2_treebuilder_node *node = NULL;
+	git_treebuilder *target = NULL;
+	HashTable **children = NULL;
+	char *path = NULL, *id = NULL, *component = NULL, *next = NULL;
+	int path_len = 0, id_len = 0, error = 0;
+	git_oid __id = {0};
+	long filemode = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rrssl", &repo, &bld, &path, &path_len, &id, &id_len, &filemode) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	ZEND_FETCH_RESOURCE(_bld, php_git2_t*, &bld, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	if (git_oid_fromstrn(&__id, id, id_len)) {
+		RETURN_FALSE;
+	}
+
+	target = PHP_GIT2_V(_bld, treebuilder);
+	children = (HashTable**)&_bld->priv;
+	component = estrndup(path, path_len);
+	path = component;
+
+	while ((next = strchr(component, '/')) != NULL) {
+		*next = '\0';
+		if (next != component) {
+			error = php_git2_treebuilder_child(&node, children, target,
+				PHP_GIT2_V(_repo, repository), component, next - component);
+			if (error) {
+				break;
+			}
+			target = node->bld;
+			children = &node->children;
+		}
+		component = next + 1;
+	}
+
+	if (!error) {
+		/* the new entry replaces any pending subtree with the same name */
+		if (*children != NULL) {
+			zend_hash_del(*children, component, strlen(component) + 1);
+		}
+		error = git_treebuilder_insert(NULL, target, component, &__id, filemode);
+	}
+	efree(path);
+
+	if (php_git2_check_error(error, "git_treebuilder_insert_path" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+	RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto string git_treebuilder_write_recursive(resource $repo, resource $bld)
+ */
+PHP_FUNCTION(git_treebuilder_write_recursive)
+{
+	zval *repo = NULL, *bld = NULL;
+	php_git2_t *_repo = NULL, *_bld = NULL;
+	git_oid id;
+	int error = 0;
+	char out[GIT2_OID_HEXSIZE] = {0};
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+		"rr", &repo, &bld) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(_repo, php_git2_t*, &repo, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+	ZEND_FETCH_RESOURCE(_bld, php_git2_t*, &bld, -1, PHP_GIT2_RESOURCE_NAME, git2_resource_handle);
+
+	error = php_git2_treebuilder_write_children(PHP_GIT2_V(_repo, repository),
+		PHP_GIT2_V(_bld, treebuilder), (HashTable*)_bld->priv);
+	if (!error) {
+		error = git_treebuilder_write(&id, PHP_GIT2_V(_repo, repository), PHP_GIT2_V(_bld, treebuilder));
+	}
+	if (php_git2_check_error(error, "git_treebuilder_write_recursive" TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+
+	git_oid_fmt(out, &id);
+	RETURN_STRING(out, 1);
+}
+/* }}} */
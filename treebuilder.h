@@ -70,6 +70,19 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_git_treebuilder_write, 0, 0, 2)
 	ZEND_ARG_INFO(0, bld)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_treebuilder_insert_path, 0, 0, 5)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, bld)
+	ZEND_ARG_INFO(0, path)
+	ZEND_ARG_INFO(0, id)
+	ZEND_ARG_INFO(0, filemode)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_git_treebuilder_write_recursive, 0, 0, 2)
+	ZEND_ARG_INFO(0, repo)
+	ZEND_ARG_INFO(0, bld)
+ZEND_END_ARG_INFO()
+
 /* {{{ proto resource git_treebuilder_create(source)
 */
 PHP_FUNCTION(git_treebuilder_create);
@@ -106,4 +119,14 @@ PHP_FUNCTION(git_treebuilder_filter);
 */
 PHP_FUNCTION(git_treebuilder_write);
 
+/* {{{ proto bool git_treebuilder_insert_path(repo, bld, path, id, filemode)
+*/
+PHP_FUNCTION(git_treebuilder_insert_path);
+
+/* {{{ proto string git_treebuilder_write_recursive(repo, bld)
+*/
+PHP_FUNCTION(git_treebuilder_write_recursive);
+
+void php_git2_treebuilder_children_free(HashTable *children);
+
 #endif
\ No newline at end of file